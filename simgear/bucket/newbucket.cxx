@@ -27,6 +27,7 @@
 #  include <simgear_config.h>
 #endif
 
+#include <algorithm>
 #include <cmath>
 #include <cstdio> // some platforms need this for ::snprintf
 #include <iostream>
@@ -102,7 +103,10 @@ SGBucket::SGBucket(const long int bindex) {
  */
 static int floorWithEpsilon(double x)
 {
-    return static_cast<int>(floor(x + SG_EPSILON));
+    // floor() without the library call, for the small values here
+    double v = x + SG_EPSILON;
+    int i = static_cast<int>(v);
+    return i - (i > v);
 }
 
 #ifndef NO_DEPRECATED_API
@@ -497,20 +501,208 @@ void sgBucketDiff( const SGBucket& b1, const SGBucket& b2, int *dx, int *dy ) {
 #endif
 }
 
+// Bucket widths for each degree of latitude from -90 on, the same as
+// sg_bucket_span() anywhere in that degree, and the number of buckets
+// around the earth at that latitude
+namespace {
+struct BucketBands {
+    double span[180];
+    int count[180];
+
+    BucketBands()
+    {
+        for (int i = 0; i < 180; ++i) {
+            span[i] = sg_bucket_span(i - 90 + 0.5);
+            count[i] = static_cast<int>(360.0 / span[i] + 0.5);
+        }
+    }
+
+    int band(double dlat) const
+    {
+        return static_cast<int>(SGMiscd::clip(floor(dlat), -90.0, 89.0)) + 90;
+    }
+};
+}
+
+static const BucketBands& bucketBands()
+{
+    static const BucketBands bands;
+    return bands;
+}
+
+// Degrees as they come back from an SGGeod made from them
+static double geodDegrees(double deg)
+{
+#ifdef SG_GEOD_NATIVE_DEGREE
+    return deg;
+#else
+    return (deg*SGD_DEGREES_TO_RADIANS)*SGD_RADIANS_TO_DEGREES;
+#endif
+}
+
+// The longitude index and x of the bucket at dlon in a row of buckets
+// span wide, as SGBucket::innerSet() finds them. Returns false if that is
+// not a valid bucket.
+static bool bucketInRow(double dlon, double span, double invSpan, int& lon, int& x)
+{
+    if ((dlon < -180.0) || (dlon >= 180.0)) {
+        dlon = SGMiscd::normalizePeriodic(-180.0, 180.0, dlon);
+    }
+
+    lon = floorWithEpsilon(dlon);
+    x = 0;
+    if ( span <= 1.0 ) {
+        // the spans up to 1 are powers of two, so this is exact
+        x = floorWithEpsilon((dlon - lon) * invSpan);
+    } else {
+        lon = static_cast<int>(floor(lon / span) * span);
+    }
+
+    // as SGBucket::isValid()
+    return (lon >= -180) && (lon < 180) && (x >= 0) && (x < 8);
+}
+
+void SGBucket::appendRow( int lon, int x, int lat, int y, size_t count,
+                          std::vector<SGBucket>& list )
+{
+    const double span = bucketBands().span[lat + 90];
+    const int perDegree = static_cast<int>(1.0 / span);
+    const int step = static_cast<int>(span);
+    for (size_t i = 0; i < count; ++i) {
+        list.push_back(SGBucket(lon, lat, x, y));
+        if (span <= 1.0) {
+            if (++x == perDegree) {
+                x = 0;
+                ++lon;
+            }
+        } else {
+            lon += step;
+        }
+        if (lon >= 180) {
+            lon -= 360;
+        }
+    }
+}
+
 void sgGetBuckets( const SGGeod& min, const SGGeod& max, std::vector<SGBucket>& list ) {
     double lon, lat, span;
+    const BucketBands& bands = bucketBands();
+    const double minLon = min.getLongitudeDeg();
+    const double maxLon = max.getLongitudeDeg();
 
+    // Steps through the rectangle as constructing an SGBucket at every
+    // position would, but with the latitude part of that done once per row
     for (lat = min.getLatitudeDeg(); lat < max.getLatitudeDeg()+SG_BUCKET_SPAN; lat += SG_BUCKET_SPAN) {
-        span = sg_bucket_span( lat );
-        for (lon = min.getLongitudeDeg(); lon <= max.getLongitudeDeg(); lon += span)
-        {
-            SGBucket b(SGGeod::fromDeg(lon, lat));
-            if (!b.isValid()) {
-                continue;
+        span = bands.span[bands.band(lat)];
+
+        double dlat = SGMiscd::clip(geodDegrees(lat), -90.0, 90.0);
+        int blat = floorWithEpsilon(dlat);
+        int by;
+        if (blat == 90) {
+            blat = 89;
+            by = 7;
+        } else {
+            by = floorWithEpsilon((dlat - blat) * 8);
+        }
+        if ((by < 0) || (by >= 8)) {
+            continue;
+        }
+        double bspan = bands.span[bands.band(dlat)];
+        double invSpan = 1.0 / bspan;
+
+        // Every step goes on to the next bucket east, unless the first
+        // position is about SG_EPSILON short of a bucket edge, where the
+        // rounding in the steps could decide which bucket a position is
+        // attributed to
+        double dlon = geodDegrees(minLon);
+        double edge = (dlon + 180.0) * invSpan;
+        double below = (1.0 - (edge - floor(edge))) * bspan;
+        int blon, bx;
+        if ((bspan == span) && bucketInRow(dlon, bspan, invSpan, blon, bx) &&
+            ((below < 1e-9) || (below > 3 * SG_EPSILON))) {
+            size_t count = 0;
+            for (lon = minLon; lon <= maxLon; lon += span) {
+                ++count;
             }
-            
-            list.push_back(b);
+            SGBucket::appendRow(blon, bx, blat, by, count, list);
+        } else {
+            for (lon = minLon; lon <= maxLon; lon += span) {
+                if (bucketInRow(geodDegrees(lon), bspan, invSpan, blon, bx)) {
+                    SGBucket::appendRow(blon, bx, blat, by, 1, list);
+                }
+            }
+        }
+    }
+}
+
+void sgGetBucketsInRange( const SGGeod& center, double rangeM, std::vector<SGBucket>& list )
+{
+    const BucketBands& bands = bucketBands();
+    const double d = rangeM / SG_EQUATORIAL_RADIUS_M;
+    if (!(d >= 0.0)) {
+        return;
+    }
+
+    const double lat0 = center.getLatitudeRad();
+    const double sinLat0 = sin(lat0);
+    const double cosLat0 = cos(lat0);
+    const double cosD = cos(SGMiscd::min(d, SGD_PI));
+    const double lon0 = center.getLongitudeDeg();
+
+    // The rows of buckets the circle reaches into, counted from -90
+    const double south = SGMiscd::max(lat0 - d, -SGD_PI_2);
+    const double north = SGMiscd::min(lat0 + d, SGD_PI_2);
+    const int firstRow = std::max(static_cast<int>(floor(south * SGD_RADIANS_TO_DEGREES / SG_BUCKET_SPAN)), -720) + 720;
+    const int lastRow = std::min(static_cast<int>(floor(north * SGD_RADIANS_TO_DEGREES / SG_BUCKET_SPAN)), 719) + 720;
+
+    // Latitude where the circle is widest in longitude
+    double widest = 2.0;
+    if (cosD > 0.0 && fabs(sinLat0) <= cosD) {
+        widest = asin(sinLat0 / cosD);
+    }
+
+    for (int row = firstRow; row <= lastRow; ++row) {
+        // The part of the circle's latitudes in the row
+        double a = SGMiscd::max((row - 720) * SG_BUCKET_SPAN * SGD_DEGREES_TO_RADIANS, south);
+        double b = SGMiscd::min((row - 719) * SG_BUCKET_SPAN * SGD_DEGREES_TO_RADIANS, north);
+
+        // Half the longitudes the circle spans in it, the most at the
+        // edges or at the widest latitude:
+        // cos(dlon) = (cos d - sin lat0 sin lat) / (cos lat0 cos lat)
+        double cosDLon = 1.0;
+        const double candidates[3] = { a, b, SGMiscd::clip(widest, a, b) };
+        for (double lat : candidates) {
+            double den = cosLat0 * cos(lat);
+            double c = den > 1e-12 ? (cosD - sinLat0 * sin(lat)) / den : -1.0;
+            cosDLon = SGMiscd::min(cosDLon, c);
+        }
+
+        const int band = row / 8;
+        const int count = bands.count[band];
+        const double span = bands.span[band];
+        int first = 0, last = count - 1;
+        if (cosDLon > -1.0) {
+            double dlon = acos(SGMiscd::min(cosDLon, 1.0)) * SGD_RADIANS_TO_DEGREES;
+            first = static_cast<int>(floor((lon0 - dlon + 180.0) / span));
+            last = static_cast<int>(floor((lon0 + dlon + 180.0) / span));
+            if (last - first >= count) {
+                first = 0;
+                last = count - 1;
+            }
+        }
+
+        // The westernmost bucket, counted from -180
+        int k = ((first % count) + count) % count;
+        int lon, x;
+        if (span <= 1.0) {
+            int perDegree = static_cast<int>(1.0 / span);
+            lon = k / perDegree - 180;
+            x = k % perDegree;
+        } else {
+            lon = k * static_cast<int>(span) - 180;
+            x = 0;
         }
+        SGBucket::appendRow(lon, x, band - 90, row % 8, last - first + 1, list);
     }
 }
 
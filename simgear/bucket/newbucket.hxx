@@ -104,6 +104,15 @@ private:
     unsigned char y;          // y subdivision (0 to 7)
 
     void innerSet( double dlon, double dlat );
+
+    SGBucket(int lonIndex, int latIndex, int xIndex, int yIndex) :
+        lon(lonIndex), lat(latIndex), x(xIndex), y(yIndex)
+    { }
+
+    // append count buckets of a row, from lon:x eastwards, for the bucket
+    // lists of sgGetBuckets() and sgGetBucketsInRange()
+    static void appendRow( int lon, int x, int lat, int y, size_t count,
+                           std::vector<SGBucket>& list );
 public:
 
     /**
@@ -304,6 +313,8 @@ public:
 
     friend std::ostream& operator<< ( std::ostream&, const SGBucket& );
     friend bool operator== ( const SGBucket&, const SGBucket& );
+    friend void sgGetBuckets( const SGGeod&, const SGGeod&, std::vector<SGBucket>& );
+    friend void sgGetBucketsInRange( const SGGeod&, double, std::vector<SGBucket>& );
 };
 
 inline bool operator!= (const SGBucket& lhs, const SGBucket& rhs)
@@ -346,6 +357,16 @@ void sgBucketDiff( const SGBucket& b1, const SGBucket& b2, int *dx, int *dy );
  */
 void sgGetBuckets( const SGGeod& min, const SGGeod& max, std::vector<SGBucket>& list );
 
+/**
+ * \relates SGBucket
+ * retrieve a list of the buckets that intersect a circle, on a sphere
+ * with the equatorial radius, row by row from south to north
+ * @param center center of the circle
+ * @param rangeM radius of the circle in meters
+ * @param list standard vector the buckets are appended to
+ */
+void sgGetBucketsInRange( const SGGeod& center, double rangeM, std::vector<SGBucket>& list );
+
 /**
  * Write the bucket lon, lat, x, and y to the output stream.
  * @param out output stream
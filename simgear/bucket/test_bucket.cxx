@@ -22,15 +22,18 @@
 
 #include <simgear/compiler.h>
 
+#include <chrono>
 #include <iostream>
 #include <cstdlib>
 #include <cstring>
+#include <set>
 
 using std::cout;
 using std::cerr;
 using std::endl;
 
 #include <simgear/bucket/newbucket.hxx>
+#include <simgear/math/sg_random.h>
 #include <simgear/misc/test_macros.hxx>
 
 void testBucketSpans()
@@ -345,6 +348,199 @@ void testSiblings()
     siblings.clear();
 }
 
+// sgGetBuckets() as it was, constructing a bucket at every step
+void referenceGetBuckets( const SGGeod& min, const SGGeod& max, std::vector<SGBucket>& list ) {
+    double lon, lat, span;
+
+    for (lat = min.getLatitudeDeg(); lat < max.getLatitudeDeg()+SG_BUCKET_SPAN; lat += SG_BUCKET_SPAN) {
+        span = sg_bucket_span( lat );
+        for (lon = min.getLongitudeDeg(); lon <= max.getLongitudeDeg(); lon += span)
+        {
+            SGBucket b(SGGeod::fromDeg(lon, lat));
+            if (!b.isValid()) {
+                continue;
+            }
+
+            list.push_back(b);
+        }
+    }
+}
+
+void checkGetBuckets(double minLon, double minLat, double maxLon, double maxLat)
+{
+    const SGGeod min = SGGeod::fromDeg(minLon, minLat);
+    const SGGeod max = SGGeod::fromDeg(maxLon, maxLat);
+    std::vector<SGBucket> expected, buckets;
+    referenceGetBuckets(min, max, expected);
+    sgGetBuckets(min, max, buckets);
+    SG_CHECK_EQUAL(buckets.size(), expected.size());
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        SG_CHECK_EQUAL(buckets[i].gen_index(), expected[i].gen_index());
+    }
+}
+
+void testGetBuckets()
+{
+    mt seed;
+    mt_init(&seed, 1234);
+
+    for (int i = 0; i < 2000; ++i) {
+        double lon = mt_rand(&seed) * 400.0 - 200.0;
+        double lat = mt_rand(&seed) * 190.0 - 95.0;
+        checkGetBuckets(lon, lat, lon + mt_rand(&seed) * 20.0 - 1.0,
+                        lat + mt_rand(&seed) * 5.0 - 0.5);
+    }
+
+    // near the poles, where the buckets are widest
+    for (int i = 0; i < 500; ++i) {
+        double lon = mt_rand(&seed) * 360.0 - 180.0;
+        double lat = (mt_rand(&seed) < 0.5 ? -90.0 : 80.0) + mt_rand(&seed) * 10.0;
+        checkGetBuckets(lon, lat, lon + mt_rand(&seed) * 90.0,
+                        lat + mt_rand(&seed) * 3.0);
+    }
+
+    // on bucket edges and band boundaries, and across the date line
+    checkGetBuckets(-1.0, 21.875, 1.0, 22.25);
+    checkGetBuckets(-0.125, -22.125, 0.125, -21.75);
+    checkGetBuckets(170.0, 61.5, 190.0, 62.5);
+    checkGetBuckets(-181.0, 88.0, 181.0, 90.0);
+    checkGetBuckets(-180.0, -90.0, 180.0, -88.875);
+    checkGetBuckets(10.0, 45.0, 10.0, 45.0);
+    checkGetBuckets(10.0 - 1e-7, 45.0 - 1e-7, 20.0, 45.5);
+    checkGetBuckets(10.25 - 2.5e-8, 45.0, 20.0, 45.5);
+    checkGetBuckets(10.0 - 1e-9, 45.0 - 1e-9, 20.0, 45.5);
+    checkGetBuckets(10.0 - 5e-8, 80.0, 40.0, 80.5);
+    checkGetBuckets(10.0, 45.0, 9.0, 44.0);
+}
+
+// Great circle distance on the sphere sgGetBucketsInRange() works on
+double sphereDistanceM(const SGGeod& a, const SGGeod& b)
+{
+    double dlat = b.getLatitudeRad() - a.getLatitudeRad();
+    double dlon = b.getLongitudeRad() - a.getLongitudeRad();
+    double h = sin(dlat / 2) * sin(dlat / 2) +
+        cos(a.getLatitudeRad()) * cos(b.getLatitudeRad()) * sin(dlon / 2) * sin(dlon / 2);
+    return 2 * asin(std::min(sqrt(h), 1.0)) * SG_EQUATORIAL_RADIUS_M;
+}
+
+void checkBucketsInRange(mt* seed, const SGGeod& center, double rangeM)
+{
+    std::vector<SGBucket> buckets;
+    sgGetBucketsInRange(center, rangeM, buckets);
+
+    std::set<long> indices;
+    for (const SGBucket& b : buckets) {
+        SG_VERIFY(b.isValid());
+        SG_VERIFY(indices.insert(b.gen_index()).second);
+
+        // Something of the bucket is in range
+        double minDistance = 1e30;
+        for (int i = 0; i <= 8; ++i) {
+            for (int j = 0; j <= 8; ++j) {
+                SGGeod p = SGGeod::fromDeg(
+                    b.get_center_lon() + (i / 8.0 - 0.5) * b.get_width(),
+                    b.get_center_lat() + (j / 8.0 - 0.5) * b.get_height());
+                minDistance = std::min(minDistance, sphereDistanceM(center, p));
+            }
+        }
+        double spacingM = std::max(b.get_width(), b.get_height()) / 8 * 111200.0;
+        SG_VERIFY(minDistance <= rangeM + spacingM);
+    }
+
+    // Everything in range is in one of the buckets
+    SG_VERIFY(indices.count(SGBucket(center).gen_index()) == 1);
+    for (int i = 0; i < 300; ++i) {
+        double course = mt_rand(seed) * SGD_2PI;
+        double d = sqrt(mt_rand(seed)) * rangeM / SG_EQUATORIAL_RADIUS_M;
+        double lat0 = center.getLatitudeRad();
+        double lat = asin(sin(lat0) * cos(d) + cos(lat0) * sin(d) * cos(course));
+        double lon = center.getLongitudeRad() +
+            atan2(sin(course) * sin(d) * cos(lat0), cos(d) - sin(lat0) * sin(lat));
+        lon = SGMiscd::normalizePeriodic(-SGD_PI, SGD_PI, lon);
+        SGGeod p = SGGeod::fromRad(lon, lat);
+        if (sphereDistanceM(center, p) < rangeM * 0.999) {
+            SG_VERIFY(indices.count(SGBucket(p).gen_index()) == 1);
+        }
+    }
+}
+
+void testBucketsInRange()
+{
+    mt seed;
+    mt_init(&seed, 4321);
+
+    for (int i = 0; i < 200; ++i) {
+        double lat = mt_rand(&seed) * 180.0 - 90.0;
+        if (i % 4 == 0) {
+            lat = (lat < 0 ? -1 : 1) * (80.0 + mt_rand(&seed) * 10.0);
+        }
+        SGGeod center = SGGeod::fromDeg(mt_rand(&seed) * 360.0 - 180.0, lat);
+        checkBucketsInRange(&seed, center, 1000.0 + mt_rand(&seed) * 300000.0);
+    }
+    checkBucketsInRange(&seed, SGGeod::fromDeg(179.99, 0.01), 50000.0);
+    checkBucketsInRange(&seed, SGGeod::fromDeg(-179.99, 89.99), 50000.0);
+    checkBucketsInRange(&seed, SGGeod::fromDeg(12.3, -90.0), 20000.0);
+
+    // A point finds its own bucket
+    std::vector<SGBucket> buckets;
+    SGGeod bna = SGGeod::fromDeg(-86.678, 36.1248);
+    sgGetBucketsInRange(bna, 0.0, buckets);
+    SG_CHECK_EQUAL(buckets.size(), static_cast<std::vector<SGBucket>::size_type>(1));
+    SG_CHECK_EQUAL(buckets[0].gen_index(), SGBucket(bna).gen_index());
+
+    // and the whole earth all of them
+    buckets.clear();
+    sgGetBucketsInRange(bna, 3e7, buckets);
+    size_t total = 0;
+    for (int lat = -90; lat < 90; ++lat) {
+        total += 8 * static_cast<size_t>(360.0 / sg_bucket_span(lat + 0.5) + 0.5);
+    }
+    SG_CHECK_EQUAL(buckets.size(), total);
+
+    buckets.clear();
+    sgGetBucketsInRange(bna, -1.0, buckets);
+    SG_VERIFY(buckets.empty());
+}
+
+// Walking large areas at high latitudes, where the bucket widths change
+// quickly
+void benchmarkGetBuckets()
+{
+    const SGGeod min = SGGeod::fromDeg(-40.0, 60.0);
+    const SGGeod max = SGGeod::fromDeg(40.0, 85.0);
+    std::vector<SGBucket> buckets;
+    buckets.reserve(100000);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 10; ++i) {
+        buckets.clear();
+        referenceGetBuckets(min, max, buckets);
+    }
+    auto middle = std::chrono::steady_clock::now();
+    for (int i = 0; i < 10; ++i) {
+        buckets.clear();
+        sgGetBuckets(min, max, buckets);
+    }
+    auto end = std::chrono::steady_clock::now();
+    size_t count = buckets.size();
+
+    const SGGeod center = SGGeod::fromDeg(25.0, 78.0);
+    auto rangeStart = std::chrono::steady_clock::now();
+    for (int i = 0; i < 1000; ++i) {
+        buckets.clear();
+        sgGetBucketsInRange(center, 100000.0, buckets);
+    }
+    auto rangeEnd = std::chrono::steady_clock::now();
+
+    cout << count << " buckets between 60 and 85 deg north: stepping "
+         << std::chrono::duration<double, std::micro>(middle - start).count() / 10
+         << " us, arithmetic "
+         << std::chrono::duration<double, std::micro>(end - middle).count() / 10
+         << " us; " << buckets.size() << " buckets within 100 km at 78 deg north: "
+         << std::chrono::duration<double, std::micro>(rangeEnd - rangeStart).count() / 1000
+         << " us" << endl;
+}
+
 int main(int argc, char* argv[])
 {
     testBucketSpans();
@@ -356,6 +552,9 @@ int main(int argc, char* argv[])
     testOffsetWrap();
     testPolarOffset();
     testSiblings();
+    testGetBuckets();
+    testBucketsInRange();
+    benchmarkGetBuckets();
 
     cout << "all tests passed OK" << endl;
     return 0; // passed
@@ -273,4 +273,45 @@ void CelestialBody::getPos(double* ra, double* dec, double* magn)
   *magn = magnitude;
 }
 
+/*****************************************************************************
+ * void CelestialBody::interpolate(const CelestialBody& from,
+ *                                 const CelestialBody& to, double f)
+ * sets the position of the body in between two positions calculated by
+ * updatePosition(), as a fraction f of the way from one to the other. This
+ * is what SGEphemeris uses instead of updatePosition() when the error of
+ * that is small enough.
+ *
+ * Arguments: the body at the two positions, and f from 0 to 1
+ *
+ * return value: none
+ ****************************************************************************/
+void CelestialBody::interpolate(const CelestialBody& from,
+                                const CelestialBody& to, double f)
+{
+  N = lerp(from.N, to.N, f);
+  i = lerp(from.i, to.i, f);
+  w = lerp(from.w, to.w, f);
+  a = lerp(from.a, to.a, f);
+  e = lerp(from.e, to.e, f);
+  M = lerp(from.M, to.M, f);
 
+  rightAscension = lerpAngle(from.rightAscension, to.rightAscension, f);
+  if (rightAscension > SGD_PI) {
+    rightAscension -= SGD_2PI;
+  } else if (rightAscension < -SGD_PI) {
+    rightAscension += SGD_2PI;
+  }
+  declination = lerp(from.declination, to.declination, f);
+  r = lerp(from.r, to.r, f);
+  R = lerp(from.R, to.R, f);
+  s = lerp(from.s, to.s, f);
+  FV = lerp(from.FV, to.FV, f);
+  magnitude = lerp(from.magnitude, to.magnitude, f);
+  lonEcl = lerpAngle(from.lonEcl, to.lonEcl, f);
+  latEcl = lerp(from.latEcl, to.latEcl, f);
+}
+
+double CelestialBody::lerpAngle(double a, double b, double f)
+{
+  return a + f * remainder(b - a, SGD_2PI);
+}
@@ -63,6 +63,11 @@ protected:              // make the data protected, in order to give the
   double sgCalcActTime(double mjd);
   void updateOrbElements(double mjd);
 
+  // helpers for interpolate(): a + f * (b - a), and the same for angles,
+  // the short way round
+  static double lerp(double a, double b, double f) { return a + f * (b - a); }
+  static double lerpAngle(double a, double b, double f);
+
 public:
   CelestialBody(double Nf, double Ns,
 		double If, double Is,
@@ -84,6 +89,7 @@ public:
   double getLon() const;
   double getLat() const; 
   void updatePosition(double mjd, Star *ourSun);
+  void interpolate(const CelestialBody& from, const CelestialBody& to, double f);
 };
 
 inline double CelestialBody::getRightAscension() { return rightAscension; }
@@ -25,11 +25,76 @@
 #  include <simgear_config.h>
 #endif
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 
 #include "ephemeris.hxx"
 
 
+// The sun, moon and planets at one time
+struct SGEphemeris::Bodies {
+    Star sun;
+    MoonPos moon;
+    Mercury mercury;
+    Venus venus;
+    Mars mars;
+    Jupiter jupiter;
+    Saturn saturn;
+    Uranus uranus;
+    Neptune neptune;
+
+    void update( double mjd ) {
+        sun.updatePosition( mjd );
+        moon.updatePosition( mjd, &sun );
+        mercury.updatePosition( mjd, &sun );
+        venus.updatePosition( mjd, &sun );
+        mars.updatePosition( mjd, &sun );
+        jupiter.updatePosition( mjd, &sun );
+        saturn.updatePosition( mjd, &sun );
+        uranus.updatePosition( mjd, &sun );
+        neptune.updatePosition( mjd, &sun );
+    }
+
+    void interpolate( const Bodies& from, const Bodies& to, double f ) {
+        sun.interpolate( from.sun, to.sun, f );
+        moon.interpolate( from.moon, to.moon, f );
+        mercury.interpolate( from.mercury, to.mercury, f );
+        venus.interpolate( from.venus, to.venus, f );
+        mars.interpolate( from.mars, to.mars, f );
+        jupiter.interpolate( from.jupiter, to.jupiter, f );
+        saturn.interpolate( from.saturn, to.saturn, f );
+        uranus.interpolate( from.uranus, to.uranus, f );
+        neptune.interpolate( from.neptune, to.neptune, f );
+    }
+
+    // largest angle between the positions of a body here and in other,
+    // in degrees
+    double maxError( Bodies& other ) {
+        CelestialBody *mine[] = { &sun, &moon, &mercury, &venus, &mars,
+                                  &jupiter, &saturn, &uranus, &neptune };
+        CelestialBody *theirs[] = { &other.sun, &other.moon, &other.mercury,
+                                    &other.venus, &other.mars, &other.jupiter,
+                                    &other.saturn, &other.uranus, &other.neptune };
+        double error = 0.0;
+        for ( int i = 0; i < 9; ++i ) {
+            double dec = mine[i]->getDeclination();
+            double dra = remainder( mine[i]->getRightAscension()
+                                    - theirs[i]->getRightAscension(), SGD_2PI );
+            double ddec = dec - theirs[i]->getDeclination();
+            dra *= cos( dec );
+            error = std::max( error, sqrt( dra*dra + ddec*ddec )
+                                     * SGD_RADIANS_TO_DEGREES );
+            // magnitudes count as degrees, Mercury's changes fast near
+            // conjunction
+            error = std::max( error, fabs( mine[i]->getMagnitude()
+                                           - theirs[i]->getMagnitude() ) );
+        }
+        return error;
+    }
+};
+
+
 // Constructor
 SGEphemeris::SGEphemeris( const SGPath& path ) {
     our_sun = new Star;
@@ -45,6 +110,14 @@ SGEphemeris::SGEphemeris( const SGPath& path ) {
     for ( int i = 0; i < nplanets; ++i )
       planets[i] = SGVec3d::zeros();
     stars = new SGStarData(path);
+
+    window[0] = new Bodies;
+    window[1] = new Bodies;
+    windowStart = 1.0;
+    windowEnd = 0.0;
+    windowError = 0.0;
+    maxInterpolationError = 0.0;
+    maxWindowLength = 1.0;
 }
 
 
@@ -60,23 +133,80 @@ SGEphemeris::~SGEphemeris( void ) {
     delete uranus;
     delete neptune;
     delete stars;
+    delete window[0];
+    delete window[1];
+}
+
+
+void SGEphemeris::setInterpolation( double maxErrorDeg, double maxWindowDays ) {
+    maxInterpolationError = maxWindowDays > 0.0 ? std::max( maxErrorDeg, 0.0 ) : 0.0;
+    maxWindowLength = maxWindowDays;
+    windowStart = 1.0;
+    windowEnd = 0.0;
+    windowError = 0.0;
+}
+
+
+// Calculate the positions at the ends of a new window around mjd
+void SGEphemeris::newWindow( double mjd ) {
+    // The error grows with the square of the length, so a window twice
+    // as long as the last one will do if that had a quarter of the error
+    // to spare. Otherwise halve the length until it is small enough.
+    double length = windowEnd - windowStart;
+    if ( !(length > 0.0) ) {
+        length = maxWindowLength;
+    } else if ( windowError * 4 < maxInterpolationError ) {
+        length = std::min( 2 * length, maxWindowLength );
+    }
+
+    Bodies middle, interpolated;
+    middle.update( mjd );
+    for ( int halvings = 0; ; ++halvings ) {
+        window[0]->update( mjd - length / 2 );
+        window[1]->update( mjd + length / 2 );
+        interpolated.interpolate( *window[0], *window[1], 0.5 );
+        windowError = interpolated.maxError( middle );
+        if ( windowError <= maxInterpolationError || halvings == 20 ) {
+            break;
+        }
+        length /= 2;
+    }
+
+    windowStart = mjd - length / 2;
+    windowEnd = mjd + length / 2;
 }
 
 
 // Update (recalculate) the positions of all objects for the specified
 // time
 void SGEphemeris::update( double mjd, double lst, double lat ) {
-    // update object positions
-    our_sun->updatePosition( mjd );
-    //    moon->updatePositionTopo( mjd, lst, lat, our_sun );
-    moon->updatePosition( mjd, our_sun );
-    mercury->updatePosition( mjd, our_sun );
-    venus->updatePosition( mjd, our_sun );
-    mars->updatePosition( mjd, our_sun );
-    jupiter->updatePosition( mjd, our_sun );
-    saturn->updatePosition( mjd, our_sun );
-    uranus->updatePosition( mjd, our_sun );
-    neptune->updatePosition( mjd, our_sun );
+    if ( maxInterpolationError > 0.0 ) {
+        if ( !(mjd >= windowStart && mjd <= windowEnd) ) {
+            newWindow( mjd );
+        }
+        double f = (mjd - windowStart) / (windowEnd - windowStart);
+        our_sun->interpolate( window[0]->sun, window[1]->sun, f );
+        moon->interpolate( window[0]->moon, window[1]->moon, f );
+        mercury->interpolate( window[0]->mercury, window[1]->mercury, f );
+        venus->interpolate( window[0]->venus, window[1]->venus, f );
+        mars->interpolate( window[0]->mars, window[1]->mars, f );
+        jupiter->interpolate( window[0]->jupiter, window[1]->jupiter, f );
+        saturn->interpolate( window[0]->saturn, window[1]->saturn, f );
+        uranus->interpolate( window[0]->uranus, window[1]->uranus, f );
+        neptune->interpolate( window[0]->neptune, window[1]->neptune, f );
+    } else {
+        // update object positions
+        our_sun->updatePosition( mjd );
+        //    moon->updatePositionTopo( mjd, lst, lat, our_sun );
+        moon->updatePosition( mjd, our_sun );
+        mercury->updatePosition( mjd, our_sun );
+        venus->updatePosition( mjd, our_sun );
+        mars->updatePosition( mjd, our_sun );
+        jupiter->updatePosition( mjd, our_sun );
+        saturn->updatePosition( mjd, our_sun );
+        uranus->updatePosition( mjd, our_sun );
+        neptune->updatePosition( mjd, our_sun );
+    }
 
     // update planets list
     nplanets = 7;
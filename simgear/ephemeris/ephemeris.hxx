@@ -89,6 +89,17 @@ class SGEphemeris {
 
     SGStarData *stars;
 
+    // The positions at the start and the end of the time window update()
+    // interpolates in, see setInterpolation()
+    struct Bodies;
+    Bodies *window[2];
+    double windowStart, windowEnd;  // modified julian dates
+    double windowError;             // of the last window at its middle
+    double maxInterpolationError;   // degrees, 0 to always update in full
+    double maxWindowLength;         // days
+
+    void newWindow( double mjd );
+
 public:
 
     /**
@@ -114,6 +125,22 @@ public:
      */
     void update(double mjd, double lst, double lat);
 
+    /**
+     * Let update() interpolate the positions between full calculations
+     * at the ends of a time window, instead of calculating them in full
+     * on every call. That is a lot cheaper when update() is called at
+     * high rates, such as with time warp or replay.  Each window is
+     * centered on the time that needs it and made as long as it can be,
+     * up to maxWindowDays, with the interpolated right ascensions and
+     * declinations at its middle, where their error is largest, no more
+     * than maxErrorDeg away from the calculated ones. The planet
+     * magnitudes are held to the same bound, in magnitudes.
+     * @param maxErrorDeg bound on the error of the positions in degrees,
+     * 0 to calculate them in full on every update, which is the default
+     * @param maxWindowDays length of the longest window in days
+     */
+    void setInterpolation(double maxErrorDeg, double maxWindowDays = 1.0);
+
     /**
      * @return a pointer to a Star class containing all the positional
      * information for Earth's Sun.
@@ -369,3 +369,24 @@ void MoonPos::updatePosition(double mjd, Star *ourSun)
   I_factor = (log_I - max_loglux) / (max_loglux - min_loglux) + 1.0;
   I_factor = SGMiscd::clip(I_factor, 0, 1);
 }
+
+
+/*****************************************************************************
+ * void MoonPos::interpolate(const MoonPos& from, const MoonPos& to, double f)
+ * sets the position of the moon in between two calculated ones, see
+ * CelestialBody::interpolate(). The phase follows from the interpolated age.
+ ****************************************************************************/
+void MoonPos::interpolate(const MoonPos& from, const MoonPos& to, double f)
+{
+  CelestialBody::interpolate(from, to, f);
+  xg = lerp(from.xg, to.xg, f);
+  yg = lerp(from.yg, to.yg, f);
+  ye = lerp(from.ye, to.ye, f);
+  ze = lerp(from.ze, to.ze, f);
+  distance = lerp(from.distance, to.distance, f);
+  distance_in_a = lerp(from.distance_in_a, to.distance_in_a, f);
+  age = lerpAngle(from.age, to.age, f);
+  phase = (1 - cos(age)) / 2;
+  log_I = lerp(from.log_I, to.log_I, f);
+  I_factor = lerp(from.I_factor, to.I_factor, f);
+}
@@ -62,6 +62,7 @@ public:
     ~MoonPos();
     void updatePositionTopo(double mjd, double lst, double lat, Star *ourSun);
     void updatePosition(double mjd, Star *ourSun);
+    void interpolate(const MoonPos& from, const MoonPos& to, double f);
   // void newImage();
     double getM() const;
     double getw() const;
@@ -108,3 +108,21 @@ void Star::updatePosition(double mjd)
   rightAscension = atan2 (ye, xe);
   declination = atan2 (ze, sqrt (xe*xe + ye*ye));
 }
+
+
+/*************************************************************************
+ * void Star::interpolate(const Star& from, const Star& to, double f)
+ *
+ * sets the position of our sun in between two calculated ones, see
+ * CelestialBody::interpolate().
+ *************************************************************************/
+void Star::interpolate(const Star& from, const Star& to, double f)
+{
+  CelestialBody::interpolate(from, to, f);
+  lonEcl = lerpAngle(from.lonEcl, to.lonEcl, f);
+  xs = lerp(from.xs, to.xs, f);
+  ys = lerp(from.ys, to.ys, f);
+  ye = lerp(from.ye, to.ye, f);
+  ze = lerp(from.ze, to.ze, f);
+  distance = lerp(from.distance, to.distance, f);
+}
@@ -44,6 +44,7 @@ public:
     Star ();
     ~Star();
     void updatePosition(double mjd);
+    void interpolate(const Star& from, const Star& to, double f);
     double getM() const;
     double getw() const;
     double getxs() const;
@@ -24,6 +24,19 @@
 #  include <simgear_config.h>
 #endif
 
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+
+#ifndef _WIN32
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+#include <simgear/constants.h>
 #include <simgear/debug/logstream.hxx>
 #include <simgear/misc/sg_path.hxx>
 #include <simgear/io/iostreams/sgstream.hxx>
@@ -36,8 +49,71 @@
 
 using std::string;
 
+namespace {
+
+// The binary catalog is a header followed by the stars as they are
+// held in memory, in native byte order and with the padding of SGVec3d
+// in this build, so it can be mapped as it is. It is only valid for the
+// text catalog with the modification time and size in its header.
+struct BinaryHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t numStars;
+    int64_t textModTime;
+    uint64_t textSize;
+    uint32_t starSize;
+    uint32_t reserved;
+};
+
+const char BinaryMagic[8] = { 'S', 'G', 'S', 'T', 'A', 'R', 'S', 'B' };
+// 2: no longer with a copy of the last star at the end
+const uint32_t BinaryVersion = 2;
+
+// the stars start here, aligned for SGVec3d
+const size_t DataOffset = 64;
+
+static_assert( sizeof(BinaryHeader) <= DataOffset
+               && DataOffset % alignof(SGVec3d) == 0,
+               "stars in the binary catalog must be aligned" );
+
+// 3x3 rotation matrices, for getLocalDirections()
+struct Rotation {
+    double m[3][3];
+
+    // about the z axis
+    static Rotation z( double angle ) {
+        double c = cos( angle ), s = sin( angle );
+        Rotation r = { { { c, -s, 0 }, { s, c, 0 }, { 0, 0, 1 } } };
+        return r;
+    }
+
+    // about the y axis, turning x towards z
+    static Rotation y( double angle ) {
+        double c = cos( angle ), s = sin( angle );
+        Rotation r = { { { c, 0, -s }, { 0, 1, 0 }, { s, 0, c } } };
+        return r;
+    }
+
+    Rotation operator*( const Rotation& other ) const {
+        Rotation r;
+        for ( int i = 0; i < 3; ++i ) {
+            for ( int j = 0; j < 3; ++j ) {
+                r.m[i][j] = m[i][0] * other.m[0][j] + m[i][1] * other.m[1][j]
+                    + m[i][2] * other.m[2][j];
+            }
+        }
+        return r;
+    }
+};
+
+} // anonymous namespace
+
 // Constructor
-SGStarData::SGStarData( const SGPath& path )
+SGStarData::SGStarData( const SGPath& path ) :
+    _stars( 0 ),
+    _numStars( 0 ),
+    _mapping( 0 ),
+    _mappingSize( 0 )
 {
     load(path);
 }
@@ -45,18 +121,71 @@ SGStarData::SGStarData( const SGPath& path )
 
 // Destructor
 SGStarData::~SGStarData() {
+    unmap();
+}
+
+
+void SGStarData::unmap() {
+#ifndef _WIN32
+    if ( _mapping ) {
+        munmap( _mapping, _mappingSize );
+    }
+#endif
+    _mapping = 0;
+    _mappingSize = 0;
 }
 
 
 bool SGStarData::load( const SGPath& path ) {
 
-    _stars.clear();
+    unmap();
+    _buffer.clear();
+    _stars = 0;
+    _numStars = 0;
 
     // build the full path name to the stars data base file
     SGPath tmp = path;
     tmp.append( "stars" );
     SG_LOG( SG_ASTRO, SG_INFO, "  Loading stars from " << tmp );
 
+    // the text catalog may be compressed, as sg_gzifstream finds it
+    SGPath text = tmp;
+    if ( ! text.exists() ) {
+        text.concat( ".gz" );
+    }
+    SGPath binary = path;
+    binary.append( "stars.bin" );
+
+    if ( text.exists() && mapBinary( binary, text ) ) {
+        SG_LOG( SG_ASTRO, SG_INFO, "  Mapped " << _numStars
+                << " stars from " << binary );
+    } else {
+        if ( ! loadText( tmp ) ) {
+            return false;
+        }
+        _stars = _buffer.empty() ? 0 : &_buffer[0];
+        _numStars = static_cast<int>(_buffer.size());
+        SG_LOG( SG_ASTRO, SG_INFO, "  Loaded " << _numStars << " stars" );
+        if ( text.exists() ) {
+            writeBinary( binary, text );
+        }
+    }
+
+    _x.resize( _numStars );
+    _y.resize( _numStars );
+    _z.resize( _numStars );
+    for ( int i = 0; i < _numStars; ++i ) {
+        double cosdec = cos( _stars[i][1] );
+        _x[i] = cosdec * cos( _stars[i][0] );
+        _y[i] = cosdec * sin( _stars[i][0] );
+        _z[i] = sin( _stars[i][1] );
+    }
+
+    return true;
+}
+
+
+bool SGStarData::loadText( const SGPath& tmp ) {
     sg_gzifstream in( tmp );
     if ( ! in.is_open() ) {
 	SG_LOG( SG_ASTRO, SG_ALERT, "Cannot open star file: " << tmp );
@@ -107,11 +236,167 @@ bool SGStarData::load( const SGPath& path ) {
 
 	in >> mag;
 
+	// nothing but comments or white space after the last star
+	if ( ! in ) {
+	    break;
+	}
+
 	// cout << " star data = " << ra << " " << dec << " " << mag << endl;
-        _stars.push_back(SGVec3d(ra, dec, mag));
+        _buffer.push_back(SGVec3d(ra, dec, mag));
     }
 
-    SG_LOG( SG_ASTRO, SG_INFO, "  Loaded " << _stars.size() << " stars" );
+    return true;
+}
 
+
+bool SGStarData::mapBinary( const SGPath& path, const SGPath& textPath ) {
+    if ( ! path.exists() ) {
+        return false;
+    }
+
+    const char *data;
+    size_t size;
+#ifndef _WIN32
+    int fd = ::open( path.local8BitStr().c_str(), O_RDONLY );
+    if ( fd < 0 ) {
+        return false;
+    }
+    struct stat st;
+    if ( fstat( fd, &st ) != 0 || st.st_size < (off_t)DataOffset ) {
+        ::close( fd );
+        return false;
+    }
+    // private and writable, as getStars() hands out a non-const pointer
+    void *mapping = mmap( 0, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                          fd, 0 );
+    ::close( fd );
+    if ( mapping == MAP_FAILED ) {
+        return false;
+    }
+    _mapping = mapping;
+    _mappingSize = st.st_size;
+    data = static_cast<const char *>(mapping);
+    size = st.st_size;
+#else
+    sg_ifstream stream( path, std::ios::in | std::ios::binary );
+    if ( ! stream.is_open() ) {
+        return false;
+    }
+    const string contents = stream.read_all();
+    if ( contents.size() < DataOffset ) {
+        return false;
+    }
+    data = contents.data();
+    size = contents.size();
+#endif
+
+    BinaryHeader header;
+    std::memcpy( &header, data, sizeof(header) );
+    size_t numStars = header.numStars;
+    if ( std::memcmp( header.magic, BinaryMagic, sizeof(BinaryMagic) ) != 0
+         || header.version != BinaryVersion
+         || header.textModTime != int64_t(textPath.modTime())
+         || header.textSize != uint64_t(textPath.sizeInBytes())
+         || header.starSize != sizeof(SGVec3d)
+         || ( size - DataOffset ) / sizeof(SGVec3d) != numStars
+         || ( size - DataOffset ) % sizeof(SGVec3d) != 0 ) {
+        SG_LOG( SG_ASTRO, SG_INFO, "  Ignoring outdated " << path );
+        unmap();
+        return false;
+    }
+
+#ifndef _WIN32
+    _stars = reinterpret_cast<SGVec3d *>(static_cast<char *>(_mapping)
+                                         + DataOffset);
+#else
+    _buffer.resize( numStars );
+    if ( numStars ) {
+        std::memcpy( &_buffer[0], data + DataOffset,
+                     numStars * sizeof(SGVec3d) );
+    }
+    _stars = numStars ? &_buffer[0] : 0;
+#endif
+    _numStars = static_cast<int>(numStars);
     return true;
 }
+
+
+void SGStarData::writeBinary( const SGPath& path, const SGPath& textPath ) const {
+    BinaryHeader header;
+    std::memcpy( header.magic, BinaryMagic, sizeof(BinaryMagic) );
+    header.version = BinaryVersion;
+    header.numStars = _numStars;
+    header.textModTime = textPath.modTime();
+    header.textSize = textPath.sizeInBytes();
+    header.starSize = sizeof(SGVec3d);
+    header.reserved = 0;
+    char padding[DataOffset - sizeof(BinaryHeader)] = { 0 };
+
+    // write to a temporary file first, so that nobody maps a partially
+    // written catalog
+    std::ostringstream tmpName;
+    tmpName << path.file() << ".tmp" << this;
+    SGPath tmp = path.dirPath() / tmpName.str();
+    {
+        sg_ofstream out( tmp, std::ios::out | std::ios::binary );
+        if ( ! out.is_open() ) {
+            // the data directory is often read only, this is no error
+            SG_LOG( SG_ASTRO, SG_DEBUG, "  Cannot write " << path );
+            return;
+        }
+        out.write( reinterpret_cast<const char *>(&header), sizeof(header) );
+        out.write( padding, sizeof(padding) );
+        out.write( reinterpret_cast<const char *>(_stars),
+                   _numStars * sizeof(SGVec3d) );
+        if ( ! out.good() ) {
+            out.close();
+            tmp.remove();
+            return;
+        }
+    }
+    if ( ! tmp.rename( path ) ) {
+        tmp.remove();
+        return;
+    }
+    SG_LOG( SG_ASTRO, SG_INFO, "  Wrote " << path );
+}
+
+
+void SGStarData::getLocalDirections( double mjd, double lst, double lat,
+                                     SGVec3f *directions ) const {
+    // precession from J2000 to the date, IAU 1976, as in Meeus,
+    // Astronomical Algorithms, chapter 21
+    double t = ( mjd - 36525.0 ) / 36525.0;
+    double arcsec = SGD_DEGREES_TO_RADIANS / 3600.0;
+    double zeta = ( ( 0.017998 * t + 0.30188 ) * t + 2306.2181 ) * t * arcsec;
+    double z = ( ( 0.018203 * t + 1.09468 ) * t + 2306.2181 ) * t * arcsec;
+    double theta = ( ( -0.041833 * t - 0.42665 ) * t + 2004.3109 ) * t * arcsec;
+    Rotation precession = Rotation::z( z ) * Rotation::y( theta )
+        * Rotation::z( zeta );
+
+    // from the equator of the date to east, north and up
+    double c = cos( lst ), s = sin( lst );
+    double cl = cos( lat ), sl = sin( lat );
+    Rotation local = { { { -s, c, 0 },
+                         { -sl * c, -sl * s, cl },
+                         { cl * c, cl * s, sl } } };
+    Rotation r = local * precession;
+
+    // one matrix for all stars, on separate arrays of the coordinates so
+    // the compiler can vectorize the loop
+    float m[3][3];
+    for ( int i = 0; i < 3; ++i ) {
+        for ( int j = 0; j < 3; ++j ) {
+            m[i][j] = r.m[i][j];
+        }
+    }
+    const float *x = _numStars ? &_x[0] : 0;
+    const float *y = _numStars ? &_y[0] : 0;
+    const float *zs = _numStars ? &_z[0] : 0;
+    for ( int i = 0; i < _numStars; ++i ) {
+        SGVec3f& d = directions[i];
+        d[0] = m[0][0] * x[i] + m[0][1] * y[i] + m[0][2] * zs[i];
+        d[1] = m[1][0] * x[i] + m[1][1] * y[i] + m[1][2] * zs[i];
+        d[2] = m[2][0] * x[i] + m[2][1] * y[i] + m[2][2] * zs[i];
+    }
+}
@@ -37,15 +37,56 @@ public:
     // Destructor
     ~SGStarData();
 
-    // load the stars database
+    // load the stars database, from the binary catalog "stars.bin" next
+    // to the text one if that is up to date, otherwise from the text
+    // catalog "stars", writing the binary catalog for the next time
     bool load( const SGPath& path );
 
     // stars
-    inline int getNumStars() const { return static_cast<int>(_stars.size()); }
-    inline SGVec3d *getStars() { return &(_stars[0]); }
+    // stars[i][0] = Right Ascension
+    // stars[i][1] = Declination
+    // stars[i][2] = Magnitude
+    inline int getNumStars() const { return _numStars; }
+    inline SGVec3d *getStars() { return _stars; }
+
+    /**
+     * Calculate the directions towards all stars at once, as unit
+     * vectors in the local frame of an observer, x pointing east, y
+     * north and z up. The catalog positions are precessed from J2000 to
+     * the date.
+     *
+     * This is for code that needs to know where the stars are on the
+     * CPU, such as for celestial navigation. SGSky does not use it: it
+     * draws the catalog positions as they are and rotates them with one
+     * transform, which is cheaper.
+     * @param mjd modified julian date, as SGEphemeris::update() takes
+     * @param lst local sidereal time in radians
+     * @param lat latitude of the observer in radians
+     * @param directions getNumStars() directions to fill in
+     */
+    void getLocalDirections( double mjd, double lst, double lat,
+                             SGVec3f *directions ) const;
 
 private:
-    std::vector<SGVec3d> _stars;
+    SGStarData( const SGStarData& );
+    SGStarData& operator=( const SGStarData& );
+
+    bool loadText( const SGPath& path );
+    bool mapBinary( const SGPath& path, const SGPath& textPath );
+    void writeBinary( const SGPath& path, const SGPath& textPath ) const;
+    void unmap();
+
+    SGVec3d *_stars;
+    int _numStars;
+
+    // the stars, unless they are mapped from the binary catalog
+    std::vector<SGVec3d> _buffer;
+    void *_mapping;
+    size_t _mappingSize;
+
+    // unit vectors towards the catalog positions, for
+    // getLocalDirections()
+    std::vector<float> _x, _y, _z;
 };
 
 
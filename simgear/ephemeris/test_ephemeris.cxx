@@ -0,0 +1,115 @@
+// Compares the positions SGEphemeris interpolates with the ones it
+// calculates in full, under time warp and when scrubbing back and forth,
+// and how long the updates take either way.
+
+#ifdef HAVE_CONFIG_H
+#  include <simgear_config.h>
+#endif
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#include <simgear/constants.h>
+#include <simgear/ephemeris/ephemeris.hxx>
+#include <simgear/math/sg_random.h>
+#include <simgear/misc/test_macros.hxx>
+
+// 1st of January 2020, in the modified julian dates SGEphemeris takes
+// (days since 1899 December 31 12h)
+static const double Mjd2020 = 36524.5 + 7305.0;
+
+static double angleDeg(double ra1, double dec1, double ra2, double dec2)
+{
+    double dra = remainder(ra1 - ra2, SGD_2PI) * cos(dec1);
+    double ddec = dec1 - dec2;
+    return sqrt(dra * dra + ddec * ddec) * SGD_RADIANS_TO_DEGREES;
+}
+
+// Largest difference between the positions of the two
+static double maxErrorDeg(const SGEphemeris& a, const SGEphemeris& b, double maxError)
+{
+    double error = angleDeg(a.getSunRightAscension(), a.getSunDeclination(),
+                            b.getSunRightAscension(), b.getSunDeclination());
+    error = std::max(error, angleDeg(a.getMoonRightAscension(), a.getMoonDeclination(),
+                                     b.getMoonRightAscension(), b.getMoonDeclination()));
+    for (int i = 0; i < a.getNumPlanets(); ++i) {
+        const SGVec3d& p = a.getPlanets()[i];
+        const SGVec3d& q = b.getPlanets()[i];
+        error = std::max(error, angleDeg(p[0], p[1], q[0], q[1]));
+        // Magnitudes have the same bound
+        SG_VERIFY(fabs(p[2] - q[2]) <= maxError * 1.5);
+    }
+    SG_VERIFY(fabs(a.getMoonDistanceInMayorAxis() - b.getMoonDistanceInMayorAxis()) < 1e-3);
+    SG_VERIFY(fabs(a.get_moon()->getPhase() - b.get_moon()->getPhase()) < 1e-3);
+    return error;
+}
+
+int main(int argc, char* argv[])
+{
+    const double maxError = 0.01;
+    const SGPath noStars("no-such-star-catalog");
+    SGEphemeris full(noStars);
+    SGEphemeris interpolated(noStars);
+    interpolated.setInterpolation(maxError);
+
+    // Time warp, a minute of simulated time per update over two months
+    const int steps = 60 * 24 * 60;
+    double warpError = 0.0;
+    for (int i = 0; i < steps; ++i) {
+        double mjd = Mjd2020 + i / 1440.0;
+        full.update(mjd, 0.0, 0.0);
+        interpolated.update(mjd, 0.0, 0.0);
+        warpError = std::max(warpError, maxErrorDeg(full, interpolated, maxError));
+    }
+    // The bound holds in the middle of the windows, where the error is
+    // largest for smooth motion
+    SG_VERIFY(warpError <= maxError * 1.5);
+
+    // Scrubbing back and forth over a few days
+    mt seed;
+    mt_init(&seed, 1969);
+    double mjd = Mjd2020 + 100.0;
+    double scrubError = 0.0;
+    for (int i = 0; i < 20000; ++i) {
+        mjd += (mt_rand(&seed) - 0.5) * 0.05;
+        full.update(mjd, 0.0, 0.0);
+        interpolated.update(mjd, 0.0, 0.0);
+        scrubError = std::max(scrubError, maxErrorDeg(full, interpolated, maxError));
+    }
+    SG_VERIFY(scrubError <= maxError * 1.5);
+
+    // Across the year, and back to full updates
+    for (int i = 0; i < 1000; ++i) {
+        double mjd = Mjd2020 + mt_rand(&seed) * 3650.0;
+        full.update(mjd, 0.0, 0.0);
+        interpolated.update(mjd, 0.0, 0.0);
+        SG_VERIFY(maxErrorDeg(full, interpolated, maxError) <= maxError * 1.5);
+    }
+    interpolated.setInterpolation(0.0);
+    interpolated.update(Mjd2020 + 0.3, 0.0, 0.0);
+    full.update(Mjd2020 + 0.3, 0.0, 0.0);
+    SG_CHECK_EQUAL(interpolated.getMoonRightAscension(), full.getMoonRightAscension());
+    SG_CHECK_EQUAL(interpolated.getPlanets()[3][1], full.getPlanets()[3][1]);
+
+    // Benchmark, at a frame rate with 100x time warp
+    interpolated.setInterpolation(maxError);
+    const int frames = 100000;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; ++i)
+        full.update(Mjd2020 + i * 100.0 / 60 / 86400, 0.0, 0.0);
+    auto middle = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; ++i)
+        interpolated.update(Mjd2020 + i * 100.0 / 60 / 86400, 0.0, 0.0);
+    auto end = std::chrono::steady_clock::now();
+
+    std::cout << "max error " << warpError << " deg with time warp, " << scrubError
+              << " deg scrubbing; " << frames << " updates: full "
+              << std::chrono::duration<double, std::milli>(middle - start).count()
+              << " ms, interpolated "
+              << std::chrono::duration<double, std::milli>(end - middle).count()
+              << " ms" << std::endl;
+
+    return EXIT_SUCCESS;
+}
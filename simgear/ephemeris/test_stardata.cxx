@@ -0,0 +1,172 @@
+// Checks that SGStarData writes a binary catalog next to the text one,
+// maps it instead of parsing the text while that is unchanged and
+// regenerates it when it is not, checks the batch directions against
+// the ones calculated star by star and against a precession example,
+// and compares the time loading and transforming the stars take.
+
+#ifdef HAVE_CONFIG_H
+#  include <simgear_config.h>
+#endif
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include <simgear/constants.h>
+#include <simgear/ephemeris/stardata.hxx>
+#include <simgear/io/iostreams/sgstream.hxx>
+#include <simgear/math/sg_random.h>
+#include <simgear/misc/sg_dir.hxx>
+#include <simgear/misc/test_macros.hxx>
+
+// J2000, in the modified julian dates SGEphemeris takes
+static const double MjdJ2000 = 36525.0;
+
+static void writeCatalog(const SGPath& path, const std::vector<SGVec3d>& stars)
+{
+    sg_ofstream out(path);
+    out << "# name, right ascension, declination, magnitude\n";
+    out << std::fixed << std::setprecision(6);
+    for (size_t i = 0; i < stars.size(); ++i) {
+        if (i % 1000 == 0)
+            out << "# block " << i / 1000 << "\n";
+        out << "Star " << i << ", " << stars[i][0] << "," << stars[i][1]
+            << ", " << stars[i][2] << "\n";
+    }
+    out << "\n# end of the catalog\n\n";
+}
+
+static double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+    simgear::Dir tmpDir = simgear::Dir::tempDir("FlightGear");
+    tmpDir.setRemoveOnDestroy();
+    const SGPath text = tmpDir.path() / "stars";
+    const SGPath binary = tmpDir.path() / "stars.bin";
+
+    // About as many stars as the catalog of FGData
+    mt seed;
+    mt_init(&seed, 2000);
+    std::vector<SGVec3d> stars;
+    for (int i = 0; i < 8000; ++i)
+        stars.push_back(SGVec3d(mt_rand(&seed) * SGD_2PI,
+                                asin(mt_rand(&seed) * 2.0 - 1.0),
+                                mt_rand(&seed) * 8.0 - 1.5));
+    writeCatalog(text, stars);
+
+    // The first load parses the text and writes the binary catalog
+    auto start = std::chrono::steady_clock::now();
+    SGStarData data(tmpDir.path());
+    const double textMs = elapsedMs(start);
+    SG_VERIFY(binary.exists());
+    SG_CHECK_EQUAL(data.getNumStars(), (int)stars.size());
+    for (size_t i = 0; i < stars.size(); ++i)
+        for (int k = 0; k < 3; ++k)
+            SG_VERIFY(fabs(data.getStars()[i][k] - stars[i][k]) < 1e-6);
+
+    // The next one maps it, with the same stars
+    start = std::chrono::steady_clock::now();
+    SGStarData mapped(tmpDir.path());
+    const double binaryMs = elapsedMs(start);
+    SG_CHECK_EQUAL(mapped.getNumStars(), data.getNumStars());
+    for (int i = 0; i < data.getNumStars(); ++i)
+        for (int k = 0; k < 3; ++k)
+            SG_CHECK_EQUAL(mapped.getStars()[i][k], data.getStars()[i][k]);
+
+    // A changed text catalog replaces it
+    stars.resize(5000);
+    stars[7] = SGVec3d(1.0, 0.5, 2.0);
+    writeCatalog(text, stars);
+    SG_VERIFY(mapped.load(tmpDir.path()));
+    SG_CHECK_EQUAL(mapped.getNumStars(), (int)stars.size());
+    SG_CHECK_EQUAL(mapped.getStars()[7][1], 0.5);
+    SGStarData reloaded(tmpDir.path());
+    SG_CHECK_EQUAL(reloaded.getNumStars(), mapped.getNumStars());
+    SG_CHECK_EQUAL(reloaded.getStars()[7][1], 0.5);
+
+    // So does a corrupt one
+    {
+        sg_ofstream out(binary, std::ios::out | std::ios::binary);
+        out << "SGSTARSB but not much more";
+    }
+    SGStarData repaired(tmpDir.path());
+    SG_CHECK_EQUAL(repaired.getNumStars(), mapped.getNumStars());
+    SG_CHECK_EQUAL(repaired.getStars()[7][0], 1.0);
+    SG_VERIFY(binary.sizeInBytes() > 5000 * sizeof(SGVec3d));
+
+    // Without a catalog there are no stars
+    SGStarData none(tmpDir.path() / "no-such-directory");
+    SG_CHECK_EQUAL(none.getNumStars(), 0);
+    none.getLocalDirections(MjdJ2000, 1.0, 0.5, 0);
+
+    // Without precession, the directions from the hour angles
+    const double lst = 1.234, lat = 47.5 * SGD_DEGREES_TO_RADIANS;
+    std::vector<SGVec3f> directions(data.getNumStars());
+    data.getLocalDirections(MjdJ2000, lst, lat, &directions[0]);
+    for (int i = 0; i < data.getNumStars(); ++i) {
+        const SGVec3d& star = data.getStars()[i];
+        double h = lst - star[0];
+        SGVec3d expected(-cos(star[1]) * sin(h),
+                         cos(lat) * sin(star[1]) - sin(lat) * cos(star[1]) * cos(h),
+                         sin(lat) * sin(star[1]) + cos(lat) * cos(star[1]) * cos(h));
+        SG_VERIFY(length(toVec3d(directions[i]) - expected) < 1e-6);
+    }
+
+    // Meeus, Astronomical Algorithms, example 21.b: theta Persei, at
+    // JD 2462088.69, seen from the north pole
+    {
+        SGPath dir = tmpDir.path() / "persei";
+        simgear::Dir(dir).create(0755);
+        // without a line end after the last star
+        sg_ofstream out(dir / "stars");
+        out << "# theta Persei\n" << std::setprecision(12) << "theta Persei, "
+            << 41.054063 * SGD_DEGREES_TO_RADIANS << ", "
+            << 49.227750 * SGD_DEGREES_TO_RADIANS << ", 4.1";
+        out.close();
+        SGStarData precessed(dir);
+        SGVec3f d[1];
+        SG_CHECK_EQUAL(precessed.getNumStars(), 1);
+        precessed.getLocalDirections(2462088.69 - 2415020.0, 0.0, SGD_PI_2, d);
+        double ra = atan2(d[0][0], -d[0][1]) * SGD_RADIANS_TO_DEGREES;
+        double dec = asin(d[0][2]) * SGD_RADIANS_TO_DEGREES;
+        SG_VERIFY(fabs(ra - 41.547214) < 5e-5);
+        SG_VERIFY(fabs(dec - 49.348483) < 5e-5);
+    }
+
+    // Benchmark, the directions of all stars for 1000 frames
+    const int frames = 1000;
+    std::vector<SGVec3f> single(data.getNumStars());
+    start = std::chrono::steady_clock::now();
+    for (int f = 0; f < frames; ++f) {
+        double t = lst + f * 1e-4;
+        for (int i = 0; i < data.getNumStars(); ++i) {
+            const SGVec3d& star = data.getStars()[i];
+            double h = t - star[0];
+            single[i] = SGVec3f(-cos(star[1]) * sin(h),
+                                cos(lat) * sin(star[1]) - sin(lat) * cos(star[1]) * cos(h),
+                                sin(lat) * sin(star[1]) + cos(lat) * cos(star[1]) * cos(h));
+        }
+    }
+    const double singleMs = elapsedMs(start);
+    start = std::chrono::steady_clock::now();
+    for (int f = 0; f < frames; ++f)
+        data.getLocalDirections(MjdJ2000, lst + f * 1e-4, lat, &directions[0]);
+    const double batchMs = elapsedMs(start);
+    for (int i = 0; i < data.getNumStars(); ++i)
+        SG_VERIFY(length(directions[i] - single[i]) < 1e-5);
+
+    std::cout << data.getNumStars() << " stars: loading text " << textMs
+              << " ms, binary " << binaryMs << " ms; " << frames
+              << " updates: star by star " << singleMs << " ms, batch "
+              << batchMs << " ms" << std::endl;
+
+    return EXIT_SUCCESS;
+}
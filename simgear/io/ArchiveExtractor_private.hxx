@@ -18,6 +18,9 @@
 
 #pragma once
 
+#include <atomic>
+#include <cassert>
+
 #include "untar.hxx"
 
 namespace simgear {
@@ -47,13 +50,20 @@ public:
         FILTER_STOPPED
     } State;
 
-    State state = INVALID;
+    // atomic since pipelined extractors update it from their worker thread
+    std::atomic<State> state{INVALID};
     ArchiveExtractor* outer = nullptr;
 
     virtual void extractBytes(const uint8_t* bytes, size_t count) = 0;
 
     virtual void flush() = 0;
 
+    /// stop without processing queued input, see ArchiveExtractor::cancel()
+    virtual void abort() = 0;
+
+    /// stop the thread calling filterPath(), if there is one
+    virtual void stopWorkers() {}
+
     SGPath extractRootPath()
     {
         return outer->_rootPath;
@@ -124,6 +124,31 @@ void Client::setMaxPipelineDepth(unsigned int depth)
 #endif
 }
 
+unsigned int Client::maxConnections() const
+{
+    return d->maxConnections;
+}
+
+unsigned int Client::maxHostConnections() const
+{
+    return d->maxHostConnections;
+}
+
+unsigned int Client::maxPipelineDepth() const
+{
+    return d->maxPipelineDepth;
+}
+
+bool Client::isPipelining() const
+{
+#if (LIBCURL_VERSION_NUM >= 0x073e00)
+    // CURLMOPT_PIPELINING is ignored from 7.62 on
+    return false;
+#else
+    return d->maxPipelineDepth > 0;
+#endif
+}
+
 void Client::reset()
 {
     if (d.get()) {
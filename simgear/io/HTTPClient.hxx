@@ -87,6 +87,19 @@ public:
      */
     void setMaxPipelineDepth(unsigned int depth);
 
+    unsigned int maxConnections() const;
+
+    unsigned int maxHostConnections() const;
+
+    unsigned int maxPipelineDepth() const;
+
+    /**
+     * true if requests to a host are pipelined on its connections: the
+     * pipeline depth is not zero and libcurl still supports HTTP/1.1
+     * pipelining, which it dropped in 7.62
+     */
+    bool isPipelining() const;
+
     const std::string& userAgent() const;
 
     const std::string& proxyHost() const;
@@ -963,6 +963,25 @@ std::string HTTPRepository::resultCodeAsString(ResultCode code)
     return innerResultCodeAsString(code);
 }
 
+void HTTPRepository::setMaxConcurrentRequests(unsigned int maxRequests)
+{
+    if (maxRequests == 0) {
+        maxRequests = std::max(1u, _d->http->maxHostConnections());
+        if (_d->http->isPipelining()) {
+            maxRequests *= _d->http->maxPipelineDepth();
+        }
+    }
+
+    _d->maxActiveRequests = maxRequests;
+    // if the limit was raised mid-sync, use the new capacity right away
+    _d->startQueuedRequests();
+}
+
+unsigned int HTTPRepository::maxConcurrentRequests() const
+{
+    return static_cast<unsigned int>(_d->maxActiveRequests);
+}
+
 HTTPRepository::FailureVec HTTPRepository::failures() const {
   return _d->failures;
 }
@@ -1321,7 +1340,7 @@ HTTPRepository::failure() const
 
     void HTTPRepoPrivate::makeRequest(RepoRequestPtr req)
     {
-        if (activeRequests.size() > 4) {
+        if (activeRequests.size() >= maxActiveRequests) {
           queuedRequests.push_back(req);
         } else {
             activeRequests.push_back(req);
@@ -1329,6 +1348,17 @@ HTTPRepository::failure() const
         }
     }
 
+    void HTTPRepoPrivate::startQueuedRequests()
+    {
+      while (!queuedRequests.empty() &&
+             (activeRequests.size() < maxActiveRequests)) {
+        RepoRequestPtr rr = queuedRequests.front();
+        queuedRequests.erase(queuedRequests.begin());
+        activeRequests.push_back(rr);
+        http->makeRequest(rr);
+      }
+    }
+
     void HTTPRepoPrivate::finishedRequest(const RepoRequestPtr &req,
                                           RequestFinish retryRequest) {
       auto it = std::find(activeRequests.begin(), activeRequests.end(), req);
@@ -1344,12 +1374,7 @@ HTTPRepository::failure() const
         queuedRequests.push_back(req);
       }
 
-      if (!queuedRequests.empty()) {
-        RepoRequestPtr rr = queuedRequests.front();
-        queuedRequests.erase(queuedRequests.begin());
-        activeRequests.push_back(rr);
-        http->makeRequest(rr);
-      }
+      startQueuedRequests();
 
       if (countDirtyHashCaches() > 32) {
           flushHashCaches();
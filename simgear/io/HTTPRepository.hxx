@@ -79,6 +79,18 @@ public:
    */
   void setInstalledCopyPath(const SGPath &copyPath);
 
+  /**
+   * set the number of requests this repository keeps in flight at once;
+   * further requests are queued until one completes. Pass zero to
+   * derive the limit from the HTTP::Client: one request per permitted
+   * host connection, times the pipeline depth if the client is pipelining
+   * (see HTTP::Client::isPipelining()).
+   * The default is 5.
+   */
+  void setMaxConcurrentRequests(unsigned int maxRequests);
+
+  unsigned int maxConcurrentRequests() const;
+
   static std::string resultCodeAsString(ResultCode code);
 
   enum class SyncAction { Add, Update, Delete, UpToDate };
@@ -59,6 +59,7 @@ public:
 
   HTTPRepository::FailureVec failures;
   size_t maxPermittedFailures = 16;
+  size_t maxActiveRequests = 5;
 
   HTTPRepoPrivate(HTTPRepository *parent)
       : p(parent), isUpdating(false), status(HTTPRepository::REPO_NO_ERROR),
@@ -95,6 +96,7 @@ public:
   RequestVector queuedRequests, activeRequests;
 
   void makeRequest(RepoRequestPtr req);
+  void startQueuedRequests();
 
   enum class RequestFinish { Done, Retry };
 
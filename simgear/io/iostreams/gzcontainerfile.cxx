@@ -37,6 +37,18 @@
  * is implemented.
  *
  * Use this for storing/loading user-data only - not for distribution files (scenery, aircraft etc).
+ *
+ * Indexed variant (gzIndexedContainerWriter/gzIndexedContainerReader):
+ * the gzip stream is the same, except that it is fully flushed (Z_FULL_FLUSH)
+ * every few hundred KiB, at container boundaries. Deflate data can be
+ * decompressed (as raw deflate) from any such flush point. Following the gzip
+ * stream, which gzip readers ignore as trailing garbage, come:
+ *  - one index entry per container, including the file header:
+ *    uint64 flush point offset in the file (0: start of the gzip stream),
+ *    uint64 uncompressed bytes from the flush point to the container,
+ *    uint32 container type, uint64 container payload size
+ *  - the trailer: uint64 offset of the first index entry, uint64 number of
+ *    entries, uint32 format version, uint32 IndexMagic
  */
 
 #ifdef HAVE_CONFIG_H
@@ -50,6 +62,7 @@
 #include <simgear/misc/sg_path.hxx>
 
 #include <string.h>
+#include <zlib.h>
 
 using namespace std;
 using namespace simgear;
@@ -67,15 +80,27 @@ const ContainerType HeaderType = 0;
 /** Magic word to detect big/little-endian file formats */
 static const uint32_t EndianMagic = 0x11223344;
 
+/** Magic word ending indexed files ("SGCI"), also detects the byte order */
+static const uint32_t IndexMagic = 0x49434753;
+static const uint32_t IndexVersion = 1;
+
+/** Sizes of the serialized container header, index entry and trailer */
+static const size_t ContainerHeaderSize = sizeof(uint32_t) + sizeof(uint64_t);
+static const size_t IndexEntrySize = 3 * sizeof(uint64_t) + sizeof(uint32_t);
+static const size_t IndexTrailerSize = 2 * sizeof(uint64_t) + 2 * sizeof(uint32_t);
+
 /**************************************************************************
  * gzContainerWriter
  **************************************************************************/
 
 gzContainerWriter::gzContainerWriter(const SGPath& name,
-                                     const std::string& fileMagic) :
-        sg_gzofstream(name, ios_out | ios_binary),
+                                     const std::string& fileMagic,
+                                     unsigned int compressionThreads) :
         filename(name.utf8Str())
 {
+    setCompressionThreads(compressionThreads);
+    open(name, ios_out | ios_binary);
+
     /* write byte-order marker **************************************/
     write((char*)&EndianMagic, sizeof(EndianMagic));
 
@@ -90,6 +115,14 @@ gzContainerWriter::writeContainerHeader(ContainerType Type, size_t Size)
     uint32_t ui32Data;
     uint64_t ui64Data;
 
+    if (!is_open() || fail())
+        return false;
+
+    // the file header is written by the constructor, before a subclass
+    // could take note of it
+    if ((Type != HeaderType) && !beginContainer(Type, Size))
+        return false;
+
     SG_LOG(SG_IO, MY_SG_DEBUG, "Writing container " << Type << ", size " << Size);
 
     // write container type
@@ -259,3 +292,343 @@ gzContainerReader::readContainer(ContainerType* pType, char** ppData, size_t* pS
     *pSize = Size;
     return true;
 }
+
+bool
+gzContainerWriter::beginContainer(ContainerType Type, size_t Size)
+{
+    return true;
+}
+
+bool
+gzContainerWriter::finish()
+{
+    if (finished)
+        return finishedOk;
+
+    bool ok = !fail();
+    if (is_open())
+    {
+        sg_gzofstream::close();
+        ok = ok && !fail();
+    }
+
+    finished = true;
+    finishedOk = finishFile(ok);
+    return finishedOk;
+}
+
+bool
+gzContainerWriter::finishFile(bool ok)
+{
+    return ok;
+}
+
+/**************************************************************************
+ * gzIndexedContainerWriter
+ **************************************************************************/
+
+gzIndexedContainerWriter::gzIndexedContainerWriter(const SGPath& name,
+                                                   const std::string& fileMagic,
+                                                   size_t flushInterval) :
+        gzContainerWriter(name, fileMagic),
+        path(name),
+        flushInterval(flushInterval),
+        lastFlushOffset(0),
+        sinceFlush(0)
+{
+    // The base class has written the byte-order marker and the file header
+    const uint64_t headerSize = fileMagic.size() + 1;
+    index.push_back({0, sizeof(EndianMagic), HeaderType, headerSize});
+    sinceFlush = sizeof(EndianMagic) + ContainerHeaderSize + headerSize;
+}
+
+gzIndexedContainerWriter::~gzIndexedContainerWriter()
+{
+    // the base classes only close the gzip stream when destroyed
+    finish();
+}
+
+bool
+gzIndexedContainerWriter::beginContainer(ContainerType Type, size_t Size)
+{
+    if (sinceFlush >= flushInterval)
+    {
+        if (!rdbuf_gz().fullflush())
+        {
+            SG_LOG(SG_IO, SG_ALERT, "Cannot flush compressed stream: " << path);
+            setstate(badbit);
+            return false;
+        }
+
+        lastFlushOffset = rdbuf_gz().approxOffset();
+        sinceFlush = 0;
+    }
+
+    index.push_back({lastFlushOffset, sinceFlush, (uint32_t) Type, Size});
+    sinceFlush += ContainerHeaderSize + Size;
+    return true;
+}
+
+bool
+gzIndexedContainerWriter::finishFile(bool ok)
+{
+    // Without a complete gzip stream, an index would be useless
+    return ok && appendIndex();
+}
+
+/** Append the index and trailer after the (closed) gzip stream. */
+bool
+gzIndexedContainerWriter::appendIndex()
+{
+    sg_ofstream out(path, ios_out | ios_binary | ios_app);
+    out.seekp(0, std::ios_base::end);
+    const uint64_t indexOffset = out.tellp();
+    if (!out.is_open() || !out.good())
+    {
+        SG_LOG(SG_IO, SG_ALERT, "Cannot append index to " << path);
+        return false;
+    }
+
+    for (const IndexEntry& e : index)
+    {
+        out.write((const char*) &e.flushOffset, sizeof(e.flushOffset));
+        out.write((const char*) &e.skip, sizeof(e.skip));
+        out.write((const char*) &e.type, sizeof(e.type));
+        out.write((const char*) &e.size, sizeof(e.size));
+    }
+
+    const uint64_t count = index.size();
+    out.write((const char*) &indexOffset, sizeof(indexOffset));
+    out.write((const char*) &count, sizeof(count));
+    out.write((const char*) &IndexVersion, sizeof(IndexVersion));
+    out.write((const char*) &IndexMagic, sizeof(IndexMagic));
+    out.close();
+
+    if (out.fail())
+    {
+        SG_LOG(SG_IO, SG_ALERT, "Error writing index of " << path);
+        return false;
+    }
+
+    return true;
+}
+
+/**************************************************************************
+ * gzIndexedContainerReader
+ **************************************************************************/
+
+gzIndexedContainerReader::gzIndexedContainerReader(const SGPath& name,
+                                                   const std::string& fileMagic) :
+        file(name, ios_in | ios_binary),
+        filename(name.utf8Str()),
+        valid(false)
+{
+    if (!file.is_open() || !readIndex())
+    {
+        SG_LOG(SG_IO, SG_ALERT, "Not an indexed container file: " << filename);
+        return;
+    }
+
+    /* read file header *********************************************/
+    const IndexEntry& header = index.front();
+    std::string fileHeader(header.size, '\0');
+    if ((header.type != HeaderType) || !readEntry(header, &fileHeader[0]) ||
+        (strcmp(fileHeader.c_str(), fileMagic.c_str())))
+    {
+        SG_LOG(SG_IO, SG_ALERT, "File not recognized. This is not a valid '" << fileMagic << "' file: " << filename);
+        return;
+    }
+
+    valid = true;
+}
+
+gzIndexedContainerReader::~gzIndexedContainerReader()
+{
+}
+
+/** Load the index from the end of the file. */
+bool
+gzIndexedContainerReader::readIndex()
+{
+    file.seekg(0, std::ios_base::end);
+    const uint64_t fileSize = file.tellg();
+    if (!file.good() || (fileSize < IndexTrailerSize))
+        return false;
+
+    uint64_t indexOffset, count;
+    uint32_t version, magic;
+    file.seekg(fileSize - IndexTrailerSize);
+    file.read((char*) &indexOffset, sizeof(indexOffset));
+    file.read((char*) &count, sizeof(count));
+    file.read((char*) &version, sizeof(version));
+    file.read((char*) &magic, sizeof(magic));
+    if (!file.good())
+        return false;
+
+    if (magic != IndexMagic)
+    {
+        // also catches files written on machines with another byte order
+        return false;
+    }
+
+    if ((version != IndexVersion) || (count == 0) ||
+        (indexOffset + count * IndexEntrySize + IndexTrailerSize != fileSize))
+    {
+        SG_LOG(SG_IO, SG_ALERT, "Unsupported or corrupt container index in " << filename);
+        return false;
+    }
+
+    file.seekg(indexOffset);
+    index.resize(count);
+    for (IndexEntry& e : index)
+    {
+        uint32_t type;
+        file.read((char*) &e.flushOffset, sizeof(e.flushOffset));
+        file.read((char*) &e.skip, sizeof(e.skip));
+        file.read((char*) &type, sizeof(type));
+        file.read((char*) &e.size, sizeof(e.size));
+        e.type = (ContainerType) type;
+        if (e.flushOffset >= indexOffset)
+            return false;
+    }
+
+    return file.good();
+}
+
+size_t
+gzIndexedContainerReader::containerCount() const
+{
+    return index.empty() ? 0 : index.size() - 1;
+}
+
+ContainerType
+gzIndexedContainerReader::containerType(size_t i) const
+{
+    return index.at(i + 1).type;
+}
+
+size_t
+gzIndexedContainerReader::containerSize(size_t i) const
+{
+    return index.at(i + 1).size;
+}
+
+/** Decompress the payload of the given container into pData, starting
+ * at its flush point. */
+bool
+gzIndexedContainerReader::readEntry(const IndexEntry& entry, char* pData)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    // offset 0 is the start of the gzip stream, all others are raw deflate
+    if (inflateInit2(&zs, (entry.flushOffset == 0) ? 16 + MAX_WBITS : -MAX_WBITS) != Z_OK)
+        return false;
+
+    file.clear();
+    file.seekg(entry.flushOffset);
+
+    const uint64_t headerStart = entry.skip;
+    const uint64_t dataStart = headerStart + ContainerHeaderSize;
+    const uint64_t dataEnd = dataStart + entry.size;
+    char header[ContainerHeaderSize];
+    std::vector<char> inBuf(65536), outBuf(65536);
+    uint64_t pos = 0;               // uncompressed bytes produced so far
+    int ret = Z_OK;
+
+    while (pos < dataEnd)
+    {
+        if (zs.avail_in == 0)
+        {
+            file.read(inBuf.data(), inBuf.size());
+            if (file.gcount() <= 0)
+                break;
+            zs.next_in = (Bytef*) inBuf.data();
+            zs.avail_in = (uInt) file.gcount();
+        }
+
+        zs.next_out = (Bytef*) outBuf.data();
+        zs.avail_out = (uInt) std::min<uint64_t>(outBuf.size(), dataEnd - pos);
+        ret = inflate(&zs, Z_NO_FLUSH);
+        if ((ret != Z_OK) && (ret != Z_STREAM_END))
+            break;
+
+        // Dispatch what was produced: skipped data, container header, payload
+        const uint64_t produced = (char*) zs.next_out - outBuf.data();
+        for (uint64_t i = 0; i < produced; )
+        {
+            const uint64_t p = pos + i;
+            if (p < headerStart)
+            {
+                i += std::min(produced - i, headerStart - p);
+            }
+            else if (p < dataStart)
+            {
+                const uint64_t n = std::min(produced - i, dataStart - p);
+                memcpy(header + (p - headerStart), outBuf.data() + i, n);
+                i += n;
+            }
+            else
+            {
+                const uint64_t n = std::min(produced - i, dataEnd - p);
+                memcpy(pData + (p - dataStart), outBuf.data() + i, n);
+                i += n;
+            }
+        }
+        pos += produced;
+
+        if (ret == Z_STREAM_END)
+            break;
+    }
+
+    inflateEnd(&zs);
+
+    if (pos < dataEnd)
+    {
+        SG_LOG(SG_IO, SG_ALERT, "File corrupt? Unexpected end of data when reading " << filename);
+        return false;
+    }
+
+    // Cross-check the container header with the index
+    uint32_t type;
+    uint64_t size;
+    memcpy(&type, header, sizeof(type));
+    memcpy(&size, header + sizeof(type), sizeof(size));
+    if (((ContainerType) type != entry.type) || (size != entry.size))
+    {
+        SG_LOG(SG_IO, SG_ALERT, "File corrupt? Container header does not match index in " << filename);
+        return false;
+    }
+
+    return true;
+}
+
+/** Read a single container and return its contents as a binary blob */
+bool
+gzIndexedContainerReader::readContainer(size_t i, ContainerType* pType, char** ppData, size_t* pSize)
+{
+    *ppData = 0;
+    *pSize = 0;
+    *pType = -1;
+
+    if (!valid || (i >= containerCount()))
+        return false;
+
+    const IndexEntry& entry = index[i + 1];
+    char* pData = (char*) malloc(entry.size ? entry.size : 1);
+    if (!pData)
+    {
+        SG_LOG(SG_IO, SG_ALERT, "Cannot load data. No more memory when reading " << filename);
+        return false;
+    }
+
+    if (!readEntry(entry, pData))
+    {
+        free(pData);
+        return false;
+    }
+
+    *ppData = pData;
+    *pSize = entry.size;
+    *pType = entry.type;
+    return true;
+}
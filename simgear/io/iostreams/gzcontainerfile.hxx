@@ -21,8 +21,11 @@
 #ifndef GZ_CONTAINER_FILE_HXX
 #define GZ_CONTAINER_FILE_HXX
 
+#include <cstdint>
 #include <string>
+#include <vector>
 #include <simgear/io/iostreams/sgstream.hxx>
+#include <simgear/misc/sg_path.hxx>
 
 class SGPropertyNode;
 
@@ -48,15 +51,133 @@ private:
 class gzContainerWriter : public sg_gzofstream
 {
 public:
+    /**
+     * @param compressionThreads number of threads compressing the file
+     *        (0 means one per hardware thread); the output is a regular
+     *        gzip file either way.
+     */
     gzContainerWriter( const SGPath& name,
-                       const std::string& fileMagic);
+                       const std::string& fileMagic,
+                       unsigned int compressionThreads = 1);
 
     bool writeContainerHeader(ContainerType Type, size_t Size);
     bool writeContainer(ContainerType Type, const char* pData, size_t Size);
     bool writeContainer(ContainerType Type, const char* stringBuffer);
     bool writeContainer(ContainerType Type, SGPropertyNode* root);
+
+    /**
+     * Complete the file: close the gzip stream, if it is still open, and
+     * write whatever a subclass appends after it. Calling it more than
+     * once returns the first result. A stream closed with
+     * sg_gzofstream::close() is not complete until finish() is called,
+     * which gzIndexedContainerWriter's destructor also does.
+     * @return false if anything could not be written.
+     */
+    bool finish();
+
+protected:
+    /** Called before the header of each container but the file header is
+     * written. @return false to fail writing the container. */
+    virtual bool beginContainer(ContainerType Type, size_t Size);
+
+    /** Called once the compressed stream is closed.
+     * @param ok whether all of it was written */
+    virtual bool finishFile(bool ok);
+
+private:
+    std::string filename;
+    bool finished = false;
+    bool finishedOk = false;
+};
+
+/**
+ * A container writer producing files which also support random access.
+ *
+ * The compressed stream is fully flushed every flushInterval bytes (at
+ * container boundaries), and an index of all containers is appended after
+ * the gzip data. gzip readers ignore such trailing data, so these files can
+ * still be read sequentially by gzContainerReader. Use
+ * gzIndexedContainerReader to access any container directly.
+ *
+ * Parallel compression is not available for this format.
+ */
+class gzIndexedContainerWriter : public gzContainerWriter
+{
+public:
+    gzIndexedContainerWriter( const SGPath& name,
+                              const std::string& fileMagic,
+                              size_t flushInterval = 256 * 1024);
+    ~gzIndexedContainerWriter();
+
+protected:
+    /** Starts a new flush point if enough data was written since the last
+     * one, and adds the container to the index. */
+    bool beginContainer(ContainerType Type, size_t Size) override;
+
+    /** Appends the index after the closed gzip stream. The destructor
+     * calls finish(), so the index is written even if it wasn't. */
+    bool finishFile(bool ok) override;
+
 private:
+    struct IndexEntry
+    {
+        uint64_t flushOffset;   // compressed offset of the flush point
+        uint64_t skip;          // bytes to decompress from there
+        uint32_t type;
+        uint64_t size;
+    };
+
+    bool appendIndex();
+
+    SGPath path;
+    size_t flushInterval;
+    uint64_t lastFlushOffset;
+    uint64_t sinceFlush;        // uncompressed bytes since lastFlushOffset
+    std::vector<IndexEntry> index;
+};
+
+/**
+ * Random access to the containers of a file written by
+ * gzIndexedContainerWriter. Reading any container only decompresses the data
+ * between the preceding flush point and the end of that container.
+ */
+class gzIndexedContainerReader
+{
+public:
+    gzIndexedContainerReader( const SGPath& name,
+                              const std::string& fileMagic);
+    ~gzIndexedContainerReader();
+
+    /** @return false if the file could not be opened, has no valid index,
+     *          or does not have the expected file magic */
+    bool isValid() const { return valid; }
+
+    /** @return the number of containers, not counting the file header */
+    size_t containerCount() const;
+    ContainerType containerType(size_t i) const;
+    size_t containerSize(size_t i) const;
+
+    /** Read container i (0-based, not counting the file header). The data is
+     * allocated with malloc(), as for gzContainerReader::readContainer(). */
+    bool readContainer(size_t i, ContainerType* pType, char** ppData,
+                       size_t* pSize);
+
+private:
+    struct IndexEntry
+    {
+        uint64_t flushOffset;
+        uint64_t skip;
+        ContainerType type;
+        uint64_t size;
+    };
+
+    bool readIndex();
+    bool readEntry(const IndexEntry& entry, char* pData);
+
+    sg_ifstream file;
     std::string filename;
+    std::vector<IndexEntry> index;  // index[0] is the file header
+    bool valid;
 };
 
 }
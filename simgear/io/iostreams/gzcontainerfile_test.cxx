@@ -0,0 +1,144 @@
+#include <simgear_config.h>
+
+#include <cstdlib> // for EXIT_SUCCESS
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <simgear/misc/test_macros.hxx>
+#include <simgear/io/iostreams/gzcontainerfile.hxx>
+#include <simgear/misc/sg_path.hxx>
+#include <simgear/misc/sg_dir.hxx>
+
+using std::string;
+using std::cout;
+using std::endl;
+using namespace simgear;
+
+static const string fileMagic = "SimGearContainerTest";
+
+// Payload of container i: a few KiB of not-too-compressible data
+static string payload(int i)
+{
+    string s;
+    unsigned int x = 12345 + i;
+    const size_t size = 1000 + (i * 397) % 5000;
+    while (s.size() < size) {
+        x = x * 1103515245 + 12345;
+        s += (char) ('a' + (x >> 16) % 26);
+    }
+    return s;
+}
+
+static void testSequentialReadOfIndexedFile(const SGPath& p, int count)
+{
+    gzContainerReader reader(p, fileMagic);
+    SG_VERIFY(reader.good());
+
+    for (int i = 0; i < count; ++i) {
+        ContainerType type;
+        char* data;
+        size_t size;
+        SG_VERIFY(reader.readContainer(&type, &data, &size));
+        SG_CHECK_EQUAL(type, 1 + i % 3);
+        SG_CHECK_EQUAL(string(data, size), payload(i));
+        free(data);
+    }
+
+    // The index after the gzip data is not seen as a container
+    char c;
+    reader.read(&c, 1);
+    SG_VERIFY(reader.eof());
+    cout << "Indexed file is readable sequentially." << endl;
+}
+
+static void testRandomAccess(const SGPath& p, int count)
+{
+    gzIndexedContainerReader reader(p, fileMagic);
+    SG_VERIFY(reader.isValid());
+    SG_CHECK_EQUAL(reader.containerCount(), (size_t) count);
+
+    // Backwards, then in a scattered order
+    std::vector<int> order;
+    for (int i = count - 1; i >= 0; --i)
+        order.push_back(i);
+    for (int i = 0; i < count; ++i)
+        order.push_back((i * 37) % count);
+
+    for (int i : order) {
+        SG_CHECK_EQUAL(reader.containerType(i), 1 + i % 3);
+        SG_CHECK_EQUAL(reader.containerSize(i), payload(i).size());
+
+        ContainerType type;
+        char* data;
+        size_t size;
+        SG_VERIFY(reader.readContainer(i, &type, &data, &size));
+        SG_CHECK_EQUAL(type, 1 + i % 3);
+        SG_CHECK_EQUAL(string(data, size), payload(i));
+        free(data);
+    }
+
+    ContainerType type;
+    char* data;
+    size_t size;
+    SG_VERIFY(!reader.readContainer(count, &type, &data, &size));
+    cout << "Random access to indexed file works." << endl;
+}
+
+int main()
+{
+    simgear::Dir tmpDir = simgear::Dir::tempDir("FlightGear");
+    tmpDir.setRemoveOnDestroy();
+    const int count = 200;
+
+    // Small flush interval: many flush points. Written through the base
+    // class, which must not bypass the index.
+    const SGPath indexed = tmpDir.path() / "indexed.gz";
+    {
+        gzIndexedContainerWriter indexedWriter(indexed, fileMagic, 16 * 1024);
+        gzContainerWriter& writer = indexedWriter;
+        SG_VERIFY(writer.good());
+        for (int i = 0; i < count; ++i) {
+            const string s = payload(i);
+            SG_VERIFY(writer.writeContainer(1 + i % 3, s.data(), s.size()));
+        }
+        SG_VERIFY(writer.finish());
+        SG_VERIFY(writer.finish());
+        SG_VERIFY(!writer.writeContainer(1, "too late"));
+    }
+
+    testSequentialReadOfIndexedFile(indexed, count);
+    testRandomAccess(indexed, count);
+
+    // Closed as a plain gzip stream: the destructor still adds the index
+    const SGPath closed = tmpDir.path() / "closed.gz";
+    {
+        gzIndexedContainerWriter indexedWriter(closed, fileMagic, 16 * 1024);
+        for (int i = 0; i < count; ++i) {
+            const string s = payload(i);
+            SG_VERIFY(indexedWriter.writeContainer(1 + i % 3, s.data(), s.size()));
+        }
+        sg_gzofstream& stream = indexedWriter;
+        stream.close();
+    }
+
+    testRandomAccess(closed, count);
+
+    // Plain sequential files have no index
+    const SGPath plain = tmpDir.path() / "plain.gz";
+    {
+        gzContainerWriter writer(plain, fileMagic);
+        writer.writeContainer(1, "hello");
+        writer.finish();
+    }
+
+    gzIndexedContainerReader noIndex(plain, fileMagic);
+    SG_VERIFY(!noIndex.isValid());
+
+    // Wrong file magic
+    gzIndexedContainerReader wrongMagic(indexed, "SomethingElse");
+    SG_VERIFY(!wrongMagic.isValid());
+
+    return EXIT_SUCCESS;
+}
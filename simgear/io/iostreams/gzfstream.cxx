@@ -35,6 +35,7 @@
 
 #include <zlib.h>
 #include "gzfstream.hxx"
+#include "zlibstream.hxx"
 
 //
 // Construct a gzfilebuf object.
@@ -48,7 +49,9 @@ gzfilebuf::gzfilebuf()
       ibuf_size(0),
       ibuffer(0),
       obuf_size(0),
-      obuffer(0)
+      obuffer(0),
+      compressionThreads(1),
+      parallelWriteError(false)
 {
 //     try {
     ibuf_size = page_size / sizeof(char);
@@ -67,6 +70,8 @@ gzfilebuf::~gzfilebuf()
     sync();
     if ( own_file_descriptor )
         this->close();
+    else if ( is_open() )
+        finishParallel();
     delete [] ibuffer;
     if (obuffer)
         delete [] obuffer;
@@ -104,6 +109,10 @@ gzfilebuf::cvt_iomode( char* p, ios_openmode io_mode )
     if ( io_mode & (ios_out | ios_app) )
     {
         *p++ = '9';
+
+        // zlib only writes what ZlibParallelCompressor produces
+        if ( compressionThreads != 1 )
+            *p++ = 'T';
     }
 
     *p = '\0';
@@ -131,6 +140,7 @@ gzfilebuf::open( const char *name, ios_openmode io_mode )
     }
 
     own_file_descriptor = true;
+    startParallel();
 
     return this;
 }
@@ -150,6 +160,7 @@ gzfilebuf::attach( int file_descriptor, ios_openmode io_mode )
     }
 
     own_file_descriptor = false;
+    startParallel();
 
     return this;
 }
@@ -161,8 +172,12 @@ gzfilebuf::close()
     if ( is_open() )
     {
         sync();
+        // the trailer and the last blocks are only written here
+        bool ok = finishParallel();
         gzclose( file );
         file = NULL;
+        if ( !ok )
+            return NULL;
         // cout << "done" << endl;
     } else {
         // cout << "error" << endl;
@@ -171,6 +186,39 @@ gzfilebuf::close()
     return this;
 }
 
+void
+gzfilebuf::startParallel()
+{
+    if ( compressionThreads == 1 || !(mode & (ios_out | ios_app)) )
+        return;
+
+    parallelWriteError = false;
+    parallel.reset( new simgear::ZlibParallelCompressor(
+        [this](const char* data, std::size_t size) {
+            if ( gzwrite( file, data, size ) < static_cast<int>(size) )
+                parallelWriteError = true;
+        },
+        9, simgear::ZLibCompressionFormat::GZIP, compressionThreads ) );
+}
+
+bool
+gzfilebuf::finishParallel()
+{
+    if ( !parallel )
+        return true;
+
+    bool ok = !parallelWriteError;
+    try {
+        parallel->finish();
+    } catch (const sg_exception& e) {
+        SG_LOG( SG_IO, SG_ALERT, "gzfilebuf: " << e.getFormattedMessage() );
+        ok = false;
+    }
+
+    parallel.reset();
+    return ok && !parallelWriteError;
+}
+
 int
 gzfilebuf::setcompressionlevel( int comp_level )
 {
@@ -208,6 +256,18 @@ gzfilebuf::approxOffset() {
     return res;
 }
 
+bool
+gzfilebuf::fullflush()
+{
+    if ( !is_open() || !(mode & (ios_out | ios_app)) || parallel )
+        return false;
+
+    if ( sync() == EOF )
+        return false;
+
+    return gzflush( file, Z_FULL_FLUSH ) == Z_OK;
+}
+
 std::streampos
 gzfilebuf::seekoff( std::streamoff, ios_seekdir, ios_openmode )
 {
@@ -285,7 +345,18 @@ gzfilebuf::flushbuf()
     char* q = pbase();
     int n = pptr() - q;
 
-    if ( gzwrite( file, q, n) < n )
+    if ( parallel ) {
+        try {
+            parallel->write( q, n );
+        } catch (const sg_exception& e) {
+            SG_LOG( SG_IO, SG_ALERT, "gzfilebuf: " << e.getFormattedMessage() );
+            return traits_type::eof();
+        }
+
+        if ( parallelWriteError )
+            return traits_type::eof();
+    }
+    else if ( gzwrite( file, q, n) < n )
         return traits_type::eof();
 
     setp(0,0);
@@ -32,9 +32,12 @@
 #include <zlib.h>
 
 
+#include <memory>
 #include <streambuf>
 #include <istream>
 
+namespace simgear { class ZlibParallelCompressor; }
+
 #define ios_openmode std::ios_base::openmode
 #define ios_in       std::ios_base::in
 #define ios_out      std::ios_base::out
@@ -86,6 +89,17 @@ public:
     int setcompressionlevel( int comp_level );
     int setcompressionstrategy( int comp_strategy );
 
+    /**
+     * Set the number of threads used to compress data written to the
+     * stream; 0 means one per hardware thread. With more than one thread,
+     * compression is done by simgear::ZlibParallelCompressor and zlib only
+     * writes its output to the file; setcompressionlevel() and
+     * setcompressionstrategy() then have no effect. Must be called before
+     * open() or attach().
+     */
+    void setCompressionThreads( unsigned int nbThreads )
+    { compressionThreads = nbThreads; }
+
     /** @return true if open, false otherwise */
     bool is_open() const { return (file != NULL); }
 
@@ -98,6 +112,15 @@ public:
      */
     z_off_t approxOffset();
 
+    /**
+     * Write out everything buffered so far and reset the compression state
+     * (Z_FULL_FLUSH), so that decompression can start from the current
+     * point of the file. approxOffset() is exact right after this call.
+     * Not available with parallel compression.
+     * @return true on success
+     */
+    bool fullflush();
+
     /** @return stream position */
     virtual std::streampos seekoff( std::streamoff off, ios_seekdir way, ios_openmode which );
 
@@ -122,6 +145,11 @@ private:
     // Convert io_mode to "rwab" string.
     void cvt_iomode( char* mode_str, ios_openmode io_mode );
 
+    // Create the parallel compressor if needed, after a successful open.
+    void startParallel();
+    // Write the gzip trailer, if compressing in parallel.
+    bool finishParallel();
+
 private:
 
     gzFile file;
@@ -138,6 +166,11 @@ private:
 
     enum { page_size = 65536 };
 
+    // Parallel compression, when compressionThreads != 1
+    unsigned int compressionThreads;
+    std::unique_ptr<simgear::ZlibParallelCompressor> parallel;
+    bool parallelWriteError;
+
 private:
     // Not defined
     gzfilebuf( const gzfilebuf& );
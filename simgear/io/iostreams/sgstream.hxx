@@ -174,13 +174,29 @@ public:
     void attach( int fd, ios_openmode io_mode = ios_out|ios_binary );
 
     /**
-     * Close the stream.
+     * Close the stream. Sets failbit if the data that was still buffered,
+     * or compressed on other threads, could not be written.
      */
-    void close() { gzbuf.close(); }
+    void close()
+    {
+        if ( !gzbuf.close() )
+            setstate( std::ios_base::failbit );
+    }
 
     /** @return true if the file is successfully opened, false otherwise. */
     bool is_open() { return gzbuf.is_open(); }
 
+    /**
+     * Compress on several threads (0 means one per hardware thread).
+     * Must be called before open() or attach(); see
+     * gzfilebuf::setCompressionThreads().
+     */
+    void setCompressionThreads( unsigned int nbThreads )
+    { gzbuf.setCompressionThreads( nbThreads ); }
+
+protected:
+    gzfilebuf& rdbuf_gz() { return gzbuf; }
+
 private:
     // Not defined!
     sg_gzofstream( const sg_gzofstream& );
@@ -35,6 +35,11 @@
 #include <type_traits>          // std::make_unsigned(), std::underlying_type
 #include <cstddef>              // std::size_t, std::ptrdiff_t
 #include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include <zlib.h>
 
@@ -839,4 +844,417 @@ ZlibDecompressorIStream::ZlibDecompressorIStream(
 ZlibDecompressorIStream::~ZlibDecompressorIStream()
 { }
 
+// ***************************************************************************
+// *                      ZlibParallelCompressor class                       *
+// ***************************************************************************
+
+// Size of the deflate window, hence of the dictionary each block is primed
+// with.
+static const std::size_t DEFLATE_WINDOW_SIZE = 32768;
+
+class ZlibParallelCompressor::Private
+{
+public:
+  struct Block {
+    std::string input;
+    std::string dictionary;     // tail of the previous block's input
+    std::string output;         // raw deflate data
+    uLong check = 0;            // CRC-32 or Adler-32 of 'input'
+    bool last = false;
+    bool done = false;
+    bool failed = false;
+  };
+
+  using Block_ptr = std::shared_ptr<Block>;
+
+  Private(OutputFunction output, int level, ZLibCompressionFormat format,
+          unsigned int nbThreads, std::size_t blockSize)
+    : _output(std::move(output)),
+      _level(level),
+      _format(format),
+      _blockSize(std::max(blockSize, DEFLATE_WINDOW_SIZE))
+  {
+    if (format != ZLibCompressionFormat::ZLIB &&
+        format != ZLibCompressionFormat::GZIP) {
+      throw std::logic_error("Unexpected compression format: " +
+                             std::to_string(enumValue(format)));
+    }
+
+    if (nbThreads == 0) {
+      nbThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // both checksums start from the value for empty input
+    _check = (format == ZLibCompressionFormat::GZIP) ?
+      crc32(0L, Z_NULL, 0) : adler32(0L, Z_NULL, 0);
+
+    for (unsigned int i = 0; i < nbThreads; i++) {
+      _workers.emplace_back(&Private::workerMain, this);
+    }
+  }
+
+  ~Private()
+  {
+    {
+      std::lock_guard<std::mutex> g(_lock);
+      _stopping = true;
+    }
+    _workAvailable.notify_all();
+
+    for (auto& w : _workers) {
+      w.join();
+    }
+  }
+
+  void write(const char* data, std::size_t size)
+  {
+    if (_finished) {
+      throw std::logic_error("ZlibParallelCompressor::write() called after "
+                             "finish()");
+    }
+
+    while (size > 0) {
+      const std::size_t n = std::min(size, _blockSize - _current.size());
+      _current.append(data, n);
+      data += n;
+      size -= n;
+
+      if (_current.size() == _blockSize) {
+        submit(false);
+      }
+    }
+
+    emitCompleted(false);
+  }
+
+  void finish()
+  {
+    if (_finished) {
+      return;
+    }
+
+    submit(true);
+    emitCompleted(true);
+    _finished = true;
+    emitTrailer();
+  }
+
+  unsigned int nbThreads() const
+  {
+    return static_cast<unsigned int>(_workers.size());
+  }
+
+private:
+  void submit(bool last)
+  {
+    if (!_headerWritten) {
+      emitHeader();
+    }
+
+    auto b = std::make_shared<Block>();
+    b->input.swap(_current);
+    b->dictionary.swap(_dictionary);
+    b->last = last;
+
+    // The next block's dictionary is the last 32 KiB of data seen so far
+    // (blocks are never shorter than that, except the last one)
+    const std::size_t dictSize = std::min(b->input.size(),
+                                          DEFLATE_WINDOW_SIZE);
+    _dictionary.assign(b->input, b->input.size() - dictSize, dictSize);
+
+    // Bound the work in flight (and hence memory use) to a couple of blocks
+    // per worker, by emitting the oldest ones first
+    {
+      std::unique_lock<std::mutex> g(_lock);
+      _blockDone.wait(g, [this] {
+          return _pending.size() < 2 * _workers.size() || _pending.front()->done;
+        });
+    }
+    emitCompleted(false);
+
+    {
+      std::lock_guard<std::mutex> g(_lock);
+      _pending.push_back(b);
+      _queue.push_back(b);
+    }
+    _workAvailable.notify_one();
+  }
+
+  // Output, in order, all blocks whose compression is complete. If
+  // 'waitForAll' is true, wait for every pending block.
+  void emitCompleted(bool waitForAll)
+  {
+    for (;;) {
+      Block_ptr b;
+      {
+        std::unique_lock<std::mutex> g(_lock);
+        if (_pending.empty()) {
+          return;
+        }
+
+        if (waitForAll) {
+          _blockDone.wait(g, [this] { return _pending.front()->done; });
+        } else if (!_pending.front()->done) {
+          return;
+        }
+
+        b = _pending.front();
+        _pending.pop_front();
+      }
+
+      if (b->failed) {
+        throw sg_io_exception("zlib: parallel compression of a block failed");
+      }
+
+      if (_format == ZLibCompressionFormat::GZIP) {
+        _check = crc32_combine(_check, b->check, b->input.size());
+      } else {
+        _check = adler32_combine(_check, b->check, b->input.size());
+      }
+      _totalIn += b->input.size();
+      _output(b->output.data(), b->output.size());
+    }
+  }
+
+  void emitHeader()
+  {
+    _headerWritten = true;
+    if (_format == ZLibCompressionFormat::GZIP) {
+      // RFC 1952: no file name, no modification time, OS 'unknown'
+      const char header[10] = {
+        '\x1f', '\x8b', 8 /* deflate */, 0, 0, 0, 0, 0,
+        static_cast<char>(_level == 9 ? 2 : (_level == 1 ? 4 : 0)),
+        '\xff'
+      };
+      _output(header, sizeof(header));
+    } else {
+      // RFC 1950: deflate with a 32 KiB window, and the level hint zlib uses
+      const int level = (_level == Z_DEFAULT_COMPRESSION) ? 6 : _level;
+      const int levelFlags = (level < 2) ? 0 : (level < 6) ? 1 :
+                             (level == 6) ? 2 : 3;
+      unsigned int header = (0x78 << 8) | (levelFlags << 6);
+      header += 31 - (header % 31);
+      const char bytes[2] = { static_cast<char>(header >> 8),
+                              static_cast<char>(header & 0xff) };
+      _output(bytes, sizeof(bytes));
+    }
+  }
+
+  void emitTrailer()
+  {
+    char trailer[8];
+    if (_format == ZLibCompressionFormat::GZIP) {
+      // CRC-32 then input size modulo 2^32, both little-endian
+      for (int i = 0; i < 4; i++) {
+        trailer[i] = static_cast<char>((_check >> (8 * i)) & 0xff);
+        trailer[4 + i] = static_cast<char>((_totalIn >> (8 * i)) & 0xff);
+      }
+      _output(trailer, 8);
+    } else {
+      // Adler-32, big-endian
+      for (int i = 0; i < 4; i++) {
+        trailer[i] = static_cast<char>((_check >> (8 * (3 - i))) & 0xff);
+      }
+      _output(trailer, 4);
+    }
+  }
+
+  void workerMain()
+  {
+    for (;;) {
+      Block_ptr b;
+      {
+        std::unique_lock<std::mutex> g(_lock);
+        _workAvailable.wait(g, [this] { return _stopping || !_queue.empty(); });
+        if (_stopping) {
+          return;
+        }
+
+        b = _queue.front();
+        _queue.pop_front();
+      }
+
+      compressBlock(*b);
+
+      {
+        std::lock_guard<std::mutex> g(_lock);
+        b->done = true;
+      }
+      _blockDone.notify_all();
+    }
+  }
+
+  void compressBlock(Block& b)
+  {
+    const Bytef* in = reinterpret_cast<const Bytef*>(b.input.data());
+    b.check = (_format == ZLibCompressionFormat::GZIP) ?
+      crc32(crc32(0L, Z_NULL, 0), in, b.input.size()) :
+      adler32(adler32(0L, Z_NULL, 0), in, b.input.size());
+
+    z_stream zs;
+    zs.zalloc = Z_NULL;
+    zs.zfree = Z_NULL;
+    zs.opaque = Z_NULL;
+    // raw deflate: the header and trailer are written by emitHeader() and
+    // emitTrailer()
+    if (deflateInit2(&zs, _level, Z_DEFLATED, -15, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+      b.failed = true;
+      return;
+    }
+
+    if (!b.dictionary.empty()) {
+      deflateSetDictionary(
+        &zs, reinterpret_cast<const Bytef*>(b.dictionary.data()),
+        static_cast<uInt>(b.dictionary.size()));
+    }
+
+    // A sync flush adds at most a few bytes beyond deflateBound()
+    b.output.resize(deflateBound(&zs, b.input.size()) + 16);
+    zs.next_in = const_cast<Bytef*>(in);
+    zs.avail_in = static_cast<uInt>(b.input.size());
+    zs.next_out = reinterpret_cast<Bytef*>(&b.output[0]);
+    zs.avail_out = static_cast<uInt>(b.output.size());
+
+    const int flush = b.last ? Z_FINISH : Z_SYNC_FLUSH;
+    int retCode = deflate(&zs, flush);
+    if ((b.last && retCode != Z_STREAM_END) ||
+        (!b.last && (retCode != Z_OK || zs.avail_in != 0))) {
+      b.failed = true;
+    }
+
+    b.output.resize(zs.total_out);
+    deflateEnd(&zs);
+  }
+
+  const OutputFunction _output;
+  const int _level;
+  const ZLibCompressionFormat _format;
+  const std::size_t _blockSize;
+
+  // Only used on the thread calling write() and finish()
+  std::string _current;
+  std::string _dictionary;
+  uLong _check;
+  uLong _totalIn = 0;
+  bool _headerWritten = false;
+  bool _finished = false;
+
+  // Shared with the workers, protected by _lock
+  std::mutex _lock;
+  std::condition_variable _workAvailable, _blockDone;
+  std::deque<Block_ptr> _queue;   // blocks not yet picked by a worker
+  std::deque<Block_ptr> _pending; // blocks not yet output, in stream order
+  bool _stopping = false;
+
+  std::vector<std::thread> _workers;
+};
+
+ZlibParallelCompressor::ZlibParallelCompressor(OutputFunction output,
+                                               int compressionLevel,
+                                               ZLibCompressionFormat format,
+                                               unsigned int nbThreads,
+                                               std::size_t blockSize)
+  : d(new Private(std::move(output), compressionLevel, format, nbThreads,
+                  blockSize))
+{ }
+
+ZlibParallelCompressor::~ZlibParallelCompressor()
+{ }
+
+void ZlibParallelCompressor::write(const char* data, std::size_t size)
+{
+  d->write(data, size);
+}
+
+void ZlibParallelCompressor::finish()
+{
+  d->finish();
+}
+
+unsigned int ZlibParallelCompressor::nbThreads() const
+{
+  return d->nbThreads();
+}
+
+// ***************************************************************************
+// *                 ZlibParallelCompressorIStreambuf class                  *
+// ***************************************************************************
+
+ZlibParallelCompressorIStreambuf::ZlibParallelCompressorIStreambuf(
+  std::istream& iStream,
+  const SGPath& path,
+  int compressionLevel,
+  ZLibCompressionFormat format,
+  unsigned int nbThreads,
+  std::size_t blockSize)
+  : _iStream(iStream),
+    _path(path),
+    _blockSize(blockSize),
+    _compressor([this](const char* data, std::size_t size) {
+                  _outData.append(data, size);
+                },
+                compressionLevel, format, nbThreads, blockSize)
+{
+  _inBuf.resize(_blockSize);
+  setg(nullptr, nullptr, nullptr);
+}
+
+ZlibParallelCompressorIStreambuf::~ZlibParallelCompressorIStreambuf()
+{ }
+
+int ZlibParallelCompressorIStreambuf::underflow()
+{
+  if (gptr() < egptr()) {
+    return traits::to_int_type(*gptr());
+  }
+
+  _outData.clear();
+  // Keep feeding input until some compressed output is ready. Since
+  // ZlibParallelCompressor only blocks once every worker has work queued,
+  // this reads ahead far enough to keep all of them busy.
+  while (_outData.empty() && !_allInputRead) {
+    _iStream.read(&_inBuf[0], clipCast<std::streamsize>(_blockSize));
+    if (_iStream.bad()) {
+      string errMsg = simgear::strutils::error_string(errno);
+      string msgStart = (_path.isNull()) ?
+        "Error while reading from a stream" : "Read error";
+      throw sg_io_exception(msgStart + ": " + errMsg, sg_location(_path));
+    }
+
+    const std::streamsize nbCharsRead = _iStream.gcount();
+    _compressor.write(_inBuf.data(), static_cast<std::size_t>(nbCharsRead));
+
+    if (_iStream.eof()) {
+      _allInputRead = true;
+      _compressor.finish();
+    }
+  }
+
+  char* start = &_outData[0];
+  setg(start, start, start + _outData.size());
+  return (gptr() == egptr()) ? traits::eof() : traits::to_int_type(*gptr());
+}
+
+// ***************************************************************************
+// *                   ZlibParallelCompressorIStream class                   *
+// ***************************************************************************
+
+ZlibParallelCompressorIStream::ZlibParallelCompressorIStream(
+  std::istream& iStream,
+  const SGPath& path,
+  int compressionLevel,
+  ZLibCompressionFormat format,
+  unsigned int nbThreads,
+  std::size_t blockSize)
+  : std::istream(nullptr),
+    _streamBuf(iStream, path, compressionLevel, format, nbThreads, blockSize)
+{
+  // Associate _streamBuf to 'this' and clear the error state flags
+  rdbuf(&_streamBuf);
+}
+
+ZlibParallelCompressorIStream::~ZlibParallelCompressorIStream()
+{ }
+
 } // of namespace simgear
@@ -28,6 +28,8 @@
 #include <istream>
 #include <streambuf>
 #include <memory>               // std::unique_ptr
+#include <functional>
+#include <string>
 #include <zlib.h>               // struct z_stream
 
 #include <simgear/misc/sg_path.hxx>
@@ -45,6 +47,10 @@
 // All these allow one to work with RFC 1950 and RFC 1952 compression
 // formats, respectively known as the zlib and gzip formats.
 //
+// In addition, ZlibParallelCompressor (and the ZlibParallelCompressorIStream
+// built on it) compresses on several threads at once, pigz-style, while
+// still producing a single standard zlib or gzip stream.
+//
 // These classes are *input* streaming classes, which means they can
 // efficiently handle arbitrary amounts of data without using any disk
 // space nor increasing amounts of memory, and allow “client code” to pull
@@ -472,6 +478,113 @@ private:
   ZlibDecompressorIStreambuf _streamBuf;
 };
 
+// Multi-threaded compressor. Input is cut into blocks which are deflated
+// independently on a pool of worker threads; each block is primed with the
+// last 32 KiB of the previous one as a preset dictionary, so the compression
+// ratio stays within a fraction of a percent of the single-threaded path.
+// Blocks end on a Z_SYNC_FLUSH boundary, so their concatenation (plus the
+// header and a check value combined from the per-block ones) is one ordinary
+// zlib or gzip stream, which any decompressor (including
+// ZlibDecompressorIStream) can read.
+//
+// This is a push interface: feed data with write(), then call finish().
+// Compressed data is handed, strictly in order, to the output function on
+// the thread calling write() or finish().
+class ZlibParallelCompressor
+{
+public:
+  using OutputFunction = std::function<void(const char* data,
+                                            std::size_t size)>;
+
+  //   compressionLevel: as for ZlibCompressorIStreambuf
+  //   format            either ZLibCompressionFormat::ZLIB or
+  //                     ZLibCompressionFormat::GZIP
+  //   nbThreads         number of worker threads; 0 means one per hardware
+  //                     thread
+  //   blockSize         amount of input compressed by each job; smaller
+  //                     blocks cost a little compression ratio
+  explicit ZlibParallelCompressor(
+    OutputFunction output,
+    int compressionLevel = Z_DEFAULT_COMPRESSION,
+    ZLibCompressionFormat format = ZLibCompressionFormat::GZIP,
+    unsigned int nbThreads = 0,
+    std::size_t blockSize = 131072);
+
+  ZlibParallelCompressor(const ZlibParallelCompressor&) = delete;
+  ZlibParallelCompressor& operator=(const ZlibParallelCompressor&) = delete;
+  // Stops the workers. Any data not yet finish()ed is discarded.
+  ~ZlibParallelCompressor();
+
+  void write(const char* data, std::size_t size);
+  // Compress everything still pending, and output the stream trailer. No
+  // further write() is allowed afterwards.
+  void finish();
+
+  unsigned int nbThreads() const;
+
+private:
+  class Private;
+  std::unique_ptr<Private> d;
+};
+
+// Stream buffer class equivalent to ZlibCompressorIStreambuf, but
+// compressing on several threads with ZlibParallelCompressor. The compressed
+// bytes differ from the single-threaded path; the decompressed data does not.
+// Input is read from iStream one block at a time, up to a few blocks ahead of
+// what the "client" has consumed, to keep the workers busy.
+class ZlibParallelCompressorIStreambuf: public std::streambuf
+{
+public:
+  explicit ZlibParallelCompressorIStreambuf(
+    std::istream& iStream,
+    const SGPath& path = SGPath(),
+    int compressionLevel = Z_DEFAULT_COMPRESSION,
+    ZLibCompressionFormat format = ZLibCompressionFormat::ZLIB,
+    unsigned int nbThreads = 0,
+    std::size_t blockSize = 131072);
+
+  ZlibParallelCompressorIStreambuf(const ZlibParallelCompressorIStreambuf&)
+                                                                      = delete;
+  ZlibParallelCompressorIStreambuf& operator=(
+    const ZlibParallelCompressorIStreambuf&) = delete;
+  virtual ~ZlibParallelCompressorIStreambuf();
+
+private:
+  virtual int underflow() override;
+
+  std::istream& _iStream;
+  const SGPath _path;
+  const std::size_t _blockSize;
+  // Compressed data ready to be read; the get area points into it
+  std::string _outData;
+  std::string _inBuf;
+  bool _allInputRead = false;
+  ZlibParallelCompressor _compressor;
+};
+
+// std::istream subclass for compressing data on several threads, see
+// ZlibParallelCompressorIStreambuf.
+class ZlibParallelCompressorIStream: public std::istream
+{
+public:
+  // Same parameters as for ZlibParallelCompressorIStreambuf
+  explicit ZlibParallelCompressorIStream(
+    std::istream& iStream,
+    const SGPath& path = SGPath(),
+    int compressionLevel = Z_DEFAULT_COMPRESSION,
+    ZLibCompressionFormat format = ZLibCompressionFormat::ZLIB,
+    unsigned int nbThreads = 0,
+    std::size_t blockSize = 131072);
+
+  ZlibParallelCompressorIStream(const ZlibParallelCompressorIStream&) = delete;
+  ZlibParallelCompressorIStream& operator=(
+    const ZlibParallelCompressorIStream&) = delete;
+  virtual ~ZlibParallelCompressorIStream();
+
+private:
+  ZlibParallelCompressorIStreambuf _streamBuf;
+};
+
 } // of namespace simgear
 
 #endif  // of SG_ZLIBSTREAM_HXX
@@ -35,6 +35,7 @@
 #include <cstdlib>              // EXIT_SUCCESS
 #include <cstddef>              // std::size_t
 #include <cstring>              // strcmp()
+#include <chrono>
 
 #include <zlib.h>               // Z_BEST_COMPRESSION
 
@@ -718,6 +719,175 @@ void test_IStreamConstructorWithSinkSemantics()
   SG_CHECK_EQUAL(roundTripResult.str(), someString);
 }
 
+// Decompress 'compressed' with ZlibDecompressorIStream
+static string decompressString(const string& compressed,
+                               simgear::ZLibCompressionFormat format)
+{
+  std::istringstream compressed_ss(compressed);
+  simgear::ZlibDecompressorIStream decompressor(compressed_ss, SGPath(),
+                                                format);
+  decompressor.exceptions(std::ios_base::badbit);
+  std::ostringstream result;
+  decompressor >> result.rdbuf();
+
+  return result.str();
+}
+
+// Data that compresses somewhat, but not trivially
+static string compressibleData(std::size_t size)
+{
+  string data;
+  while (data.size() < size) {
+    data += lipsum;
+    data += randomString(0, 600);
+  }
+  data.resize(size);
+
+  return data;
+}
+
+void test_ParallelCompressor()
+{
+  cerr << "Testing ZlibParallelCompressor and ZlibParallelCompressorIStream\n";
+
+  const std::size_t blockSize = 40000;
+  for (auto format: {simgear::ZLibCompressionFormat::ZLIB,
+                     simgear::ZLibCompressionFormat::GZIP}) {
+    // Empty input, less than a block, exactly some blocks, and partial ones
+    for (std::size_t size: {std::size_t(0), std::size_t(100), 3 * blockSize,
+                            10 * blockSize + 17}) {
+      for (unsigned int nbThreads: {1u, 3u}) {
+        const string input = compressibleData(size);
+        string compressed;
+        simgear::ZlibParallelCompressor compressor(
+          [&compressed](const char* data, std::size_t len) {
+            compressed.append(data, len);
+          }, 6, format, nbThreads, blockSize);
+        SG_CHECK_EQUAL(compressor.nbThreads(), nbThreads);
+
+        // Feed it in uneven chunks
+        std::size_t pos = 0;
+        std::size_t chunk = 1;
+        while (pos < input.size()) {
+          const std::size_t n = std::min(chunk, input.size() - pos);
+          compressor.write(input.data() + pos, n);
+          pos += n;
+          chunk = chunk * 7 + 3;
+        }
+        compressor.finish();
+
+        SG_CHECK_EQUAL(decompressString(compressed, format), input);
+        // The zlib and gzip headers are also checked by AUTODETECT
+        SG_CHECK_EQUAL(
+          decompressString(compressed,
+                           simgear::ZLibCompressionFormat::AUTODETECT),
+          input);
+      }
+    }
+  }
+
+  // Pipeline through the std::istream subclasses, with the default
+  // (hardware-dependent) number of threads
+  const string input = compressibleData(2 * 1024 * 1024 + 5);
+  for (auto format: {simgear::ZLibCompressionFormat::ZLIB,
+                     simgear::ZLibCompressionFormat::GZIP}) {
+    std::istringstream input_ss(input);
+    simgear::ZlibParallelCompressorIStream compressor(
+      input_ss, SGPath(), Z_DEFAULT_COMPRESSION, format, 0, 65536);
+    compressor.exceptions(std::ios_base::badbit);
+    simgear::ZlibDecompressorIStream decompressor(compressor, SGPath(),
+                                                  format);
+    decompressor.exceptions(std::ios_base::badbit);
+    std::ostringstream roundTripResult;
+    decompressor >> roundTripResult.rdbuf();
+    SG_CHECK_EQUAL(roundTripResult.str(), input);
+  }
+}
+
+// Files written by gzfilebuf with several threads must remain ordinary gzip
+// files.
+void test_ParallelGzofstream()
+{
+  cerr << "Testing sg_gzofstream with parallel compression\n";
+
+  simgear::Dir tmpDir = simgear::Dir::tempDir("FlightGear");
+  tmpDir.setRemoveOnDestroy();
+  const SGPath path = tmpDir.path() / "parallel.gz";
+  const string input = compressibleData(1024 * 1024 + 123);
+
+  {
+    sg_gzofstream out;
+    out.setCompressionThreads(4);
+    out.open(path);
+    SG_VERIFY(out.is_open());
+    // Several flushes, each feeding a partial block to the compressor
+    out.write(input.data(), 1000);
+    out.flush();
+    out.write(input.data() + 1000, input.size() - 1000);
+    out.close();
+  }
+
+  sg_gzifstream in(path);
+  SG_VERIFY(in.is_open());
+  std::ostringstream result;
+  result << in.rdbuf();
+  SG_CHECK_EQUAL(result.str(), input);
+}
+
+// Write errors of the parallel compressor must be reported by close().
+void test_ParallelGzofstreamWriteError()
+{
+#if defined(__linux__)
+  cerr << "Testing sg_gzofstream::close() after parallel write errors\n";
+
+  const string input = compressibleData(1024 * 1024);
+  sg_gzofstream out;
+  out.setCompressionThreads(4);
+  out.open(SGPath("/dev/full"));
+  SG_VERIFY(out.is_open());
+  out.write(input.data(), input.size());
+  out.close();
+  SG_VERIFY(out.fail());
+#endif
+}
+
+// Not a test as such: print how the parallel compressor compares to the
+// single-threaded ZlibCompressorIStream on this machine.
+void benchmark_ParallelCompressor()
+{
+  const string input = compressibleData(16 * 1024 * 1024);
+  using Clock = std::chrono::steady_clock;
+
+  auto timeIt = [&input](std::istream& compressor) {
+    std::ostringstream sink;
+    sink << compressor.rdbuf();
+    return sink.str().size();
+  };
+
+  std::istringstream in1(input);
+  auto t0 = Clock::now();
+  simgear::ZlibCompressorIStream single(
+    in1, SGPath(), Z_DEFAULT_COMPRESSION,
+    simgear::ZLibCompressionFormat::GZIP,
+    simgear::ZLibMemoryStrategy::FAVOR_SPEED_OVER_MEMORY);
+  const std::size_t singleSize = timeIt(single);
+  auto t1 = Clock::now();
+
+  std::istringstream in2(input);
+  simgear::ZlibParallelCompressorIStream parallel(
+    in2, SGPath(), Z_DEFAULT_COMPRESSION,
+    simgear::ZLibCompressionFormat::GZIP);
+  const std::size_t parallelSize = timeIt(parallel);
+  auto t2 = Clock::now();
+
+  using ms = std::chrono::milliseconds;
+  cerr << "Compressing " << input.size() << " bytes: single thread "
+       << std::chrono::duration_cast<ms>(t1 - t0).count() << " ms ("
+       << singleSize << " bytes), parallel "
+       << std::chrono::duration_cast<ms>(t2 - t1).count() << " ms ("
+       << parallelSize << " bytes)\n";
+}
+
 int main(int argc, char** argv)
 {
   test_pipeCompOrDecompIStreambufIntoOStream();
@@ -727,6 +897,10 @@ int main(int argc, char** argv)
   test_formattedInputFromDecompressor();
   test_ZlibDecompressorIStream_readPutbackEtc();
   test_IStreamConstructorWithSinkSemantics();
+  test_ParallelCompressor();
+  test_ParallelGzofstream();
+  test_ParallelGzofstreamWriteError();
+  benchmark_ParallelCompressor();
 
   return EXIT_SUCCESS;
 }
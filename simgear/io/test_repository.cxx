@@ -901,6 +901,79 @@ void testPersistentSocketFailure(HTTP::Client *cl) {
   verifyRequestCount("dirD/subdirDB/fileDBA", 1);
 }
 
+void testConcurrentRequests(HTTP::Client *cl) {
+  TestApi::setResponseDoneCallback(cl, {});
+  global_repo->clearRequestCounts();
+  global_repo->clearFailFlags();
+
+  for (int d = 0; d < 4; ++d) {
+    for (int f = 0; f < 8; ++f) {
+      global_repo->defineFile("dirF/subdirF" + std::to_string(d) + "/fileF" +
+                              std::to_string(f));
+    }
+  }
+
+  // sync the same tree with increasing numbers of requests in flight;
+  // the result must be identical, only the elapsed time may differ
+  cl->setMaxConnections(4);
+  for (unsigned int maxRequests : {1u, 4u, 16u, 0u}) {
+    std::unique_ptr<HTTPRepository> repo;
+    SGPath p(simgear::Dir::current().path());
+    p.append("http_repo_concurrent_" + std::to_string(maxRequests));
+    simgear::Dir pd(p);
+    if (pd.exists()) {
+      pd.removeChildren();
+    }
+
+    repo.reset(new HTTPRepository(p, cl));
+    repo->setBaseUrl("http://localhost:2000/repo");
+    repo->setMaxConcurrentRequests(maxRequests);
+    const unsigned int expected =
+        maxRequests ? maxRequests
+                    : cl->maxHostConnections() *
+                          (cl->isPipelining() ? cl->maxPipelineDepth() : 1);
+    if (repo->maxConcurrentRequests() != expected) {
+      throw sg_exception("Bad concurrent request limit");
+    }
+
+    SGTimeStamp st;
+    st.stamp();
+    repo->update();
+    waitForUpdateComplete(cl, repo.get());
+
+    if (repo->failure() != HTTPRepository::REPO_NO_ERROR) {
+      throw sg_exception("Bad result from concurrent requests test");
+    }
+
+    for (int d = 0; d < 4; ++d) {
+      for (int f = 0; f < 8; ++f) {
+        verifyFileState(p, "dirF/subdirF" + std::to_string(d) + "/fileF" +
+                               std::to_string(f));
+      }
+    }
+
+    std::cout << "concurrent sync with " << repo->maxConcurrentRequests()
+              << " requests in flight took " << st.elapsedMSec() << " msec"
+              << std::endl;
+  }
+
+  // without pipelining, the derived limit is one request per connection
+  const unsigned int depth = cl->maxPipelineDepth();
+  cl->setMaxPipelineDepth(0);
+  {
+    HTTPRepository repo(simgear::Dir::current().path(), cl);
+    repo.setMaxConcurrentRequests(0);
+    if (cl->isPipelining() ||
+        (repo.maxConcurrentRequests() != cl->maxHostConnections())) {
+      throw sg_exception("Bad concurrent request limit without pipelining");
+    }
+  }
+  cl->setMaxPipelineDepth(depth);
+
+  cl->setMaxConnections(1);
+  std::cout << "Passed test: concurrent requests" << std::endl;
+}
+
 int main(int argc, char* argv[])
 {
   sglog().setLogLevels( SG_ALL, SG_INFO );
@@ -950,6 +1023,7 @@ int main(int argc, char* argv[])
     testCopyInstalledChildren(&cl);
     testRetryAfterSocketFailure(&cl);
     testPersistentSocketFailure(&cl);
+    testConcurrentRequests(&cl);
 
     std::cout << "all tests passed ok" << std::endl;
     return 0;
@@ -5,7 +5,17 @@
 #include <simgear_config.h>
 #include <simgear/compiler.h>
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
 #include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <zlib.h>
 
 #include "untar.hxx"
 
@@ -13,6 +23,7 @@
 #include <simgear/misc/sg_path.hxx>
 #include <simgear/misc/sg_dir.hxx>
 #include <simgear/io/sg_file.hxx>
+#include <simgear/timing/timestamp.hxx>
 
 
 using std::cout;
@@ -202,6 +213,245 @@ void testExtractXZ()
     SG_VERIFY((extractDir / "testDir/foo.txt").exists());
 }
 
+std::string syntheticFileData(int index, size_t size)
+{
+    std::string d;
+    d.reserve(size);
+    while (d.size() < size) {
+        d += "file " + std::to_string(index) + " offset " + std::to_string(d.size()) + "\n";
+    }
+    d.resize(size);
+    return d;
+}
+
+void appendTarEntry(std::string& tar, const std::string& name, const std::string& data)
+{
+    char header[512];
+    memset(header, 0, sizeof(header));
+    strncpy(header, name.c_str(), 99);
+    snprintf(header + 100, 8, "%07o", 0644);
+    snprintf(header + 124, 12, "%011lo", (unsigned long) data.size());
+    header[156] = '0';
+    memcpy(header + 257, "ustar", 6);
+    memcpy(header + 263, "00", 2);
+
+    tar.append(header, sizeof(header));
+    tar += data;
+    tar.append((512 - (data.size() % 512)) % 512, '\0');
+}
+
+std::string gzipBytes(const std::string& in)
+{
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    SG_VERIFY(deflateInit2(&z, 6, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+
+    std::string out(deflateBound(&z, in.size()), '\0');
+    z.next_in = (Bytef*) in.data();
+    z.avail_in = in.size();
+    z.next_out = (Bytef*) &out[0];
+    z.avail_out = out.size();
+    SG_VERIFY(deflate(&z, Z_FINISH) == Z_STREAM_END);
+    out.resize(z.total_out);
+    deflateEnd(&z);
+    return out;
+}
+
+void testLargeStreamedTarGz()
+{
+    // a few dozen MB of mixed-size files, fed in network-sized chunks, to
+    // exercise the decompress / parse / write pipeline
+    const int fileCount = 96;
+    std::string tar;
+    for (int i = 0; i < fileCount; ++i) {
+        const size_t sz = (i % 3 == 0) ? 1024 * 1024 : 7 * 1024 + i;
+        appendTarEntry(tar, "large/file" + std::to_string(i) + ".dat", syntheticFileData(i, sz));
+    }
+    tar.append(1024, '\0');
+    const std::string gz = gzipBytes(tar);
+
+    SGPath extractDir = simgear::Dir::current().path() / "test_extract_large";
+    simgear::Dir pd(extractDir);
+    pd.removeChildren();
+    SG_VERIFY(simgear::Dir(extractDir / "large").create(0755));
+
+    SGTimeStamp st;
+    st.stamp();
+
+    ArchiveExtractor ex(extractDir);
+    const size_t chunk = 16 * 1024;
+    for (size_t offset = 0; offset < gz.size(); offset += chunk) {
+        ex.extractBytes((const uint8_t*) gz.data() + offset, std::min(chunk, gz.size() - offset));
+    }
+
+    ex.flush();
+    const int elapsed = st.elapsedMSec();
+
+    SG_VERIFY(ex.isAtEndOfArchive());
+    SG_VERIFY(ex.hasError() == false);
+
+    for (int i = 0; i < fileCount; ++i) {
+        const size_t sz = (i % 3 == 0) ? 1024 * 1024 : 7 * 1024 + i;
+        SGBinaryFile f(extractDir / ("large/file" + std::to_string(i) + ".dat"));
+        SG_VERIFY(f.open(SG_IO_IN));
+        std::string contents(sz + 1, '\0');
+        SG_CHECK_EQUAL(f.read(&contents[0], sz + 1), (int) sz);
+        contents.resize(sz);
+        SG_VERIFY(contents == syntheticFileData(i, sz));
+    }
+
+    cout << "extracted " << (tar.size() >> 20) << "MB tarball in " << elapsed << " msec" << endl;
+}
+
+// Holds the worker thread in filterPath() at the first entry, so the test
+// knows everything else is still queued when it cancels. Created as an
+// OwnedArchiveExtractor, so it needs no cancel() in its destructor.
+class BlockingExtractor : public ArchiveExtractor
+{
+public:
+    BlockingExtractor(const SGPath& p) : ArchiveExtractor(p) {}
+
+    void release()
+    {
+        std::lock_guard<std::mutex> g(lock);
+        released = true;
+        cond.notify_all();
+    }
+
+    std::atomic<int> filterCount{0};
+
+protected:
+    PathResult filterPath(std::string& path) override
+    {
+        filterCount++;
+        std::unique_lock<std::mutex> g(lock);
+        cond.wait(g, [this] { return released; });
+        return Accepted;
+    }
+
+private:
+    std::mutex lock;
+    std::condition_variable cond;
+    bool released = false;
+};
+
+void testCancelStreamedTarGz()
+{
+    const int fileCount = 200;
+    std::string tar;
+    for (int i = 0; i < fileCount; ++i) {
+        appendTarEntry(tar, "cancel/file" + std::to_string(i) + ".dat", syntheticFileData(i, 1000));
+    }
+    tar.append(1024, '\0');
+    const std::string gz = gzipBytes(tar);
+
+    SGPath extractDir = simgear::Dir::current().path() / "test_extract_cancel";
+    simgear::Dir pd(extractDir);
+    pd.removeChildren();
+    SG_VERIFY(simgear::Dir(extractDir / "cancel").create(0755));
+
+    OwnedArchiveExtractor<BlockingExtractor> ex(extractDir);
+    ex.extractBytes((const uint8_t*) gz.data(), gz.size());
+    while (ex.filterCount == 0) {
+        SGTimeStamp::sleepForMSec(1);
+    }
+
+    // let the worker go once cancel() has dropped the queued input
+    std::thread releaser([&ex] {
+        SGTimeStamp::sleepForMSec(100);
+        ex.release();
+    });
+    ex.cancel();
+    releaser.join();
+
+    SG_CHECK_EQUAL(ex.filterCount, 1);
+    SG_VERIFY(ex.hasError());
+    SG_VERIFY(!ex.isAtEndOfArchive());
+    SG_VERIFY(!(extractDir / "cancel/file199.dat").exists());
+
+    // further input is ignored
+    ex.extractBytes((const uint8_t*) gz.data(), gz.size());
+    ex.flush();
+    SG_CHECK_EQUAL(ex.filterCount, 1);
+}
+
+// Records the threads filterPath() runs on, in a member the worker thread
+// would use after it was destroyed if nothing stopped the worker first
+class ThreadRecordingExtractor : public ArchiveExtractor
+{
+public:
+    ThreadRecordingExtractor(const SGPath& p) : ArchiveExtractor(p) {}
+
+    std::vector<std::thread::id> threads()
+    {
+        std::lock_guard<std::mutex> g(lock);
+        return filterThreads;
+    }
+
+protected:
+    PathResult filterPath(std::string& path) override
+    {
+        std::lock_guard<std::mutex> g(lock);
+        filterThreads.push_back(std::this_thread::get_id());
+        return Accepted;
+    }
+
+private:
+    std::mutex lock;
+    std::vector<std::thread::id> filterThreads;
+};
+
+void testSubclassThreads()
+{
+    const int fileCount = 500;
+    std::string tar;
+    for (int i = 0; i < fileCount; ++i) {
+        appendTarEntry(tar, "threads/file" + std::to_string(i) + ".dat", syntheticFileData(i, 4000));
+    }
+    tar.append(1024, '\0');
+    const std::string gz = gzipBytes(tar);
+
+    SGPath extractDir = simgear::Dir::current().path() / "test_extract_threads";
+    simgear::Dir pd(extractDir);
+    pd.removeChildren();
+    SG_VERIFY(simgear::Dir(extractDir / "threads").create(0755));
+
+    // a plain subclass filters on the calling thread
+    {
+        ThreadRecordingExtractor ex(extractDir);
+        ex.extractBytes((const uint8_t*) gz.data(), gz.size());
+        const auto threads = ex.threads();
+        SG_CHECK_EQUAL(threads.size(), (size_t) fileCount);
+        for (const auto& id : threads) {
+            SG_VERIFY(id == std::this_thread::get_id());
+        }
+        ex.flush();
+        SG_VERIFY(ex.isAtEndOfArchive());
+    }
+
+    // an owned one on the worker
+    {
+        OwnedArchiveExtractor<ThreadRecordingExtractor> ex(extractDir);
+        ex.extractBytes((const uint8_t*) gz.data(), gz.size());
+        ex.flush();
+        SG_VERIFY(ex.isAtEndOfArchive());
+        const auto threads = ex.threads();
+        SG_CHECK_EQUAL(threads.size(), (size_t) fileCount);
+        for (const auto& id : threads) {
+            SG_VERIFY(id != std::this_thread::get_id());
+        }
+    }
+
+    // and destroying it mid-archive stops the worker before the members
+    // of the subclass go away
+    for (int i = 0; i < 20; ++i) {
+        OwnedArchiveExtractor<ThreadRecordingExtractor> ex(extractDir);
+        for (size_t offset = 0; offset < gz.size(); offset += 4096) {
+            ex.extractBytes((const uint8_t*) gz.data() + offset, std::min<size_t>(4096, gz.size() - offset));
+        }
+    }
+}
+
 int main(int ac, char ** av)
 {
     testTarGz();
@@ -210,6 +460,9 @@ int main(int ac, char ** av)
 	testExtractStreamed();
 	testExtractZip();
     testExtractXZ();
+    testLargeStreamedTarGz();
+    testCancelStreamedTarGz();
+    testSubclassThreads();
 
     // disabled to avoiding checking in large PAX archive
     // testPAXAttributes();
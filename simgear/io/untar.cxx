@@ -25,6 +25,12 @@
 #include <cstring>
 #include <cstddef>
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <typeinfo>
 
 #include <zlib.h>
 
@@ -92,6 +98,202 @@ typedef struct
     const int ZLIB_INFLATE_WINDOW_BITS = MAX_WBITS;
     const int ZLIB_DECODE_GZIP_HEADER = 16;
 
+    // bounds on the data queued between extraction stages: enough to keep
+    // each stage busy while the next catches up, without buffering a
+    // whole archive in memory when the disk is slower than the network
+    const size_t COMPRESSED_QUEUE_BYTES = 4 * 1024 * 1024;
+    const size_t WRITE_QUEUE_BYTES = 16 * 1024 * 1024;
+    // file data is handed to the writer stage in blocks of this size
+    const size_t WRITE_BLOCK_SIZE = 256 * 1024;
+
+    /**
+     * @brief bounded FIFO linking two extraction stages which run on
+     * different threads. push() blocks while more than the byte limit is
+     * queued, so a fast producer can't run arbitrarily far ahead.
+     */
+    template <class T>
+    class StageQueue
+    {
+    public:
+        explicit StageQueue(size_t maxBytes) : _maxBytes(maxBytes) {}
+
+        void push(T&& item, size_t bytes)
+        {
+            std::unique_lock<std::mutex> g(_lock);
+            _notFull.wait(g, [this] { return (_queuedBytes < _maxBytes) || _closed; });
+            if (_closed) {
+                return; // aborted, nobody will pop it
+            }
+
+            _queuedBytes += bytes;
+            _items.emplace_back(std::move(item), bytes);
+            _notEmpty.notify_one();
+        }
+
+        /// returns false once the queue is closed and fully drained
+        bool pop(T& item)
+        {
+            std::unique_lock<std::mutex> g(_lock);
+            _notEmpty.wait(g, [this] { return !_items.empty() || _closed; });
+            if (_items.empty()) {
+                return false;
+            }
+
+            item = std::move(_items.front().first);
+            _queuedBytes -= _items.front().second;
+            _items.pop_front();
+            _notFull.notify_one();
+            return true;
+        }
+
+        void close()
+        {
+            std::lock_guard<std::mutex> g(_lock);
+            _closed = true;
+            _notEmpty.notify_all();
+            _notFull.notify_all();
+        }
+
+        /// close the queue and drop what is still in it, so the consumer
+        /// stops after the item it is working on
+        void abort()
+        {
+            std::lock_guard<std::mutex> g(_lock);
+            _items.clear();
+            _queuedBytes = 0;
+            _closed = true;
+            _notEmpty.notify_all();
+            _notFull.notify_all();
+        }
+
+    private:
+        const size_t _maxBytes;
+        size_t _queuedBytes = 0;
+        bool _closed = false;
+        std::deque<std::pair<T, size_t>> _items;
+        std::mutex _lock;
+        std::condition_variable _notEmpty, _notFull;
+    };
+
+    /**
+     * @brief final extraction stage: creates and writes extracted files on
+     * a dedicated thread, so inflating and parsing the archive never waits
+     * on the disk. Operations are applied strictly in the order issued.
+     */
+    class FileWriterStage
+    {
+    public:
+        FileWriterStage() : _queue(WRITE_QUEUE_BYTES) {}
+
+        ~FileWriterStage()
+        {
+            // destroyed without finish(): drop whatever is queued
+            abort();
+        }
+
+        void open(const SGPath& path)
+        {
+            if (!_thread.joinable()) {
+                _thread = std::thread(&FileWriterStage::run, this);
+            }
+
+            push(Op::Open, path);
+        }
+
+        void write(const char* bytes, size_t count)
+        {
+            _pending.append(bytes, count);
+            if (_pending.size() >= WRITE_BLOCK_SIZE) {
+                push(Op::Data);
+            }
+        }
+
+        void close()
+        {
+            if (!_pending.empty()) {
+                push(Op::Data);
+            }
+            push(Op::Close);
+        }
+
+        /// wait until everything queued is on disk. Returns false if any
+        /// file could not be written.
+        bool finish()
+        {
+            if (_thread.joinable()) {
+                _queue.close();
+                _thread.join();
+            }
+
+            return !_failed;
+        }
+
+        /// stop after the current operation, dropping what is queued;
+        /// the file being written is left incomplete
+        void abort()
+        {
+            if (_thread.joinable()) {
+                _aborted = true;
+                _queue.abort();
+                _thread.join();
+            }
+        }
+
+    private:
+        struct Op {
+            enum Kind { Open, Data, Close } kind = Close;
+            SGPath path;
+            std::string bytes;
+        };
+
+        void push(Op::Kind kind, const SGPath& path = SGPath())
+        {
+            Op op;
+            op.kind = kind;
+            op.path = path;
+            if (kind == Op::Data) {
+                op.bytes.swap(_pending);
+            }
+
+            const size_t sz = op.bytes.size();
+            _queue.push(std::move(op), sz);
+        }
+
+        void run()
+        {
+            std::unique_ptr<SGBinaryFile> file;
+            Op op;
+            while (_queue.pop(op)) {
+                if (_aborted) {
+                    continue;
+                }
+
+                if (op.kind == Op::Open) {
+                    file.reset(new SGBinaryFile(op.path));
+                    if (!file->open(SG_IO_OUT)) {
+                        SG_LOG(SG_IO, SG_WARN, "Unable to create extracted file:" << op.path);
+                        _failed = true;
+                        file.reset();
+                    }
+                } else if (op.kind == Op::Data) {
+                    if (file && (file->write(op.bytes.data(), op.bytes.size()) != (int) op.bytes.size())) {
+                        SG_LOG(SG_IO, SG_WARN, "Failed writing extracted file:" << file->get_file_name());
+                        _failed = true;
+                    }
+                } else if (file) {
+                    file->close();
+                    file.reset();
+                }
+            }
+        }
+
+        StageQueue<Op> _queue;
+        std::string _pending; ///< file bytes not yet handed to the thread
+        std::thread _thread;
+        std::atomic<bool> _failed{false};
+        std::atomic<bool> _aborted{false};
+    };
+
     /* tar Header Block, from POSIX 1003.1-1990.  */
 
 
@@ -104,8 +306,12 @@ typedef struct
         };
 
         size_t bytesRemaining;
-        std::unique_ptr<SGFile> currentFile;
+        bool haveCurrentFile = false;
         size_t currentFileSize;
+        FileWriterStage writer;
+
+        /// set by abort(), possibly while the worker thread is parsing
+        std::atomic<bool> aborted{false};
 
         uint8_t* headerPtr;
         bool skipCurrentEntry = false;
@@ -137,9 +343,9 @@ typedef struct
             }
 
             if (state == READING_FILE) {
-                if (currentFile) {
-                    currentFile->close();
-                    currentFile.reset();
+                if (haveCurrentFile) {
+                    writer.close();
+                    haveCurrentFile = false;
                 }
                 readPaddingIfRequired();
             } else if (state == READING_HEADER) {
@@ -179,7 +385,21 @@ typedef struct
 
         void flush() override
         {
-            // no-op for tar files, we process everything greedily
+            // we parse everything greedily, just wait for the writes
+            finishWrites();
+        }
+
+        void abort() override
+        {
+            aborted = true;
+            writer.abort();
+        }
+
+        void finishWrites()
+        {
+            if (!writer.finish() && (state < ERROR_STATE)) {
+                state = BAD_DATA;
+            }
         }
 
         void processHeader()
@@ -230,8 +450,8 @@ typedef struct
                 currentFileSize = ::strtol(header.size, NULL, 8);
                 bytesRemaining = currentFileSize;
                 if (!skipCurrentEntry) {
-                    currentFile.reset(new SGBinaryFile(p));
-                    currentFile->open(SG_IO_OUT);
+                    writer.open(p);
+                    haveCurrentFile = true;
                 }
                 setState(READING_FILE);
             } else if (header.typeflag == PAX_GLOBAL_HEADER) {
@@ -256,14 +476,14 @@ typedef struct
 
         void processBytes(const char* bytes, size_t count)
         {
-            if ((state >= ERROR_STATE) || (state == END_OF_ARCHIVE)) {
+            if (aborted || (state >= ERROR_STATE) || (state == END_OF_ARCHIVE)) {
                 return;
             }
 
             size_t curBytes = std::min(bytesRemaining, count);
             if (state == READING_FILE) {
-                if (currentFile) {
-                    currentFile->write(bytes, curBytes);
+                if (haveCurrentFile) {
+                    writer.write(bytes, curBytes);
                 }
                 bytesRemaining -= curBytes;
             } else if ((state == READING_HEADER) || (state == PRE_END_OF_ARCHVE) || (state == END_OF_ARCHIVE)) {
@@ -332,11 +552,109 @@ typedef struct
 
 ///////////////////////////////////////////////////////////////////////////////
 
+/**
+ * @brief base for compressed tarballs: compressed bytes are queued by
+ * extractBytes() and decompressed and parsed on a worker thread, which in
+ * turn hands file contents to the writer thread. The caller (usually the
+ * network or repository update loop) only pays for a copy.
+ */
+class CompressedTarExtractor : public TarExtractorPrivate
+{
+public:
+    /// without a worker, bytes are decompressed and parsed in extractBytes()
+    CompressedTarExtractor(ArchiveExtractor* outer, bool useWorker) :
+        TarExtractorPrivate(outer),
+        _input(COMPRESSED_QUEUE_BYTES),
+        _useWorker(useWorker)
+    {
+    }
+
+    void extractBytes(const uint8_t* bytes, size_t count) override
+    {
+        if (!_useWorker) {
+            decompress(bytes, count);
+            return;
+        }
+
+        if (!_thread.joinable()) {
+            _thread = std::thread(&CompressedTarExtractor::run, this);
+        }
+
+        _input.push(std::string((const char*)bytes, count), count);
+    }
+
+    void flush() override
+    {
+        if (_thread.joinable()) {
+            _finishing = true;
+            _input.close();
+            _thread.join();
+        } else if (!_useWorker && (state < ERROR_STATE)) {
+            finishDecompress();
+        }
+
+        finishWrites();
+    }
+
+    void abort() override
+    {
+        stopWorker();
+        TarExtractorPrivate::abort();
+    }
+
+    void stopWorkers() override
+    {
+        stopWorker();
+    }
+
+protected:
+    virtual void decompress(const uint8_t* bytes, size_t count) = 0;
+
+    /// called on the worker thread once all input has been seen
+    virtual void finishDecompress() {}
+
+    /// subclasses must call this first thing in their destructor, so the
+    /// worker thread is gone before their decompressor state is released.
+    /// Input still queued is dropped rather than decompressed, and the
+    /// chunk being decompressed is abandoned.
+    void stopWorker()
+    {
+        if (_thread.joinable()) {
+            aborted = true;
+            _input.abort();
+            _thread.join();
+        }
+    }
 
-class GZTarExtractor : public TarExtractorPrivate
+private:
+    void run()
+    {
+        std::string chunk;
+        while (_input.pop(chunk)) {
+            // keep draining on error, so the producer can't block
+            if (state < ERROR_STATE) {
+                decompress((const uint8_t*)chunk.data(), chunk.size());
+            }
+        }
+
+        if (_finishing && (state < ERROR_STATE)) {
+            finishDecompress();
+        }
+    }
+
+    StageQueue<std::string> _input;
+    const bool _useWorker;
+    std::thread _thread;
+    std::atomic<bool> _finishing{false};
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+class GZTarExtractor : public CompressedTarExtractor
 {
 public:
-    GZTarExtractor(ArchiveExtractor* outer) : TarExtractorPrivate(outer)
+    GZTarExtractor(ArchiveExtractor* outer, bool useWorker) :
+        CompressedTarExtractor(outer, useWorker)
     {
         memset(&zlibStream, 0, sizeof(z_stream));
         zlibOutput = (unsigned char*)malloc(ZLIB_DECOMPRESS_BUFFER_SIZE);
@@ -348,10 +666,15 @@ public:
 
     ~GZTarExtractor()
     {
+        stopWorker();
+        if (haveInitedZLib) {
+            inflateEnd(&zlibStream);
+        }
         free(zlibOutput);
     }
 
-    void extractBytes(const uint8_t* bytes, size_t count) override
+protected:
+    void decompress(const uint8_t* bytes, size_t count) override
     {
         zlibStream.next_in = (uint8_t*)bytes;
         zlibStream.avail_in = count;
@@ -403,7 +726,7 @@ public:
             if (result == Z_STREAM_END) {
                 break;
             }
-        } while ((zlibStream.avail_in > 0) || (writtenSize > 0));
+        } while (!aborted && ((zlibStream.avail_in > 0) || (writtenSize > 0)));
     }
 
 private:
@@ -418,10 +741,11 @@ private:
 
 #include <lzma.h>
 
-class XZTarExtractor : public TarExtractorPrivate
+class XZTarExtractor : public CompressedTarExtractor
 {
 public:
-    XZTarExtractor(ArchiveExtractor* outer) : TarExtractorPrivate(outer)
+    XZTarExtractor(ArchiveExtractor* outer, bool useWorker) :
+        CompressedTarExtractor(outer, useWorker)
     {
         _xzStream = LZMA_STREAM_INIT;
         _outputBuffer = (uint8_t*)malloc(ZLIB_DECOMPRESS_BUFFER_SIZE);
@@ -436,10 +760,13 @@ public:
 
     ~XZTarExtractor()
     {
+        stopWorker();
+        lzma_end(&_xzStream);
         free(_outputBuffer);
     }
 
-    void extractBytes(const uint8_t* bytes, size_t count) override
+protected:
+    void decompress(const uint8_t* bytes, size_t count) override
     {
         lzma_action action = LZMA_RUN;
         _xzStream.next_in = bytes;
@@ -466,10 +793,10 @@ public:
                 setState(BAD_ARCHIVE);
                 break;
             }
-        } while ((_xzStream.avail_in > 0) || (writtenSize > 0));
+        } while (!aborted && ((_xzStream.avail_in > 0) || (writtenSize > 0)));
     }
 
-    void flush() override
+    void finishDecompress() override
     {
         const auto ret = lzma_code(&_xzStream, LZMA_FINISH);
         if (ret != LZMA_STREAM_END) {
@@ -494,6 +821,7 @@ class ZipExtractorPrivate : public ArchiveExtractorPrivate
 {
 public:
 	std::string m_buffer;
+	FileWriterStage writer;
 
 	ZipExtractorPrivate(ArchiveExtractor* outer) :
 		ArchiveExtractorPrivate(outer)
@@ -527,7 +855,9 @@ public:
 #endif
 		unzFile zip = unzOpen2(bufferName, &memoryAccessFuncs);
 
-		const size_t BUFFER_SIZE = 1024 * 1024;
+		// inflate in writer-sized blocks; the writes themselves happen
+		// on the writer thread while we inflate the next block
+		const size_t BUFFER_SIZE = WRITE_BLOCK_SIZE;
 		void* buf = malloc(BUFFER_SIZE);
 
         int result = unzGoToFirstFile(zip);
@@ -560,6 +890,17 @@ public:
 
         free(buf);
         unzClose(zip);
+
+        // like the exceptions above, and like the files were written
+        // here before the writer stage existed
+        if (!writer.finish()) {
+            throw sg_io_exception("failed to write extracted files", outer->rootPath());
+        }
+    }
+
+    void abort() override
+    {
+        m_buffer.clear();
     }
     
     void extractCurrentFile(unzFile zip, char* buffer, size_t bufferSize)
@@ -600,7 +941,6 @@ public:
 			throw sg_io_exception("opening current zip file failed", sg_location(name));
 		}
 
-		sg_ofstream outFile;
 		bool eof = false;
 		SGPath path = extractRootPath() / name;
 
@@ -613,11 +953,7 @@ public:
 			}
 		}
 
-		outFile.open(path, std::ios::binary | std::ios::trunc | std::ios::out);
-		if (outFile.fail()) {
-			throw sg_io_exception("failed to open output file for writing:" + strutils::error_string(errno), path);
-		}
-
+		writer.open(path);
 		while (!eof) {
 			int bytes = unzReadCurrentFile(zip, buffer, bufferSize);
 			if (bytes < 0) {
@@ -627,11 +963,11 @@ public:
 				eof = true;
 			}
 			else {
-				outFile.write(buffer, bytes);
+				writer.write(buffer, bytes);
 			}
 		}
 
-		outFile.close();
+		writer.close();
 		unzCloseCurrentFile(zip);
 	}
 };
@@ -654,12 +990,16 @@ void ArchiveExtractor::extractBytes(const uint8_t* bytes, size_t count)
 			return;
 		}
 
+		// filterPath() overrides may only run on the worker thread when
+		// OwnedArchiveExtractor stops it before the subclass is destroyed
+		const bool useWorker = _owned || (typeid(*this) == typeid(ArchiveExtractor));
+
 		if (r == TarData) {
 			d.reset(new TarExtractorPrivate(this));
         } else if (r == GZData) {
-            d.reset(new GZTarExtractor(this));
+            d.reset(new GZTarExtractor(this, useWorker));
         } else if (r == XZData) {
-            d.reset(new XZTarExtractor(this));
+            d.reset(new XZTarExtractor(this, useWorker));
         } else if (r == ZipData) {
             d.reset(new ZipExtractorPrivate(this));
         } else {
@@ -690,6 +1030,21 @@ void ArchiveExtractor::flush()
 	d->flush();
 }
 
+void ArchiveExtractor::stopWorkers()
+{
+	if (d)
+		d->stopWorkers();
+}
+
+void ArchiveExtractor::cancel()
+{
+	if (!d)
+		return;
+
+	d->abort();
+	d->state = ArchiveExtractorPrivate::FILTER_STOPPED;
+}
+
 bool ArchiveExtractor::isAtEndOfArchive() const
 {
 	if (!d)
@@ -19,6 +19,7 @@
 #define SG_IO_UNTAR_HXX
 
 #include <memory>
+#include <utility>
 
 #include <cstdlib>
 #include <cstdint>
@@ -30,6 +31,9 @@ namespace simgear
 
 class ArchiveExtractorPrivate;
 
+template <class Extractor>
+class OwnedArchiveExtractor;
+
 class ArchiveExtractor
 {
 public:
@@ -55,13 +59,46 @@ public:
 	/**
 	 * @brief API to extract from memory - this can be called multiple
 	 * times for streamking from a network socket etc
+	 *
+	 * Compressed tarballs are decompressed and parsed on a worker thread,
+	 * and files are written on another, so this mostly just queues the
+	 * bytes; it blocks only when the pipeline is full. A subclass is only
+	 * decompressed on the worker when it is created as an
+	 * OwnedArchiveExtractor, see filterPath(); otherwise this call does it.
 	 */
     void extractBytes(const uint8_t* bytes, size_t count);
 
+	/**
+	 * @brief signal the end of input, and wait until all extracted files
+	 * are completely written. Check hasError() / isAtEndOfArchive()
+	 * afterwards.
+	 *
+	 * For zip archives this is where the extraction happens; it throws
+	 * sg_io_exception when an entry can't be read or a file can't be
+	 * written.
+	 */
 	void flush();
 
+	/**
+	 * @brief stop extracting without waiting for the input queued so far.
+	 * Files already written are left in place, the one being written is
+	 * incomplete. Further input is ignored, hasError() is true and
+	 * isAtEndOfArchive() false afterwards. The destructor does the same
+	 * when flush() wasn't called.
+	 */
+	void cancel();
+
     bool isAtEndOfArchive() const;
 
+	/**
+	 * @brief true if the archive is invalid or extracting it failed.
+	 *
+	 * Compressed tarballs are processed on worker threads, so a problem
+	 * with the bytes passed to extractBytes() may only show here after
+	 * later calls, and is certain to only after flush() has returned.
+	 * Checking it after each extractBytes() call is still useful to stop
+	 * feeding an archive which has already failed.
+	 */
     bool hasError() const;
 
 	enum PathResult {
@@ -79,16 +116,62 @@ public:
 protected:
 
 
+    /**
+     * @brief decide if an archive entry is extracted, possibly changing
+     * the path it is extracted to.
+     *
+     * It is called on the thread calling extractBytes() and flush(),
+     * unless the subclass is created as an OwnedArchiveExtractor. Then,
+     * for compressed tarballs, it is called on the extraction worker
+     * thread, and may run while the caller is in other member functions.
+     * Calls never overlap each other, but state an override shares with
+     * the rest of the subclass needs a lock.
+     */
     virtual PathResult filterPath(std::string& pathToExtract);
 private:
 	static DetermineResult isTarData(const uint8_t* bytes, size_t count);
 
+    /// stop the worker thread calling filterPath(), dropping its input
+    void stopWorkers();
+
     friend class ArchiveExtractorPrivate;
+    template <class Extractor>
+    friend class OwnedArchiveExtractor;
     std::unique_ptr<ArchiveExtractorPrivate> d;
 
 	SGPath _rootPath;
 	std::string _prebuffer; // store bytes before type is determined
 	bool _invalidDataType = false;
+	bool _owned = false; ///< created as an OwnedArchiveExtractor
+};
+
+/**
+ * @brief an ArchiveExtractor subclass which may run filterPath() on the
+ * extraction worker thread.
+ *
+ * Its destructor runs before the one of the subclass, and stops the worker
+ * as ~ArchiveExtractor() would, so filterPath() never runs while members
+ * of the subclass are destroyed:
+ *
+ *     OwnedArchiveExtractor<MyExtractor> ex(args...);
+ */
+template <class Extractor>
+class OwnedArchiveExtractor final : public Extractor
+{
+public:
+    template <typename... Args>
+    explicit OwnedArchiveExtractor(Args&&... args) :
+        Extractor(std::forward<Args>(args)...)
+    {
+        ArchiveExtractor& base = *this;
+        base._owned = true;
+    }
+
+    ~OwnedArchiveExtractor()
+    {
+        ArchiveExtractor& base = *this;
+        base.stopWorkers();
+    }
 };
 
 } // of namespace simgear
@@ -174,15 +174,65 @@ static double htnm_wmm2015[13][13]=
 
 static const int nmax = 12;
 
-static double P[13][13];
-static double DP[13][13];
-static double gnm[13][13];
-static double hnm[13][13];
-static double sm[13];
-static double cm[13];
+/* Gauss coefficients at one date */
+struct MagCoefficients {
+    bool valid;
+    long date;
+    double gnm[13][13];
+    double hnm[13][13];
+};
+
+/* Factors of the Legendre recursions, these never change */
+struct LegendreRoots {
+    double root[13];
+    double roots[13][13][2];
+
+    LegendreRoots()
+    {
+	for ( int n = 2; n <= nmax; n++ ) {
+	    root[n] = sqrt((2.0*n-1) / (2.0*n));
+	}
+
+	for ( int m = 0; m <= nmax; m++ ) {
+	    double mm = m*m;
+	    for ( int n = SG_MAX2(m + 1, 2); n <= nmax; n++ ) {
+		roots[m][n][0] = sqrt((n-1)*(n-1) - mm);
+		roots[m][n][1] = 1.0 / sqrt( n*n - mm);
+	    }
+	}
+    }
+};
+
+static const LegendreRoots& legendre_roots()
+{
+    static const LegendreRoots roots;
+    return roots;
+}
 
-static double root[13];
-static double roots[13][13][2];
+/* compute Gauss coefficients gnm and hnm of degree n and order m for the desired time
+   achieved by adjusting the coefficients at time t0 for linear secular variation.
+   Each thread keeps the coefficients of the last date it asked for, so repeated
+   calls for the same day share them. */
+static const MagCoefficients& mag_coefficients( long dat )
+{
+    /* reference date for current model is 1 januari 2015 */
+    static const long date0_wmm2015 = yymmdd_to_julian_days(15,1,1);
+    static thread_local MagCoefficients coeffs = { false, 0, {}, {} };
+
+    if ( !coeffs.valid || coeffs.date != dat ) {
+	/* WMM2015 */
+	double yearfrac = (dat - date0_wmm2015) / 365.25;
+	for ( int n = 1; n <= nmax; n++ ) {
+	    for ( int m = 0; m <= nmax; m++ ) {
+		coeffs.gnm[n][m] = gnm_wmm2015[n][m] + yearfrac * gtnm_wmm2015[n][m];
+		coeffs.hnm[n][m] = hnm_wmm2015[n][m] + yearfrac * htnm_wmm2015[n][m];
+	    }
+	}
+	coeffs.date = dat;
+	coeffs.valid = true;
+    }
+    return coeffs;
+}
 
 /* Convert date to Julian day    1950-2049 */
 unsigned long int yymmdd_to_julian_days( int yy, int mm, int dd )
@@ -209,13 +259,13 @@ double calc_magvar( double lat, double lon, double h, long dat, double* field )
 {
     /* output field B_r,B_th,B_phi,B_x,B_y,B_z */
     int n,m;
-    /* reference date for current model is 1 januari 2015 */
-    long date0_wmm2015 = yymmdd_to_julian_days(15,1,1);
 
-    double yearfrac,sr,r,theta,c,s,psi,fn,fn_0,B_r,B_theta,B_phi,X,Y,Z;
+    double sr,r,theta,c,s,psi,fn,fn_0,B_r,B_theta,B_phi,X,Y,Z;
     double sinpsi, cospsi, inv_s;
+    double P[13][13], DP[13][13], sm[13], cm[13];
 
-    static int been_here = 0;
+    const MagCoefficients& coeffs = mag_coefficients(dat);
+    const LegendreRoots& lr = legendre_roots();
 
     double sinlat = sin(lat);
     double coslat = cos(lat);
@@ -240,9 +290,9 @@ double calc_magvar( double lat, double lon, double h, long dat, double* field )
     /* protect against zero divide at geographic poles */
     inv_s =  1.0 / (s + (s == 0.)*1.0e-8);
 
-    /* zero out arrays */
+    /* zero out arrays, the recursion reads P[m-1][m] too */
     for ( n = 0; n <= nmax; n++ ) {
-	for ( m = 0; m <= n; m++ ) {
+	for ( m = 0; m <= nmax; m++ ) {
 	    P[n][m] = 0;
 	    DP[n][m] = 0;
 	}
@@ -256,53 +306,22 @@ double calc_magvar( double lat, double lon, double h, long dat, double* field )
     P[1][0] = c ;
     DP[1][0] = -s;
 
-    // these values will not change for subsequent function calls
-    if( !been_here ) {
-	for ( n = 2; n <= nmax; n++ ) {
-	    root[n] = sqrt((2.0*n-1) / (2.0*n));
-	}
-
-	for ( m = 0; m <= nmax; m++ ) {
-	    double mm = m*m;
-	    for ( n = SG_MAX2(m + 1, 2); n <= nmax; n++ ) {
-		roots[m][n][0] = sqrt((n-1)*(n-1) - mm);
-		roots[m][n][1] = 1.0 / sqrt( n*n - mm);
-	    }
-	}
-	been_here = 1;
-    }
-
     for ( n=2; n <= nmax; n++ ) {
-	// double root = sqrt((2.0*n-1) / (2.0*n));
-	P[n][n] = P[n-1][n-1] * s * root[n];
+	P[n][n] = P[n-1][n-1] * s * lr.root[n];
 	DP[n][n] = (DP[n-1][n-1] * s + P[n-1][n-1] * c) *
-	    root[n];
+	    lr.root[n];
     }
 
     /* lower triangle */
     for ( m = 0; m <= nmax; m++ ) {
-	// double mm = m*m;
 	for ( n = SG_MAX2(m + 1, 2); n <= nmax; n++ ) {
-	    // double root1 = sqrt((n-1)*(n-1) - mm);
-	    // double root2 = 1.0 / sqrt( n*n - mm);
 	    P[n][m] = (P[n-1][m] * c * (2.0*n-1) -
-		       P[n-2][m] * roots[m][n][0]) *
-		roots[m][n][1];
+		       P[n-2][m] * lr.roots[m][n][0]) *
+		lr.roots[m][n][1];
 
 	    DP[n][m] = ((DP[n-1][m] * c - P[n-1][m] * s) *
-			(2.0*n-1) - DP[n-2][m] * roots[m][n][0]) *
-		roots[m][n][1];
-	}
-    }
-
-    /* compute Gauss coefficients gnm and hnm of degree n and order m for the desired time
-       achieved by adjusting the coefficients at time t0 for linear secular variation */
-    /* WMM2015 */
-    yearfrac = (dat - date0_wmm2015) / 365.25;
-    for ( n = 1; n <= nmax; n++ ) {
-	for ( m = 0; m <= nmax; m++ ) {
-	    gnm[n][m] = gnm_wmm2015[n][m] + yearfrac * gtnm_wmm2015[n][m];
-	    hnm[n][m] = hnm_wmm2015[n][m] + yearfrac * htnm_wmm2015[n][m];
+			(2.0*n-1) - DP[n-2][m] * lr.roots[m][n][0]) *
+		lr.roots[m][n][1];
 	}
     }
 
@@ -324,10 +343,10 @@ double calc_magvar( double lat, double lon, double h, long dat, double* field )
 	double c2_n=0;
 	double c3_n=0;
 	for ( m = 0; m <= n; m++ ) {
-	    double tmp = (gnm[n][m] * cm[m] + hnm[n][m] * sm[m]);
+	    double tmp = (coeffs.gnm[n][m] * cm[m] + coeffs.hnm[n][m] * sm[m]);
 	    c1_n=c1_n + tmp * P[n][m];
 	    c2_n=c2_n + tmp * DP[n][m];
-	    c3_n=c3_n + m * (gnm[n][m] * sm[m] - hnm[n][m] * cm[m]) * P[n][m];
+	    c3_n=c3_n + m * (coeffs.gnm[n][m] * sm[m] - coeffs.hnm[n][m] * cm[m]) * P[n][m];
 	}
 	// fn=pow(r_0/r,n+2.0);
 	fn *= fn_0;
@@ -358,7 +377,165 @@ double calc_magvar( double lat, double lon, double h, long dat, double* field )
 }
 
 
+/* Number of positions calc_magvar_batch() runs through the recursions
+   together. The innermost loops go over them, which the compiler turns
+   into vector instructions. */
+static const int lanes = 4;
+
+void calc_magvar_batch( const double* lat, const double* lon, const double* h,
+			size_t count, long dat, double* var, double* field )
+{
+    int k,n,m;
+
+    const MagCoefficients& coeffs = mag_coefficients(dat);
+    const LegendreRoots& lr = legendre_roots();
+
+    for ( size_t first = 0; first < count; first += lanes ) {
+	double c[lanes], s[lanes], inv_s[lanes], fn_0[lanes], fn[lanes];
+	double sinpsi[lanes], cospsi[lanes];
+	double B_r[lanes], B_theta[lanes], B_phi[lanes];
+	double c1_n[lanes], c2_n[lanes], c3_n[lanes];
+	double P[13][13][lanes], DP[13][13][lanes], sm[13][lanes], cm[13][lanes];
+
+	/* geocentric coords as in calc_magvar(), the last block is
+	   padded with its last position */
+	for ( k = 0; k < lanes; k++ ) {
+	    size_t i = SG_MIN2(first + k, count - 1);
+	    double sinlat = sin(lat[i]);
+	    double coslat = cos(lat[i]);
+	    double sr = sqrt(a*a*coslat*coslat + b*b*sinlat*sinlat);
+	    double theta = atan2(coslat * (h[i]*sr + a*a),
+				 sinlat * (h[i]*sr + b*b));
+	    double r = h[i]*h[i] + 2.0*h[i] * sr +
+		(a*a*a*a - ( a*a*a*a - b*b*b*b ) * sinlat*sinlat ) /
+		(a*a - (a*a - b*b) * sinlat*sinlat );
+
+	    c[k] = cos(theta);
+	    s[k] = sin(theta);
+	    inv_s[k] = 1.0 / (s[k] + (s[k] == 0.)*1.0e-8);
+	    fn_0[k] = r_0 / sqrt(r);
+
+	    double psi = theta - ((M_PI / 2.0) - lat[i]);
+	    sinpsi[k] = sin(psi);
+	    cospsi[k] = cos(psi);
+
+	    sm[1][k] = sin(lon[i]);
+	    cm[1][k] = cos(lon[i]);
+	}
+
+	/* sin(m lon) and cos(m lon) by the angle sum formulas */
+	for ( k = 0; k < lanes; k++ ) {
+	    sm[0][k] = 0;
+	    cm[0][k] = 1;
+	}
+	for ( m = 2; m <= nmax; m++ ) {
+	    for ( k = 0; k < lanes; k++ ) {
+		sm[m][k] = sm[m-1][k] * cm[1][k] + cm[m-1][k] * sm[1][k];
+		cm[m][k] = cm[m-1][k] * cm[1][k] - sm[m-1][k] * sm[1][k];
+	    }
+	}
+
+	/* diagonal elements, and the zeros above them the recursion reads */
+	for ( k = 0; k < lanes; k++ ) {
+	    P[0][0][k] = 1;
+	    P[1][1][k] = s[k];
+	    DP[0][0][k] = 0;
+	    DP[1][1][k] = c[k];
+	    P[1][0][k] = c[k];
+	    DP[1][0][k] = -s[k];
+	}
+	for ( m = 1; m <= nmax; m++ ) {
+	    for ( k = 0; k < lanes; k++ ) {
+		P[m-1][m][k] = 0;
+		DP[m-1][m][k] = 0;
+	    }
+	}
+
+	for ( n=2; n <= nmax; n++ ) {
+	    for ( k = 0; k < lanes; k++ ) {
+		P[n][n][k] = P[n-1][n-1][k] * s[k] * lr.root[n];
+		DP[n][n][k] = (DP[n-1][n-1][k] * s[k] + P[n-1][n-1][k] * c[k]) *
+		    lr.root[n];
+	    }
+	}
+
+	/* lower triangle */
+	for ( m = 0; m <= nmax; m++ ) {
+	    for ( n = SG_MAX2(m + 1, 2); n <= nmax; n++ ) {
+		double root0 = lr.roots[m][n][0];
+		double root1 = lr.roots[m][n][1];
+		for ( k = 0; k < lanes; k++ ) {
+		    P[n][m][k] = (P[n-1][m][k] * c[k] * (2.0*n-1) -
+				  P[n-2][m][k] * root0) * root1;
+
+		    DP[n][m][k] = ((DP[n-1][m][k] * c[k] - P[n-1][m][k] * s[k]) *
+				   (2.0*n-1) - DP[n-2][m][k] * root0) * root1;
+		}
+	    }
+	}
+
+	/* compute B fields */
+	for ( k = 0; k < lanes; k++ ) {
+	    B_r[k] = 0.0;
+	    B_theta[k] = 0.0;
+	    B_phi[k] = 0.0;
+	    fn[k] = fn_0[k] * fn_0[k];
+	}
+
+	for ( n = 1; n <= nmax; n++ ) {
+	    for ( k = 0; k < lanes; k++ ) {
+		c1_n[k] = 0;
+		c2_n[k] = 0;
+		c3_n[k] = 0;
+	    }
+	    for ( m = 0; m <= n; m++ ) {
+		double g = coeffs.gnm[n][m];
+		double hh = coeffs.hnm[n][m];
+		for ( k = 0; k < lanes; k++ ) {
+		    double tmp = (g * cm[m][k] + hh * sm[m][k]);
+		    c1_n[k] = c1_n[k] + tmp * P[n][m][k];
+		    c2_n[k] = c2_n[k] + tmp * DP[n][m][k];
+		    c3_n[k] = c3_n[k] + m * (g * sm[m][k] - hh * cm[m][k]) * P[n][m][k];
+		}
+	    }
+	    for ( k = 0; k < lanes; k++ ) {
+		fn[k] *= fn_0[k];
+		B_r[k] = B_r[k] + (n + 1) * c1_n[k] * fn[k];
+		B_theta[k] = B_theta[k] - c2_n[k] * fn[k];
+		B_phi[k] = B_phi[k] + c3_n[k] * fn[k] * inv_s[k];
+	    }
+	}
+
+	/* Find geodetic field components and the variation */
+	for ( k = 0; k < lanes && first + k < count; k++ ) {
+	    double X = -B_theta[k] * cospsi[k] - B_r[k] * sinpsi[k];
+	    double Y = B_phi[k];
+	    double Z = B_theta[k] * sinpsi[k] - B_r[k] * cospsi[k];
+
+	    if ( field ) {
+		double* f = field + 6 * (first + k);
+		f[0]=B_r[k];
+		f[1]=B_theta[k];
+		f[2]=B_phi[k];
+		f[3]=X;
+		f[4]=Y;
+		f[5]=Z;
+	    }
+
+	    var[first + k] = (X != 0. || Y != 0.) ? atan2(Y, X) : (double) 0.;
+	}
+    }
+}
+
+
 #ifdef TEST_NHV_HACKS
+static double P[13][13];
+static double DP[13][13];
+static double gnm[13][13];
+static double hnm[13][13];
+static double sm[13];
+static double cm[13];
+
 double SGMagVarOrig( double lat, double lon, double h, long dat, double* field )
 {
     /* output field B_r,B_th,B_phi,B_x,B_y,B_z */
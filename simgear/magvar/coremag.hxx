@@ -36,6 +36,7 @@
 #ifndef SG_MAGVAR_HXX
 #define SG_MAGVAR_HXX
 
+#include <cstddef>
 
 /* Convert date to Julian day    1950-2049 */
 unsigned long int yymmdd_to_julian_days( int yy, int mm, int dd );
@@ -46,5 +47,12 @@ N and E lat and long are positive, S and W negative
 */
 double calc_magvar( double lat, double lon, double h, long dat, double* field );
 
+/* calc_magvar() for count positions at the same date, given as arrays of
+latitude, longitude and height. The variations go to var, and if field is not
+NULL the 6 field values of each position go to field
+*/
+void calc_magvar_batch( const double* lat, const double* lon, const double* h,
+			size_t count, long dat, double* var, double* field );
+
 
 #endif // SG_MAGVAR_HXX
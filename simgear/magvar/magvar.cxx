@@ -26,10 +26,12 @@
 #endif
 
 
+#include <algorithm>
 #include <cmath>
 
 #include <simgear/magvar/magvar.hxx>
 #include <simgear/math/SGMath.hxx>
+#include <simgear/structure/exception.hxx>
 
 #include "coremag.hxx"
 #include "magvar.hxx"
@@ -59,11 +61,215 @@ void SGMagVar::update( const SGGeod& geod, double jd ) {
     geod.getElevationM(), jd);
 }
 
+// The grid sgGetMagVar() uses, swapped atomically so that lookups in
+// other threads keep the one they started with
+static std::shared_ptr<const SGMagVarGrid> magVarGrid;
+
+std::shared_ptr<const SGMagVarGrid>
+SGMagVar::buildGrid( double jd, double resolutionDeg, double minAltM,
+                     double maxAltM, int altLevels, double maxErrorDeg )
+{
+  std::shared_ptr<const SGMagVarGrid> grid =
+    std::make_shared<SGMagVarGrid>(jd, resolutionDeg, minAltM, maxAltM,
+                                   altLevels, maxErrorDeg);
+  std::atomic_store(&magVarGrid, grid);
+  return grid;
+}
+
+void SGMagVar::clearGrid()
+{
+  std::atomic_store(&magVarGrid, std::shared_ptr<const SGMagVarGrid>());
+}
+
+std::shared_ptr<const SGMagVarGrid> SGMagVar::getGrid()
+{
+  return std::atomic_load(&magVarGrid);
+}
+
+
+// How finely SGMagVarGrid checks its cells, and the share of the bound
+// the error at the checked points may use: between them it can be up to
+// about 10% larger
+static const int CheckSteps = 2;
+static const double CheckMargin = 0.8;
+
+// Wrap an angle to [-pi, pi]
+static double wrapAngle(double a)
+{
+  if (a > SGD_PI)
+    return a - SGD_2PI;
+  if (a < -SGD_PI)
+    return a + SGD_2PI;
+  return a;
+}
+
+SGMagVarGrid::SGMagVarGrid( double jd, double resolutionDeg, double minAltM,
+                            double maxAltM, int altLevels, double maxErrorDeg )
+  : date((long)jd),
+    maxError(0.0),
+    numFailed(0)
+{
+  if (!(resolutionDeg > 0.0) || !(maxAltM > minAltM))
+    throw sg_exception("Invalid magvar grid dimensions");
+
+  numLat = (int)std::ceil(180.0 / resolutionDeg) + 1;
+  numLon = (int)std::ceil(360.0 / resolutionDeg) + 1;
+  numAlt = std::max(altLevels, 2);
+  latStep = SGD_PI / (numLat - 1);
+  lonStep = SGD_2PI / (numLon - 1);
+  altStep = (maxAltM - minAltM) / (numAlt - 1);
+  minAlt = minAltM;
+
+  // The nodes, in their storage order
+  std::vector<double> lat, lon, h;
+  const size_t numNodes = size_t(numLat) * numLon * numAlt;
+  lat.reserve(numNodes);
+  lon.reserve(numNodes);
+  h.reserve(numNodes);
+  for (int k = 0; k < numAlt; ++k) {
+    for (int i = 0; i < numLat; ++i) {
+      for (int j = 0; j < numLon; ++j) {
+        lat.push_back(-SGD_PI_2 + i * latStep);
+        lon.push_back(-SGD_PI + j * lonStep);
+        h.push_back((minAlt + k * altStep) / 1000.0);
+      }
+    }
+  }
+  std::vector<double> var(numNodes);
+  calc_magvar_batch(&lat[0], &lon[0], &h[0], numNodes, date, &var[0], NULL);
+  values.assign(var.begin(), var.end());
+
+  // Check each cell against the model on a lattice that divides it into
+  // CheckSteps parts in every direction, so at its centre and at the
+  // middles of its faces and edges for 2. The nodes are exact, and the
+  // points on shared faces count for all cells around them.
+  const int numY = (numLat - 1) * CheckSteps + 1;
+  const int numX = (numLon - 1) * CheckSteps + 1;
+  const int numZ = (numAlt - 1) * CheckSteps + 1;
+  const size_t numCells = size_t(numLat - 1) * (numLon - 1) * (numAlt - 1);
+  std::vector<float> cellError(numCells, 0.0f);
+
+  // One altitude of the lattice at a time, in chunks for the batch
+  const size_t chunk = 4096;
+  lat.resize(chunk);
+  lon.resize(chunk);
+  h.resize(chunk);
+  var.resize(chunk);
+  for (int kz = 0; kz < numZ; ++kz) {
+    const double z = double(kz) / CheckSteps;
+    const size_t numPoints = size_t(numY) * numX;
+    for (size_t first = 0; first < numPoints; first += chunk) {
+      const size_t n = std::min(chunk, numPoints - first);
+      for (size_t p = 0; p < n; ++p) {
+        const int ky = int((first + p) / numX), kx = int((first + p) % numX);
+        lat[p] = -SGD_PI_2 + ky * latStep / CheckSteps;
+        lon[p] = -SGD_PI + kx * lonStep / CheckSteps;
+        h[p] = (minAlt + z * altStep) / 1000.0;
+      }
+      calc_magvar_batch(&lat[0], &lon[0], &h[0], n, date, &var[0], NULL);
+
+      for (size_t p = 0; p < n; ++p) {
+        const int ky = int((first + p) / numX), kx = int((first + p) % numX);
+        if (ky % CheckSteps == 0 && kx % CheckSteps == 0 && kz % CheckSteps == 0)
+          continue;
+        size_t cell;
+        const double y = double(ky) / CheckSteps, x = double(kx) / CheckSteps;
+        const float error = std::fabs(wrapAngle(interpolate(y, x, z, cell) - var[p]));
+        // All cells the point is in or on the boundary of
+        const int i0 = std::max((ky - 1) / CheckSteps, 0);
+        const int i1 = std::min(ky / CheckSteps, numLat - 2);
+        const int j0 = std::max((kx - 1) / CheckSteps, 0);
+        const int j1 = std::min(kx / CheckSteps, numLon - 2);
+        const int k0 = std::max((kz - 1) / CheckSteps, 0);
+        const int k1 = std::min(kz / CheckSteps, numAlt - 2);
+        for (int k = k0; k <= k1; ++k)
+          for (int i = i0; i <= i1; ++i)
+            for (int j = j0; j <= j1; ++j) {
+              float& e = cellError[(size_t(k) * (numLat - 1) + i) * (numLon - 1) + j];
+              e = std::max(e, error);
+            }
+      }
+    }
+  }
+
+  failed.assign(numCells, false);
+  const double maxErrorRad = CheckMargin * maxErrorDeg * SGD_DEGREES_TO_RADIANS;
+  for (size_t c = 0; c < numCells; ++c) {
+    if (!(cellError[c] <= maxErrorRad)) {
+      failed[c] = true;
+      ++numFailed;
+    } else {
+      maxError = std::max(maxError, double(cellError[c]));
+    }
+  }
+  maxError *= SGD_RADIANS_TO_DEGREES;
+}
+
+double SGMagVarGrid::interpolate( double y, double x, double z, size_t& cell ) const
+{
+  int i = std::min(std::max((int)y, 0), numLat - 2);
+  int j = std::min(std::max((int)x, 0), numLon - 2);
+  int k = std::min(std::max((int)z, 0), numAlt - 2);
+  double fy = y - i, fx = x - j, fz = z - k;
+  cell = (size_t(k) * (numLat - 1) + i) * (numLon - 1) + j;
+
+  // Relative to one corner, so that the variation does not jump by 2 pi
+  // between the corners
+  const float* v00 = &values[nodeIndex(i, j, k)];
+  const float* v10 = v00 + numLon;
+  const float* v01 = v00 + size_t(numLat) * numLon;
+  const float* v11 = v01 + numLon;
+  double v0 = v00[0];
+  double d[8] = {
+    0.0, wrapAngle(v00[1] - v0),
+    wrapAngle(v10[0] - v0), wrapAngle(v10[1] - v0),
+    wrapAngle(v01[0] - v0), wrapAngle(v01[1] - v0),
+    wrapAngle(v11[0] - v0), wrapAngle(v11[1] - v0)
+  };
+
+  double d0 = (d[0] + fx * (d[1] - d[0])) * (1 - fy) + (d[2] + fx * (d[3] - d[2])) * fy;
+  double d1 = (d[4] + fx * (d[5] - d[4])) * (1 - fy) + (d[6] + fx * (d[7] - d[6])) * fy;
+  return wrapAngle(v0 + d0 + fz * (d1 - d0));
+}
+
+bool SGMagVarGrid::lookup( const SGGeod& pos, double& magvar ) const
+{
+  double z = (pos.getElevationM() - minAlt) / altStep;
+  if (!(z >= 0.0 && z <= numAlt - 1))
+    return false;
+
+  double y = (pos.getLatitudeRad() + SGD_PI_2) / latStep;
+  double x = (pos.getLongitudeRad() + SGD_PI) / lonStep;
+  if (!(y >= 0.0 && y <= numLat - 1) || !std::isfinite(x))
+    return false;
+  double lonCells = numLon - 1;
+  if (!(x >= 0.0 && x < lonCells))
+    x -= std::floor(x / lonCells) * lonCells;
+
+  size_t cell;
+  double v = interpolate(y, x, z, cell);
+  if (failed[cell])
+    return false;
+  magvar = v;
+  return true;
+}
+
+
+// The grid, if there is one for the date and it covers pos
+static bool gridMagVar( const SGGeod& pos, double jd, double& magvar )
+{
+  std::shared_ptr<const SGMagVarGrid> grid = SGMagVar::getGrid();
+  return grid && grid->getDate() == (long)jd && grid->lookup(pos, magvar);
+}
 
 double sgGetMagVar( double lon, double lat, double alt_m, double jd ) {
     // cout << "lat = " << lat << " lon = " << lon << " elev = " << alt_m
     //      << " JD = " << jd << endl;
 
+    double magvar;
+    if (gridMagVar(SGGeod::fromRadM(lon, lat, alt_m), jd, magvar))
+      return magvar;
+
     double field[6];
     return calc_magvar( lat, lon, alt_m / 1000.0, (long)jd, field );
 }
@@ -74,3 +280,35 @@ double sgGetMagVar( const SGGeod& pos, double jd )
     pos.getElevationM(), jd);
 }
 
+void sgGetMagVar( const SGGeod* pos, size_t count, double jd, double* magvar )
+{
+    std::shared_ptr<const SGMagVarGrid> grid = SGMagVar::getGrid();
+    if (grid && grid->getDate() != (long)jd)
+        grid.reset();
+
+    // The positions the grid does not cover, in chunks for
+    // calc_magvar_batch()
+    const size_t chunk = 256;
+    double lat[chunk], lon[chunk], h[chunk], var[chunk];
+    size_t index[chunk];
+    size_t n = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (grid && grid->lookup(pos[i], magvar[i]))
+            continue;
+        lat[n] = pos[i].getLatitudeRad();
+        lon[n] = pos[i].getLongitudeRad();
+        h[n] = pos[i].getElevationM() / 1000.0;
+        index[n++] = i;
+        if (n == chunk) {
+            calc_magvar_batch(lat, lon, h, n, (long)jd, var, NULL);
+            for (size_t j = 0; j < n; ++j)
+                magvar[index[j]] = var[j];
+            n = 0;
+        }
+    }
+    if (n > 0) {
+        calc_magvar_batch(lat, lon, h, n, (long)jd, var, NULL);
+        for (size_t j = 0; j < n; ++j)
+            magvar[index[j]] = var[j];
+    }
+}
@@ -32,9 +32,13 @@
 # error This library requires C++
 #endif
 
+#include <cstddef>
+#include <memory>
+#include <vector>
 
 // forward decls
 class SGGeod;
+class SGMagVarGrid;
 
 /**
  * Magnetic variation wrapper class.
@@ -91,6 +95,92 @@ public:
 
     /** @return the current magnetic dip in radians. */
     double get_magdip() const { return magdip; }
+
+    /**
+     * Build a grid of the magnetic variation at the given julian date
+     * and make all the sgGetMagVar() functions interpolate in it for
+     * positions at that date. This replaces any previous grid. See
+     * SGMagVarGrid for the parameters. update() still evaluates the
+     * model, as the grid has no dip.
+     * @return the new grid
+     */
+    static std::shared_ptr<const SGMagVarGrid>
+    buildGrid( double jd, double resolutionDeg = 1.0,
+               double minAltM = -1000.0, double maxAltM = 15000.0,
+               int altLevels = 4, double maxErrorDeg = 0.05 );
+
+    /** Stop sgGetMagVar() from using the grid. */
+    static void clearGrid();
+
+    /** @return the grid sgGetMagVar() uses, if any. */
+    static std::shared_ptr<const SGMagVarGrid> getGrid();
+};
+
+
+/**
+ * The magnetic variation at one date on a regular grid of latitude,
+ * longitude and altitude, for bulk lookups that do not need the full
+ * model for every position.
+ *
+ * Lookups interpolate trilinearly between the 8 nodes around the
+ * position. The error of that is checked against calc_magvar() when
+ * building the grid, at the centre of every cell and the middles of its
+ * faces and edges. Cells where it is larger than 80% of the given bound
+ * there, such as the ones near the magnetic poles, are marked so that
+ * lookups in them fail and the caller can fall back to the model. The
+ * margin covers the error between the checked points, which is at most
+ * about 10% larger.
+ */
+class SGMagVarGrid {
+public:
+    /**
+     * Evaluate the model on the grid.
+     * @param jd julian date
+     * @param resolutionDeg the largest spacing of the nodes in latitude
+     * and longitude, in degrees
+     * @param minAltM lowest altitude of the grid in meters
+     * @param maxAltM highest altitude of the grid in meters
+     * @param altLevels number of altitudes, at least 2
+     * @param maxErrorDeg the largest interpolation error a cell may have
+     */
+    SGMagVarGrid( double jd, double resolutionDeg = 1.0,
+                  double minAltM = -1000.0, double maxAltM = 15000.0,
+                  int altLevels = 4, double maxErrorDeg = 0.05 );
+
+    /** @return the julian day number the grid was built for. */
+    long getDate() const { return date; }
+
+    /**
+     * Interpolate the magvar at pos.
+     * @param magvar receives the magvar in radians
+     * @return false if pos is outside the altitudes of the grid or in a
+     * cell that failed the error check.
+     */
+    bool lookup( const SGGeod& pos, double& magvar ) const;
+
+    /** @return the largest error at the checked points of the cells
+     * that are used, in degrees. */
+    double getMaxErrorDeg() const { return maxError; }
+
+    /** @return the number of cells lookups fail in. */
+    size_t getNumFailedCells() const { return numFailed; }
+
+    /** @return the number of cells. */
+    size_t getNumCells() const { return failed.size(); }
+
+private:
+    size_t nodeIndex( int lat, int lon, int alt ) const
+    { return (size_t(alt) * numLat + lat) * numLon + lon; }
+
+    double interpolate( double y, double x, double z, size_t& cell ) const;
+
+    long date;
+    int numLat, numLon, numAlt;     // nodes, the last longitude wraps
+    double latStep, lonStep, altStep, minAlt;
+    double maxError;
+    size_t numFailed;
+    std::vector<float> values;      // radians
+    std::vector<bool> failed;
 };
 
 
@@ -104,8 +194,23 @@ public:
 double sgGetMagVar( double lon, double lat, double alt_m, double jd );
 
 /**
- * overload version of the above to take a SGGeod
+ * overload version of the above to take a SGGeod. If SGMagVar::buildGrid()
+ * was called for the day of jd, both interpolate in the grid where they
+ * can.
  */
 double sgGetMagVar( const SGGeod& pos, double jd );
 
+/**
+ * \relates SGMagVar
+ * Lookup the magvar for count positions at the same date. This shares
+ * the work that only depends on the date and evaluates the model for
+ * several positions at a time, so it is a lot cheaper than calling
+ * sgGetMagVar() for each of them. Uses the grid as sgGetMagVar() does.
+ * @param pos array of count positions
+ * @param count number of positions
+ * @param jd julian date
+ * @param magvar receives count magvars in radians
+ */
+void sgGetMagVar( const SGGeod* pos, size_t count, double jd, double* magvar );
+
 #endif // _MAGVAR_HXX
@@ -0,0 +1,106 @@
+// Checks calc_magvar() against the WMM2015 test values, and the batch
+// variants against it over a grid of positions, and compares the time
+// both take for the grid.
+
+#ifdef HAVE_CONFIG_H
+#  include <simgear_config.h>
+#endif
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <simgear/constants.h>
+#include <simgear/math/SGMath.hxx>
+#include <simgear/misc/test_macros.hxx>
+
+#include "coremag.hxx"
+#include "magvar.hxx"
+
+struct TestValue {
+    int yy, mm, dd;
+    double lat, lon, h;     // degrees, degrees, km
+    double decl;            // degrees
+};
+
+// From the WMM2015 report, 2015.0 and 2017.5
+static const TestValue testValues[] = {
+    { 15, 1, 1, 80, 0, 0, -3.85 },
+    { 15, 1, 1, 0, 120, 0, 0.57 },
+    { 15, 1, 1, -80, 240, 0, 69.81 },
+    { 17, 7, 2, 80, 0, 0, -2.75 },
+    { 17, 7, 2, 0, 120, 0, 0.32 },
+    { 17, 7, 2, -80, 240, 0, 69.58 },
+};
+
+int main(int argc, char* argv[])
+{
+    double field[6];
+    for (const TestValue& t : testValues) {
+        long date = yymmdd_to_julian_days(t.yy, t.mm, t.dd);
+        double var = calc_magvar(t.lat * SGD_DEGREES_TO_RADIANS,
+                                 t.lon * SGD_DEGREES_TO_RADIANS, t.h, date, field);
+        SG_VERIFY(std::fabs(var * SGD_RADIANS_TO_DEGREES - t.decl) < 0.01);
+    }
+
+    // A grid that includes both poles, with a size that does not fill the
+    // last block of the batch
+    const long date = yymmdd_to_julian_days(18, 3, 20);
+    std::vector<double> lat, lon, h;
+    for (int i = -90; i <= 90; i += 2) {
+        for (int j = -180; j < 180; j += 3) {
+            lat.push_back(i * SGD_DEGREES_TO_RADIANS);
+            lon.push_back(j * SGD_DEGREES_TO_RADIANS);
+            h.push_back((i + 90) * 0.1);
+        }
+    }
+    const size_t count = lat.size() - 1;
+    SG_VERIFY(count % 4 != 0);
+
+    std::vector<double> var(count + 1, 1000.0), batchField(6 * count);
+    calc_magvar_batch(&lat[0], &lon[0], &h[0], count, date, &var[0], &batchField[0]);
+    SG_CHECK_EQUAL(var[count], 1000.0);
+    for (size_t i = 0; i < count; ++i) {
+        double expected = calc_magvar(lat[i], lon[i], h[i], date, field);
+        SG_VERIFY(std::fabs(var[i] - expected) < 1e-9);
+        for (int k = 0; k < 6; ++k)
+            SG_VERIFY(std::fabs(batchField[6 * i + k] - field[k]) < 1e-6);
+    }
+
+    // Through SGGeod, and for another date
+    const double jd = yymmdd_to_julian_days(19, 11, 5);
+    std::vector<SGGeod> positions;
+    for (size_t i = 0; i < count; ++i)
+        positions.push_back(SGGeod::fromRadM(lon[i], lat[i], h[i] * 1000.0));
+    sgGetMagVar(&positions[0], count, jd, &var[0]);
+    for (size_t i = 0; i < count; ++i)
+        SG_VERIFY(std::fabs(var[i] - sgGetMagVar(positions[i], jd)) < 1e-9);
+    sgGetMagVar(&positions[0], 0, jd, &var[0]);
+
+    // Benchmark over a one degree grid
+    positions.clear();
+    for (int i = -90; i <= 90; ++i)
+        for (int j = -180; j < 180; ++j)
+            positions.push_back(SGGeod::fromDegM(j, i, 3000.0));
+    std::vector<double> single(positions.size()), batch(positions.size());
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < positions.size(); ++i)
+        single[i] = sgGetMagVar(positions[i], jd);
+    auto middle = std::chrono::steady_clock::now();
+    sgGetMagVar(&positions[0], positions.size(), jd, &batch[0]);
+    auto end = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < positions.size(); ++i)
+        SG_VERIFY(std::fabs(single[i] - batch[i]) < 1e-9);
+
+    std::cout << positions.size() << " positions: single "
+              << std::chrono::duration<double, std::milli>(middle - start).count()
+              << " ms, batch "
+              << std::chrono::duration<double, std::milli>(end - middle).count()
+              << " ms" << std::endl;
+
+    return EXIT_SUCCESS;
+}
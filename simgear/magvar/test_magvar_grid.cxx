@@ -0,0 +1,139 @@
+// Checks that sgGetMagVar() interpolates in the grid of SGMagVar::buildGrid()
+// within the error bound and falls back to the model everywhere else. With
+// --benchmark it checks a grid of three altitude layers at more positions and
+// reports how long building the grid and looking up in it take.
+
+#ifdef HAVE_CONFIG_H
+#  include <simgear_config.h>
+#endif
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <simgear/constants.h>
+#include <simgear/math/SGMath.hxx>
+#include <simgear/math/sg_random.h>
+#include <simgear/misc/test_macros.hxx>
+
+#include "coremag.hxx"
+#include "magvar.hxx"
+
+static double modelMagVar(const SGGeod& pos, double jd)
+{
+    double field[6];
+    return calc_magvar(pos.getLatitudeRad(), pos.getLongitudeRad(),
+                       pos.getElevationM() / 1000.0, (long)jd, field);
+}
+
+static double angleDiffDeg(double a, double b)
+{
+    double d = std::fabs(a - b);
+    return std::min(d, SGD_2PI - d) * SGD_RADIANS_TO_DEGREES;
+}
+
+int main(int argc, char* argv[])
+{
+    const bool benchmark = argc > 1 && !strcmp(argv[1], "--benchmark");
+    const double jd = yymmdd_to_julian_days(18, 6, 1);
+    const double maxErrorDeg = 0.05;
+    // A single altitude layer keeps the plain test run short
+    const int altLevels = benchmark ? 4 : 2;
+    const int numPositions = benchmark ? 100000 : 10000;
+
+    auto start = std::chrono::steady_clock::now();
+    std::shared_ptr<const SGMagVarGrid> grid =
+        SGMagVar::buildGrid(jd, 1.0, -1000.0, 15000.0, altLevels, maxErrorDeg);
+    auto built = std::chrono::steady_clock::now();
+
+    SG_VERIFY(SGMagVar::getGrid() == grid);
+    SG_CHECK_EQUAL(grid->getDate(), (long)jd);
+    SG_CHECK_EQUAL(grid->getNumCells(),
+                   size_t(180 * 360 * (altLevels - 1)));
+    SG_VERIFY(grid->getMaxErrorDeg() <= maxErrorDeg);
+    // Only the cells near the magnetic poles fail, about 6% of them
+    SG_VERIFY(grid->getNumFailedCells() > 0);
+    SG_VERIFY(grid->getNumFailedCells() < grid->getNumCells() / 10);
+
+    // Random positions, anywhere on the grid and around it
+    mt seed;
+    mt_init(&seed, 4711);
+    std::vector<SGGeod> positions;
+    for (int i = 0; i < numPositions; ++i)
+        positions.push_back(SGGeod::fromDegM(mt_rand(&seed) * 720.0 - 360.0,
+                                             mt_rand(&seed) * 180.0 - 90.0,
+                                             mt_rand(&seed) * 20000.0 - 2000.0));
+
+    std::vector<SGGeod> interpolated;
+    double maxError = 0.0;
+    for (const SGGeod& pos : positions) {
+        double exact = modelMagVar(pos, jd);
+        double magvar = sgGetMagVar(pos, jd);
+        SG_CHECK_EQUAL(sgGetMagVar(pos.getLongitudeRad(), pos.getLatitudeRad(),
+                                   pos.getElevationM(), jd), magvar);
+        double gridded;
+        if (grid->lookup(pos, gridded)) {
+            SG_CHECK_EQUAL(magvar, gridded);
+            maxError = std::max(maxError, angleDiffDeg(magvar, exact));
+            interpolated.push_back(pos);
+        } else {
+            SG_CHECK_EQUAL(magvar, exact);
+            SG_VERIFY(pos.getElevationM() < -1000.0 || pos.getElevationM() > 15000.0
+                      || std::fabs(pos.getLatitudeDeg()) > 50.0);
+        }
+    }
+    // The bound holds anywhere in the cells that are used
+    SG_VERIFY(interpolated.size() > positions.size() / 2);
+    SG_VERIFY(maxError <= maxErrorDeg);
+
+    // The batch lookup uses the grid too, and the batch model elsewhere
+    std::vector<double> batch(positions.size());
+    sgGetMagVar(&positions[0], positions.size(), jd, &batch[0]);
+    for (size_t i = 0; i < positions.size(); ++i)
+        SG_VERIFY(std::fabs(batch[i] - sgGetMagVar(positions[i], jd)) < 1e-9);
+
+    // Other days, and no grid, use the model
+    const SGGeod pos = SGGeod::fromDegM(8.5, 47.5, 500.0);
+    SG_CHECK_EQUAL(sgGetMagVar(pos, jd + 1), modelMagVar(pos, jd + 1));
+    SG_VERIFY(sgGetMagVar(pos, jd) != modelMagVar(pos, jd));
+    SG_VERIFY(angleDiffDeg(sgGetMagVar(pos, jd), modelMagVar(pos, jd)) < maxErrorDeg);
+
+    if (!benchmark) {
+        SGMagVar::clearGrid();
+        SG_VERIFY(!SGMagVar::getGrid());
+        SG_CHECK_EQUAL(sgGetMagVar(pos, jd), modelMagVar(pos, jd));
+        return EXIT_SUCCESS;
+    }
+
+    // Lookup throughput against the model, where the grid is used
+    std::vector<double> magvar(interpolated.size());
+    auto gridStart = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < interpolated.size(); ++i)
+        magvar[i] = sgGetMagVar(interpolated[i], jd);
+    auto gridEnd = std::chrono::steady_clock::now();
+
+    SGMagVar::clearGrid();
+    SG_VERIFY(!SGMagVar::getGrid());
+    SG_CHECK_EQUAL(sgGetMagVar(pos, jd), modelMagVar(pos, jd));
+
+    auto modelStart = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < interpolated.size(); ++i)
+        magvar[i] = sgGetMagVar(interpolated[i], jd);
+    auto modelEnd = std::chrono::steady_clock::now();
+
+    std::cout << "grid of " << grid->getNumCells() << " cells built in "
+              << std::chrono::duration<double, std::milli>(built - start).count()
+              << " ms, " << grid->getNumFailedCells() << " failed, max error "
+              << grid->getMaxErrorDeg() << " deg at the checked points, " << maxError
+              << " deg at random positions" << std::endl;
+    std::cout << interpolated.size() << " lookups: grid "
+              << std::chrono::duration<double, std::milli>(gridEnd - gridStart).count()
+              << " ms, model "
+              << std::chrono::duration<double, std::milli>(modelEnd - modelStart).count()
+              << " ms" << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -138,6 +138,333 @@ SGGeodesy::SGGeodToCart(const SGGeod& geod, SGVec3<double>& cart)
   cart(2) = (h+n-e2*n)*sphi;
 }
 
+////////////////////////////////////////////////////////////////////////
+//
+// Batch conversions
+//
+// The points are converted a few at a time in the lanes of the widest
+// double precision vector the compiler targets, with polynomial
+// approximations of cbrt, atan2, sin and cos in place of the library
+// calls.  Points outside the range the approximations are made for, and
+// the special case at the geocenter, are handed to the single point
+// versions.
+//
+
+namespace {
+
+#if defined(__AVX__)
+
+struct DVec {
+  enum { Size = 4 };
+  __m256d v;
+  DVec() {}
+  DVec(__m256d x) : v(x) {}
+  DVec(double d) : v(_mm256_set1_pd(d)) {}
+  static DVec load(const double* p) { return _mm256_loadu_pd(p); }
+  void store(double* p) const { _mm256_storeu_pd(p, v); }
+};
+
+struct DMask {
+  __m256d m;
+  DMask(__m256d x) : m(x) {}
+  int bits() const { return _mm256_movemask_pd(m); }
+};
+
+inline DVec operator+(DVec a, DVec b) { return _mm256_add_pd(a.v, b.v); }
+inline DVec operator-(DVec a, DVec b) { return _mm256_sub_pd(a.v, b.v); }
+inline DVec operator*(DVec a, DVec b) { return _mm256_mul_pd(a.v, b.v); }
+inline DVec operator/(DVec a, DVec b) { return _mm256_div_pd(a.v, b.v); }
+inline DVec sqrt(DVec a) { return _mm256_sqrt_pd(a.v); }
+inline DVec min(DVec a, DVec b) { return _mm256_min_pd(a.v, b.v); }
+inline DVec max(DVec a, DVec b) { return _mm256_max_pd(a.v, b.v); }
+inline DVec abs(DVec a)
+{ return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a.v); }
+inline DMask operator<(DVec a, DVec b)
+{ return _mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ); }
+inline DMask operator<=(DVec a, DVec b)
+{ return _mm256_cmp_pd(a.v, b.v, _CMP_LE_OQ); }
+inline DMask operator&(DMask a, DMask b) { return _mm256_and_pd(a.m, b.m); }
+inline DMask operator|(DMask a, DMask b) { return _mm256_or_pd(a.m, b.m); }
+inline DMask operator~(DMask a)
+{ return _mm256_xor_pd(a.m, _mm256_castsi256_pd(_mm256_set1_epi32(-1))); }
+inline DVec select(DMask m, DVec a, DVec b)
+{ return _mm256_blendv_pd(b.v, a.v, m.m); }
+
+#elif defined(__SSE2__)
+
+struct DVec {
+  enum { Size = 2 };
+  __m128d v;
+  DVec() {}
+  DVec(__m128d x) : v(x) {}
+  DVec(double d) : v(_mm_set1_pd(d)) {}
+  static DVec load(const double* p) { return _mm_loadu_pd(p); }
+  void store(double* p) const { _mm_storeu_pd(p, v); }
+};
+
+struct DMask {
+  __m128d m;
+  DMask(__m128d x) : m(x) {}
+  int bits() const { return _mm_movemask_pd(m); }
+};
+
+inline DVec operator+(DVec a, DVec b) { return _mm_add_pd(a.v, b.v); }
+inline DVec operator-(DVec a, DVec b) { return _mm_sub_pd(a.v, b.v); }
+inline DVec operator*(DVec a, DVec b) { return _mm_mul_pd(a.v, b.v); }
+inline DVec operator/(DVec a, DVec b) { return _mm_div_pd(a.v, b.v); }
+inline DVec sqrt(DVec a) { return _mm_sqrt_pd(a.v); }
+inline DVec min(DVec a, DVec b) { return _mm_min_pd(a.v, b.v); }
+inline DVec max(DVec a, DVec b) { return _mm_max_pd(a.v, b.v); }
+inline DVec abs(DVec a) { return _mm_andnot_pd(_mm_set1_pd(-0.0), a.v); }
+inline DMask operator<(DVec a, DVec b) { return _mm_cmplt_pd(a.v, b.v); }
+inline DMask operator<=(DVec a, DVec b) { return _mm_cmple_pd(a.v, b.v); }
+inline DMask operator&(DMask a, DMask b) { return _mm_and_pd(a.m, b.m); }
+inline DMask operator|(DMask a, DMask b) { return _mm_or_pd(a.m, b.m); }
+inline DMask operator~(DMask a)
+{ return _mm_xor_pd(a.m, _mm_castsi128_pd(_mm_set1_epi32(-1))); }
+inline DVec select(DMask m, DVec a, DVec b)
+{ return _mm_or_pd(_mm_and_pd(m.m, a.v), _mm_andnot_pd(m.m, b.v)); }
+
+#else
+
+struct DVec {
+  enum { Size = 1 };
+  double v;
+  DVec() {}
+  DVec(double d) : v(d) {}
+  static DVec load(const double* p) { return *p; }
+  void store(double* p) const { *p = v; }
+};
+
+struct DMask {
+  bool m;
+  DMask(bool x) : m(x) {}
+  int bits() const { return m; }
+};
+
+inline DVec operator+(DVec a, DVec b) { return a.v + b.v; }
+inline DVec operator-(DVec a, DVec b) { return a.v - b.v; }
+inline DVec operator*(DVec a, DVec b) { return a.v * b.v; }
+inline DVec operator/(DVec a, DVec b) { return a.v / b.v; }
+inline DVec sqrt(DVec a) { return std::sqrt(a.v); }
+inline DVec min(DVec a, DVec b) { return a.v < b.v ? a.v : b.v; }
+inline DVec max(DVec a, DVec b) { return a.v < b.v ? b.v : a.v; }
+inline DVec abs(DVec a) { return std::fabs(a.v); }
+inline DMask operator<(DVec a, DVec b) { return a.v < b.v; }
+inline DMask operator<=(DVec a, DVec b) { return a.v <= b.v; }
+inline DMask operator&(DMask a, DMask b) { return a.m && b.m; }
+inline DMask operator|(DMask a, DMask b) { return a.m || b.m; }
+inline DMask operator~(DMask a) { return !a.m; }
+inline DVec select(DMask m, DVec a, DVec b) { return m.m ? a : b; }
+
+#endif
+
+inline DVec operator-(DVec a) { return DVec(0.0) - a; }
+
+template<size_t N>
+inline DVec polynomial(DVec x, const double (&c)[N])
+{
+  DVec r = c[0];
+  for (size_t i = 1; i < N; ++i)
+    r = r*x + c[i];
+  return r;
+}
+
+// Rounds to the nearest integer, for |x| < 2^51
+inline DVec round(DVec x)
+{
+  const DVec magic = 6755399441055744.0; // 1.5*2^52
+  return (x + magic) - magic;
+}
+
+// The cube root for 1 <= x <= 2, which is all the geodetic conversion
+// needs outside the earth's core: a quadratic first guess, good to
+// 0.1%, and two steps of Halley's iteration, each of which triples the
+// correct digits.
+inline DVec cbrt_1_2(DVec x)
+{
+  static const double guess[] = {
+    -0.05836172077613474, 0.43356059182365925, 0.6256872265641462
+  };
+  DVec t = polynomial(x, guess);
+  for (int i = 0; i < 2; ++i) {
+    DVec t3 = t*t*t;
+    t = t*(t3 + x + x)/(t3 + t3 + x);
+  }
+  return t;
+}
+
+// The arcus tangent for 0 <= x <= 1, the rational approximation from
+// the Cephes library.
+inline DVec atan_0_1(DVec x)
+{
+  static const double P[] = {
+    -8.750608600031904122785E-1, -1.615753718733365076637E1,
+    -7.500855792314704667340E1, -1.228866684490136173410E2,
+    -6.485021904942025371773E1
+  };
+  static const double Q[] = {
+    1.0, 2.485846490142306297962E1, 1.650270098316988542046E2,
+    4.328810604912902668951E2, 4.853903996359136964868E2,
+    1.945506571482613964425E2
+  };
+  // Above tan(pi/8) use atan(x) = pi/4 + atan((x - 1)/(x + 1))
+  DMask upper = DVec(0.66) < x;
+  x = select(upper, (x - 1.0)/(x + 1.0), x);
+  DVec z = x*x;
+  z = x + x*z*polynomial(z, P)/polynomial(z, Q);
+  return select(upper, z + (0.25*SGMiscd::pi() + 0.5*6.123233995736765886130E-17), z);
+}
+
+inline DVec atan2(DVec y, DVec x)
+{
+  DVec ay = abs(y);
+  DVec ax = abs(x);
+  DVec num = min(ay, ax);
+  DVec den = max(ay, ax);
+  DMask zero = den <= 0.0;
+  DVec r = atan_0_1(num/select(zero, 1.0, den));
+  r = select(ax < ay, 0.5*SGMiscd::pi() - r, r);
+  r = select(x < 0.0, SGMiscd::pi() - r, r);
+  return select(y < 0.0, -r, r);
+}
+
+// Sine and cosine with the Cephes polynomials on [-pi/4, pi/4], after
+// taking out the multiple of pi/2 in three steps, for |x| < 2^51.
+inline void sincos(DVec x, DVec& s, DVec& c)
+{
+  static const double S[] = {
+    1.58962301576546568060E-10, -2.50507477628578072866E-8,
+    2.75573136213857245213E-6, -1.98412698295895385996E-4,
+    8.33333333332211858878E-3, -1.66666666666666307295E-1
+  };
+  static const double C[] = {
+    -1.13585365213876817300E-11, 2.08757008419747316778E-9,
+    -2.75573141792967388112E-7, 2.48015872888517045348E-5,
+    -1.38888888888730564116E-3, 4.16666666666665929218E-2
+  };
+  DVec q = round(x*(2/SGMiscd::pi()));
+  DVec z = ((x - q*1.57079625129699707031) - q*7.54978941586159635335E-8)
+    - q*5.39030285815811905290E-15;
+  DVec zz = z*z;
+  DVec sz = z + z*zz*polynomial(zz, S);
+  DVec cz = (1.0 - 0.5*zz) + zz*zz*polynomial(zz, C);
+
+  // The quadrant q modulo 4, as one of -2, -1, 0, 1, 2
+  DVec h = q - 4.0*round(0.25*q);
+  DVec ah = abs(h);
+  DMask odd = (0.5 <= ah) & (ah <= 1.5);
+  DMask sinNeg = (h <= -1.0) | (1.5 <= h);
+  DMask cosNeg = (0.5 <= h) | (h <= -1.5);
+  s = select(odd, cz, sz);
+  c = select(odd, sz, cz);
+  s = select(sinNeg, -s, s);
+  c = select(cosNeg, -c, c);
+}
+
+} // anonymous namespace
+
+void
+SGGeodesy::SGCartToGeod(const SGVec3<double>* cart, SGGeod* geod,
+                        size_t count)
+{
+  const size_t N = DVec::Size;
+  size_t i = 0;
+  for (; i + N <= count; i += N) {
+    double x[N], y[N], z[N];
+    for (size_t j = 0; j < N; ++j) {
+      x[j] = cart[i + j](0);
+      y[j] = cart[i + j](1);
+      z[j] = cart[i + j](2);
+    }
+    DVec X = DVec::load(x), Y = DVec::load(y), Z = DVec::load(z);
+
+    // The same steps as the single point version
+    DVec XXpYY = X*X + Y*Y;
+    DMask fallback = XXpYY + Z*Z < 25.0;
+    DVec sqrtXXpYY = sqrt(XXpYY);
+    DVec p = XXpYY*ra2;
+    DVec q = Z*Z*((1 - e2)*ra2);
+    DVec r = (p + q - e4)*(1/6.0);
+    DVec s = e4*p*q/(4.0*r*r*r);
+    s = select((-2.0 <= s) & (s <= 0.0), 0.0, s);
+    DVec arg = 1.0 + s + sqrt(s*(2.0 + s));
+    // This also catches NaNs
+    fallback = fallback | ~((1.0 <= arg) & (arg <= 2.0));
+    DVec t = cbrt_1_2(arg);
+    DVec u = r*(1.0 + t + 1.0/t);
+    DVec v = sqrt(u*u + e4*q);
+    DVec w = e2*(u + v - q)/(v + v);
+    DVec k = sqrt(u + v + w*w) - w;
+    DVec D = k*sqrtXXpYY/(k + e2);
+    DVec sqrtDDpZZ = sqrt(D*D + Z*Z);
+    // atan2(Y, X) is what 2*atan2(Y, X + sqrtXXpYY) computes, without
+    // the cancellation on the negative x axis
+    DVec lon = atan2(Y, X);
+    DVec lat = 2.0*atan2(Z, D + sqrtDDpZZ);
+    DVec elev = (k + e2 - 1.0)*sqrtDDpZZ/k;
+
+    double lons[N], lats[N], elevs[N];
+    lon.store(lons);
+    lat.store(lats);
+    elev.store(elevs);
+    int bits = fallback.bits();
+    for (size_t j = 0; j < N; ++j) {
+      if (bits & (1 << j)) {
+        SGCartToGeod(cart[i + j], geod[i + j]);
+      } else {
+        geod[i + j].setLongitudeRad(lons[j]);
+        geod[i + j].setLatitudeRad(lats[j]);
+        geod[i + j].setElevationM(elevs[j]);
+      }
+    }
+  }
+  for (; i < count; ++i)
+    SGCartToGeod(cart[i], geod[i]);
+}
+
+void
+SGGeodesy::SGGeodToCart(const SGGeod* geod, SGVec3<double>* cart,
+                        size_t count)
+{
+  const size_t N = DVec::Size;
+  size_t i = 0;
+  for (; i + N <= count; i += N) {
+    double lons[N], lats[N], elevs[N];
+    for (size_t j = 0; j < N; ++j) {
+      lons[j] = geod[i + j].getLongitudeRad();
+      lats[j] = geod[i + j].getLatitudeRad();
+      elevs[j] = geod[i + j].getElevationM();
+    }
+    DVec lambda = DVec::load(lons), phi = DVec::load(lats);
+    DVec h = DVec::load(elevs);
+    // Angles beyond a few turns lose accuracy in the range reduction
+    DMask fallback = ~((abs(lambda) <= 1e5) & (abs(phi) <= 1e5));
+
+    DVec sphi, cphi, slambda, clambda;
+    sincos(phi, sphi, cphi);
+    sincos(lambda, slambda, clambda);
+    DVec n = a/sqrt(1.0 - e2*sphi*sphi);
+    DVec x = (h + n)*cphi*clambda;
+    DVec y = (h + n)*cphi*slambda;
+    DVec z = (h + n - e2*n)*sphi;
+
+    double xs[N], ys[N], zs[N];
+    x.store(xs);
+    y.store(ys);
+    z.store(zs);
+    int bits = fallback.bits();
+    for (size_t j = 0; j < N; ++j) {
+      if (bits & (1 << j))
+        SGGeodToCart(geod[i + j], cart[i + j]);
+      else
+        cart[i + j] = SGVec3<double>(xs[j], ys[j], zs[j]);
+    }
+  }
+  for (; i < count; ++i)
+    SGGeodToCart(geod[i], cart[i]);
+}
+
 double
 SGGeodesy::SGGeodToSeaLevelRadius(const SGGeod& geod)
 {
@@ -500,6 +827,102 @@ SGGeodesy::distanceNm(const SGGeod& from, const SGGeod& to)
   return distanceM(from, to) * SG_METER_TO_NM;
 }
 
+bool
+SGGeodesy::inverse(const SGGeod& from, const double* lonRad,
+                   const double* latRad, size_t count,
+                   double* course1Deg, double* distanceM)
+{
+  double lat1 = from.getLatitudeDeg(), lon1 = from.getLongitudeDeg();
+  bool ok = true;
+  for (size_t i = 0; i < count; ++i) {
+    SGGeod to = SGGeod::fromRad(lonRad[i], latRad[i]);
+    double course1, course2, distance;
+    if (_geo_inverse_wgs_84(lat1, lon1, to.getLatitudeDeg(),
+                            to.getLongitudeDeg(),
+                            &course1, &course2, &distance) != 0) {
+      course1 = distance = SGLimitsd::quiet_NaN();
+      ok = false;
+    }
+    if (course1Deg)
+      course1Deg[i] = course1;
+    if (distanceM)
+      distanceM[i] = distance;
+  }
+  return ok;
+}
+
+// The spherical pre-filter: with the geodetic latitudes and longitudes
+// taken to a sphere of radius EQURAD, the local scale of the map back to
+// the ellipsoid lies between the smallest meridional radius of curvature
+// and the largest transverse one, a(1 - e^2) and a/sqrt(1 - e^2), over
+// a.  So a great circle distance a*sigma on that sphere bounds the
+// geodesic distance s:
+//
+//   (1 - e^2)*a*sigma <= s <= a*sigma/sqrt(1 - e^2)
+//
+// and no position with (1 - e^2)*a*sigma > range can be in range.  The
+// test is made on the haversine of sigma, which needs no inverse
+// trigonometric functions.
+size_t
+SGGeodesy::withinRangeM(const SGGeod& center, double rangeM,
+                        const double* lonRad, const double* latRad,
+                        size_t count, size_t* indices, double* distanceM)
+{
+  double lon0 = center.getLongitudeRad(), lat0 = center.getLatitudeRad();
+  double lat0Deg = center.getLatitudeDeg(), lon0Deg = center.getLongitudeDeg();
+  double cosLat0 = cos(lat0);
+
+  // Some slack for the rounding and the polynomial approximations
+  double maxSigma = rangeM/(a*(1 - e2))*(1 + 1e-9) + 1e-12;
+  double maxHav = 2;
+  if (maxSigma < SGMiscd::pi()) {
+    double sHalf = sin(0.5*maxSigma);
+    maxHav = sHalf*sHalf*(1 + 1e-9) + 1e-15;
+  }
+
+  size_t found = 0;
+  auto check = [&](size_t i) {
+    SGGeod to = SGGeod::fromRad(lonRad[i], latRad[i]);
+    double course1, course2, distance;
+    if (_geo_inverse_wgs_84(lat0Deg, lon0Deg, to.getLatitudeDeg(),
+                            to.getLongitudeDeg(),
+                            &course1, &course2, &distance) != 0) {
+      // Nearly antipodal, judge by the spherical distance
+      double sHalfDLat = sin(0.5*(latRad[i] - lat0));
+      double sHalfDLon = sin(0.5*(lonRad[i] - lon0));
+      double hav = sHalfDLat*sHalfDLat
+        + cosLat0*cos(latRad[i])*sHalfDLon*sHalfDLon;
+      distance = 2*a*asin(SGMiscd::min(1.0, sqrt(hav)));
+    }
+    if (distance <= rangeM) {
+      indices[found] = i;
+      if (distanceM)
+        distanceM[found] = distance;
+      ++found;
+    }
+  };
+
+  const size_t N = DVec::Size;
+  size_t i = 0;
+  for (; i + N <= count; i += N) {
+    DVec lon = DVec::load(lonRad + i), lat = DVec::load(latRad + i);
+    DVec sLat, cLat, sHalfDLat, cHalfDLat, sHalfDLon, cHalfDLon;
+    sincos(lat, sLat, cLat);
+    sincos(0.5*(lat - lat0), sHalfDLat, cHalfDLat);
+    sincos(0.5*(lon - lon0), sHalfDLon, cHalfDLon);
+    DVec hav = sHalfDLat*sHalfDLat + cosLat0*cLat*sHalfDLon*sHalfDLon;
+    // Out of range, NaNs and angles beyond what sincos handles go on
+    DMask pass = ~(DVec(maxHav) < hav) | ~((abs(lon) <= 1e5) & (abs(lat) <= 1e5));
+    int bits = pass.bits();
+    for (size_t j = 0; bits; ++j, bits >>= 1)
+      if (bits & 1)
+        check(i + j);
+  }
+  for (; i < count; ++i)
+    check(i);
+  return found;
+}
+
 /// Geocentric routines
 
 void
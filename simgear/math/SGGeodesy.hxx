@@ -18,6 +18,8 @@
 #ifndef SGGeodesy_H
 #define SGGeodesy_H
 
+#include <cstddef>
+
 class SGGeodesy {
 public:
   // Hard numbers from the WGS84 standard.
@@ -34,6 +36,15 @@ public:
   /// Takes a geodetic coordinate data and returns the cartesian
   /// coordinates.
   static void SGGeodToCart(const SGGeod& geod, SGVec3<double>& cart);
+
+  /// Batch versions of the above, converting count points at once.
+  /// They give the same results as the single point versions to well
+  /// below a millimetre, several times faster, and are meant for the
+  /// loops over whole tiles or traffic lists.
+  static void SGCartToGeod(const SGVec3<double>* cart, SGGeod* geod,
+                           size_t count);
+  static void SGGeodToCart(const SGGeod* geod, SGVec3<double>* cart,
+                           size_t count);
   
   /// Takes a geodetic coordinate data and returns the sea level radius.
   static double SGGeodToSeaLevelRadius(const SGGeod& geod);
@@ -61,6 +72,27 @@ public:
   static double courseDeg(const SGGeod& from, const SGGeod& to);
   static double distanceM(const SGGeod& from, const SGGeod& to);
   static double distanceNm(const SGGeod& from, const SGGeod& to);
+
+  /// One to many version of inverse(), for count positions given as
+  /// arrays of longitudes and latitudes in radians.  Writes the initial
+  /// courses in degrees and the distances in metres, either may be null.
+  /// Returns false if the computation failed for any of the positions,
+  /// their entries are set to NaN.
+  static bool inverse(const SGGeod& from, const double* lonRad,
+                      const double* latRad, size_t count,
+                      double* course1Deg, double* distanceM);
+
+  /// Finds the positions, given as above, within rangeM of center.
+  /// A spherical distance, with bounds on its error that hold all over
+  /// the ellipsoid, rules out most of them a few at a time; only the
+  /// remaining ones get the exact ellipsoidal distance.  Writes the
+  /// indices of the positions in range, in increasing order, and their
+  /// distances in metres, if distanceM is not null, and returns their
+  /// number.  Both outputs need room for count entries.
+  static size_t withinRangeM(const SGGeod& center, double rangeM,
+                             const double* lonRad, const double* latRad,
+                             size_t count, size_t* indices,
+                             double* distanceM);
     
   // Geocentric course/distance computation
   static void advanceRadM(const SGGeoc& geoc, double course, double distance,
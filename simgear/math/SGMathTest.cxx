@@ -21,8 +21,11 @@
 
 #include <simgear/misc/test_macros.hxx>
 
+#include <chrono>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <vector>
 
 #include "SGMath.hxx"
 #include "SGRect.hxx"
@@ -274,6 +277,135 @@ MatrixTest(void)
   return true;
 }
 
+// Compare the vector and matrix operations, whichever SIMD code they
+// are compiled to, against plain scalar arithmetic on random values.
+template<typename T>
+bool
+SimdTest(void)
+{
+  T eps = 100*SGLimits<T>::epsilon();
+  for (int n = 0; n < 1000; ++n) {
+    SGVec3<T> a(sg_random() - 0.5, sg_random() - 0.5, sg_random() - 0.5);
+    SGVec3<T> b(sg_random() - 0.5, sg_random() - 0.5, sg_random() - 0.5);
+    SGVec4<T> c(sg_random() - 0.5, sg_random() - 0.5, sg_random() - 0.5, sg_random() - 0.5);
+    SGMatrix<T> m1, m2;
+    for (unsigned i = 0; i < 4; ++i)
+      for (unsigned j = 0; j < 4; ++j) {
+        m1(i,j) = sg_random() - 0.5;
+        m2(i,j) = sg_random() - 0.5;
+      }
+
+    if (eps < fabs(dot(a, b) - (a(0)*b(0) + a(1)*b(1) + a(2)*b(2))))
+      { lineno = __LINE__; return false; }
+    if (eps < fabs(dot(c, c) - (c(0)*c(0) + c(1)*c(1) + c(2)*c(2) + c(3)*c(3))))
+      { lineno = __LINE__; return false; }
+    if (eps < fabs(length(a) - sqrt(a(0)*a(0) + a(1)*a(1) + a(2)*a(2))))
+      { lineno = __LINE__; return false; }
+    // A 3-element vector must not pick up a fourth one on the way
+    SGVec3<T> s = a + SGVec3<T>(1, 1, 1);
+    if (eps < fabs(dot(s, s) - ((a(0)+1)*(a(0)+1) + (a(1)+1)*(a(1)+1) + (a(2)+1)*(a(2)+1))))
+      { lineno = __LINE__; return false; }
+    if (!equivalent(cross(a, b), SGVec3<T>(a(1)*b(2) - a(2)*b(1),
+                                           a(2)*b(0) - a(0)*b(2),
+                                           a(0)*b(1) - a(1)*b(0)), eps, eps))
+      { lineno = __LINE__; return false; }
+    if (!equivalent(min(a, b), SGVec3<T>(std::min(a(0), b(0)), std::min(a(1), b(1)),
+                                         std::min(a(2), b(2)))))
+      { lineno = __LINE__; return false; }
+    if (!equivalent(max(a, b), SGVec3<T>(std::max(a(0), b(0)), std::max(a(1), b(1)),
+                                         std::max(a(2), b(2)))))
+      { lineno = __LINE__; return false; }
+    simd4_t<T,3> q = a.simd3() / b.simd3();
+    for (unsigned i = 0; i < 3; ++i)
+      if (eps*std::max(T(1), std::abs(q[i])) < std::abs(q[i] - a(i)/b(i)))
+        { lineno = __LINE__; return false; }
+
+    SGVec3<T> pt = m1.xformPt(a), v = m1.xformVec(a);
+    SGVec4<T> mc = m1*c;
+    for (unsigned i = 0; i < 3; ++i) {
+      T r = m1(i,0)*a(0) + m1(i,1)*a(1) + m1(i,2)*a(2);
+      if (eps < fabs(v(i) - r) || eps < fabs(pt(i) - (r + m1(i,3))))
+        { lineno = __LINE__; return false; }
+    }
+    for (unsigned i = 0; i < 4; ++i) {
+      T r = m1(i,0)*c(0) + m1(i,1)*c(1) + m1(i,2)*c(2) + m1(i,3)*c(3);
+      if (eps < fabs(mc(i) - r))
+        { lineno = __LINE__; return false; }
+    }
+    if (eps < fabs(dot(pt, pt) - (pt(0)*pt(0) + pt(1)*pt(1) + pt(2)*pt(2))))
+      { lineno = __LINE__; return false; }
+
+    SGMatrix<T> t;
+    t.simd4x4() = simd4x4::transpose(m1.simd4x4());
+    for (unsigned i = 0; i < 4; ++i)
+      for (unsigned j = 0; j < 4; ++j)
+        if (t(i,j) != m1(j,i))
+          { lineno = __LINE__; return false; }
+
+    SGMatrix<T> affine = m1;
+    affine(3,0) = affine(3,1) = affine(3,2) = 0;
+    affine(3,3) = 1;
+    SGMatrix<T> post = affine, pre = affine;
+    post.postMultTranslate(a);
+    pre.preMultTranslate(a);
+    if (!equivalent(post.xformPt(b), affine.xformPt(a + b), eps, eps))
+      { lineno = __LINE__; return false; }
+    if (!equivalent(pre.xformPt(b), affine.xformPt(b) + a, eps, eps))
+      { lineno = __LINE__; return false; }
+  }
+
+  return true;
+}
+
+// Time the double precision operations the cartesian WGS84 code is made of;
+// run SGMathTest --benchmark to see them
+void
+MathBenchmark(void)
+{
+#if defined(ENABLE_SIMD_CODE) && defined(__AVX__)
+  const char* path = "AVX";
+#elif defined(ENABLE_SIMD_CODE) && defined(__SSE2__)
+  const char* path = "SSE2";
+#else
+  const char* path = "scalar";
+#endif
+  const int count = 1000000;
+  std::vector<SGVec3d> points(1024);
+  for (auto& p : points)
+    p = SGVec3d::fromGeod(SGGeod::fromDegM(360*sg_random() - 180, 180*sg_random() - 90, 0));
+  SGMatrixd m = SGMatrixd::unit();
+  m.postMultRotate(SGQuatd::fromLonLatDeg(8.5, 47.5));
+  m.postMultTranslate(SGVec3d(100, 200, 300));
+
+  auto start = std::chrono::steady_clock::now();
+  SGVec3d sum(0, 0, 0);
+  for (int i = 0; i < count; ++i)
+    sum += m.xformPt(points[i & 1023]);
+  auto middle = std::chrono::steady_clock::now();
+  double d = 0;
+  for (int i = 0; i < count; ++i) {
+    const SGVec3d& p = points[i & 1023];
+    const SGVec3d& q = points[(i + 1) & 1023];
+    d += dot(p, q) + length(cross(p - q, q)) + distSqr(p, q);
+  }
+  auto middle2 = std::chrono::steady_clock::now();
+  SGMatrixd prod = SGMatrixd::unit();
+  for (int i = 0; i < count; ++i) {
+    prod = m*prod;
+    if ((i & 15) == 15)
+      prod = SGMatrixd::unit();
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  std::cout << path << ": " << count << " SGMatrixd::xformPt "
+            << std::chrono::duration<double, std::milli>(middle - start).count()
+            << " ms, SGVec3d dot/cross/length "
+            << std::chrono::duration<double, std::milli>(middle2 - middle).count()
+            << " ms, SGMatrixd products "
+            << std::chrono::duration<double, std::milli>(end - middle2).count()
+            << " ms (" << sum(0) + d + prod(0,0) << ")" << std::endl;
+}
+
 template<typename T>
 void doRectTest()
 {
@@ -357,9 +489,204 @@ GeodesyTest(void)
   return true;
 }
 
+bool
+GeodesyBatchTest(void)
+{
+  // The batch conversions must agree with the single point ones to well
+  // below a millimetre
+  const double epsM = 1e-4;
+  const double epsRad = epsM/SGGeodesy::POLRAD;
+
+  // An odd count to go through the remainder loop, and points the batch
+  // versions hand back to the single point ones: at the geocenter, deep
+  // inside the earth and with angles of many turns
+  const size_t count = 100003;
+  std::vector<SGGeod> geod(count);
+  for (size_t i = 0; i < count; ++i) {
+    double lon = SGMiscd::pi()*(2*sg_random() - 1);
+    double lat = 0.5*SGMiscd::pi()*(2*sg_random() - 1);
+    double elev = 20000*sg_random() - 1000;
+    if (i % 10 == 0)
+      elev = 4e7*sg_random();
+    if (i % 1000 == 1)
+      elev = -6e6*sg_random();
+    if (i % 1000 == 2)
+      lon *= 1e6;
+    geod[i] = SGGeod::fromRadM(lon, lat, elev);
+  }
+  geod[3] = SGGeod::fromRadM(0, 0, -SGGeodesy::EQURAD);
+  geod[4] = SGGeod::fromRadM(SGMiscd::pi(), 0, 0);
+  geod[5] = SGGeod::fromRadM(0, 0.5*SGMiscd::pi(), 100);
+
+  std::vector<SGVec3d> cart(count), batchCart(count);
+  std::vector<SGGeod> batchGeod(count);
+  for (size_t i = 0; i < count; ++i)
+    SGGeodesy::SGGeodToCart(geod[i], cart[i]);
+  SGGeodesy::SGGeodToCart(geod.data(), batchCart.data(), count);
+  SGGeodesy::SGCartToGeod(cart.data(), batchGeod.data(), count);
+
+  for (size_t i = 0; i < count; ++i) {
+    if (epsM < norm(cart[i] - batchCart[i]))
+      { lineno = __LINE__; return false; }
+
+    SGGeod single;
+    SGGeodesy::SGCartToGeod(cart[i], single);
+    double dlon = fabs(single.getLongitudeRad() - batchGeod[i].getLongitudeRad());
+    dlon = SGMiscd::min(dlon, fabs(dlon - 2*SGMiscd::pi()));
+    // Near the poles the longitude is meaningless
+    double radius = SGMiscd::max(1.0, norm(SGVec2d(cart[i](0), cart[i](1))));
+    if (epsM < dlon*radius ||
+        epsRad < fabs(single.getLatitudeRad() - batchGeod[i].getLatitudeRad()) ||
+        epsM < fabs(single.getElevationM() - batchGeod[i].getElevationM()))
+      { lineno = __LINE__; return false; }
+  }
+
+  // Throughput, for points on a tile
+  for (size_t i = 0; i < count; ++i)
+    geod[i] = SGGeod::fromDegM(8 + 0.25*sg_random(), 50 + 0.125*sg_random(),
+                               100 + 500*sg_random());
+  for (size_t i = 0; i < count; ++i)
+    SGGeodesy::SGGeodToCart(geod[i], cart[i]);
+
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point t0 = Clock::now();
+  for (size_t i = 0; i < count; ++i)
+    SGGeodesy::SGGeodToCart(geod[i], batchCart[i]);
+  Clock::time_point t1 = Clock::now();
+  SGGeodesy::SGGeodToCart(geod.data(), batchCart.data(), count);
+  Clock::time_point t2 = Clock::now();
+  for (size_t i = 0; i < count; ++i)
+    SGGeodesy::SGCartToGeod(cart[i], batchGeod[i]);
+  Clock::time_point t3 = Clock::now();
+  SGGeodesy::SGCartToGeod(cart.data(), batchGeod.data(), count);
+  Clock::time_point t4 = Clock::now();
+
+  typedef std::chrono::duration<double, std::milli> Ms;
+  std::cout << count << " points, single/batch: geod to cart "
+            << Ms(t1 - t0).count() << "/" << Ms(t2 - t1).count()
+            << " ms, cart to geod "
+            << Ms(t3 - t2).count() << "/" << Ms(t4 - t3).count()
+            << " ms" << std::endl;
+
+  return true;
+}
+
+bool
+GeodesyRangeTest(void)
+{
+  // A navaid set: 30k positions, mostly in a few dense regions
+  const size_t count = 30000;
+  std::vector<double> lon(count), lat(count);
+  for (size_t i = 0; i < count; ++i) {
+    if (i % 3 == 0) {
+      lon[i] = SGMiscd::pi()*(2*sg_random() - 1);
+      lat[i] = asin(2*sg_random() - 1);
+    } else {
+      double centerLon = (i % 3 == 1) ? -90 : 10;
+      lon[i] = SGMiscd::deg2rad(centerLon + 30*sg_random());
+      lat[i] = SGMiscd::deg2rad(35 + 20*sg_random());
+    }
+  }
+  lon[7] = lat[7] = 0;
+
+  // The spherical bounds the pre-filter relies on
+  double e2 = 1 - SGGeodesy::SQUASH*SGGeodesy::SQUASH;
+  for (size_t i = 0; i + 1 < count; i += 2) {
+    SGGeod p1 = SGGeod::fromRad(lon[i], lat[i]);
+    SGGeod p2 = SGGeod::fromRad(lon[i + 1], lat[i + 1]);
+    double course1, course2, distance;
+    if (!SGGeodesy::inverse(p1, p2, course1, course2, distance))
+      continue;
+    double sigma = SGGeodesy::distanceRad(SGGeoc::fromRadM(lon[i], lat[i], 1),
+                                          SGGeoc::fromRadM(lon[i + 1], lat[i + 1], 1));
+    if (distance < (1 - e2)*SGGeodesy::EQURAD*sigma - 1e-3 ||
+        SGGeodesy::EQURAD*sigma/sqrt(1 - e2) + 1e-3 < distance)
+      { lineno = __LINE__; return false; }
+  }
+
+  // The one to many inverse gives what the single one does
+  SGGeod center = SGGeod::fromDeg(-75, 40);
+  std::vector<double> course(count), distance(count);
+  bool inverseOk = SGGeodesy::inverse(center, lon.data(), lat.data(), count,
+                                      course.data(), distance.data());
+  for (size_t i = 0; i < count; i += 97) {
+    SGGeod p = SGGeod::fromRad(lon[i], lat[i]);
+    double course1, course2, dist;
+    if (SGGeodesy::inverse(center, p, course1, course2, dist)) {
+      if (course[i] != course1 || distance[i] != dist)
+        { lineno = __LINE__; return false; }
+    } else {
+      if (inverseOk || !SGMiscd::isNaN(distance[i]))
+        { lineno = __LINE__; return false; }
+    }
+  }
+
+  // The range search finds exactly the positions an exhaustive search does
+  const SGGeod centers[] = {
+    SGGeod::fromDeg(-75, 40), SGGeod::fromDeg(179.9, -10),
+    SGGeod::fromDeg(20, 89.5), SGGeod::fromDeg(0, 0)
+  };
+  const double ranges[] = { 0, 50*SG_NM_TO_METER, 500*SG_NM_TO_METER,
+                            3000*SG_NM_TO_METER, 30000e3 };
+  std::vector<size_t> indices(count);
+  std::vector<double> found(count);
+  for (const SGGeod& c : centers) {
+    SGGeodesy::inverse(c, lon.data(), lat.data(), count, 0, distance.data());
+    for (double range : ranges) {
+      size_t n = SGGeodesy::withinRangeM(c, range, lon.data(), lat.data(),
+                                         count, indices.data(), found.data());
+      size_t k = 0;
+      for (size_t i = 0; i < count; ++i) {
+        if (SGMiscd::isNaN(distance[i]))
+          continue;
+        while (k < n && indices[k] < i)
+          ++k;
+        bool listed = k < n && indices[k] == i;
+        if (listed != (distance[i] <= range))
+          { lineno = __LINE__; return false; }
+        if (listed && found[k] != distance[i])
+          { lineno = __LINE__; return false; }
+      }
+    }
+  }
+
+  // Throughput: nearest navaids within 50 nm, exhaustively and filtered
+  typedef std::chrono::steady_clock Clock;
+  typedef std::chrono::duration<double, std::milli> Ms;
+  const int queries = 20;
+  size_t exhaustiveFound = 0, filteredFound = 0;
+  Clock::time_point t0 = Clock::now();
+  for (int q = 0; q < queries; ++q) {
+    SGGeod c = SGGeod::fromDeg(-90 + q, 40);
+    for (size_t i = 0; i < count; ++i) {
+      double course1, course2, dist;
+      if (SGGeodesy::inverse(c, SGGeod::fromRad(lon[i], lat[i]), course1, course2, dist) &&
+          dist <= 50*SG_NM_TO_METER)
+        ++exhaustiveFound;
+    }
+  }
+  Clock::time_point t1 = Clock::now();
+  for (int q = 0; q < queries; ++q) {
+    SGGeod c = SGGeod::fromDeg(-90 + q, 40);
+    filteredFound += SGGeodesy::withinRangeM(c, 50*SG_NM_TO_METER, lon.data(),
+                                             lat.data(), count, indices.data(), 0);
+  }
+  Clock::time_point t2 = Clock::now();
+  if (exhaustiveFound != filteredFound)
+    { lineno = __LINE__; return false; }
+  std::cout << queries << " range queries over " << count << " navaids: exhaustive "
+            << Ms(t1 - t0).count() << " ms, filtered " << Ms(t2 - t1).count()
+            << " ms, " << filteredFound << " found" << std::endl;
+
+  return true;
+}
+
 int
-main(void)
+main(int argc, char* argv[])
 {
+  // The timings are only printed on request
+  const bool benchmark = argc > 1 && !strcmp(argv[1], "--benchmark");
+
   sg_srandom(17);
 
   // Do vector tests
@@ -384,6 +711,14 @@ main(void)
   if (!MatrixTest<double>())
     { fprintf(stderr, "Error at line: %i called from line: %i\n", lineno, __LINE__); return EXIT_FAILURE; }
 
+  // Check the SIMD code against scalar arithmetic
+  if (!SimdTest<float>())
+    { fprintf(stderr, "Error at line: %i called from line: %i\n", lineno, __LINE__); return EXIT_FAILURE; }
+  if (!SimdTest<double>())
+    { fprintf(stderr, "Error at line: %i called from line: %i\n", lineno, __LINE__); return EXIT_FAILURE; }
+  if (benchmark)
+    MathBenchmark();
+
   // Do rect tests
   doRectTest<int>();
   doRectTest<double>();
@@ -391,6 +726,10 @@ main(void)
   // Check geodetic/geocentric/cartesian conversions
   if (!GeodesyTest())
     { fprintf(stderr, "Error at line: %i called from line: %i\n", lineno, __LINE__); return EXIT_FAILURE; }
+  if (!GeodesyBatchTest())
+    { fprintf(stderr, "Error at line: %i called from line: %i\n", lineno, __LINE__); return EXIT_FAILURE; }
+  if (!GeodesyRangeTest())
+    { fprintf(stderr, "Error at line: %i called from line: %i\n", lineno, __LINE__); return EXIT_FAILURE; }
 
   std::cout << "Successfully passed all tests!" << std::endl;
   return EXIT_SUCCESS;
@@ -18,8 +18,13 @@
 #ifndef __SIMD_H__
 #define __SIMD_H__	1
 
-#ifdef HAVE_CONFIG_H
-# include <simgear/simgear_config.h>
+// Always, so code using SimGear selects the same SIMD code and layout
+#include <simgear/simgear_config.h>
+
+// SimGear built with ENABLE_SIMD_AVX lays out SGVec3d, SGVec4d and
+// SGMatrixd for AVX; code compiled without it would disagree on that.
+#if defined(ENABLE_SIMD_AVX) && !defined(__AVX__)
+# error "SimGear was built with ENABLE_SIMD_AVX: compile with -mavx (/arch:AVX)"
 #endif
 
 #include <cstdint>
@@ -568,7 +573,7 @@ inline simd4_t<float,N>abs(simd4_t<float,N> v) {
 # endif
 
 
-# ifdef __AVX_unsupported__
+# ifdef __AVX__
 template<int N>
 class alignas(32) simd4_t<double,N>
 {
@@ -749,12 +754,20 @@ namespace simd4
 inline static double hsum_pd_avx(__m256d v) {
     const __m128d valupper = _mm256_extractf128_pd(v, 1);
     const __m128d vallower = _mm256_castpd256_pd128(v);
-    _mm256_zeroupper();
     const __m128d valval = _mm_add_pd(valupper, vallower);
     const __m128d sums =   _mm_add_pd(_mm_permute_pd(valval,1), valval);
     return                 _mm_cvtsd_f64(sums);
 }
 
+// a*b + c, fused where the CPU supports it
+inline static __m256d fmadd_pd_avx(__m256d a, __m256d b, __m256d c) {
+#  ifdef __FMA__
+    return _mm256_fmadd_pd(a, b, c);
+#  else
+    return _mm256_add_pd(_mm256_mul_pd(a, b), c);
+#  endif
+}
+
 template<>
 inline double magnitude2(const simd4_t<double,4>& v) {
     return hsum_pd_avx(_mm256_mul_pd(v.v4(),v.v4()));
@@ -765,6 +778,20 @@ inline double dot(const simd4_t<double,4>& v1, const simd4_t<double,4>& v2) {
     return hsum_pd_avx(_mm256_mul_pd(v1.v4(),v2.v4()));
 }
 
+// The fourth element of a 3-element vector is not always zero, e.g.
+// after adding a scalar, so leave it out of the sum.
+template<>
+inline double magnitude2(const simd4_t<double,3>& v) {
+    __m256d v2 = _mm256_mul_pd(v.v4(),v.v4());
+    return hsum_pd_avx(_mm256_blend_pd(v2, _mm256_setzero_pd(), 0x8));
+}
+
+template<>
+inline double dot(const simd4_t<double,3>& v1, const simd4_t<double,3>& v2) {
+    __m256d mv = _mm256_mul_pd(v1.v4(),v2.v4());
+    return hsum_pd_avx(_mm256_blend_pd(mv, _mm256_setzero_pd(), 0x8));
+}
+
 #  ifdef __AVX2__
 template<>
 inline simd4_t<double,3> cross(const simd4_t<double,3>& v1, const simd4_t<double,3>& v2)
@@ -779,6 +806,23 @@ inline simd4_t<double,3> cross(const simd4_t<double,3>& v1, const simd4_t<double
                      _mm256_permute4x64_pd(v41,_MM_SHUFFLE(3, 1, 0, 2)),
                      _mm256_permute4x64_pd(v42,_MM_SHUFFLE(3, 0, 2, 1))));
 }
+#  else
+// (x,y,z,w) -> (y,z,x,w) without the cross-lane permute of AVX2
+inline static __m256d rotate_yzx_pd_avx(__m256d v) {
+    __m256d s = _mm256_permute2f128_pd(v, v, 0x01);   // (z,w,x,y)
+    return _mm256_permute_pd(_mm256_blend_pd(v, s, 0x5), 0x9);
+}
+
+template<>
+inline simd4_t<double,3> cross(const simd4_t<double,3>& v1, const simd4_t<double,3>& v2)
+{
+    // as the SSE version for float
+    __m256d v41 = v1.v4(), v42 = v2.v4();
+    __m256d a = rotate_yzx_pd_avx(v41);
+    __m256d b = rotate_yzx_pd_avx(v42);
+    __m256d c = _mm256_sub_pd(_mm256_mul_pd(v41, b), _mm256_mul_pd(a, v42));
+    return rotate_yzx_pd_avx(c);
+}
 #  endif
 
 template<int N>
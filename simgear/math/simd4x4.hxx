@@ -495,7 +495,7 @@ inline simd4_t<float,3> transform<float>(const simd4x4_t<float,4>& m, const simd
 # endif
 
 
-# ifdef __AVX_unsupported__
+# ifdef __AVX__
 template<>
 class alignas(32) simd4x4_t<double,4>
 {
@@ -597,7 +597,7 @@ public:
             row = _mm256_mul_pd(m1.m4x4()[0], col);
             for (int j=1; j<4; ++j) {
                 col = _mm256_set1_pd(m2.ptr()[i][j]);
-                row = _mm256_add_pd(row, _mm256_mul_pd(m1.m4x4()[j], col));
+                row = simd4::fmadd_pd_avx(m1.m4x4()[j], col, row);
             }
             simd4x4[i] = row;
         }
@@ -610,8 +610,11 @@ inline simd4_t<double,M> operator*(const simd4x4_t<double,4>& m, const simd4_t<d
 {
     __m256d mv = _mm256_mul_pd(m.m4x4()[0], _mm256_set1_pd(vi.ptr()[0]));
     for (int i=1; i<M; ++i) {
-        __m256d row = _mm256_mul_pd(m.m4x4()[i], _mm256_set1_pd(vi.ptr()[i]));
-        mv = _mm256_add_pd(mv, row);
+        mv = simd4::fmadd_pd_avx(m.m4x4()[i], _mm256_set1_pd(vi.ptr()[i]), mv);
+    }
+    // Like the generic code, leave the unused elements zero
+    if (M < 4) {
+        mv = _mm256_blend_pd(mv, _mm256_setzero_pd(), (M == 3) ? 0x8 : 0xC);
     }
     return mv;
 }
@@ -696,7 +699,7 @@ inline void post_translate(simd4x4_t<double,4>& m, const simd4_t<S,3>& dist) {
     __m256d col3 = m.m4x4()[3];
     for (int i=0; i<3; ++i) {
         __m256d t = _mm256_set1_pd(double(dist[i]));
-        col3 = _mm256_add_pd(col3, _mm256_mul_pd(t, m.m4x4()[i]));
+        col3 = simd4::fmadd_pd_avx(t, m.m4x4()[i], col3);
     }
     m.m4x4()[3] = col3;
 }
@@ -707,9 +710,9 @@ inline simd4_t<double,3> transform<double>(const simd4x4_t<double,4>& m, const s
     __m256d tpt = m.m4x4()[3];
     for (int i=0; i<3; ++i) {
         __m256d ptd = _mm256_set1_pd(pt[i]);
-        tpt = _mm256_add_pd(tpt, _mm256_mul_pd(ptd, m.m4x4()[i]));
+        tpt = simd4::fmadd_pd_avx(ptd, m.m4x4()[i], tpt);
     }
-    res = tpt;
+    res = _mm256_blend_pd(tpt, _mm256_setzero_pd(), 0x8);
     return res;
 }
 
@@ -29,6 +29,7 @@ namespace simgear
 {
     
 static ResourceManager* static_manager = nullptr;
+static std::mutex static_managerMutex;
 
 ResourceProvider::~ResourceProvider()
 {
@@ -42,6 +43,7 @@ ResourceManager::ResourceManager()
 
 ResourceManager* ResourceManager::instance()
 {
+    std::lock_guard<std::mutex> g(static_managerMutex);
     if (!static_manager) {
         static_manager = new ResourceManager();
     }
@@ -100,6 +102,7 @@ void ResourceManager::addBasePath(const SGPath& aPath, Priority aPriority)
 void ResourceManager::addProvider(ResourceProvider* aProvider)
 {
     assert(aProvider);
+    std::lock_guard<std::recursive_mutex> g(_providersMutex);
 
     ProviderVec::iterator it = _providers.begin();
     for (; it != _providers.end(); ++it) {
@@ -116,6 +119,7 @@ void ResourceManager::addProvider(ResourceProvider* aProvider)
 void ResourceManager::removeProvider(ResourceProvider* aProvider)
 {
     assert(aProvider);
+    std::lock_guard<std::recursive_mutex> g(_providersMutex);
     auto it = std::find(_providers.begin(), _providers.end(), aProvider);
     if (it == _providers.end()) {
         SG_LOG(SG_GENERAL, SG_DEV_ALERT, "unknown provider doing remove");
@@ -134,6 +138,7 @@ SGPath ResourceManager::findPath(const std::string& aResource, SGPath aContext)
         }
     }
     
+    std::lock_guard<std::recursive_mutex> g(_providersMutex);
     for (auto provider : _providers) {
       SGPath path = provider->resolve(aResource, aContext);
       if (!path.isNull()) {
@@ -21,6 +21,7 @@
 #ifndef SG_RESOURCE_MANAGER_HXX
 #define SG_RESOURCE_MANAGER_HXX
 
+#include <mutex>
 #include <vector>
 
 #include <simgear/misc/sg_path.hxx>
@@ -32,6 +33,9 @@ class ResourceProvider;
 
 /**
  * singleton management of resources
+ *
+ * Resources can be looked up from any thread, for example by the threads
+ * loading models. The providers are called with the provider list locked.
  */
 class ResourceManager
 {
@@ -76,6 +80,8 @@ private:
     
     typedef std::vector<ResourceProvider*> ProviderVec;
     ProviderVec _providers;
+    // Recursive, a provider may look up other resources in turn
+    std::recursive_mutex _providersMutex;
 };      
     
 class ResourceProvider
@@ -0,0 +1,77 @@
+#include <simgear_config.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include <simgear/io/iostreams/sgstream.hxx>
+#include <simgear/misc/sg_dir.hxx>
+#include <simgear/misc/sg_path.hxx>
+#include <simgear/misc/test_macros.hxx>
+#include "ResourceManager.hxx"
+
+using simgear::ResourceManager;
+
+static void writeFile(const SGPath& path)
+{
+    sg_ofstream out(path);
+    out << "resource\n";
+}
+
+void test_findPath(const SGPath& base, const SGPath& high)
+{
+    ResourceManager* manager = ResourceManager::instance();
+    SG_CHECK_EQUAL(manager->findPath("a.xml"), base / "a.xml");
+    // The provider with the higher priority is asked first
+    SG_CHECK_EQUAL(manager->findPath("b.xml"), high / "b.xml");
+    SG_VERIFY(manager->findPath("missing.xml").isNull());
+    // The context comes before all providers
+    SG_CHECK_EQUAL(manager->findPath("b.xml", base), base / "b.xml");
+}
+
+// Threads loading models look up resources while others add base paths
+void test_concurrentLookups(const SGPath& base, const SGPath& high)
+{
+    std::atomic<int> failed(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&]() {
+            for (int i = 0; i < 2000; ++i) {
+                if (ResourceManager::instance()->findPath("b.xml") != high / "b.xml")
+                    ++failed;
+            }
+        });
+    }
+    threads.emplace_back([&]() {
+        for (int i = 0; i < 200; ++i)
+            ResourceManager::instance()->addBasePath(base / "none", ResourceManager::PRIORITY_FALLBACK);
+    });
+    for (std::thread& t : threads)
+        t.join();
+    SG_CHECK_EQUAL(failed.load(), 0);
+}
+
+int main(int argc, char* argv[])
+{
+    simgear::Dir tmpDir = simgear::Dir::tempDir("FlightGear");
+    tmpDir.setRemoveOnDestroy();
+    const SGPath base = tmpDir.path() / "base";
+    const SGPath high = tmpDir.path() / "high";
+    simgear::Dir(base).create(0755);
+    simgear::Dir(high).create(0755);
+    writeFile(base / "a.xml");
+    writeFile(base / "b.xml");
+    writeFile(high / "b.xml");
+
+    ResourceManager::instance()->addBasePath(base);
+    ResourceManager::instance()->addBasePath(high, ResourceManager::PRIORITY_HIGH);
+
+    test_findPath(base, high);
+    test_concurrentLookups(base, high);
+
+    ResourceManager::reset();
+    SG_VERIFY(!ResourceManager::haveInstance());
+
+    return EXIT_SUCCESS;
+}
@@ -121,7 +121,9 @@ protected:
     void gotBodyData(const char* s, int n) override
     {
         // if there's a pre-existing error, discard byte sinstead of pushing
-        // more through the extactor
+        // more through the extactor. Tarballs are extracted on worker
+        // threads, so an error may only show up some calls later;
+        // onDone() checks again once flush() has finished.
         if (m_extractor->hasError()) {
             return;
         }
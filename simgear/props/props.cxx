@@ -847,7 +847,12 @@ SGPropertyNode::make_string () const
     default:
         return "";
     }
-    _buffer = sstr.str();
+    // Only write the buffer when the value changed: a tree nobody changes,
+    // like a shared model XML tree, can then be read from several threads
+    // once every buffer has been filled.
+    const std::string value = sstr.str();
+    if (_buffer != value)
+        _buffer = value;
     return _buffer.c_str();
 }
 
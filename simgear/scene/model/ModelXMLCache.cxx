@@ -0,0 +1,201 @@
+// ModelXMLCache.cxx -- parsed model XML files shared between model instances
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifdef HAVE_CONFIG_H
+#  include <simgear_config.h>
+#endif
+
+#include "ModelXMLCache.hxx"
+
+#include <algorithm>
+#include <sstream>
+
+#include <simgear/misc/ResourceManager.hxx>
+#include <simgear/props/props_io.hxx>
+#include <simgear/xml/easyxml.hxx>
+
+namespace simgear {
+
+namespace {
+
+// Collects the files named by the include attributes of an XML file,
+// resolved as readProperties() resolves them.
+class IncludeVisitor : public XMLVisitor
+{
+public:
+    explicit IncludeVisitor(const SGPath& path) :
+        _dir(path.dir())
+    {
+    }
+
+    void startElement(const char* name, const XMLAttributes& atts) override
+    {
+        const char* include = atts.getValue("include");
+        if (include) {
+            SGPath path = ResourceManager::instance()->findPath(include, _dir);
+            if (!path.isNull())
+                includes.push_back(path);
+        }
+    }
+
+    std::vector<SGPath> includes;
+
+private:
+    SGPath _dir;
+};
+
+}
+
+ModelXMLCache::ModelXMLCache() :
+    _maxSize(1024)
+{
+}
+
+ModelXMLCache* ModelXMLCache::instance()
+{
+    static ModelXMLCache cache;
+    return &cache;
+}
+
+void ModelXMLCache::addFiles(const SGPath& path, std::vector<FileStamp>& files)
+{
+    for (const FileStamp& file : files) {
+        if (file.path == path)
+            return;             // included twice, or an include loop
+    }
+    FileStamp file;
+    file.path = path;
+    file.path.set_cached(false);    // checked again on every get()
+    file.modTime = path.modTime();
+    file.size = path.sizeInBytes();
+    files.push_back(file);
+
+    IncludeVisitor visitor(path);
+    try {
+        readXML(path, visitor);
+    } catch (const sg_exception&) {
+        // readProperties() reports it
+    }
+    for (const SGPath& include : visitor.includes)
+        addFiles(include, files);
+}
+
+bool ModelXMLCache::isCurrent(const std::vector<FileStamp>& files)
+{
+    return std::all_of(files.begin(), files.end(), [](const FileStamp& file) {
+        return file.path.modTime() == file.modTime
+            && file.path.sizeInBytes() == file.size;
+    });
+}
+
+// Fill the string buffers of all typed values, so that reading the tree
+// does not write to it any more.
+void ModelXMLCache::freeze(const SGPropertyNode* node)
+{
+    node->getStringValue();
+    for (int i = 0; i < node->nChildren(); ++i)
+        freeze(node->getChild(i));
+}
+
+SGPropertyNode_ptr ModelXMLCache::copy(const SGPropertyNode* tree)
+{
+    SGPropertyNode_ptr props = new SGPropertyNode;
+    copyProperties(tree, props);
+    return props;
+}
+
+SGPropertyNode_ptr ModelXMLCache::find(const std::string& key)
+{
+    Entry entry;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto i = _entries.find(key);
+        if (i == _entries.end())
+            return SGPropertyNode_ptr();
+        entry = i->second;
+    }
+    // The files are checked without holding the lock
+    if (isCurrent(entry.files))
+        return entry.root;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto i = _entries.find(key);
+    if (i != _entries.end() && i->second.root == entry.root)
+        _entries.erase(i);
+    return SGPropertyNode_ptr();
+}
+
+void ModelXMLCache::insert(const std::string& key, const Entry& entry)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_entries.size() >= _maxSize) {
+        for (auto i = _entries.begin(); i != _entries.end();) {
+            if (!i->second.root.isShared())
+                i = _entries.erase(i);
+            else
+                ++i;
+        }
+    }
+    // Another thread may have parsed the same file meanwhile; either
+    // tree will do.
+    _entries[key] = entry;
+}
+
+SGPropertyNode_ptr ModelXMLCache::get(const SGPath& path, const SGPropertyNode* overlay)
+{
+    // Instances bring their own overlay nodes, so overlays are told apart
+    // by their contents.
+    std::string key = path.utf8Str();
+    if (overlay) {
+        std::ostringstream out;
+        writeProperties(out, overlay, true);
+        key += '\n' + out.str();
+    }
+
+    SGPropertyNode_ptr root = find(key);
+    if (root)
+        return root;
+
+    Entry entry;
+    addFiles(path, entry.files);
+    entry.root = new SGPropertyNode;
+    readProperties(path, entry.root);
+    if (overlay)
+        copyProperties(overlay, entry.root);
+    freeze(entry.root);
+    insert(key, entry);
+    return entry.root;
+}
+
+size_t ModelXMLCache::size() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _entries.size();
+}
+
+void ModelXMLCache::clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _entries.clear();
+}
+
+void ModelXMLCache::setMaxSize(size_t maxSize)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _maxSize = maxSize;
+}
+
+}
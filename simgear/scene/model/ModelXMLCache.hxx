@@ -0,0 +1,92 @@
+// ModelXMLCache.hxx -- parsed model XML files shared between model instances
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef _SG_MODEL_XML_CACHE_HXX
+#define _SG_MODEL_XML_CACHE_HXX 1
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <simgear/misc/sg_path.hxx>
+#include <simgear/props/props.hxx>
+
+namespace simgear {
+
+/**
+ * Property trees of model XML files, parsed once for all instances of the
+ * same model and overlay. get() hands every instance the same tree, which
+ * must not be changed: an instance that needs to change part of it takes
+ * a copy of that part first (copy-on-write). Shared trees can be read from
+ * several threads, as reading their values writes nothing once get() has
+ * filled their string buffers.
+ *
+ * A tree is parsed again when the modification time or size of its file,
+ * or of a file it includes, changes.
+ */
+class ModelXMLCache
+{
+public:
+    static ModelXMLCache* instance();
+
+    /// The shared tree of an XML file, with an overlay applied.
+    /// @throws sg_io_exception like readProperties() if the file is invalid
+    SGPropertyNode_ptr get(const SGPath& path, const SGPropertyNode* overlay = 0);
+
+    /// A private copy of a shared tree or subtree, to be changed.
+    static SGPropertyNode_ptr copy(const SGPropertyNode* tree);
+
+    /// Number of trees in the cache
+    size_t size() const;
+
+    void clear();
+
+    /// Trees no instance uses any more are dropped once there are more
+    /// than this many.
+    void setMaxSize(size_t maxSize);
+
+private:
+    ModelXMLCache();
+
+    struct FileStamp {
+        SGPath path;
+        int64_t modTime;
+        int64_t size;
+    };
+
+    struct Entry {
+        SGPropertyNode_ptr root;
+        // The file and the files it includes, as they were parsed
+        std::vector<FileStamp> files;
+    };
+
+    static void addFiles(const SGPath& path, std::vector<FileStamp>& files);
+    static bool isCurrent(const std::vector<FileStamp>& files);
+    static void freeze(const SGPropertyNode* node);
+
+    SGPropertyNode_ptr find(const std::string& key);
+    void insert(const std::string& key, const Entry& entry);
+
+    mutable std::mutex _mutex;
+    std::map<std::string, Entry> _entries;
+    size_t _maxSize;
+};
+
+}
+
+#endif // _SG_MODEL_XML_CACHE_HXX
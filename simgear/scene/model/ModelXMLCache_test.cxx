@@ -0,0 +1,199 @@
+// Checks that ModelXMLCache hands every instance of a model the same parsed
+// tree, applies overlays, notices changed files, included ones too, and can
+// be read from several loader threads at once, and compares the load time
+// and property node count of many instances of a model with and without it.
+
+#ifdef HAVE_CONFIG_H
+#  include <simgear_config.h>
+#endif
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <simgear/io/iostreams/sgstream.hxx>
+#include <simgear/misc/sg_dir.hxx>
+#include <simgear/misc/test_macros.hxx>
+#include <simgear/props/props_io.hxx>
+
+#include "ModelXMLCache.hxx"
+
+using namespace simgear;
+
+static const int NumInstances = 100;
+
+// An AI aircraft model: many animations, each with a few properties
+static void writeModel(const SGPath& path, int animations)
+{
+    sg_ofstream xml(path);
+    xml << "<?xml version=\"1.0\"?>\n<PropertyList>\n";
+    xml << "  <path>Models/aircraft.ac</path>\n";
+    xml << "  <sound include=\"sound.xml\"/>\n";
+    xml << "  <offsets><x-m>1.5</x-m><pitch-deg>2</pitch-deg></offsets>\n";
+    for (int i = 0; i < animations; ++i) {
+        xml << "  <animation>\n";
+        xml << "    <type>rotate</type>\n";
+        xml << "    <object-name>part" << i << "</object-name>\n";
+        xml << "    <property>surface-positions/part" << i << "-pos-norm</property>\n";
+        xml << "    <factor type=\"double\">" << i * 0.5 << "</factor>\n";
+        xml << "    <center><x-m>" << i << "</x-m><y-m>0</y-m><z-m>0.25</z-m></center>\n";
+        xml << "    <axis><x>0</x><y>1</y><z>0</z></axis>\n";
+        xml << "  </animation>\n";
+    }
+    xml << "</PropertyList>\n";
+}
+
+static void writeSound(const SGPath& path, double volume)
+{
+    sg_ofstream xml(path);
+    xml << "<?xml version=\"1.0\"?>\n<PropertyList>\n";
+    xml << "  <volume type=\"double\">" << volume << "</volume>\n";
+    xml << "</PropertyList>\n";
+}
+
+static std::string contents(const SGPropertyNode* tree)
+{
+    std::ostringstream out;
+    writeProperties(out, tree, true);
+    return out.str();
+}
+
+static size_t countNodes(const SGPropertyNode* node)
+{
+    size_t count = 1;
+    for (int i = 0; i < node->nChildren(); ++i)
+        count += countNodes(node->getChild(i));
+    return count;
+}
+
+int main(int argc, char* argv[])
+{
+    simgear::Dir tmpDir = simgear::Dir::tempDir("FlightGear");
+    tmpDir.setRemoveOnDestroy();
+
+    const SGPath model = tmpDir.path() / "aircraft.xml";
+    const SGPath sound = tmpDir.path() / "sound.xml";
+    writeModel(model, 400);
+    writeSound(sound, 0.5);
+
+    ModelXMLCache* cache = ModelXMLCache::instance();
+    cache->clear();
+
+    // Every instance gets the same tree, with the contents of a fresh parse
+    SGPropertyNode_ptr parsed = new SGPropertyNode;
+    readProperties(model, parsed);
+    SGPropertyNode_ptr first = cache->get(model);
+    SGPropertyNode_ptr second = cache->get(model);
+    SG_VERIFY(first == second);
+    SG_CHECK_EQUAL(cache->size(), 1u);
+    SG_CHECK_EQUAL(first->getChildren("animation").size(), 400u);
+    SG_CHECK_EQUAL(contents(first), contents(parsed));
+    SG_CHECK_EQUAL(first->getDoubleValue("offsets/x-m"), 1.5);
+    SG_CHECK_EQUAL(first->getDoubleValue("sound/volume"), 0.5);
+    SG_CHECK_EQUAL(first->getNode("animation[3]/factor")->getType(), simgear::props::DOUBLE);
+
+    // Changing a copy changes neither the other instances nor the cache
+    SGPropertyNode_ptr own = ModelXMLCache::copy(first);
+    SG_CHECK_EQUAL(contents(own), contents(parsed));
+    own->addChild("interior-path")->setStringValue("interior.xml");
+    own->removeChildren("effect");
+    own->setDoubleValue("animation[3]/factor", 99.0);
+    SGPropertyNode_ptr animation = ModelXMLCache::copy(first->getNode("animation[5]"));
+    animation->setStringValue("type", "pick");
+    SG_CHECK_EQUAL(contents(second), contents(parsed));
+    SG_CHECK_EQUAL(contents(cache->get(model)), contents(parsed));
+
+    // Overlays are told apart by their contents
+    SGPropertyNode_ptr overlay = new SGPropertyNode;
+    overlay->setStringValue("path", "Models/livery1.ac");
+    SGPropertyNode_ptr withOverlay = cache->get(model, overlay);
+    SG_VERIFY(withOverlay != first);
+    SG_CHECK_EQUAL(std::string(withOverlay->getStringValue("path")), "Models/livery1.ac");
+    SG_CHECK_EQUAL(std::string(cache->get(model)->getStringValue("path")), "Models/aircraft.ac");
+    SGPropertyNode_ptr sameOverlay = new SGPropertyNode;
+    copyProperties(overlay, sameOverlay);
+    SG_VERIFY(cache->get(model, sameOverlay) == withOverlay);
+    SG_CHECK_EQUAL(cache->size(), 2u);
+
+    // A changed file is parsed again
+    writeModel(model, 200);
+    SGPropertyNode_ptr changed = cache->get(model);
+    SG_VERIFY(changed != first);
+    SG_CHECK_EQUAL(changed->getChildren("animation").size(), 200u);
+    writeModel(model, 400);
+    SG_CHECK_EQUAL(cache->get(model)->getChildren("animation").size(), 400u);
+
+    // So is a file including a changed file
+    first = cache->get(model);
+    writeSound(sound, 0.75);
+    SGPropertyNode_ptr newSound = cache->get(model);
+    SG_VERIFY(newSound != first);
+    SG_CHECK_EQUAL(newSound->getDoubleValue("sound/volume"), 0.75);
+    writeSound(sound, 0.5);
+    first = second = changed = newSound = withOverlay = 0;
+
+    // Trees no instance uses are dropped once the cache is full
+    const SGPath other = tmpDir.path() / "other.xml";
+    writeModel(other, 10);
+    cache->setMaxSize(1);
+    cache->get(other);
+    SG_CHECK_EQUAL(cache->size(), 1u);
+    cache->setMaxSize(1024);
+
+    // One cached model loaded by several pager threads at once, reading
+    // the values of the shared tree as the loader does
+    parsed = new SGPropertyNode;
+    readProperties(model, parsed);
+    const std::string expected = contents(parsed);
+    cache->clear();
+    const int numThreads = 8;
+    std::vector<std::thread> threads;
+    std::vector<int> good(numThreads, 0);
+    for (int t = 0; t < numThreads; ++t) {
+        threads.emplace_back([&, t]() {
+            for (int n = 0; n < 10; ++n) {
+                SGPropertyNode_ptr props = cache->get(model);
+                for (int i = 0; i < 400; i += 37)
+                    props->getNode("animation", i)->getStringValue("factor");
+                if (contents(props) == expected)
+                    good[t]++;
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    for (int t = 0; t < numThreads; ++t)
+        SG_CHECK_EQUAL(good[t], 10);
+
+    // Many instances of one model: parse each or share the cached tree
+    std::vector<SGPropertyNode_ptr> instances;
+    size_t parsedNodes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < NumInstances; ++i) {
+        SGPropertyNode_ptr props = new SGPropertyNode;
+        readProperties(model, props);
+        parsedNodes += countNodes(props);
+        instances.push_back(props);
+    }
+    auto middle = std::chrono::steady_clock::now();
+    instances.clear();
+
+    cache->clear();
+    auto middle2 = std::chrono::steady_clock::now();
+    for (int i = 0; i < NumInstances; ++i)
+        instances.push_back(cache->get(model));
+    auto end = std::chrono::steady_clock::now();
+    SG_CHECK_EQUAL(cache->size(), 1u);
+
+    double parseMs = std::chrono::duration<double, std::milli>(middle - start).count();
+    double cacheMs = std::chrono::duration<double, std::milli>(end - middle2).count();
+    std::cout << NumInstances << " instances of a " << parsed->getChildren("animation").size()
+              << " animation model: parsed in " << parseMs << " ms, " << parsedNodes
+              << " property nodes; shared in " << cacheMs << " ms, "
+              << countNodes(instances.front()) << " property nodes" << std::endl;
+
+    return EXIT_SUCCESS;
+}
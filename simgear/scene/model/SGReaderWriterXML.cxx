@@ -24,6 +24,8 @@
 //yuck
 #include <cstring>
 #include <cassert>
+#include <memory>
+#include <vector>
 
 #include <osg/Version>
 #include <osg/Geode>
@@ -41,8 +43,10 @@
 #include <simgear/props/condition.hxx>
 #include <simgear/scene/util/SGNodeMasks.hxx>
 #include <simgear/scene/util/SGReaderWriterOptions.hxx>
+#include <simgear/threads/SGWorkerPool.hxx>
 
 #include "modellib.hxx"
+#include "ModelXMLCache.hxx"
 #include "SGReaderWriterXML.hxx"
 
 #include "animation.hxx"
@@ -56,10 +60,190 @@ using namespace std;
 using namespace simgear;
 using namespace osg;
 
+namespace {
+
+// The files of a model and its sub-models, read ahead of assembling the
+// model. Whatever is missing is read again by sgLoad3DModel_internal.
+struct PrefetchedModel {
+    // XML wrapper with its overlay applied, null if it was not read
+    SGPropertyNode_ptr props;
+    // Whether props is a shared tree of the ModelXMLCache
+    bool sharedProps = false;
+    // Geometry file and what reading it returned
+    std::string modelPath;
+    osgDB::ReaderWriter::ReadResult geometry;
+    // One per <model> child of props, null if not prefetched
+    std::vector<std::unique_ptr<PrefetchedModel> > submodels;
+};
+
+// Reads the XML wrappers and geometry files, with their textures, of a
+// model and all its sub-models on the shared worker pool, one level of
+// <model> nesting at a time. The workers only read files into their own
+// PrefetchedModel. The sub-model paths are resolved on the calling thread
+// between the levels. The workers still resolve include= files and
+// textures through the ResourceManager, which locks its providers for
+// that. The global property tree, animations and effects are left to the
+// serial assembly.
+class ModelPrefetcher {
+public:
+    ModelPrefetcher(const osgDB::Options* dbOptions, bool isAI) :
+        _dbOptions(dbOptions), _isAI(isAI)
+    {
+        _previewMode = dbOptions->getPluginStringData("SimGear::PREVIEW") == "ON";
+        _useXMLCache = dbOptions->getPluginStringData("SimGear::MODEL_XML_CACHE") == "ON";
+    }
+
+    void run(PrefetchedModel& root, const SGPath& path)
+    {
+        std::vector<Task> tasks;
+        addTask(tasks, &root, path, SGPropertyNode_ptr());
+        while (!tasks.empty()) {
+            SGWorkerPool::shared().forEach(tasks.size(), [this, &tasks](unsigned i) {
+                try {
+                    readTask(tasks[i]);
+                } catch (...) {
+                    // Left to sgLoad3DModel_internal, which reports it
+                }
+            });
+
+            std::vector<Task> next;
+            for (const auto& task : tasks) {
+                if (task.isXML)
+                    addSubTasks(next, task);
+            }
+            tasks.swap(next);
+        }
+    }
+
+private:
+    // One file to read: an XML wrapper, or a geometry file with the
+    // directory of its textures
+    struct Task {
+        PrefetchedModel* model;
+        bool isXML;
+        SGPath path;
+        SGPath texturepath;
+        SGPropertyNode_ptr overlay;
+    };
+
+    static void addTask(std::vector<Task>& tasks, PrefetchedModel* model,
+                        const SGPath& path, SGPropertyNode_ptr overlay)
+    {
+        if (!path.exists())
+            return;
+
+        Task task;
+        task.model = model;
+        task.isXML = path.extension() == "xml";
+        task.path = path;
+        task.texturepath = path;
+        task.overlay = overlay;
+        tasks.push_back(task);
+    }
+
+    // Called on a worker
+    void readTask(const Task& task)
+    {
+        if (task.isXML) {
+            SGPropertyNode_ptr props;
+            if (_useXMLCache) {
+                props = ModelXMLCache::instance()->get(task.path, task.overlay);
+            } else {
+                props = new SGPropertyNode;
+                readProperties(task.path, props);
+                if (task.overlay)
+                    copyProperties(task.overlay, props);
+            }
+            task.model->props = props;
+            task.model->sharedProps = _useXMLCache;
+        } else {
+            readGeometry(task.model, task.path, task.texturepath);
+        }
+    }
+
+    // Called on the calling thread, once the XML wrapper of task is read
+    void addSubTasks(std::vector<Task>& tasks, const Task& task)
+    {
+        PrefetchedModel* model = task.model;
+        SGPropertyNode_ptr props = model->props;
+        if (!props)
+            return;
+        if (_previewMode && props->hasChild("nopreview"))
+            return;
+
+        SGPath modelDir(task.path.dir());
+        PropertyList model_nodes = props->getChildren("model");
+        model->submodels.resize(model_nodes.size());
+        for (unsigned i = 0; i < model_nodes.size(); ++i) {
+            SGPropertyNode_ptr sub_props = model_nodes[i];
+            string subPathStr = sub_props->getStringValue("path");
+            SGPath submodelPath = SGModelLib::findDataFile(subPathStr, NULL, modelDir);
+            if (submodelPath.isNull())
+                continue;
+            if (_isAI && std::string(sub_props->getStringValue("usage")) == "interior")
+                continue;
+
+            // The overlay is copied, so that no worker reads this tree
+            SGPropertyNode_ptr subOverlay;
+            if (SGPropertyNode* o = sub_props->getNode("overlay")) {
+                subOverlay = new SGPropertyNode;
+                copyProperties(o, subOverlay);
+            }
+            model->submodels[i].reset(new PrefetchedModel);
+            addTask(tasks, model->submodels[i].get(), submodelPath, subOverlay);
+        }
+
+        if (!props->hasValue("/path"))
+            return;
+        string modelPathStr = props->getStringValue("/path");
+        SGPath modelpath = SGModelLib::findDataFile(modelPathStr, NULL, modelDir);
+        // An XML file named by /path is left to the serial assembly
+        if (modelpath.isNull() || modelpath.extension() == "xml")
+            return;
+        SGPath texturepath(task.path);
+        if (props->hasValue("/texture-path")) {
+            string texturePathStr = props->getStringValue("/texture-path");
+            if (!texturePathStr.empty()) {
+                texturepath = SGModelLib::findDataFile(texturePathStr, NULL, modelDir);
+                if (texturepath.isNull())
+                    return;
+            }
+        }
+
+        Task geometry;
+        geometry.model = model;
+        geometry.isXML = false;
+        geometry.path = modelpath;
+        geometry.texturepath = texturepath;
+        tasks.push_back(geometry);
+    }
+
+    void readGeometry(PrefetchedModel* model, const SGPath& modelpath, SGPath texturepath)
+    {
+        if (!texturepath.extension().empty())
+            texturepath = texturepath.dir();
+
+        osg::ref_ptr<SGReaderWriterOptions> options;
+        options = SGReaderWriterOptions::copyOrCreate(_dbOptions.get());
+        options->setModelData(0);
+        options->setDatabasePath(texturepath.utf8Str());
+        model->geometry = osgDB::readRefNodeFile(modelpath.utf8Str(), options.get());
+        model->modelPath = modelpath.utf8Str();
+    }
+
+    osg::ref_ptr<const osgDB::Options> _dbOptions;
+    bool _isAI;
+    bool _previewMode;
+    bool _useXMLCache;
+};
+
+} // anonymous namespace
+
 static std::tuple<int, osg::Node *>
 sgLoad3DModel_internal(const SGPath& path,
                        const osgDB::Options* options,
-                       SGPropertyNode *overlay = 0);
+                       SGPropertyNode *overlay = 0,
+                       PrefetchedModel* prefetched = 0);
 
 
 SGReaderWriterXML::SGReaderWriterXML()
@@ -89,8 +273,17 @@ SGReaderWriterXML::readNode(const std::string& name,
           return ReadResult::FILE_NOT_FOUND;
         }
 
+        // Read all files of the model concurrently, then assemble it
+        PrefetchedModel prefetched;
+        if (options && options->getPluginStringData("SimGear::MODEL_PREFETCH") != "OFF") {
+            const SGReaderWriterOptions* sgOptions = dynamic_cast<const SGReaderWriterOptions*>(options);
+            bool isAI = sgOptions && sgOptions->getPropertyNode().valid() &&
+                std::string(sgOptions->getPropertyNode()->getStringValue("type")) == "AI";
+            ModelPrefetcher(options, isAI).run(prefetched, p);
+        }
+
         int num_anims;
-        std::tie(num_anims, result) = sgLoad3DModel_internal(p, options);
+        std::tie(num_anims, result) = sgLoad3DModel_internal(p, options, 0, &prefetched);
     } catch (const sg_exception &t) {
         SG_LOG(SG_IO, SG_DEV_ALERT, "Failed to load model: " << t.getFormattedMessage()
           << "\n\tfrom:" << fileName);
@@ -220,17 +413,40 @@ private:
 }
 
 namespace {
+    // The animations with bindings, which write their arguments
+    bool isPickAnimation(const SGPropertyNode* aNode)
+    {
+        string typeString(aNode->getStringValue("type"));
+        return (typeString == "pick") || (typeString == "knob") || (typeString == "slider") || (typeString == "touch");
+    }
+
     class ExcludeInPreview
     {
     public:
         bool operator()(SGPropertyNode* aNode) const
         {
-            string typeString(aNode->getStringValue("type"));
             // exclude these so we don't show yellow outlines in preview mode
-            return (typeString == "pick") || (typeString == "knob") || (typeString == "slider") || (typeString == "touch");
+            return isPickAnimation(aNode);
         }
     };
 
+    // A shared tree of the ModelXMLCache is copied before it is changed
+    void makeWritable(SGPropertyNode_ptr& node, bool& shared)
+    {
+        if (shared) {
+            node = ModelXMLCache::copy(node);
+            shared = false;
+        }
+    }
+
+    void makeWritable(PropertyList& nodes, bool shared)
+    {
+        if (shared) {
+            for (SGPropertyNode_ptr& node : nodes)
+                node = ModelXMLCache::copy(node);
+        }
+    }
+
     bool removeNamedNode(osg::Group* aGroup, const std::string& aName)
     {
         int nKids = aGroup->getNumChildren();
@@ -497,7 +713,8 @@ void addTooltipAnimations(const SGPath& path, SGPropertyNode_ptr props, osg::ref
 static std::tuple<int, osg::Node *>
 sgLoad3DModel_internal(const SGPath& path,
                        const osgDB::Options* dbOptions,
-                       SGPropertyNode *overlay)
+                       SGPropertyNode *overlay,
+                       PrefetchedModel* prefetched)
 {
     if (!path.exists()) {
       SG_LOG(SG_IO, SG_DEV_ALERT, "Failed to load file: \"" << path << "\"");
@@ -522,22 +739,38 @@ sgLoad3DModel_internal(const SGPath& path,
     osg::ref_ptr<osg::Node> model;
     osg::ref_ptr<osg::Group> group;
     SGPropertyNode_ptr props = new SGPropertyNode;
+    bool sharedProps = false;
     bool previewMode = (dbOptions->getPluginStringData("SimGear::PREVIEW") == "ON");
 
     // Check for an XML wrapper
     if (modelpath.extension() == "xml") {
+      if (prefetched && prefetched->props) {
+        // already has the overlay
+        props = prefetched->props;
+        sharedProps = prefetched->sharedProps;
+        prefetched->props.clear();
+      } else {
+       // Instances of the same model can share a tree parsed once
+       bool useXMLCache = dbOptions->getPluginStringData("SimGear::MODEL_XML_CACHE") == "ON";
        try {
-           readProperties(modelpath, props);
+           if (useXMLCache) {
+               props = ModelXMLCache::instance()->get(modelpath, overlay);
+               sharedProps = true;
+           } else {
+               readProperties(modelpath, props);
+           }
         } catch (const sg_exception &t) {
             SG_LOG(SG_IO, SG_DEV_ALERT, "Failed to load xml: "
                    << t.getFormattedMessage());
             throw;
         }
 
-        if (overlay)
+        if (overlay && !useXMLCache)
             copyProperties(overlay, props);
+      }
 
         if (options->getAutoTooltipsMaster()) {
+            makeWritable(props, sharedProps);
             addTooltipAnimations(path, props, model, options->getAutoTooltipsMasterMax());
         }
         
@@ -581,7 +814,10 @@ sgLoad3DModel_internal(const SGPath& path,
 
         options->setDatabasePath(texturepath.utf8Str());
         osgDB::ReaderWriter::ReadResult modelResult;
-        modelResult = osgDB::readRefNodeFile(modelpath.utf8Str(), options.get());
+        if (prefetched && prefetched->modelPath == modelpath.utf8Str())
+            modelResult = prefetched->geometry;
+        else
+            modelResult = osgDB::readRefNodeFile(modelpath.utf8Str(), options.get());
 
         if (!modelResult.validNode())
             throw sg_io_exception("Failed to load 3D model:" + modelResult.message(),
@@ -661,15 +897,21 @@ sgLoad3DModel_internal(const SGPath& path,
             bool isInterior = (std::string(sub_props->getStringValue("usage")) == "interior");
             bool isAI = (std::string(prop_root->getStringValue("type")) == "AI");
             if(isInterior && isAI){
+                 makeWritable(props, sharedProps);
                  props->addChild("interior-path")->setStringValue(submodelPath.utf8Str());
                  continue;
             }
         }
 
+        PrefetchedModel* subPrefetched = 0;
+        if (prefetched && i < prefetched->submodels.size())
+            subPrefetched = prefetched->submodels[i].get();
+
         try {
             int num_anims;
             std::tie(num_anims, submodel) = sgLoad3DModel_internal(submodelPath, options.get(),
-                                              sub_props->getNode("overlay"));
+                                              sub_props->getNode("overlay"),
+                                              subPrefetched);
             animationcount += num_anims;
         } catch (const sg_exception &t) {
             SG_LOG(SG_IO, SG_DEV_ALERT, "Failed to load submodel: " << t.getFormattedMessage()
@@ -722,6 +964,7 @@ sgLoad3DModel_internal(const SGPath& path,
     if ( load_panel ) {
         // Load panels
         vector<SGPropertyNode_ptr> panel_nodes = props->getChildren("panel");
+        makeWritable(panel_nodes, sharedProps);
         for (unsigned i = 0; i < panel_nodes.size(); i++) {
             SG_LOG(SG_IO, SG_DEBUG, "Loading a panel");
             osg::ref_ptr<osg::Node> panel = load_panel(panel_nodes[i]);
@@ -767,8 +1010,17 @@ sgLoad3DModel_internal(const SGPath& path,
                                              options.get()));
     }
 
+    // instantiateEffects() strips the effect nodes, and bindings write
+    // their arguments
     PropertyList effect_nodes = props->getChildren("effect");
+    makeWritable(effect_nodes, sharedProps);
     PropertyList animation_nodes = props->getChildren("animation");
+    if (sharedProps) {
+        for (SGPropertyNode_ptr& node : animation_nodes) {
+            if (isPickAnimation(node))
+                node = ModelXMLCache::copy(node);
+        }
+    }
 
     if (previewMode) {
         PropertyList::iterator it;
@@ -805,6 +1057,10 @@ sgLoad3DModel_internal(const SGPath& path,
 
     animationcount += animation_nodes.size();
 
+    // The Nasal module of the model may keep and change the tree
+    if (data.valid() && props->hasChild("nasal"))
+        makeWritable(props, sharedProps);
+
     if (!needTransform && group->getNumChildren() < 2) {
         model = group->getChild(0);
         group->removeChild(model.get());
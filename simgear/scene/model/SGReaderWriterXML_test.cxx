@@ -0,0 +1,162 @@
+// Loads an aircraft-like model made of many textured sub-models, once
+// reading the files of the sub-models one after the other and once
+// prefetching them concurrently, checks that both give the same scene graph
+// and compares the loading times.
+
+#include <simgear_config.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+#include <osg/Geode>
+#include <osg/Image>
+#include <osg/NodeVisitor>
+#include <osgDB/Options>
+#include <osgDB/WriteFile>
+
+#include <simgear/io/iostreams/sgstream.hxx>
+#include <simgear/misc/sg_dir.hxx>
+#include <simgear/misc/test_macros.hxx>
+#include <simgear/props/props.hxx>
+#include <simgear/scene/util/SGReaderWriterOptions.hxx>
+
+#include "SGReaderWriterXML.hxx"
+
+using namespace simgear;
+
+static const int NumParts = 40;
+static const int PartGrid = 50;
+
+// A textured grid of quads in AC3D format
+static void writePart(const SGPath& dir, int part)
+{
+    const std::string name = "part" + std::to_string(part);
+
+    osg::ref_ptr<osg::Image> image = new osg::Image;
+    image->allocateImage(256, 256, 1, GL_RGB, GL_UNSIGNED_BYTE);
+    unsigned char* data = image->data();
+    for (int i = 0; i < 256 * 256 * 3; ++i)
+        data[i] = (unsigned char)(i * (part + 1));
+    osgDB::writeImageFile(*image, (dir / (name + ".rgb")).utf8Str());
+
+    sg_ofstream ac(dir / (name + ".ac"));
+    ac << "AC3Db\n";
+    ac << "MATERIAL \"mat\" rgb 1 1 1  amb 0.2 0.2 0.2  emis 0 0 0  "
+          "spec 0.5 0.5 0.5  shi 10  trans 0\n";
+    ac << "OBJECT world\nkids 1\n";
+    ac << "OBJECT poly\nname \"" << name << "\"\n";
+    ac << "texture \"" << name << ".rgb\"\n";
+    ac << "numvert " << (PartGrid + 1) * (PartGrid + 1) << "\n";
+    for (int y = 0; y <= PartGrid; ++y)
+        for (int x = 0; x <= PartGrid; ++x)
+            ac << x * 0.1 << " " << ((x * y) % 7) * 0.01 << " " << y * 0.1 << "\n";
+    ac << "numsurf " << PartGrid * PartGrid << "\n";
+    for (int y = 0; y < PartGrid; ++y) {
+        for (int x = 0; x < PartGrid; ++x) {
+            int i = y * (PartGrid + 1) + x;
+            ac << "SURF 0x10\nmat 0\nrefs 4\n";
+            ac << i << " " << float(x) / PartGrid << " " << float(y) / PartGrid << "\n";
+            ac << i + 1 << " " << float(x + 1) / PartGrid << " " << float(y) / PartGrid << "\n";
+            ac << i + PartGrid + 2 << " " << float(x + 1) / PartGrid << " " << float(y + 1) / PartGrid << "\n";
+            ac << i + PartGrid + 1 << " " << float(x) / PartGrid << " " << float(y + 1) / PartGrid << "\n";
+        }
+    }
+    ac << "kids 0\n";
+
+    sg_ofstream xml(dir / (name + ".xml"));
+    xml << "<?xml version=\"1.0\"?>\n<PropertyList>\n";
+    xml << "  <path>" << name << ".ac</path>\n";
+    xml << "  <animation><type>rotate</type><object-name>" << name << "</object-name>"
+        << "<property>surface-positions/part" << part << "</property></animation>\n";
+    xml << "</PropertyList>\n";
+}
+
+// The fuselage, with every part as a sub-model, some of them twice
+static SGPath writeAircraft(const SGPath& dir)
+{
+    writePart(dir, NumParts);
+    for (int i = 0; i < NumParts; ++i)
+        writePart(dir, i);
+
+    SGPath path = dir / "aircraft.xml";
+    sg_ofstream xml(path);
+    xml << "<?xml version=\"1.0\"?>\n<PropertyList>\n";
+    xml << "  <path>part" << NumParts << ".ac</path>\n";
+    for (int i = 0; i < NumParts + NumParts / 4; ++i) {
+        xml << "  <model>\n    <name>model" << i << "</name>\n";
+        xml << "    <path>part" << i % NumParts << ".xml</path>\n";
+        xml << "    <offsets><x-m>" << i << "</x-m><heading-deg>" << i * 9 << "</heading-deg></offsets>\n";
+        xml << "  </model>\n";
+    }
+    xml << "  <model><path>missing.xml</path></model>\n";
+    xml << "</PropertyList>\n";
+    return path;
+}
+
+class CountVisitor : public osg::NodeVisitor {
+public:
+    CountVisitor() :
+        osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN),
+        nodes(0), drawables(0)
+    { }
+
+    void apply(osg::Node& node) override
+    {
+        ++nodes;
+        traverse(node);
+    }
+
+    void apply(osg::Geode& geode) override
+    {
+        ++nodes;
+        drawables += geode.getNumDrawables();
+        traverse(geode);
+    }
+
+    unsigned nodes;
+    unsigned drawables;
+};
+
+static osg::ref_ptr<osg::Node> load(const SGPath& path, bool prefetch, double& ms)
+{
+    osg::ref_ptr<SGReaderWriterOptions> options = new SGReaderWriterOptions;
+    options->setPropertyNode(new SGPropertyNode);
+    options->setObjectCacheHint(osgDB::Options::CACHE_NONE);
+    options->setPluginStringData("SimGear::MODEL_PREFETCH", prefetch ? "ON" : "OFF");
+
+    osg::ref_ptr<SGReaderWriterXML> reader = new SGReaderWriterXML;
+    auto start = std::chrono::steady_clock::now();
+    osgDB::ReaderWriter::ReadResult result = reader->readNode(path.utf8Str(), options.get());
+    auto end = std::chrono::steady_clock::now();
+    ms = std::chrono::duration<double, std::milli>(end - start).count();
+    SG_VERIFY(result.validNode());
+    return result.getNode();
+}
+
+int main(int argc, char* argv[])
+{
+    simgear::Dir tmpDir = simgear::Dir::tempDir("FlightGear");
+    tmpDir.setRemoveOnDestroy();
+    const SGPath aircraft = writeAircraft(tmpDir.path());
+
+    // Once to get the files into the file system cache
+    double ms;
+    load(aircraft, false, ms);
+
+    double serialMs, prefetchMs;
+    osg::ref_ptr<osg::Node> serial = load(aircraft, false, serialMs);
+    osg::ref_ptr<osg::Node> prefetched = load(aircraft, true, prefetchMs);
+
+    CountVisitor serialCount, prefetchedCount;
+    serial->accept(serialCount);
+    prefetched->accept(prefetchedCount);
+    SG_CHECK_EQUAL(serialCount.nodes, prefetchedCount.nodes);
+    SG_CHECK_EQUAL(serialCount.drawables, prefetchedCount.drawables);
+    SG_VERIFY(serialCount.drawables >= unsigned(NumParts + NumParts / 4));
+
+    std::cout << NumParts + NumParts / 4 << " sub-models: serial " << serialMs
+              << " ms, prefetched " << prefetchMs << " ms" << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -38,7 +38,6 @@
 #include <osgDB/ReaderWriter>
 #include <osgDB/ReadFile>
 
-#include <simgear/math/sg_random.h>
 #include <simgear/math/SGGeometry.hxx>
 #include <simgear/bucket/newbucket.hxx>
 #include <simgear/debug/logstream.hxx>
@@ -59,6 +58,7 @@
 #include <simgear/scene/util/SGSceneFeatures.hxx>
 
 #include "SGOceanTile.hxx"
+#include "SGSTGCache.hxx"
 
 #define BUILDING_ROUGH "OBJECT_BUILDING_MESH_ROUGH"
 #define BUILDING_DETAILED "OBJECT_BUILDING_MESH_DETAILED"
@@ -409,14 +409,25 @@ struct ReaderWriterSTG::_ModelBin {
         }
     }
 
-    bool read(const SGPath& absoluteFileName, const osgDB::Options* options)
+    static void setPosition(_ObjectStatic& obj, const STGRecord& record)
     {
-        if (!absoluteFileName.exists()) {
-            return false;
-        }
+        obj._lon = record._lon;
+        obj._lat = record._lat;
+        obj._elev = record._elev;
+        obj._hdg = record._hdg;
+        obj._pitch = record._pitch;
+        obj._roll = record._roll;
+        obj._radius = record._radius;
+    }
 
-        sg_gzifstream stream(absoluteFileName);
-        if (!stream.is_open()) {
+    bool read(const SGPath& absoluteFileName, const osgDB::Options* options)
+    {
+        // Parsed .stg contents, with the paths and range factors resolved,
+        // are cached on disk if a cache directory is configured, so
+        // revisited tiles do not parse the text again.
+        STGCache cache(SGPath::fromUtf8(options->getPluginStringData("SimGear::STG_CACHE_PATH")));
+        STGRecordList records;
+        if (!cache.read(absoluteFileName, records)) {
             return false;
         }
 
@@ -434,12 +445,6 @@ struct ReaderWriterSTG::_ModelBin {
 
         std::string filePath = osgDB::getFilePath(absoluteFileName.utf8Str());
 
-        // Bucket provides a consistent seed
-        // so we have consistent set of pseudo-random numbers for each STG file
-        mt seed;
-        int bucket = atoi(absoluteFileName.file_base().c_str());
-        mt_init(&seed, bucket);
-
         bool vpb_active = SGSceneFeatures::instance()->getVPBActive();
 
         // do only load airport btg files.
@@ -447,32 +452,11 @@ struct ReaderWriterSTG::_ModelBin {
         // do only load terrain btg files
         bool onlyTerrain = options->getPluginStringData("SimGear::FG_ONLY_TERRAIN") == "ON";
 
-        while (!stream.eof()) {
-            // read a line
-            std::string line;
-            std::getline(stream, line);
-
-            // strip comments
-            std::string::size_type hash_pos = line.find('#');
-            if (hash_pos != std::string::npos)
-                line.resize(hash_pos);
-
-            // and process further
-            std::stringstream in(line);
-
-            std::string token;
-            in >> token;
-
-            // No comment
-            if (token.empty())
-                continue;
-
-            // Then there is always a name
-            std::string name;
-            in >> name;
+        for (const auto& record : records) {
+            const std::string& token = record._token;
+            const std::string& name = record._name;
 
-            SGPath path = filePath;
-            path.append(name);
+            const SGPath path = SGPath::fromUtf8(record._path);
 
             if (token == "OBJECT_BASE") {
                 if (!vpb_active) {
@@ -501,10 +485,7 @@ struct ReaderWriterSTG::_ModelBin {
                 // Load non-terrain objects
 
                 // Determine an appropriate range for the object, which has some randomness
-                double range = _object_range_rough;
-                double lrand = mt_rand(&seed);
-                if      (lrand < 0.1) range = range * 2.0;
-                else if (lrand < 0.4) range = range * 1.5;
+                double range = _object_range_rough * record._rangeFactor;
 
                 if (token == "OBJECT_STATIC" || token == "OBJECT_STATIC_AGL") {
                     osg::ref_ptr<SGReaderWriterOptions> opt;
@@ -520,10 +501,11 @@ struct ReaderWriterSTG::_ModelBin {
                     obj._name = name;
                     obj._agl = (token == "OBJECT_STATIC_AGL");
                     obj._proxy = true;
-                    in >> obj._lon >> obj._lat >> obj._elev >> obj._hdg >> obj._pitch >> obj._roll >> obj._radius;
+                    setPosition(obj, record);
                     obj._range = range;
                     obj._options = opt;
-                    checkInsideBucket(absoluteFileName, obj._lon, obj._lat);
+                    if (!record._insideBucket)
+                        checkInsideBucket(absoluteFileName, obj._lon, obj._lat);
                     _objectStaticList.push_back(obj);
                 } else if (token == "OBJECT_SHARED" || token == "OBJECT_SHARED_AGL") {
                     osg::ref_ptr<SGReaderWriterOptions> opt;
@@ -538,17 +520,22 @@ struct ReaderWriterSTG::_ModelBin {
                     obj._name = name;
                     obj._agl = (token == "OBJECT_SHARED_AGL");
                     obj._proxy = false;
-                    in >> obj._lon >> obj._lat >> obj._elev >> obj._hdg >> obj._pitch >> obj._roll >> obj._radius;
+                    setPosition(obj, record);
                     obj._range = range;
                     obj._options = opt;
-                    checkInsideBucket(absoluteFileName, obj._lon, obj._lat);
+                    if (!record._insideBucket)
+                        checkInsideBucket(absoluteFileName, obj._lon, obj._lat);
                     _objectStaticList.push_back(obj);
                 } else if (token == "OBJECT_SIGN" || token == "OBJECT_SIGN_AGL") {
                     _Sign sign;
                     sign._token = token;
                     sign._name = name;
                     sign._agl = (token == "OBJECT_SIGN_AGL");
-                    in >> sign._lon >> sign._lat >> sign._elev >> sign._hdg >> sign._size;
+                    sign._lon = record._lon;
+                    sign._lat = record._lat;
+                    sign._elev = record._elev;
+                    sign._hdg = record._hdg;
+                    sign._size = record._size;
                     _signList.push_back(sign);
                 } else if (token == BUILDING_ROUGH || token == BUILDING_DETAILED ||
                            token == ROAD_ROUGH     || token == ROAD_DETAILED     ||
@@ -581,33 +568,39 @@ struct ReaderWriterSTG::_ModelBin {
                     obj._name = name;
                     obj._agl = false;
                     obj._proxy = true;
-                    in >> obj._lon >> obj._lat >> obj._elev >> obj._hdg >> obj._pitch >> obj._roll >> obj._radius;
+                    setPosition(obj, record);
 
                     opt->setLocation(obj._lon, obj._lat);
                     if (token == BUILDING_DETAILED || token == ROAD_DETAILED || token == RAILWAY_DETAILED ) {
                         // Apply a lower LOD range if this is a detailed mesh.
-                        range = _object_range_detailed;
-                        double lrand = mt_rand(&seed);
-                        if      (lrand < 0.1) range = range * 2.0;
-                        else if (lrand < 0.4) range = range * 1.5;                                        
+                        range = _object_range_detailed * record._detailedRangeFactor;
                     }
                     
                     obj._range = range;
 
                     obj._options = opt;
-                    checkInsideBucket(absoluteFileName, obj._lon, obj._lat);
+                    if (!record._insideBucket)
+                        checkInsideBucket(absoluteFileName, obj._lon, obj._lat);
                     _objectStaticList.push_back(obj);
                 } else if (token == BUILDING_LIST) {
                   _BuildingList buildinglist;
                   buildinglist._filename = path.utf8Str();
-                  in >> buildinglist._material_name >> buildinglist._lon >> buildinglist._lat >> buildinglist._elev;
-                  checkInsideBucket(absoluteFileName, buildinglist._lon, buildinglist._lat);
+                  buildinglist._material_name = record._material;
+                  buildinglist._lon = record._lon;
+                  buildinglist._lat = record._lat;
+                  buildinglist._elev = record._elev;
+                  if (!record._insideBucket)
+                      checkInsideBucket(absoluteFileName, buildinglist._lon, buildinglist._lat);
                   _buildingListList.push_back(buildinglist);
                 } else if (token == TREE_LIST) {
                   _TreeList treelist;
                   treelist._filename = path.utf8Str();
-                  in >> treelist._material_name >> treelist._lon >> treelist._lat >> treelist._elev;
-                  checkInsideBucket(absoluteFileName, treelist._lon, treelist._lat);
+                  treelist._material_name = record._material;
+                  treelist._lon = record._lon;
+                  treelist._lat = record._lat;
+                  treelist._elev = record._elev;
+                  if (!record._insideBucket)
+                      checkInsideBucket(absoluteFileName, treelist._lon, treelist._lat);
                   _treeListList.push_back(treelist);
                 } else {
                     // Check registered callback for token. Keep lock until callback completed to make sure it will not be
@@ -617,15 +610,8 @@ struct ReaderWriterSTG::_ModelBin {
                         STGObjectCallback callback = globalStgObjectCallbacks[token];
 
                         if (callback != nullptr) {
-                            _ObjectStatic obj;
                             // pitch and roll are not common, so passed in "restofline" only
-                            in >> obj._lon >> obj._lat >> obj._elev >> obj._hdg;
-                            string_list restofline;
-                            std::string buf;
-                            while (in >> buf) {
-                                restofline.push_back(buf);
-                            }
-                            callback(token,name, SGGeod::fromDegM(obj._lon, obj._lat, obj._elev), obj._hdg,restofline);
+                            callback(token,name, SGGeod::fromDegM(record._lon, record._lat, record._elev), record._hdg, record._restOfLine);
                         } else {
                             SG_LOG( SG_TERRAIN, SG_ALERT, absoluteFileName << ": Unknown token '" << token << "'" );
                         }
@@ -0,0 +1,193 @@
+// SGBTGCache.cxx -- on-disk cache of the binned surface geometry of BTG tiles
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifdef HAVE_CONFIG_H
+#  include <simgear_config.h>
+#endif
+
+#include "SGBTGCache.hxx"
+
+#ifndef _WIN32
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+#include <simgear/debug/logstream.hxx>
+#include <simgear/io/iostreams/sgstream.hxx>
+
+#include "SGCacheFile_private.hxx"
+
+namespace simgear {
+
+namespace {
+
+const char CacheMagic[8] = { 'S', 'G', 'B', 'T', 'G', 'C', 'C', 'H' };
+const uint32_t CacheVersion = 1;
+
+static_assert(sizeof(BTGCacheVertex) == 12 * sizeof(float),
+              "BTGCacheVertex must not be padded");
+
+} // anonymous namespace
+
+BTGCacheFile::BTGCacheFile() :
+    _data(0), _size(0), _mapped(false),
+    _center(SGVec3d::zeros()), _hasPoints(false)
+{
+}
+
+BTGCacheFile::~BTGCacheFile()
+{
+#ifndef _WIN32
+    if (_mapped)
+        munmap(const_cast<char*>(_data), _size);
+#endif
+}
+
+bool BTGCacheFile::map(const SGPath& cacheFile)
+{
+#ifndef _WIN32
+    int fd = ::open(cacheFile.local8BitStr().c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void* data = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED)
+        return false;
+    _data = static_cast<const char*>(data);
+    _size = st.st_size;
+    _mapped = true;
+#else
+    sg_ifstream stream(cacheFile, std::ios::in | std::ios::binary);
+    if (!stream.is_open())
+        return false;
+    const std::string data = stream.read_all();
+    // std::vector<char> storage is suitably aligned for the vertex arrays
+    _buffer.assign(data.begin(), data.end());
+    _data = _buffer.data();
+    _size = _buffer.size();
+#endif
+    return true;
+}
+
+bool BTGCacheFile::parse(const SGPath& btgFile)
+{
+    CacheFileReader reader(_data, _size);
+    if (!reader.checkHeader(CacheMagic, CacheVersion, btgFile))
+        return false;
+
+    double center[3];
+    for (int i = 0; i < 3; ++i)
+        center[i] = reader.get<double>();
+    _center = SGVec3d(center[0], center[1], center[2]);
+    _hasPoints = reader.get<uint32_t>() != 0;
+
+    uint32_t count = reader.get<uint32_t>();
+    for (uint32_t i = 0; i < count && reader.ok(); ++i) {
+        BTGCacheMesh mesh;
+        mesh.material = reader.getString();
+        mesh.textureIndex = reader.get<int32_t>();
+        mesh.hasSecondaryTexCoord = reader.get<uint32_t>() != 0;
+        float s = reader.get<float>();
+        float t = reader.get<float>();
+        mesh.texCoordScale = SGVec2f(s, t);
+        mesh.numVertices = reader.get<uint32_t>();
+        mesh.numIndices = reader.get<uint32_t>();
+        mesh.vertices = reader.getArray<BTGCacheVertex>(mesh.numVertices);
+        mesh.indices = reader.getArray<uint32_t>(mesh.numIndices);
+        if (!reader.ok())
+            break;
+        for (uint32_t j = 0; j < mesh.numIndices; ++j) {
+            if (mesh.numVertices <= mesh.indices[j])
+                return false;
+        }
+        _meshes.push_back(mesh);
+    }
+
+    if (!reader.ok() || !reader.atEnd()) {
+        SG_LOG(SG_TERRAIN, SG_WARN, "Ignoring corrupt BTG cache file for " << btgFile);
+        return false;
+    }
+    return true;
+}
+
+std::unique_ptr<BTGCacheFile> BTGCacheFile::open(const SGPath& cacheFile,
+                                                 const SGPath& btgFile)
+{
+    if (!cacheFile.exists())
+        return std::unique_ptr<BTGCacheFile>();
+
+    std::unique_ptr<BTGCacheFile> file(new BTGCacheFile);
+    if (!file->map(cacheFile) || !file->parse(btgFile))
+        return std::unique_ptr<BTGCacheFile>();
+    return file;
+}
+
+void BTGCacheWriter::addMesh(const BTGCacheMesh& mesh)
+{
+    Mesh m;
+    m.mesh = mesh;
+    m.vertices.assign(mesh.vertices, mesh.vertices + mesh.numVertices);
+    m.indices.assign(mesh.indices, mesh.indices + mesh.numIndices);
+    m.mesh.vertices = m.vertices.data();
+    m.mesh.indices = m.indices.data();
+    _meshes.push_back(std::move(m));
+}
+
+std::vector<BTGCacheMesh> BTGCacheWriter::getMeshes() const
+{
+    std::vector<BTGCacheMesh> meshes;
+    for (const auto& m : _meshes)
+        meshes.push_back(m.mesh);
+    return meshes;
+}
+
+bool BTGCacheWriter::write(const SGPath& cacheFile, const SGPath& btgFile) const
+{
+    CacheFileWriter writer;
+    writer.putHeader(CacheMagic, CacheVersion, btgFile);
+    writer.put(_center[0]);
+    writer.put(_center[1]);
+    writer.put(_center[2]);
+    writer.put(uint32_t(_hasPoints));
+    writer.put(uint32_t(_meshes.size()));
+    for (const auto& m : _meshes) {
+        writer.putString(m.mesh.material);
+        writer.put(int32_t(m.mesh.textureIndex));
+        writer.put(uint32_t(m.mesh.hasSecondaryTexCoord));
+        writer.put(m.mesh.texCoordScale[0]);
+        writer.put(m.mesh.texCoordScale[1]);
+        writer.put(uint32_t(m.vertices.size()));
+        writer.put(uint32_t(m.indices.size()));
+        writer.putArray(m.vertices.data(), m.vertices.size() * sizeof(BTGCacheVertex));
+        writer.putArray(m.indices.data(), m.indices.size() * sizeof(uint32_t));
+    }
+
+    return writer.writeFile(cacheFile);
+}
+
+SGPath btgCacheFile(const SGPath& cacheDir, const SGPath& btgFile)
+{
+    return cacheFilePath(cacheDir, btgFile, ".geom");
+}
+
+}
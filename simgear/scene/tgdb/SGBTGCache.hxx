@@ -0,0 +1,133 @@
+// SGBTGCache.hxx -- on-disk cache of the binned surface geometry of BTG tiles
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef _SGBTGCACHE_HXX
+#define _SGBTGCACHE_HXX
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <simgear/math/SGMath.hxx>
+#include <simgear/misc/sg_path.hxx>
+
+namespace simgear {
+
+/// One vertex of a cached mesh, interleaved as it is uploaded.
+struct BTGCacheVertex {
+    float position[3];
+    float normal[3];
+    float texCoord0[2];
+    float texCoord1[2];
+    float overlayCoord[2];
+};
+
+/**
+ * The surface geometry of one material of a tile: the vertices in the order
+ * SGTexturedTriangleBin::buildGeometry() emits them, and three indices per
+ * triangle. The arrays are owned by whoever provides the mesh.
+ */
+struct BTGCacheMesh {
+    BTGCacheMesh() : textureIndex(0), hasSecondaryTexCoord(false),
+                     texCoordScale(1, 1), vertices(0), numVertices(0),
+                     indices(0), numIndices(0) { }
+
+    std::string material;
+    int textureIndex;
+    bool hasSecondaryTexCoord;
+    /// Scale applied to the primary texture coordinates. The cache is
+    /// only valid while the material library still uses the same scales.
+    SGVec2f texCoordScale;
+    const BTGCacheVertex* vertices;
+    uint32_t numVertices;
+    const uint32_t* indices;
+    uint32_t numIndices;
+};
+
+/**
+ * A cache file opened for reading. The file is mapped into memory where
+ * the platform allows it, so the meshes point directly into the file.
+ */
+class BTGCacheFile {
+public:
+    ~BTGCacheFile();
+
+    /// Open the cache file of a .btg file, if it exists and was written for
+    /// the current version of that .btg file. Returns null otherwise.
+    static std::unique_ptr<BTGCacheFile> open(const SGPath& cacheFile,
+                                              const SGPath& btgFile);
+
+    const SGVec3d& getCenter() const
+    { return _center; }
+    /// Whether the tile has point lights, which are not cached
+    bool hasPoints() const
+    { return _hasPoints; }
+    const std::vector<BTGCacheMesh>& getMeshes() const
+    { return _meshes; }
+
+private:
+    BTGCacheFile();
+    bool map(const SGPath& cacheFile);
+    bool parse(const SGPath& btgFile);
+
+    const char* _data;
+    size_t _size;
+    bool _mapped;
+    std::vector<char> _buffer;
+
+    SGVec3d _center;
+    bool _hasPoints;
+    std::vector<BTGCacheMesh> _meshes;
+};
+
+/**
+ * Collects the meshes of a tile and writes them into a cache file.
+ */
+class BTGCacheWriter {
+public:
+    BTGCacheWriter() : _center(SGVec3d::zeros()), _hasPoints(false) { }
+
+    void setCenter(const SGVec3d& center)
+    { _center = center; }
+    void setHasPoints(bool hasPoints)
+    { _hasPoints = hasPoints; }
+
+    /// The vertex and index arrays of the mesh are copied.
+    void addMesh(const BTGCacheMesh& mesh);
+    /// The meshes added so far, pointing into the copies of the writer
+    std::vector<BTGCacheMesh> getMeshes() const;
+
+    bool write(const SGPath& cacheFile, const SGPath& btgFile) const;
+
+private:
+    struct Mesh {
+        BTGCacheMesh mesh;
+        std::vector<BTGCacheVertex> vertices;
+        std::vector<uint32_t> indices;
+    };
+
+    SGVec3d _center;
+    bool _hasPoints;
+    std::vector<Mesh> _meshes;
+};
+
+/// The cache file for a .btg file in a cache directory.
+SGPath btgCacheFile(const SGPath& cacheDir, const SGPath& btgFile);
+
+}
+
+#endif // _SGBTGCACHE_HXX
@@ -0,0 +1,230 @@
+// Checks that a BTG cache file gives back the meshes binned from a tile,
+// that it is only used for the .btg file it was written for, and compares
+// the time SGLoadBTG takes to load a revisited tile with and without it.
+
+#ifdef HAVE_CONFIG_H
+#  include <simgear_config.h>
+#endif
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+
+#include <osg/Node>
+
+#include <simgear/io/iostreams/sgstream.hxx>
+#include <simgear/io/sg_binobj.hxx>
+#include <simgear/misc/sg_dir.hxx>
+#include <simgear/misc/test_macros.hxx>
+#include <simgear/props/props.hxx>
+#include <simgear/scene/util/SGReaderWriterOptions.hxx>
+
+#include "SGBTGCache.hxx"
+#include "SGTexturedTriangleBin.hxx"
+#include "obj.hxx"
+
+using namespace simgear;
+
+static const int GridSize = 300;
+static const int NumMaterials = 8;
+
+// A tile made of a regular grid, with the materials in bands
+static void writeBTG(const SGPath& path, int gridSize)
+{
+    SGBinObject tile;
+    tile.set_gbs_center(SGVec3d(-2706140, -4261060, 3885280));
+    tile.set_gbs_radius(10000);
+
+    std::vector<SGVec3d> points;
+    std::vector<SGVec3f> normals;
+    std::vector<SGVec2f> texCoords;
+    for (int y = 0; y < gridSize; ++y) {
+        for (int x = 0; x < gridSize; ++x) {
+            points.push_back(SGVec3d(x * 50.0, y * 50.0, 100.0 + (x * y) % 17));
+            normals.push_back(normalize(SGVec3f(x % 5, y % 7, 10)));
+            texCoords.push_back(SGVec2f(x * 0.1f, y * 0.1f));
+        }
+    }
+    tile.set_wgs84_nodes(points);
+    tile.set_normals(normals);
+    tile.set_texcoords(texCoords);
+
+    SGBinObjectTriangle tri;
+    for (int y = 0; y + 1 < gridSize; ++y) {
+        for (int x = 0; x + 1 < gridSize; ++x) {
+            int i = y * gridSize + x;
+            tri.material = "material" + std::to_string(NumMaterials * y / gridSize);
+            tri.v_list = { i, i + 1, i + gridSize };
+            tri.n_list = tri.v_list;
+            tri.tc_list[0] = tri.v_list;
+            tile.add_triangle(tri);
+            tri.v_list = { i + 1, i + gridSize + 1, i + gridSize };
+            tri.n_list = tri.v_list;
+            tri.tc_list[0] = tri.v_list;
+            tile.add_triangle(tri);
+        }
+    }
+    SG_VERIFY(tile.write_bin_file(path));
+}
+
+// The meshes SGLoadBTG caches for a tile: read it, bin the triangles of
+// each material and build their buffers.
+static void binTile(const SGPath& path, BTGCacheWriter& writer)
+{
+    SGBinObject tile;
+    SG_VERIFY(tile.read_bin(path));
+    std::map<std::string, SGTexturedTriangleBin> bins;
+
+    const std::vector<SGVec3d>& vertices(tile.get_wgs84_nodes());
+    const std::vector<SGVec3f>& normals(tile.get_normals());
+    const std::vector<SGVec2f>& texCoords(tile.get_texcoords());
+    for (unsigned grp = 0; grp < tile.get_tris_v().size(); ++grp) {
+        SGTexturedTriangleBin& bin = bins[tile.get_tri_materials()[grp]];
+        const int_list& tris_v(tile.get_tris_v()[grp]);
+        const int_list& tris_n(tile.get_tris_n()[grp]);
+        const int_list& tris_tc(tile.get_tris_tcs()[grp][0]);
+        for (unsigned i = 2; i < tris_v.size(); i += 3) {
+            SGVertNormTex v[3];
+            for (int j = 0; j < 3; ++j) {
+                v[j].SetVertex(toVec3f(vertices[tris_v[i - 2 + j]]));
+                v[j].SetNormal(normals[tris_n[i - 2 + j]]);
+                v[j].SetTexCoord(0, texCoords[tris_tc[i - 2 + j]]);
+                v[j].SetOverlayCoord(SGVec2f(0, 0));
+            }
+            bin.insert(v[0], v[1], v[2]);
+        }
+    }
+
+    writer.setCenter(tile.get_gbs_center());
+    writer.setHasPoints(!tile.get_pts_v().empty());
+    std::vector<BTGCacheVertex> meshVertices;
+    std::vector<uint32_t> meshIndices;
+    for (const auto& i : bins) {
+        i.second.getGeometryBuffers(i.second.getTriangles(), meshVertices, meshIndices);
+        BTGCacheMesh mesh;
+        mesh.material = i.first;
+        mesh.textureIndex = i.second.getTextureIndex();
+        mesh.texCoordScale = SGVec2f(1, 1);
+        mesh.vertices = meshVertices.data();
+        mesh.numVertices = meshVertices.size();
+        mesh.indices = meshIndices.data();
+        mesh.numIndices = meshIndices.size();
+        writer.addMesh(mesh);
+    }
+}
+
+// Load the tile the way the tile pager does, nodes and geometry included,
+// and return the average time
+static double loadMs(const SGPath& btg, const SGPath& cacheDir, int repeat)
+{
+    osg::ref_ptr<SGReaderWriterOptions> options = new SGReaderWriterOptions;
+    options->setPropertyNode(new SGPropertyNode);
+    if (!cacheDir.isNull())
+        options->setPluginStringData("SimGear::BTG_CACHE_PATH", cacheDir.utf8Str());
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeat; ++i) {
+        osg::ref_ptr<osg::Node> node = SGLoadBTG(btg.utf8Str(), options.get());
+        SG_VERIFY(node.valid());
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / repeat;
+}
+
+static bool sameMeshes(const std::vector<BTGCacheMesh>& a,
+                       const std::vector<BTGCacheMesh>& b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].material != b[i].material ||
+            a[i].textureIndex != b[i].textureIndex ||
+            a[i].hasSecondaryTexCoord != b[i].hasSecondaryTexCoord ||
+            a[i].texCoordScale != b[i].texCoordScale ||
+            a[i].numVertices != b[i].numVertices ||
+            a[i].numIndices != b[i].numIndices ||
+            std::memcmp(a[i].vertices, b[i].vertices,
+                        a[i].numVertices * sizeof(BTGCacheVertex)) != 0 ||
+            std::memcmp(a[i].indices, b[i].indices,
+                        a[i].numIndices * sizeof(uint32_t)) != 0)
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    simgear::Dir tmpDir = simgear::Dir::tempDir("FlightGear");
+    tmpDir.setRemoveOnDestroy();
+
+    const SGPath btg = tmpDir.path() / "942050.btg.gz";
+    writeBTG(btg, GridSize);
+
+    // Nothing cached yet
+    const SGPath cacheFile = btgCacheFile(tmpDir.path() / "cache", btg);
+    SG_VERIFY(!BTGCacheFile::open(cacheFile, btg));
+
+    BTGCacheWriter writer;
+    binTile(btg, writer);
+    const std::vector<BTGCacheMesh> meshes = writer.getMeshes();
+    SG_CHECK_EQUAL(meshes.size(), size_t(NumMaterials));
+    SG_VERIFY(writer.write(cacheFile, btg));
+
+    // The cache file holds the same meshes, with aligned arrays
+    std::unique_ptr<BTGCacheFile> cache = BTGCacheFile::open(cacheFile, btg);
+    SG_VERIFY(cache);
+    SG_VERIFY(!cache->hasPoints());
+    SG_VERIFY(cache->getCenter() == SGVec3d(-2706140, -4261060, 3885280));
+    SG_VERIFY(sameMeshes(cache->getMeshes(), meshes));
+    for (const BTGCacheMesh& mesh : cache->getMeshes()) {
+        SG_CHECK_EQUAL(reinterpret_cast<uintptr_t>(mesh.vertices) % 16, uintptr_t(0));
+        SG_CHECK_EQUAL(reinterpret_cast<uintptr_t>(mesh.indices) % 16, uintptr_t(0));
+    }
+
+    // Cache files of other .btg files are not used
+    const SGPath other = tmpDir.path() / "942051.btg.gz";
+    writeBTG(other, GridSize);
+    SG_VERIFY(!BTGCacheFile::open(cacheFile, other));
+    SG_VERIFY(btgCacheFile(tmpDir.path() / "cache", other) != cacheFile);
+
+    // Revisiting a tile: SGLoadBTG without a cache, and with one. The first
+    // load with a cache directory writes the cache file of the tile.
+    const SGPath loadCacheDir = tmpDir.path() / "load-cache";
+    const int repeat = 3;
+    double binMs = loadMs(btg, SGPath(), repeat);
+    loadMs(btg, loadCacheDir, 1);
+    cache = BTGCacheFile::open(btgCacheFile(loadCacheDir, btg), btg);
+    SG_VERIFY(cache);
+    size_t indices = 0;
+    for (const BTGCacheMesh& mesh : cache->getMeshes())
+        indices += mesh.numIndices;
+    SG_CHECK_EQUAL(indices, size_t(6 * (GridSize - 1) * (GridSize - 1)));
+    cache.reset();
+    double cacheMs = loadMs(btg, loadCacheDir, repeat);
+    std::cout << indices / 3 << " triangles, SGLoadBTG: without cache " << binMs
+              << " ms, with cache " << cacheMs << " ms" << std::endl;
+
+    // A changed .btg file invalidates the cache
+    writeBTG(btg, GridSize / 2);
+    SG_VERIFY(!BTGCacheFile::open(cacheFile, btg));
+
+    // A truncated cache file is ignored
+    BTGCacheWriter changed;
+    binTile(btg, changed);
+    SG_VERIFY(changed.write(cacheFile, btg));
+    SG_VERIFY(BTGCacheFile::open(cacheFile, btg));
+    std::string data;
+    {
+        sg_ifstream in(cacheFile, std::ios::in | std::ios::binary);
+        data = in.read_all();
+    }
+    {
+        sg_ofstream out(cacheFile, std::ios::out | std::ios::binary);
+        out.write(data.data(), data.size() / 2);
+    }
+    SG_VERIFY(!BTGCacheFile::open(cacheFile, btg));
+
+    return EXIT_SUCCESS;
+}
@@ -24,6 +24,8 @@
 #endif
 
 #include <algorithm>
+#include <atomic>
+#include <mutex>
 #include <vector>
 #include <string>
 #include <map>
@@ -49,7 +51,9 @@
 #include <simgear/misc/sg_path.hxx>
 #include <simgear/scene/model/model.hxx>
 #include <simgear/props/props.hxx>
+#include <simgear/structure/OSGUtils.hxx>
 
+#include "SGInstanceBuffer.hxx"
 #include "ShaderGeometry.hxx"
 #include "SGBuildingBin.hxx"
 
@@ -64,274 +68,319 @@ static BuildingStateSetMap statesetmap;
 typedef std::map<std::string, osg::observer_ptr<Effect> > EffectMap;
 static EffectMap buildingEffectMap;
 
-// Helper classes for creating the quad tree
-struct MakeBuildingLeaf
+// The geometry of a building, the same for all of them: the shader moves,
+// scales and deforms it for each instance.
+static Geometry* makeSharedBuildingGeometry()
 {
-    MakeBuildingLeaf(float range, Effect* effect, bool fade) :
-        _range(range), _effect(effect), _fade_out(fade) {}
+    osg::Vec3Array* v = new osg::Vec3Array;
+    osg::Vec2Array* t = new osg::Vec2Array;
+    osg::Vec3Array* n = new osg::Vec3Array;
+    osg::Vec4Array* c = new osg::Vec4Array;
+    // Color array is used to identify the different building faces by the
+    // vertex shader for texture mapping:
+    // (front, roof, roof top vertex, side)
+
+    v->reserve(52);
+    t->reserve(52);
+    n->reserve(52);
+    c->reserve(52);
+
+    // Now create an OSG Geometry based on the Building
+    // 0,0,0 is the bottom center of the front
+    // face, e.g. where the front door would be
+
+    // BASEMENT
+    // This extends 10m below the main section
+    // Front face
+    v->push_back( osg::Vec3( 0.0, -0.5, -1.0) ); // bottom right
+    v->push_back( osg::Vec3( 0.0,  0.5, -1.0) ); // bottom left
+    v->push_back( osg::Vec3( 0.0,  0.5,  0.0) ); // top left
+    v->push_back( osg::Vec3( 0.0, -0.5,  0.0) ); // top right
+
+    for (int i=0; i<4; ++i) {
+      n->push_back( osg::Vec3(1, 0, 0) );    // normal
+      c->push_back( osg::Vec4(1, 0, 0, 0) ); // color - used to differentiate wall from roof
+      t->push_back( osg::Vec2( 0.0, 0.0) );
+    }
 
-    MakeBuildingLeaf(const MakeBuildingLeaf& rhs) :
-        _range(rhs._range), _effect(rhs._effect), _fade_out(rhs._fade_out)
-    {}
+    // Left face
+    v->push_back( osg::Vec3( -1.0, -0.5, -1.0) ); // bottom right
+    v->push_back( osg::Vec3(  0.0, -0.5, -1.0) ); // bottom left
+    v->push_back( osg::Vec3(  0.0, -0.5,  0.0) ); // top left
+    v->push_back( osg::Vec3( -1.0, -0.5,  0.0) ); // top right
 
-    LOD* operator() () const
-    {
-        osg::Vec3Array* v = new osg::Vec3Array;
-        osg::Vec2Array* t = new osg::Vec2Array;
-        osg::Vec3Array* n = new osg::Vec3Array;
-        osg::Vec4Array* c = new osg::Vec4Array;
-        // Color array is used to identify the different building faces by the
-        // vertex shader for texture mapping:
-        // (front, roof, roof top vertex, side)
-
-        v->reserve(52);
-        t->reserve(52);
-        n->reserve(52);
-        c->reserve(52);
-
-        // Now create an OSG Geometry based on the Building
-        // 0,0,0 is the bottom center of the front
-        // face, e.g. where the front door would be
-
-        // BASEMENT
-        // This extends 10m below the main section
-        // Front face
-        v->push_back( osg::Vec3( 0.0, -0.5, -1.0) ); // bottom right
-        v->push_back( osg::Vec3( 0.0,  0.5, -1.0) ); // bottom left
-        v->push_back( osg::Vec3( 0.0,  0.5,  0.0) ); // top left
-        v->push_back( osg::Vec3( 0.0, -0.5,  0.0) ); // top right
-
-        for (int i=0; i<4; ++i) {
-          n->push_back( osg::Vec3(1, 0, 0) );    // normal
-          c->push_back( osg::Vec4(1, 0, 0, 0) ); // color - used to differentiate wall from roof
-          t->push_back( osg::Vec2( 0.0, 0.0) );
-        }
+    for (int i=0; i<4; ++i) {
+      n->push_back( osg::Vec3(0, -1, 0) );   // normal
+      c->push_back( osg::Vec4(1, 0, 0, 0) ); // color - used to differentiate wall from roof
+      t->push_back( osg::Vec2( 0.0, 0.0) );
+    }
 
-        // Left face
-        v->push_back( osg::Vec3( -1.0, -0.5, -1.0) ); // bottom right
-        v->push_back( osg::Vec3(  0.0, -0.5, -1.0) ); // bottom left
-        v->push_back( osg::Vec3(  0.0, -0.5,  0.0) ); // top left
-        v->push_back( osg::Vec3( -1.0, -0.5,  0.0) ); // top right
+    // Back face
+    v->push_back( osg::Vec3( -1.0,  0.5, -1.0) ); // bottom right
+    v->push_back( osg::Vec3( -1.0, -0.5, -1.0) ); // bottom left
+    v->push_back( osg::Vec3( -1.0, -0.5,  0.0) ); // top left
+    v->push_back( osg::Vec3( -1.0,  0.5,  0.0) ); // top right
 
-        for (int i=0; i<4; ++i) {
-          n->push_back( osg::Vec3(0, -1, 0) );   // normal
-          c->push_back( osg::Vec4(1, 0, 0, 0) ); // color - used to differentiate wall from roof
-          t->push_back( osg::Vec2( 0.0, 0.0) );
-        }
+    for (int i=0; i<4; ++i) {
+      n->push_back( osg::Vec3(-1, 0, 0) );   // normal
+      c->push_back( osg::Vec4(1, 0, 0, 0) ); // color - used to differentiate wall from roof
+      t->push_back( osg::Vec2( 0.0, 0.0) );
+    }
 
-        // Back face
-        v->push_back( osg::Vec3( -1.0,  0.5, -1.0) ); // bottom right
-        v->push_back( osg::Vec3( -1.0, -0.5, -1.0) ); // bottom left
-        v->push_back( osg::Vec3( -1.0, -0.5,  0.0) ); // top left
-        v->push_back( osg::Vec3( -1.0,  0.5,  0.0) ); // top right
+    // Right face
+    v->push_back( osg::Vec3(  0.0, 0.5, -1.0) ); // bottom right
+    v->push_back( osg::Vec3( -1.0, 0.5, -1.0) ); // bottom left
+    v->push_back( osg::Vec3( -1.0, 0.5,  0.0) ); // top left
+    v->push_back( osg::Vec3(  0.0, 0.5,  0.0) ); // top right
 
-        for (int i=0; i<4; ++i) {
-          n->push_back( osg::Vec3(-1, 0, 0) );   // normal
-          c->push_back( osg::Vec4(1, 0, 0, 0) ); // color - used to differentiate wall from roof
-          t->push_back( osg::Vec2( 0.0, 0.0) );
-        }
+    for (int i=0; i<4; ++i) {
+      n->push_back( osg::Vec3(0, 1, 0) );    // normal
+      c->push_back( osg::Vec4(1, 0, 0, 0) ); // color - used to differentiate wall from roof
+      t->push_back( osg::Vec2( 0.0, 0.0) );
+    }
 
-        // Right face
-        v->push_back( osg::Vec3(  0.0, 0.5, -1.0) ); // bottom right
-        v->push_back( osg::Vec3( -1.0, 0.5, -1.0) ); // bottom left
-        v->push_back( osg::Vec3( -1.0, 0.5,  0.0) ); // top left
-        v->push_back( osg::Vec3(  0.0, 0.5,  0.0) ); // top right
+    // MAIN BODY
+    // Front face
+    v->push_back( osg::Vec3( 0.0, -0.5, 0.0) ); // bottom right
+    v->push_back( osg::Vec3( 0.0,  0.5, 0.0) ); // bottom left
+    v->push_back( osg::Vec3( 0.0,  0.5, 1.0) ); // top left
+    v->push_back( osg::Vec3( 0.0, -0.5, 1.0) ); // top right
+
+    t->push_back( osg::Vec2( 1.0, 0.0) ); // bottom right
+    t->push_back( osg::Vec2( 0.0, 0.0) ); // bottom left
+    t->push_back( osg::Vec2( 0.0, 1.0) ); // top left
+    t->push_back( osg::Vec2( 1.0, 1.0) ); // top right
+
+    for (int i=0; i<4; ++i) {
+      n->push_back( osg::Vec3(1, 0, 0) );    // normal
+      c->push_back( osg::Vec4(1, 0, 0, 0) ); // color - used to differentiate wall from roof
+    }
 
-        for (int i=0; i<4; ++i) {
-          n->push_back( osg::Vec3(0, 1, 0) );    // normal
-          c->push_back( osg::Vec4(1, 0, 0, 0) ); // color - used to differentiate wall from roof
-          t->push_back( osg::Vec2( 0.0, 0.0) );
-        }
+    // Left face
+    v->push_back( osg::Vec3( -1.0, -0.5, 0.0) ); // bottom right
+    v->push_back( osg::Vec3(  0.0, -0.5, 0.0) ); // bottom left
+    v->push_back( osg::Vec3(  0.0, -0.5, 1.0) ); // top left
+    v->push_back( osg::Vec3( -1.0, -0.5, 1.0) ); // top right
 
-        // MAIN BODY
-        // Front face
-        v->push_back( osg::Vec3( 0.0, -0.5, 0.0) ); // bottom right
-        v->push_back( osg::Vec3( 0.0,  0.5, 0.0) ); // bottom left
-        v->push_back( osg::Vec3( 0.0,  0.5, 1.0) ); // top left
-        v->push_back( osg::Vec3( 0.0, -0.5, 1.0) ); // top right
-
-        t->push_back( osg::Vec2( 1.0, 0.0) ); // bottom right
-        t->push_back( osg::Vec2( 0.0, 0.0) ); // bottom left
-        t->push_back( osg::Vec2( 0.0, 1.0) ); // top left
-        t->push_back( osg::Vec2( 1.0, 1.0) ); // top right
-
-        for (int i=0; i<4; ++i) {
-          n->push_back( osg::Vec3(1, 0, 0) );    // normal
-          c->push_back( osg::Vec4(1, 0, 0, 0) ); // color - used to differentiate wall from roof
-        }
+    t->push_back( osg::Vec2( 0.0, 0.0) ); // bottom right
+    t->push_back( osg::Vec2( 1.0, 0.0) ); // bottom left
+    t->push_back( osg::Vec2( 1.0, 1.0) ); // top left
+    t->push_back( osg::Vec2( 0.0, 1.0) ); // top right
 
-        // Left face
-        v->push_back( osg::Vec3( -1.0, -0.5, 0.0) ); // bottom right
-        v->push_back( osg::Vec3(  0.0, -0.5, 0.0) ); // bottom left
-        v->push_back( osg::Vec3(  0.0, -0.5, 1.0) ); // top left
-        v->push_back( osg::Vec3( -1.0, -0.5, 1.0) ); // top right
+    for (int i=0; i<4; ++i) {
+      n->push_back( osg::Vec3(0, -1, 0) );    // normal
+      c->push_back( osg::Vec4(0, 0, 0, 1) ); // color - used to differentiate wall from roof
+    }
 
-        t->push_back( osg::Vec2( 0.0, 0.0) ); // bottom right
-        t->push_back( osg::Vec2( 1.0, 0.0) ); // bottom left
-        t->push_back( osg::Vec2( 1.0, 1.0) ); // top left
-        t->push_back( osg::Vec2( 0.0, 1.0) ); // top right
+    // Back face
+    v->push_back( osg::Vec3( -1.0,  0.5, 0.0) ); // bottom right
+    v->push_back( osg::Vec3( -1.0, -0.5, 0.0) ); // bottom left
+    v->push_back( osg::Vec3( -1.0, -0.5, 1.0) ); // top left
+    v->push_back( osg::Vec3( -1.0,  0.5, 1.0) ); // top right
 
-        for (int i=0; i<4; ++i) {
-          n->push_back( osg::Vec3(0, -1, 0) );    // normal
-          c->push_back( osg::Vec4(0, 0, 0, 1) ); // color - used to differentiate wall from roof
-        }
+    t->push_back( osg::Vec2( 1.0, 0.0) ); // bottom right
+    t->push_back( osg::Vec2( 0.0, 0.0) ); // bottom left
+    t->push_back( osg::Vec2( 0.0, 1.0 ) ); // top left
+    t->push_back( osg::Vec2( 1.0, 1.0 ) ); // top right
 
-        // Back face
-        v->push_back( osg::Vec3( -1.0,  0.5, 0.0) ); // bottom right
-        v->push_back( osg::Vec3( -1.0, -0.5, 0.0) ); // bottom left
-        v->push_back( osg::Vec3( -1.0, -0.5, 1.0) ); // top left
-        v->push_back( osg::Vec3( -1.0,  0.5, 1.0) ); // top right
+    for (int i=0; i<4; ++i) {
+      n->push_back( osg::Vec3(-1, 0, 0) );    // normal
+      c->push_back( osg::Vec4(1, 0, 0, 0) ); // color - used to differentiate wall from roof
+    }
 
-        t->push_back( osg::Vec2( 1.0, 0.0) ); // bottom right
-        t->push_back( osg::Vec2( 0.0, 0.0) ); // bottom left
-        t->push_back( osg::Vec2( 0.0, 1.0 ) ); // top left
-        t->push_back( osg::Vec2( 1.0, 1.0 ) ); // top right
+    // Right face
+    v->push_back( osg::Vec3(  0.0, 0.5, 0.0) ); // bottom right
+    v->push_back( osg::Vec3( -1.0, 0.5, 0.0) ); // bottom left
+    v->push_back( osg::Vec3( -1.0, 0.5, 1.0) ); // top left
+    v->push_back( osg::Vec3(  0.0, 0.5, 1.0) ); // top right
 
-        for (int i=0; i<4; ++i) {
-          n->push_back( osg::Vec3(-1, 0, 0) );    // normal
-          c->push_back( osg::Vec4(1, 0, 0, 0) ); // color - used to differentiate wall from roof
-        }
+    t->push_back( osg::Vec2( 0.0, 0.0) ); // bottom right
+    t->push_back( osg::Vec2( 1.0, 0.0) ); // bottom left
+    t->push_back( osg::Vec2( 1.0, 1.0 ) ); // top left
+    t->push_back( osg::Vec2( 0.0, 1.0 ) ); // top right
 
-        // Right face
-        v->push_back( osg::Vec3(  0.0, 0.5, 0.0) ); // bottom right
-        v->push_back( osg::Vec3( -1.0, 0.5, 0.0) ); // bottom left
-        v->push_back( osg::Vec3( -1.0, 0.5, 1.0) ); // top left
-        v->push_back( osg::Vec3(  0.0, 0.5, 1.0) ); // top right
+    for (int i=0; i<4; ++i) {
+      n->push_back( osg::Vec3(0, 1, 0) );    // normal
+      c->push_back( osg::Vec4(0, 0, 0, 1) ); // color - used to differentiate wall from roof
+    }
 
-        t->push_back( osg::Vec2( 0.0, 0.0) ); // bottom right
-        t->push_back( osg::Vec2( 1.0, 0.0) ); // bottom left
-        t->push_back( osg::Vec2( 1.0, 1.0 ) ); // top left
-        t->push_back( osg::Vec2( 0.0, 1.0 ) ); // top right
+    // ROOF 1 - built as a block.  The shader will deform it to the correct shape.
+    // Front face
+    v->push_back( osg::Vec3( 0.0, -0.5, 1.0) ); // bottom right
+    v->push_back( osg::Vec3( 0.0,  0.5, 1.0) ); // bottom left
+    v->push_back( osg::Vec3( 0.0,  0.5, 1.0) ); // top left
+    v->push_back( osg::Vec3( 0.0, -0.5, 1.0) ); // top right
+
+    t->push_back( osg::Vec2( -1.0, 0.0) ); // bottom right
+    t->push_back( osg::Vec2(  0.0, 0.0) ); // bottom left
+    t->push_back( osg::Vec2(  0.0, 1.0) ); // top left
+    t->push_back( osg::Vec2( -1.0, 1.0) ); // top right
+
+    c->push_back( osg::Vec4(0, 1, 0, 0) ); // color - used to differentiate wall from roof
+    c->push_back( osg::Vec4(0, 1, 0, 0) ); // color - used to differentiate wall from roof
+    c->push_back( osg::Vec4(0, 1, 1, 0) ); // color - used to differentiate wall from roof
+    c->push_back( osg::Vec4(0, 1, 1, 0) ); // color - used to differentiate wall from roof
+
+    for (int i=0; i<4; ++i) {
+      n->push_back( osg::Vec3(0.707, 0, 0.707) );    // normal
+    }
 
-        for (int i=0; i<4; ++i) {
-          n->push_back( osg::Vec3(0, 1, 0) );    // normal
-          c->push_back( osg::Vec4(0, 0, 0, 1) ); // color - used to differentiate wall from roof
-        }
+    // Left face
+    v->push_back( osg::Vec3( -1.0, -0.5, 1.0) ); // bottom right
+    v->push_back( osg::Vec3(  0.0, -0.5, 1.0) ); // bottom left
+    v->push_back( osg::Vec3(  0.0, -0.5, 1.0) ); // top left
+    v->push_back( osg::Vec3( -1.0, -0.5, 1.0) ); // top right
 
-        // ROOF 1 - built as a block.  The shader will deform it to the correct shape.
-        // Front face
-        v->push_back( osg::Vec3( 0.0, -0.5, 1.0) ); // bottom right
-        v->push_back( osg::Vec3( 0.0,  0.5, 1.0) ); // bottom left
-        v->push_back( osg::Vec3( 0.0,  0.5, 1.0) ); // top left
-        v->push_back( osg::Vec3( 0.0, -0.5, 1.0) ); // top right
-
-        t->push_back( osg::Vec2( -1.0, 0.0) ); // bottom right
-        t->push_back( osg::Vec2(  0.0, 0.0) ); // bottom left
-        t->push_back( osg::Vec2(  0.0, 1.0) ); // top left
-        t->push_back( osg::Vec2( -1.0, 1.0) ); // top right
-
-        c->push_back( osg::Vec4(0, 1, 0, 0) ); // color - used to differentiate wall from roof
-        c->push_back( osg::Vec4(0, 1, 0, 0) ); // color - used to differentiate wall from roof
-        c->push_back( osg::Vec4(0, 1, 1, 0) ); // color - used to differentiate wall from roof
-        c->push_back( osg::Vec4(0, 1, 1, 0) ); // color - used to differentiate wall from roof
-
-        for (int i=0; i<4; ++i) {
-          n->push_back( osg::Vec3(0.707, 0, 0.707) );    // normal
-        }
+    t->push_back( osg::Vec2(  0.0, 0.0) ); // bottom right
+    t->push_back( osg::Vec2( -1.0, 0.0) ); // bottom left
+    t->push_back( osg::Vec2( -1.0, 1.0) ); // top left
+    t->push_back( osg::Vec2(  0.0, 1.0) ); // top right
 
-        // Left face
-        v->push_back( osg::Vec3( -1.0, -0.5, 1.0) ); // bottom right
-        v->push_back( osg::Vec3(  0.0, -0.5, 1.0) ); // bottom left
-        v->push_back( osg::Vec3(  0.0, -0.5, 1.0) ); // top left
-        v->push_back( osg::Vec3( -1.0, -0.5, 1.0) ); // top right
+    c->push_back( osg::Vec4(0, 1, 0, 0) ); // color - used to differentiate wall from roof
+    c->push_back( osg::Vec4(0, 1, 0, 0) ); // color - used to differentiate wall from roof
+    c->push_back( osg::Vec4(0, 1, 1, 0) ); // color - used to differentiate wall from roof
+    c->push_back( osg::Vec4(0, 1, 1, 0) ); // color - used to differentiate wall from roof
 
-        t->push_back( osg::Vec2(  0.0, 0.0) ); // bottom right
-        t->push_back( osg::Vec2( -1.0, 0.0) ); // bottom left
-        t->push_back( osg::Vec2( -1.0, 1.0) ); // top left
-        t->push_back( osg::Vec2(  0.0, 1.0) ); // top right
+    for (int i=0; i<4; ++i) {
+      n->push_back( osg::Vec3(0, -0.707, 0.707) );    // normal
+    }
 
-        c->push_back( osg::Vec4(0, 1, 0, 0) ); // color - used to differentiate wall from roof
-        c->push_back( osg::Vec4(0, 1, 0, 0) ); // color - used to differentiate wall from roof
-        c->push_back( osg::Vec4(0, 1, 1, 0) ); // color - used to differentiate wall from roof
-        c->push_back( osg::Vec4(0, 1, 1, 0) ); // color - used to differentiate wall from roof
+    // Back face
+    v->push_back( osg::Vec3( -1.0,  0.5, 1.0) ); // bottom right
+    v->push_back( osg::Vec3( -1.0, -0.5, 1.0) ); // bottom left
+    v->push_back( osg::Vec3( -1.0, -0.5, 1.0) ); // top left
+    v->push_back( osg::Vec3( -1.0,  0.5, 1.0) ); // top right
 
-        for (int i=0; i<4; ++i) {
-          n->push_back( osg::Vec3(0, -0.707, 0.707) );    // normal
-        }
+    t->push_back( osg::Vec2( -1.0, 0.0) ); // bottom right
+    t->push_back( osg::Vec2(  0.0, 0.0) ); // bottom left
+    t->push_back( osg::Vec2(  0.0, 1.0 ) ); // top left
+    t->push_back( osg::Vec2( -1.0, 1.0 ) ); // top right
 
-        // Back face
-        v->push_back( osg::Vec3( -1.0,  0.5, 1.0) ); // bottom right
-        v->push_back( osg::Vec3( -1.0, -0.5, 1.0) ); // bottom left
-        v->push_back( osg::Vec3( -1.0, -0.5, 1.0) ); // top left
-        v->push_back( osg::Vec3( -1.0,  0.5, 1.0) ); // top right
+    c->push_back( osg::Vec4(0, 1, 0, 0) ); // color - used to differentiate wall from roof
+    c->push_back( osg::Vec4(0, 1, 0, 0) ); // color - used to differentiate wall from roof
+    c->push_back( osg::Vec4(0, 1, 1, 0) ); // color - used to differentiate wall from roof
+    c->push_back( osg::Vec4(0, 1, 1, 0) ); // color - used to differentiate wall from roof
 
-        t->push_back( osg::Vec2( -1.0, 0.0) ); // bottom right
-        t->push_back( osg::Vec2(  0.0, 0.0) ); // bottom left
-        t->push_back( osg::Vec2(  0.0, 1.0 ) ); // top left
-        t->push_back( osg::Vec2( -1.0, 1.0 ) ); // top right
+    for (int i=0; i<4; ++i) {
+      n->push_back( osg::Vec3(-0.707, 0, 0.707) );    // normal
+    }
 
-        c->push_back( osg::Vec4(0, 1, 0, 0) ); // color - used to differentiate wall from roof
-        c->push_back( osg::Vec4(0, 1, 0, 0) ); // color - used to differentiate wall from roof
-        c->push_back( osg::Vec4(0, 1, 1, 0) ); // color - used to differentiate wall from roof
-        c->push_back( osg::Vec4(0, 1, 1, 0) ); // color - used to differentiate wall from roof
+    // Right face
+    v->push_back( osg::Vec3(  0.0, 0.5, 1.0) ); // bottom right
+    v->push_back( osg::Vec3( -1.0, 0.5, 1.0) ); // bottom left
+    v->push_back( osg::Vec3( -1.0, 0.5, 1.0) ); // top left
+    v->push_back( osg::Vec3(  0.0, 0.5, 1.0) ); // top right
 
-        for (int i=0; i<4; ++i) {
-          n->push_back( osg::Vec3(-0.707, 0, 0.707) );    // normal
-        }
+    t->push_back( osg::Vec2(  0.0, 0.0) ); // bottom right
+    t->push_back( osg::Vec2( -1.0, 0.0) ); // bottom left
+    t->push_back( osg::Vec2( -1.0, 1.0 ) ); // top left
+    t->push_back( osg::Vec2(  0.0, 1.0 ) ); // top right
 
-        // Right face
-        v->push_back( osg::Vec3(  0.0, 0.5, 1.0) ); // bottom right
-        v->push_back( osg::Vec3( -1.0, 0.5, 1.0) ); // bottom left
-        v->push_back( osg::Vec3( -1.0, 0.5, 1.0) ); // top left
-        v->push_back( osg::Vec3(  0.0, 0.5, 1.0) ); // top right
+    c->push_back( osg::Vec4(0, 1, 0, 0) ); // color - used to differentiate wall from roof
+    c->push_back( osg::Vec4(0, 1, 0, 0) ); // color - used to differentiate wall from roof
+    c->push_back( osg::Vec4(0, 1, 1, 0) ); // color - used to differentiate wall from roof
+    c->push_back( osg::Vec4(0, 1, 1, 0) ); // color - used to differentiate wall from roof
 
-        t->push_back( osg::Vec2(  0.0, 0.0) ); // bottom right
-        t->push_back( osg::Vec2( -1.0, 0.0) ); // bottom left
-        t->push_back( osg::Vec2( -1.0, 1.0 ) ); // top left
-        t->push_back( osg::Vec2(  0.0, 1.0 ) ); // top right
+    for (int i=0; i<4; ++i) {
+      n->push_back( osg::Vec3(0, 0.707, 0.707) );    // normal
+    }
 
-        c->push_back( osg::Vec4(0, 1, 0, 0) ); // color - used to differentiate wall from roof
-        c->push_back( osg::Vec4(0, 1, 0, 0) ); // color - used to differentiate wall from roof
-        c->push_back( osg::Vec4(0, 1, 1, 0) ); // color - used to differentiate wall from roof
-        c->push_back( osg::Vec4(0, 1, 1, 0) ); // color - used to differentiate wall from roof
+    // Top face
+    v->push_back( osg::Vec3(  0.0, -0.5, 1.0) ); // bottom right
+    v->push_back( osg::Vec3(  0.0,  0.5, 1.0) ); // bottom left
+    v->push_back( osg::Vec3( -1.0,  0.5, 1.0) ); // top left
+    v->push_back( osg::Vec3( -1.0, -0.5, 1.0) ); // top right
 
-        for (int i=0; i<4; ++i) {
-          n->push_back( osg::Vec3(0, 0.707, 0.707) );    // normal
-        }
+    t->push_back( osg::Vec2( -1.0, 0.0) ); // bottom right
+    t->push_back( osg::Vec2(  0.0, 0.0) ); // bottom left
+    t->push_back( osg::Vec2(  0.0, 1.0) ); // top left
+    t->push_back( osg::Vec2( -1.0, 1.0) ); // top right
 
-        // Top face
-        v->push_back( osg::Vec3(  0.0, -0.5, 1.0) ); // bottom right
-        v->push_back( osg::Vec3(  0.0,  0.5, 1.0) ); // bottom left
-        v->push_back( osg::Vec3( -1.0,  0.5, 1.0) ); // top left
-        v->push_back( osg::Vec3( -1.0, -0.5, 1.0) ); // top right
+    c->push_back( osg::Vec4(0, 1, 1, 0) ); // color - used to differentiate wall from roof
+    c->push_back( osg::Vec4(0, 1, 1, 0) ); // color - used to differentiate wall from roof
+    c->push_back( osg::Vec4(0, 1, 1, 0) ); // color - used to differentiate wall from roof
+    c->push_back( osg::Vec4(0, 1, 1, 0) ); // color - used to differentiate wall from roof
 
-        t->push_back( osg::Vec2( -1.0, 0.0) ); // bottom right
-        t->push_back( osg::Vec2(  0.0, 0.0) ); // bottom left
-        t->push_back( osg::Vec2(  0.0, 1.0) ); // top left
-        t->push_back( osg::Vec2( -1.0, 1.0) ); // top right
+    for (int i=0; i<4; ++i) {
+      n->push_back( osg::Vec3(0, 0, -1.0) );    // normal
+    }
 
-        c->push_back( osg::Vec4(0, 1, 1, 0) ); // color - used to differentiate wall from roof
-        c->push_back( osg::Vec4(0, 1, 1, 0) ); // color - used to differentiate wall from roof
-        c->push_back( osg::Vec4(0, 1, 1, 0) ); // color - used to differentiate wall from roof
-        c->push_back( osg::Vec4(0, 1, 1, 0) ); // color - used to differentiate wall from roof
+    assert(v->size() == 52);
+    assert(t->size() == 52);
+    assert(c->size() == 52);
+    assert(n->size() == 52);
+
+    Geometry* geom = new Geometry;
+    geom->setVertexArray(v);
+    geom->setTexCoordArray(0, t, Array::BIND_PER_VERTEX);
+    geom->setNormalArray(n, Array::BIND_PER_VERTEX);
+    geom->setColorArray(c, Array::BIND_PER_VERTEX);
+    geom->setUseDisplayList( false );
+    geom->setUseVertexBufferObjects( true );
+    geom->setComputeBoundingBoxCallback(new BuildingBoundingBoxCallback);
+    return geom;
+}
 
-        for (int i=0; i<4; ++i) {
-          n->push_back( osg::Vec3(0, 0, -1.0) );    // normal
-        }
+static std::mutex static_sharedBuildingGeometryMutex;
+static ref_ptr<Geometry> sharedBuildingGeometry;
 
-        assert(v->size() == 52);
-        assert(t->size() == 52);
-        assert(c->size() == 52);
-        assert(n->size() == 52);
+void clearSharedBuildingGeometry()
+{
+    std::lock_guard<std::mutex> g(static_sharedBuildingGeometryMutex);
+    sharedBuildingGeometry = {};
+}
+
+// Per-instance data of a building in an SGInstanceBuffer: the position,
+// then one float for each component of the scale, attr1 and attr2 arrays.
+const unsigned BUILDING_INSTANCE_STRIDE = 12;
+
+// Helper classes for creating the quad tree. Its objects are the cells of
+// an SGInstanceBuffer, each drawn by a single instanced drawable.
+struct MakeBuildingLeaf
+{
+    LOD* operator() () const
+    {
+        return new LOD;
+    }
+};
 
-        Geometry* geom = new Geometry;
-        static int buildingCounter = 0;
+struct AddBuildingLeafObject
+{
+    AddBuildingLeafObject(const SGInstanceBuffer& instances, float range, Effect* effect) :
+        _instances(&instances), _range(range), _effect(effect) {}
+
+    void operator() (LOD* lod, const SGInstanceBuffer::Cell& cell) const
+    {
+        Geometry* geom = nullptr;
+        {
+            std::lock_guard<std::mutex> g(static_sharedBuildingGeometryMutex);
+            if (!sharedBuildingGeometry)
+                sharedBuildingGeometry = makeSharedBuildingGeometry();
+            geom = simgear::clone(sharedBuildingGeometry.get(),
+                                  CopyOp::SHALLOW_COPY);
+        }
+        static std::atomic<int> buildingCounter(0);
         geom->setName("BuildingGeometry_" + std::to_string(buildingCounter++));
-        geom->setVertexArray(v);
-        geom->setTexCoordArray(0, t, Array::BIND_PER_VERTEX);
-        geom->setNormalArray(n, Array::BIND_PER_VERTEX);
-        geom->setColorArray(c, Array::BIND_PER_VERTEX);
-        geom->setUseDisplayList( false );
-        geom->setUseVertexBufferObjects( true );
-        geom->setComputeBoundingBoxCallback(new BuildingBoundingBoxCallback);
-
-        geom->setVertexAttribArray(BUILDING_POSITION_ATTR, new osg::Vec3Array, Array::BIND_PER_VERTEX);
-        geom->setVertexAttribArray(BUILDING_SCALE_ATTR, new osg::Vec3Array, Array::BIND_PER_VERTEX);
-        geom->setVertexAttribArray(BUILDING_ATTR1, new osg::Vec3Array, Array::BIND_PER_VERTEX);
-        geom->setVertexAttribArray(BUILDING_ATTR2, new osg::Vec3Array, Array::BIND_PER_VERTEX);
-
-        //geom->addPrimitiveSet( new osg::DrawArrays( GL_QUADS, 0, 48, 0) );
-        geom->addPrimitiveSet( new osg::DrawArrays( GL_QUADS, 0, 52, 0) );
+
+        osg::Vec3Array* positions = new osg::Vec3Array(cell.count); // (x,y,z)
+        osg::Vec3Array* scale = new osg::Vec3Array(cell.count);     // (width, depth, height)
+        osg::Vec3Array* attrib1 = new osg::Vec3Array(cell.count);
+        osg::Vec3Array* attrib2 = new osg::Vec3Array(cell.count);
+        for (size_t i = 0; i < cell.count; ++i) {
+            const float* record = _instances->getInstance(cell.first + i);
+            (*positions)[i].set(record[0], record[1], record[2]);
+            (*scale)[i].set(record[3], record[4], record[5]);
+            (*attrib1)[i].set(record[6], record[7], record[8]);
+            (*attrib2)[i].set(record[9], record[10], record[11]);
+        }
+        geom->setVertexAttribArray(BUILDING_POSITION_ATTR, positions, Array::BIND_PER_VERTEX);
+        geom->setVertexAttribArray(BUILDING_SCALE_ATTR, scale, Array::BIND_PER_VERTEX);
+        geom->setVertexAttribArray(BUILDING_ATTR1, attrib1, Array::BIND_PER_VERTEX);
+        geom->setVertexAttribArray(BUILDING_ATTR2, attrib2, Array::BIND_PER_VERTEX);
+
+        // The shallow copy shares the primitive set of the shared geometry
+        geom->removePrimitiveSet(0, geom->getNumPrimitiveSets());
+        geom->addPrimitiveSet( new osg::DrawArrays( GL_QUADS, 0, 52, cell.count) );
 
         EffectGeode* geode = new EffectGeode;
         geode->addDrawable(geom);
@@ -343,16 +392,30 @@ struct MakeBuildingLeaf
         ss->setAttributeAndModes(new osg::VertexAttribDivisor(BUILDING_ATTR1, 1));
         ss->setAttributeAndModes(new osg::VertexAttribDivisor(BUILDING_ATTR2, 1));
 
-        LOD* result = new LOD;
-        result->addChild(geode, 0, _range);
-        return result;
+        lod->addChild(geode, 0, _range);
     }
 
+    const SGInstanceBuffer* _instances;
     float _range;
     ref_ptr<Effect> _effect;
-    bool _fade_out;
 };
 
+struct GetBuildingCellCoord
+{
+    GetBuildingCellCoord(const SGInstanceBuffer& instances) :
+        _instances(&instances) {}
+
+    Vec3 operator() (const SGInstanceBuffer::Cell& cell) const
+    {
+        return toOsg(_instances->getCellCenter(cell));
+    }
+
+    const SGInstanceBuffer* _instances;
+};
+
+typedef QuadTreeBuilder<LOD*, SGInstanceBuffer::Cell, MakeBuildingLeaf, AddBuildingLeafObject,
+                        GetBuildingCellCoord> BuildingGeometryQuadtree;
+
 const float pack_precision = 128.0;
 const float pack_precision1 = pack_precision+1.0;
 
@@ -362,56 +425,6 @@ float pack8bit(float a, float b, float c) {
 		   + floor(c * pack_precision + 0.5) * pack_precision1 * pack_precision1;
 };
 
-struct AddBuildingLeafObject
-{
-    void operator() (LOD* lod, const SGBuildingBin::BuildingInstance building) const
-    {
-        //Geode* geode = static_cast<Geode*>(lod->getChild(int(building.position.x() * 10.0f) % lod->getNumChildren()));
-        Geode* geode = static_cast<Geode*>(lod->getChild(0));
-
-        Geometry* geom = static_cast<Geometry*>(geode->getDrawable(0));
-
-        osg::Vec3Array* positions =  static_cast<osg::Vec3Array*> (geom->getVertexAttribArray(BUILDING_POSITION_ATTR));    // (x,y,z)
-        osg::Vec3Array* scale =  static_cast<osg::Vec3Array*> (geom->getVertexAttribArray(BUILDING_SCALE_ATTR)); // (width, depth, height)
-        osg::Vec3Array* attrib1 = static_cast<osg::Vec3Array*> (geom->getVertexAttribArray(BUILDING_ATTR1));
-        osg::Vec3Array* attrib2 = static_cast<osg::Vec3Array*> (geom->getVertexAttribArray(BUILDING_ATTR2));
-
-        positions->push_back(building.position);
-        // Depth is the x-axis, width is the y-axis
-        scale->push_back(osg::Vec3f(building.depth, building.width, building.height));
-        attrib1->push_back(osg::Vec3d(
-          pack8bit(building.rotation,         // attr1 in shader
-                      building.walltex0.x(),
-                      building.walltex0.y()),
-          building.pitch_height,
-          pack8bit(building.tex1.x(),    // attr2 in shader
-                      building.tex1.y(),
-                      building.rooftex0.x())
-        ));
-        attrib2->push_back(osg::Vec3f(
-          pack8bit(    // attr3 in shader
-            building.rooftex0.y(),
-            building.tex1.z(),
-            building.rooftop_scale.x()),
-          building.rooftop_scale.y(),
-          0.0f
-        ));
-
-        DrawArrays* primSet = static_cast<DrawArrays*>(geom->getPrimitiveSet(0));
-        primSet->setNumInstances(positions->size());
-    }
-};
-
-struct GetBuildingCoord
-{
-    Vec3 operator() (const SGBuildingBin::BuildingInstance& building) const
-    {
-        return building.position;
-    }
-};
-
-typedef QuadTreeBuilder<LOD*, SGBuildingBin::BuildingInstance, MakeBuildingLeaf, AddBuildingLeafObject,
-                        GetBuildingCoord> BuildingGeometryQuadtree;
 
 
   // Set up a BuildingBin from a file containing a list of individual building
@@ -787,23 +800,39 @@ typedef QuadTreeBuilder<LOD*, SGBuildingBin::BuildingInstance, MakeBuildingLeaf,
 
     // Transform building positions from the "geocentric" positions we
     // get from the scenery polys into the local Z-up coordinate
-    // system.
-    std::vector<BuildingInstance> rotatedBuildings;
-    rotatedBuildings.reserve(buildingLocations.size());
+    // system, and pack them with the rest of the per-instance data.
+    SGInstanceBuffer instances(BUILDING_INSTANCE_STRIDE, SG_BUILDING_QUAD_TREE_DEPTH);
+    instances.reserve(buildingLocations.size());
     for (const auto &b : buildingLocations) {
-        rotatedBuildings.emplace_back(BuildingInstance(
-            b.position * transInv,
-            b
-        ));
+        float* record = instances.add(toSG(Vec3f(b.position * transInv)));
+        // Depth is the x-axis, width is the y-axis
+        record[3] = b.depth;
+        record[4] = b.width;
+        record[5] = b.height;
+        record[6] = pack8bit(b.rotation,         // attr1 in shader
+                             b.walltex0.x(),
+                             b.walltex0.y());
+        record[7] = b.pitch_height;
+        record[8] = pack8bit(b.tex1.x(),         // attr2 in shader
+                             b.tex1.y(),
+                             b.rooftex0.x());
+        record[9] = pack8bit(b.rooftex0.y(),     // attr3 in shader
+                             b.tex1.z(),
+                             b.rooftop_scale.x());
+        record[10] = b.rooftop_scale.y();
     }
 
-    // Now, create a quadbuilding for the buildings.
+    // Now, create a quadbuilding for the buildings, with one leaf holding
+    // a single instanced drawable for each cell that has any.
+    const std::vector<SGInstanceBuffer::Cell> cells = instances.build();
     BuildingGeometryQuadtree
-        quadbuilding(GetBuildingCoord(), AddBuildingLeafObject(),
-                 SG_BUILDING_QUAD_TREE_DEPTH,
-                 MakeBuildingLeaf(buildingRange, effect, false));
-
-    quadbuilding.buildQuadTree(rotatedBuildings.begin(), rotatedBuildings.end());
+        quadbuilding(GetBuildingCellCoord(instances),
+                     AddBuildingLeafObject(instances, buildingRange, effect),
+                     SG_BUILDING_QUAD_TREE_DEPTH);
+    quadbuilding.setMin(Vec2(instances.getMin().x(), instances.getMin().y()));
+    quadbuilding.setMax(Vec2(instances.getMax().x(), instances.getMax().y()));
+    for (SGInstanceBuffer::Cell cell : cells)
+        quadbuilding.addNode(cell);
 
     ref_ptr<Group> group = new osg::Group();
 
@@ -811,46 +840,11 @@ typedef QuadTreeBuilder<LOD*, SGBuildingBin::BuildingInstance, MakeBuildingLeaf,
     group->setName("BuildingsGroup_" + std::to_string(buildingGroupCounter++));
 
     for (size_t j = 0; j < quadbuilding.getRoot()->getNumChildren(); ++j)
-            group->addChild(quadbuilding.getRoot()->getChild(j));
+        group->addChild(quadbuilding.getRoot()->getChild(j));
 
     return group;
   }
 
-  // We may end up with a quadtree with many empty leaves. One might say
-  // that we should avoid constructing the leaves in the first place,
-  // but this node visitor tries to clean up after the fact.
-  struct QuadTreeCleaner : public osg::NodeVisitor
-  {
-      QuadTreeCleaner() : NodeVisitor(NodeVisitor::TRAVERSE_ALL_CHILDREN)
-      {
-      }
-      void apply(LOD& lod)
-      {
-          for (int i  = lod.getNumChildren() - 1; i >= 0; --i) {
-              EffectGeode* geode = dynamic_cast<EffectGeode*>(lod.getChild(i));
-              if (!geode)
-                  continue;
-              bool geodeEmpty = true;
-              for (unsigned j = 0; j < geode->getNumDrawables(); ++j) {
-                  const Geometry* geom = dynamic_cast<Geometry*>(geode->getDrawable(j));
-                  if (!geom) {
-                      geodeEmpty = false;
-                      break;
-                  }
-                  for (unsigned k = 0; k < geom->getNumPrimitiveSets(); k++) {
-                      const PrimitiveSet* ps = geom->getPrimitiveSet(k);
-                      if (ps->getNumIndices() > 0) {
-                          geodeEmpty = false;
-                          break;
-                      }
-                  }
-              }
-              if (geodeEmpty)
-                  lod.removeChildren(i, 1);
-          }
-      }
-  };
-
   // This actually returns a MatrixTransform node. If we rotate the whole
   // set of buildings into the local Z-up coordinate system we can reuse the
   // primitive building geometry for all the buildings of the same type.
@@ -871,8 +865,6 @@ typedef QuadTreeBuilder<LOD*, SGBuildingBin::BuildingInstance, MakeBuildingLeaf,
           }
       }
 
-      QuadTreeCleaner cleaner;
-      mt->accept(cleaner);
       return mt;
   }
 }
@@ -202,5 +202,8 @@ typedef std::list<SGBuildingBin*> SGBuildingBinList;
 
 osg::Group* createRandomBuildings(SGBuildingBinList& buildinglist, const osg::Matrix& transform,
                          const SGReaderWriterOptions* options);
+
+// Drop the building geometry shared by all instanced building drawables
+void clearSharedBuildingGeometry();
 }
 #endif
@@ -0,0 +1,107 @@
+// SGCacheFile.cxx -- binary cache files of the terrain loaders
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifdef HAVE_CONFIG_H
+#  include <simgear_config.h>
+#endif
+
+#include "SGCacheFile_private.hxx"
+
+#include <functional>
+#include <sstream>
+#include <thread>
+
+#include <simgear/io/iostreams/sgstream.hxx>
+
+namespace simgear {
+
+namespace {
+
+uint64_t hashPath(const std::string& s)
+{
+    // FNV-1a, so that cache file names do not change between builds
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (unsigned char c : s) {
+        h ^= c;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+} // anonymous namespace
+
+void CacheFileWriter::putHeader(const char magic[8], uint32_t version,
+                                const SGPath& sourceFile)
+{
+    for (int i = 0; i < 8; ++i)
+        put(magic[i]);
+    put(version);
+    putString(sourceFile.utf8Str());
+    put(int64_t(sourceFile.modTime()));
+    put(uint64_t(sourceFile.sizeInBytes()));
+}
+
+bool CacheFileWriter::writeFile(const SGPath& cacheFile) const
+{
+    std::ostringstream tmpName;
+    tmpName << cacheFile.file() << ".tmp" << std::hash<std::thread::id>()(std::this_thread::get_id());
+    SGPath tmpFile = cacheFile.dirPath() / tmpName.str();
+
+    tmpFile.create_dir(0755);
+    {
+        sg_ofstream stream(tmpFile, std::ios::out | std::ios::binary);
+        if (!stream.is_open())
+            return false;
+        stream.write(_data.data(), _data.size());
+        if (!stream.good()) {
+            stream.close();
+            tmpFile.remove();
+            return false;
+        }
+    }
+
+    if (!tmpFile.rename(cacheFile)) {
+        tmpFile.remove();
+        return false;
+    }
+    return true;
+}
+
+bool CacheFileReader::checkHeader(const char magic[8], uint32_t version,
+                                  const SGPath& sourceFile)
+{
+    char fileMagic[8];
+    for (int i = 0; i < 8; ++i)
+        fileMagic[i] = get<char>();
+    if (!ok() || std::memcmp(fileMagic, magic, sizeof(fileMagic)) != 0 ||
+        get<uint32_t>() != version)
+        return false;
+
+    // Only valid for the very same file, as long as it is unchanged
+    return getString() == sourceFile.utf8Str() &&
+           get<int64_t>() == int64_t(sourceFile.modTime()) &&
+           get<uint64_t>() == uint64_t(sourceFile.sizeInBytes()) && ok();
+}
+
+SGPath cacheFilePath(const SGPath& cacheDir, const SGPath& sourceFile,
+                     const std::string& extension)
+{
+    std::ostringstream name;
+    name << sourceFile.file() << "-" << std::hex << hashPath(sourceFile.utf8Str()) << extension;
+    return cacheDir / name.str();
+}
+
+}
@@ -0,0 +1,145 @@
+// SGCacheFile_private.hxx -- binary cache files of the terrain loaders
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef _SGCACHEFILE_PRIVATE_HXX
+#define _SGCACHEFILE_PRIVATE_HXX
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <simgear/misc/sg_path.hxx>
+
+// Shared by STGCache and the BTG geometry cache. A cache file starts with
+// a magic, a version and the path, modification time and size of the file
+// it was made from, and is only used while all of those still match.
+// Cache files are only read back on the machine that wrote them, so the
+// values are stored in native byte order.
+
+namespace simgear {
+
+/// Arrays start on this boundary within a cache file
+const size_t CacheFileArrayAlignment = 16;
+
+class CacheFileWriter {
+public:
+    template<typename T>
+    void put(const T& value)
+    { _data.append(reinterpret_cast<const char*>(&value), sizeof(T)); }
+
+    void putString(const std::string& s)
+    {
+        put(uint32_t(s.size()));
+        _data.append(s);
+    }
+
+    void putArray(const void* data, size_t size)
+    {
+        _data.append((CacheFileArrayAlignment - _data.size() % CacheFileArrayAlignment) % CacheFileArrayAlignment, '\0');
+        _data.append(static_cast<const char*>(data), size);
+    }
+
+    /// Start the file with the magic, the version and the source file
+    void putHeader(const char magic[8], uint32_t version, const SGPath& sourceFile);
+
+    /// Write the data to a temporary file first and rename that, so that
+    /// tiles loaded concurrently never see a partially written cache file.
+    bool writeFile(const SGPath& cacheFile) const;
+
+    const std::string& data() const
+    { return _data; }
+
+private:
+    std::string _data;
+};
+
+class CacheFileReader {
+public:
+    CacheFileReader(const char* data, size_t size) :
+        _data(data), _size(size), _pos(0), _ok(true)
+    { }
+
+    template<typename T>
+    T get()
+    {
+        T value = T();
+        if (!check(sizeof(T)))
+            return value;
+        std::memcpy(&value, _data + _pos, sizeof(T));
+        _pos += sizeof(T);
+        return value;
+    }
+
+    std::string getString()
+    {
+        uint32_t size = get<uint32_t>();
+        if (!check(size))
+            return std::string();
+        std::string s(_data + _pos, size);
+        _pos += size;
+        return s;
+    }
+
+    /// Returns a pointer into the data instead of copying the array
+    template<typename T>
+    const T* getArray(uint32_t count)
+    {
+        size_t pad = (CacheFileArrayAlignment - _pos % CacheFileArrayAlignment) % CacheFileArrayAlignment;
+        if (!check(pad))
+            return 0;
+        _pos += pad;
+        if (count > (_size - _pos) / sizeof(T))
+            _ok = false;
+        if (!check(count * sizeof(T)))
+            return 0;
+        const T* array = reinterpret_cast<const T*>(_data + _pos);
+        _pos += count * sizeof(T);
+        return array;
+    }
+
+    /// False if the magic or version differ, or the source file changed
+    bool checkHeader(const char magic[8], uint32_t version, const SGPath& sourceFile);
+
+    bool ok() const
+    { return _ok; }
+    bool atEnd() const
+    { return _pos == _size; }
+    size_t remaining() const
+    { return _size - _pos; }
+
+private:
+    bool check(size_t size)
+    {
+        if (!_ok || _size - _pos < size)
+            _ok = false;
+        return _ok;
+    }
+
+    const char* _data;
+    size_t _size;
+    size_t _pos;
+    bool _ok;
+};
+
+/// The cache file for a source file: its name, a hash of its whole path,
+/// so files of the same name in different tiles do not collide, and the
+/// extension.
+SGPath cacheFilePath(const SGPath& cacheDir, const SGPath& sourceFile,
+                     const std::string& extension);
+
+}
+
+#endif // _SGCACHEFILE_PRIVATE_HXX
@@ -0,0 +1,193 @@
+/* -*-c++-*-
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifndef SG_INSTANCE_BUFFER_HXX
+#define SG_INSTANCE_BUFFER_HXX
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include <simgear/math/SGMath.hxx>
+
+/// Per-instance data of objects drawn with instancing, such as the random
+/// buildings: one fixed-size record of floats per instance, the position
+/// followed by whatever attributes the shader needs, all in one packed
+/// array.
+///
+/// build() sorts the records into the cells of a 2^depth x 2^depth grid
+/// over the x/y extents of the positions, the same grid QuadTreeBuilder
+/// uses for its leaves, so that each cell can be drawn by one instanced
+/// drawable straight from a contiguous range of the array. Records keep
+/// the order they were added in within their cell. The cells are meant
+/// to become the leaves of a QuadTreeBuilder, which keeps the hierarchy
+/// of groups above them for culling.
+///
+/// Random models and OBJECT_SHARED objects do not use it: they are
+/// arbitrary models, whose animations and effects don't read
+/// per-instance attributes.
+class SGInstanceBuffer {
+public:
+  struct Cell {
+    unsigned x, y;
+    size_t first;       ///< Index of the first instance in the cell
+    size_t count;
+    SGVec3f min, max;   ///< Extents of the positions in the cell
+  };
+
+  /// stride is the number of floats per instance, including the 3 of the
+  /// position.
+  explicit SGInstanceBuffer(unsigned stride, int depth = 2) :
+    _stride(std::max(stride, 3u)),
+    _dimension(1u << depth),
+    _min(SGVec3f::zeros()),
+    _max(SGVec3f::zeros())
+  { }
+
+  unsigned getStride() const
+  { return _stride; }
+
+  void reserve(size_t numInstances)
+  { _data.reserve(numInstances * _stride); }
+
+  /// Adds an instance at position and returns its record, with all
+  /// attributes zero, for the caller to fill in from index 3 on. The
+  /// pointer is valid until the next call to add().
+  float* add(const SGVec3f& position)
+  {
+    _data.resize(_data.size() + _stride, 0.0f);
+    float* record = &_data[_data.size() - _stride];
+    record[0] = position[0];
+    record[1] = position[1];
+    record[2] = position[2];
+    _cells.clear();
+    return record;
+  }
+
+  size_t size() const
+  { return _data.size() / _stride; }
+
+  bool empty() const
+  { return _data.empty(); }
+
+  const float* getInstance(size_t i) const
+  { return &_data[i * _stride]; }
+
+  SGVec3f getPosition(size_t i) const
+  {
+    const float* record = getInstance(i);
+    return SGVec3f(record[0], record[1], record[2]);
+  }
+
+  /// Sorts the instances by cell and returns the cells that hold any.
+  const std::vector<Cell>& build()
+  {
+    const size_t n = size();
+    _cells.clear();
+    if (n == 0)
+      return _cells;
+
+    SGVec3f& min = _min;
+    SGVec3f& max = _max;
+    min = max = getPosition(0);
+    for (size_t i = 1; i < n; ++i) {
+      const SGVec3f p = getPosition(i);
+      min = SGVec3f(std::min(min[0], p[0]), std::min(min[1], p[1]), std::min(min[2], p[2]));
+      max = SGVec3f(std::max(max[0], p[0]), std::max(max[1], p[1]), std::max(max[2], p[2]));
+    }
+
+    // A counting sort keeps the order within each cell
+    const unsigned numCells = _dimension * _dimension;
+    std::vector<unsigned> cellOf(n);
+    std::vector<size_t> offsets(numCells + 1, 0);
+    for (size_t i = 0; i < n; ++i) {
+      const SGVec3f p = getPosition(i);
+      cellOf[i] = cellIndex(p[1], min[1], max[1]) * _dimension
+                + cellIndex(p[0], min[0], max[0]);
+      ++offsets[cellOf[i] + 1];
+    }
+    for (unsigned c = 0; c < numCells; ++c)
+      offsets[c + 1] += offsets[c];
+
+    std::vector<float> sorted(_data.size());
+    std::vector<size_t> next(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < n; ++i) {
+      const float* record = getInstance(i);
+      std::copy(record, record + _stride, &sorted[next[cellOf[i]]++ * _stride]);
+    }
+    _data.swap(sorted);
+
+    for (unsigned c = 0; c < numCells; ++c) {
+      if (offsets[c] == offsets[c + 1])
+        continue;
+      Cell cell;
+      cell.x = c % _dimension;
+      cell.y = c / _dimension;
+      cell.first = offsets[c];
+      cell.count = offsets[c + 1] - offsets[c];
+      cell.min = cell.max = getPosition(cell.first);
+      for (size_t i = cell.first + 1; i < offsets[c + 1]; ++i) {
+        const SGVec3f p = getPosition(i);
+        cell.min = SGVec3f(std::min(cell.min[0], p[0]), std::min(cell.min[1], p[1]),
+                           std::min(cell.min[2], p[2]));
+        cell.max = SGVec3f(std::max(cell.max[0], p[0]), std::max(cell.max[1], p[1]),
+                           std::max(cell.max[2], p[2]));
+      }
+      _cells.push_back(cell);
+    }
+    return _cells;
+  }
+
+  /// The cells of the last build()
+  const std::vector<Cell>& getCells() const
+  { return _cells; }
+
+  /// Extents of the positions at the last build(), which the grid divides
+  const SGVec3f& getMin() const
+  { return _min; }
+  const SGVec3f& getMax() const
+  { return _max; }
+
+  /// The centre of the grid square of a cell. Given getMin() and getMax()
+  /// as its extents, QuadTreeBuilder puts it into the leaf of that cell.
+  SGVec3f getCellCenter(const Cell& cell) const
+  {
+    return SGVec3f(_min[0] + (cell.x + 0.5f) * (_max[0] - _min[0]) / _dimension,
+                   _min[1] + (cell.y + 0.5f) * (_max[1] - _min[1]) / _dimension,
+                   0.5f * (_min[2] + _max[2]));
+  }
+
+private:
+  // As QuadTreeBuilder::addNode()
+  unsigned cellIndex(float v, float min, float max) const
+  {
+    int i = 0;
+    if (max != min)
+      i = (int)(_dimension * (v - min) / (max - min));
+    return (unsigned)std::min(std::max(i, 0), (int)_dimension - 1);
+  }
+
+  unsigned _stride;
+  unsigned _dimension;
+  std::vector<float> _data;
+  std::vector<Cell> _cells;
+  SGVec3f _min, _max;
+};
+
+#endif
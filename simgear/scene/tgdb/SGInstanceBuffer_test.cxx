@@ -0,0 +1,553 @@
+// Checks that SGInstanceBuffer sorts instances into the cells of the quad
+// tree grid without reordering them within a cell, and that its cells end
+// up in the same QuadTreeBuilder leaves as their instances. Then compares
+// three scene graphs of a dense city tile: a transform per building over a
+// shared model, as the random objects are placed; the quad tree of the
+// random buildings before the instance buffer, a leaf with its own mesh and
+// instance arrays grown one building at a time; and a leaf per cell of the
+// instance buffer sharing the mesh. It counts their nodes, the memory they
+// hold and what a cull traversal of a view into the tile accepts. With
+// --benchmark it uses 200000 buildings and reports build and cull times.
+
+#ifdef HAVE_CONFIG_H
+#  include <simgear_config.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <tuple>
+#include <vector>
+
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/LOD>
+#include <osg/MatrixTransform>
+#include <osg/NodeVisitor>
+
+#include <simgear/math/SGMath.hxx>
+#include <simgear/math/sg_random.h>
+#include <simgear/misc/test_macros.hxx>
+#include <simgear/scene/util/OsgMath.hxx>
+#include <simgear/scene/util/QuadTreeBuilder.hxx>
+
+#include "SGInstanceBuffer.hxx"
+
+using namespace simgear;
+
+static const unsigned Stride = 12;   // As the random buildings
+static const int Depth = 2;          // As SG_BUILDING_QUAD_TREE_DEPTH
+static const float TileSize = 10000.0f;
+static const unsigned MeshVertices = 52;
+static const float Range = 10000.0f;
+
+static double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - start).count();
+}
+
+// The bounds of an instanced leaf are those of its positions, as in
+// BuildingBoundingBoxCallback.
+struct InstanceBoundingBoxCallback : public osg::Drawable::ComputeBoundingBoxCallback
+{
+  osg::BoundingBox computeBound(const osg::Drawable& drawable) const
+  {
+    osg::BoundingBox bb;
+    const osg::Geometry* geom = static_cast<const osg::Geometry*>(&drawable);
+    const osg::Vec3Array* positions =
+      static_cast<const osg::Vec3Array*>(geom->getVertexAttribArray(1));
+    for (const osg::Vec3& p : *positions)
+      bb.expandBy(p);
+    return bb;
+  }
+};
+
+// A box of 20 m, about the size of a building
+static osg::Geometry* makeMesh()
+{
+  osg::Vec3Array* vertices = new osg::Vec3Array(MeshVertices);
+  for (unsigned i = 0; i < MeshVertices; ++i)
+    (*vertices)[i].set(i & 1 ? 10.0f : -10.0f, i & 2 ? 10.0f : -10.0f, i & 4 ? 20.0f : 0.0f);
+  osg::Geometry* geom = new osg::Geometry;
+  geom->setVertexArray(vertices);
+  geom->setTexCoordArray(0, new osg::Vec2Array(MeshVertices), osg::Array::BIND_PER_VERTEX);
+  geom->setNormalArray(new osg::Vec3Array(MeshVertices), osg::Array::BIND_PER_VERTEX);
+  geom->setColorArray(new osg::Vec4Array(MeshVertices), osg::Array::BIND_PER_VERTEX);
+  return geom;
+}
+
+// The baseline: a building as the quad tree objects, each leaf with a
+// mesh of its own and the instance arrays growing by one per building.
+struct Building {
+  osg::Vec3 position;
+  osg::Vec3 scale, attrib1, attrib2;
+};
+
+struct MakeBuildingLeaf
+{
+  osg::LOD* operator() () const
+  {
+    osg::Geometry* geom = makeMesh();
+    for (unsigned a = 0; a < 4; ++a)
+      geom->setVertexAttribArray(a + 1, new osg::Vec3Array, osg::Array::BIND_PER_VERTEX);
+    geom->addPrimitiveSet(new osg::DrawArrays(GL_QUADS, 0, MeshVertices, 0));
+    geom->setComputeBoundingBoxCallback(new InstanceBoundingBoxCallback);
+    osg::Geode* geode = new osg::Geode;
+    geode->addDrawable(geom);
+    osg::LOD* lod = new osg::LOD;
+    lod->addChild(geode, 0, Range);
+    return lod;
+  }
+};
+
+struct AddBuildingLeafObject
+{
+  void operator() (osg::LOD* lod, const Building& building) const
+  {
+    osg::Geode* geode = static_cast<osg::Geode*>(lod->getChild(0));
+    osg::Geometry* geom = static_cast<osg::Geometry*>(geode->getDrawable(0));
+    osg::Vec3Array* positions = static_cast<osg::Vec3Array*>(geom->getVertexAttribArray(1));
+    positions->push_back(building.position);
+    static_cast<osg::Vec3Array*>(geom->getVertexAttribArray(2))->push_back(building.scale);
+    static_cast<osg::Vec3Array*>(geom->getVertexAttribArray(3))->push_back(building.attrib1);
+    static_cast<osg::Vec3Array*>(geom->getVertexAttribArray(4))->push_back(building.attrib2);
+    osg::DrawArrays* primSet = static_cast<osg::DrawArrays*>(geom->getPrimitiveSet(0));
+    primSet->setNumInstances(positions->size());
+  }
+};
+
+struct GetBuildingCoord
+{
+  osg::Vec3 operator() (const Building& building) const
+  {
+    return building.position;
+  }
+};
+
+typedef QuadTreeBuilder<osg::LOD*, Building, MakeBuildingLeaf, AddBuildingLeafObject,
+                        GetBuildingCoord> BuildingQuadtree;
+
+// The instance buffer: its cells as the quad tree objects, each leaf
+// sharing the mesh, with instance arrays of the final size.
+struct MakeCellLeaf
+{
+  osg::LOD* operator() () const
+  {
+    return new osg::LOD;
+  }
+};
+
+struct AddCellLeafObject
+{
+  AddCellLeafObject(const SGInstanceBuffer& instances, osg::Geometry* mesh) :
+    _instances(&instances), _mesh(mesh) {}
+
+  void operator() (osg::LOD* lod, const SGInstanceBuffer::Cell& cell) const
+  {
+    osg::Geometry* geom = new osg::Geometry(*_mesh, osg::CopyOp::SHALLOW_COPY);
+    osg::Vec3Array* arrays[4];
+    for (unsigned a = 0; a < 4; ++a) {
+      arrays[a] = new osg::Vec3Array(cell.count);
+      geom->setVertexAttribArray(a + 1, arrays[a], osg::Array::BIND_PER_VERTEX);
+    }
+    for (size_t i = 0; i < cell.count; ++i) {
+      const float* record = _instances->getInstance(cell.first + i);
+      for (unsigned a = 0; a < 4; ++a)
+        (*arrays[a])[i].set(record[3 * a], record[3 * a + 1], record[3 * a + 2]);
+    }
+    geom->addPrimitiveSet(new osg::DrawArrays(GL_QUADS, 0, MeshVertices, cell.count));
+    geom->setComputeBoundingBoxCallback(new InstanceBoundingBoxCallback);
+    osg::Geode* geode = new osg::Geode;
+    geode->addDrawable(geom);
+    lod->addChild(geode, 0, Range);
+  }
+
+  const SGInstanceBuffer* _instances;
+  osg::ref_ptr<osg::Geometry> _mesh;
+};
+
+struct GetCellCoord
+{
+  GetCellCoord(const SGInstanceBuffer& instances) : _instances(&instances) {}
+
+  osg::Vec3 operator() (const SGInstanceBuffer::Cell& cell) const
+  {
+    return toOsg(_instances->getCellCenter(cell));
+  }
+
+  const SGInstanceBuffer* _instances;
+};
+
+typedef QuadTreeBuilder<osg::LOD*, SGInstanceBuffer::Cell, MakeCellLeaf, AddCellLeafObject,
+                        GetCellCoord> CellQuadtree;
+
+// A transform per building over one shared model, in the quad tree of LODs
+// the random objects of a tile are placed in.
+typedef std::pair<osg::Node*, float> ModelLOD;
+
+struct MakeModelLeaf
+{
+  osg::LOD* operator() () const
+  {
+    return new osg::LOD;
+  }
+};
+
+struct AddModelLOD
+{
+  void operator() (osg::LOD* lod, const ModelLOD& model) const
+  {
+    lod->addChild(model.first, 0, model.second);
+  }
+};
+
+struct GetModelLODCoord
+{
+  osg::Vec3 operator() (const ModelLOD& model) const
+  {
+    return model.first->getBound().center();
+  }
+};
+
+typedef QuadTreeBuilder<osg::LOD*, ModelLOD, MakeModelLeaf, AddModelLOD,
+                        GetModelLODCoord> ModelQuadtree;
+
+// Counts the nodes of a scene graph and the bytes they hold, shared ones
+// once, and lists the instanced leaves by the south-west corner of their
+// buildings and their number. Only the node objects and the arrays of the
+// geometries are counted, so the bytes are a lower bound.
+struct TreeStats : public osg::NodeVisitor
+{
+  TreeStats() : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN) {}
+
+  bool add(const osg::Node& node, size_t size)
+  {
+    if (!seen.insert(&node).second)
+      return false;
+    ++nodes;
+    bytes += size;
+    return true;
+  }
+
+  void apply(osg::Group& group)
+  {
+    if (add(group, sizeof(osg::Group)))
+      traverse(group);
+  }
+
+  void apply(osg::LOD& lod)
+  {
+    if (add(lod, sizeof(osg::LOD)))
+      traverse(lod);
+  }
+
+  void apply(osg::MatrixTransform& transform)
+  {
+    if (add(transform, sizeof(osg::MatrixTransform)))
+      traverse(transform);
+  }
+
+  void apply(osg::Geode& geode)
+  {
+    if (!add(geode, sizeof(osg::Geode)))
+      return;
+    for (unsigned i = 0; i < geode.getNumDrawables(); ++i) {
+      osg::Geometry* geom = geode.getDrawable(i)->asGeometry();
+      bytes += sizeof(osg::Geometry);
+      addArray(geom->getVertexArray());
+      addArray(geom->getTexCoordArray(0));
+      addArray(geom->getNormalArray());
+      addArray(geom->getColorArray());
+      for (unsigned a = 1; a <= 4; ++a)
+        addArray(geom->getVertexAttribArray(a));
+      const osg::Vec3Array* positions =
+        static_cast<const osg::Vec3Array*>(geom->getVertexAttribArray(1));
+      if (!positions)
+        continue;
+      osg::Vec2 corner((*positions)[0].x(), (*positions)[0].y());
+      for (const osg::Vec3& p : *positions)
+        corner.set(std::min(corner.x(), p.x()), std::min(corner.y(), p.y()));
+      leaves.insert(Leaf(corner.x(), corner.y(),
+                         geom->getPrimitiveSet(0)->getNumInstances()));
+    }
+  }
+
+  void addArray(const osg::Array* array)
+  {
+    if (!array || !arrays.insert(array).second)
+      return;
+    // Arrays grown by push_back() hold more than they use
+    const osg::Vec3Array* vec3s = dynamic_cast<const osg::Vec3Array*>(array);
+    bytes += (vec3s ? vec3s->capacity() : array->getNumElements()) * array->getElementSize();
+  }
+
+  size_t nodes = 0;
+  size_t bytes = 0;
+  std::set<const osg::Node*> seen;
+  std::set<const osg::Array*> arrays;
+  typedef std::tuple<float, float, int> Leaf;
+  std::set<Leaf> leaves;
+};
+
+// The CPU side of a cull traversal: tests the bounding sphere of every node
+// it reaches against a view cone and its far distance, picks the children
+// of the LODs in range and counts the drawables and instances that would be
+// drawn. Only translations are applied on the way down.
+struct ConeCullVisitor : public osg::NodeVisitor
+{
+  ConeCullVisitor(const osg::Vec3& eye, const osg::Vec3& direction,
+                  float halfAngleDeg, float farDistance) :
+    osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ACTIVE_CHILDREN),
+    _eye(eye), _direction(direction),
+    _sin(std::sin(osg::DegreesToRadians(halfAngleDeg))),
+    _cos(std::cos(osg::DegreesToRadians(halfAngleDeg))),
+    _far(farDistance)
+  {
+    _direction.normalize();
+  }
+
+  void reset()
+  {
+    nodes = drawables = instances = 0;
+  }
+
+  float getDistanceToViewPoint(const osg::Vec3& pos, bool) const
+  {
+    return (pos + _offset - _eye).length();
+  }
+
+  bool isCulled(const osg::BoundingSphere& bound) const
+  {
+    if (!bound.valid())
+      return true;
+    const osg::Vec3 v = bound.center() + _offset - _eye;
+    const float along = v * _direction;
+    const float across = (v - _direction * along).length();
+    if (along - bound.radius() > _far)
+      return true;
+    // The distance of the centre from the surface of the cone
+    return across * _cos - along * _sin > bound.radius();
+  }
+
+  void apply(osg::Node& node)
+  {
+    if (isCulled(node.getBound()))
+      return;
+    ++nodes;
+    traverse(node);
+  }
+
+  void apply(osg::MatrixTransform& transform)
+  {
+    if (isCulled(transform.getBound()))
+      return;
+    ++nodes;
+    const osg::Vec3 translation(transform.getMatrix().getTrans());
+    _offset += translation;
+    traverse(transform);
+    _offset -= translation;
+  }
+
+  void apply(osg::Geode& geode)
+  {
+    if (isCulled(geode.getBound()))
+      return;
+    ++nodes;
+    for (unsigned i = 0; i < geode.getNumDrawables(); ++i) {
+      const osg::Geometry* geom = geode.getDrawable(i)->asGeometry();
+      if (isCulled(geom->getBound()))
+        continue;
+      ++drawables;
+      const unsigned numInstances = geom->getPrimitiveSet(0)->getNumInstances();
+      instances += std::max(numInstances, 1u);
+    }
+  }
+
+  osg::Vec3 _eye, _direction, _offset;
+  float _sin, _cos, _far;
+  size_t nodes = 0;
+  size_t drawables = 0;
+  size_t instances = 0;
+};
+
+// Looking north from the south-west part of the tile, 60 degrees wide and
+// 5 km deep
+static ConeCullVisitor makeCullVisitor()
+{
+  return ConeCullVisitor(osg::Vec3(TileSize / 4, 500.0f, 100.0f),
+                         osg::Vec3(0, 1, 0), 30.0f, 5000.0f);
+}
+
+// Culls a scene graph repeat times, returns the time of one traversal
+static double cullMs(osg::Node* root, int repeat, ConeCullVisitor& cull)
+{
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < repeat; ++i) {
+    cull.reset();
+    root->accept(cull);
+  }
+  return elapsedMs(start) / repeat;
+}
+
+int main(int argc, char* argv[])
+{
+  const bool benchmark = argc > 1 && !strcmp(argv[1], "--benchmark");
+  const int NumBuildings = benchmark ? 200000 : 20000;
+
+  mt seed;
+  mt_init(&seed, 123);
+
+  std::vector<Building> buildings(NumBuildings);
+  SGInstanceBuffer instances(Stride, Depth);
+  instances.reserve(NumBuildings);
+  for (int i = 0; i < NumBuildings; ++i) {
+    Building& b = buildings[i];
+    b.position.set(mt_rand(&seed) * TileSize, mt_rand(&seed) * TileSize,
+                   mt_rand(&seed) * 50.0f);
+    b.scale.set(i, 10.0f + mt_rand(&seed) * 20.0f, 10.0f);   // remember the order
+    float* record = instances.add(toSG(b.position));
+    for (int k = 0; k < 3; ++k) {
+      record[3 + k] = b.scale[k];
+      record[6 + k] = b.attrib1[k];
+      record[9 + k] = b.attrib2[k];
+    }
+  }
+  SG_CHECK_EQUAL(instances.size(), size_t(NumBuildings));
+  SG_CHECK_EQUAL(instances.getInstance(7)[3], 7.0f);
+
+  const std::vector<SGInstanceBuffer::Cell>& cells = instances.build();
+  SG_CHECK_EQUAL(cells.size(), size_t(1 << Depth) * (1 << Depth));
+
+  // Every cell is a contiguous range of its own instances, in order
+  size_t total = 0;
+  const float cellSize = TileSize / (1 << Depth);
+  for (const SGInstanceBuffer::Cell& cell : cells) {
+    SG_CHECK_EQUAL(cell.first, total);
+    total += cell.count;
+    for (size_t i = cell.first; i < cell.first + cell.count; ++i) {
+      const SGVec3f p = instances.getPosition(i);
+      SG_VERIFY(p[0] >= cell.x * cellSize - 10.0f && p[0] <= (cell.x + 1) * cellSize + 10.0f);
+      SG_VERIFY(p[1] >= cell.y * cellSize - 10.0f && p[1] <= (cell.y + 1) * cellSize + 10.0f);
+      SG_VERIFY(p[0] >= cell.min[0] && p[0] <= cell.max[0]);
+      SG_VERIFY(p[1] >= cell.min[1] && p[1] <= cell.max[1]);
+      if (i > cell.first)
+        SG_VERIFY(instances.getInstance(i)[3] > instances.getInstance(i - 1)[3]);
+    }
+  }
+  SG_CHECK_EQUAL(total, size_t(NumBuildings));
+
+  // Instances at a single point all end up in the first cell
+  SGInstanceBuffer single(3);
+  single.add(SGVec3f(1, 2, 3));
+  single.add(SGVec3f(1, 2, 3));
+  SG_CHECK_EQUAL(single.build().size(), size_t(1));
+  SG_CHECK_EQUAL(single.getCells()[0].count, size_t(2));
+  SG_VERIFY(SGInstanceBuffer(3).build().empty());
+
+  // The quad tree of the random buildings before the instance buffer
+  auto start = std::chrono::steady_clock::now();
+  BuildingQuadtree buildingTree(GetBuildingCoord(), AddBuildingLeafObject(), Depth);
+  buildingTree.buildQuadTree(buildings.begin(), buildings.end());
+  const double buildingMs = elapsedMs(start);
+
+  // The same from the instance buffer, including sorting it
+  SGInstanceBuffer sorted(Stride, Depth);
+  sorted.reserve(NumBuildings);
+  for (const Building& b : buildings) {
+    float* record = sorted.add(toSG(b.position));
+    for (int k = 0; k < 3; ++k) {
+      record[3 + k] = b.scale[k];
+      record[6 + k] = b.attrib1[k];
+      record[9 + k] = b.attrib2[k];
+    }
+  }
+  start = std::chrono::steady_clock::now();
+  CellQuadtree cellTree(GetCellCoord(sorted), AddCellLeafObject(sorted, makeMesh()), Depth);
+  std::vector<SGInstanceBuffer::Cell> sortedCells = sorted.build();
+  cellTree.setMin(osg::Vec2(sorted.getMin().x(), sorted.getMin().y()));
+  cellTree.setMax(osg::Vec2(sorted.getMax().x(), sorted.getMax().y()));
+  for (SGInstanceBuffer::Cell& cell : sortedCells)
+    cellTree.addNode(cell);
+  const double cellMs = elapsedMs(start);
+
+  // A transform per building, all over the same model
+  start = std::chrono::steady_clock::now();
+  osg::ref_ptr<osg::Geode> model = new osg::Geode;
+  osg::Geometry* modelMesh = makeMesh();
+  modelMesh->addPrimitiveSet(new osg::DrawArrays(GL_QUADS, 0, MeshVertices));
+  model->addDrawable(modelMesh);
+  std::vector<ModelLOD> models;
+  models.reserve(NumBuildings);
+  for (const Building& b : buildings) {
+    osg::MatrixTransform* transform =
+      new osg::MatrixTransform(osg::Matrix::translate(b.position));
+    transform->addChild(model.get());
+    models.push_back(ModelLOD(transform, Range));
+  }
+  ModelQuadtree modelTree(GetModelLODCoord(), AddModelLOD(), Depth);
+  modelTree.buildQuadTree(models.begin(), models.end());
+  const double modelMs = elapsedMs(start);
+
+  // Both quad trees of buildings have the same hierarchy, with the same
+  // buildings in each leaf
+  TreeStats modelStats, buildingStats, cellStats;
+  modelTree.getRoot()->accept(modelStats);
+  buildingTree.getRoot()->accept(buildingStats);
+  cellTree.getRoot()->accept(cellStats);
+  SG_CHECK_EQUAL(buildingTree.getRoot()->getNumChildren(), 4u);
+  SG_CHECK_EQUAL(cellTree.getRoot()->getNumChildren(), 4u);
+  SG_CHECK_EQUAL(buildingStats.nodes, cellStats.nodes);
+  SG_CHECK_EQUAL(cellStats.leaves.size(), cells.size());
+  SG_VERIFY(buildingStats.leaves == cellStats.leaves);
+  // Tree, leaves, transforms and the model
+  SG_CHECK_EQUAL(modelStats.nodes, cellStats.nodes - cells.size() + NumBuildings + 1);
+
+  // The quad trees of buildings draw whole leaves, so they draw the same,
+  // all of the buildings the transforms draw and more
+  ConeCullVisitor modelCull = makeCullVisitor();
+  ConeCullVisitor buildingCull = makeCullVisitor();
+  ConeCullVisitor cellCull = makeCullVisitor();
+  modelTree.getRoot()->accept(modelCull);
+  buildingTree.getRoot()->accept(buildingCull);
+  cellTree.getRoot()->accept(cellCull);
+  SG_VERIFY(modelCull.instances > 0);
+  SG_CHECK_EQUAL(modelCull.drawables, modelCull.instances);
+  SG_CHECK_EQUAL(buildingCull.drawables, cellCull.drawables);
+  SG_CHECK_EQUAL(buildingCull.instances, cellCull.instances);
+  SG_VERIFY(cellCull.instances >= modelCull.instances);
+  SG_VERIFY(cellCull.instances < size_t(NumBuildings));
+  SG_VERIFY(cellCull.nodes < modelCull.nodes / 100);
+
+  if (!benchmark)
+    return EXIT_SUCCESS;
+
+  const int repeat = 20;
+  const double modelCullMs = cullMs(modelTree.getRoot(), repeat, modelCull);
+  const double buildingCullMs = cullMs(buildingTree.getRoot(), repeat, buildingCull);
+  const double cellCullMs = cullMs(cellTree.getRoot(), repeat, cellCull);
+
+  std::cout << NumBuildings << " buildings, " << modelCull.instances
+            << " of them in view" << std::endl;
+  std::cout << "transform per building: " << modelStats.nodes << " nodes, "
+            << modelStats.bytes / 1024 << " KiB, built in " << modelMs
+            << " ms; cull " << modelCullMs << " ms, " << modelCull.nodes
+            << " nodes and " << modelCull.drawables << " drawables accepted"
+            << std::endl;
+  std::cout << "quad tree of buildings: " << buildingStats.nodes << " nodes, "
+            << buildingStats.bytes / 1024 << " KiB, built in " << buildingMs
+            << " ms; cull " << buildingCullMs << " ms, " << buildingCull.nodes
+            << " nodes and " << buildingCull.drawables << " drawables of "
+            << buildingCull.instances << " instances accepted" << std::endl;
+  std::cout << "quad tree of cells: " << cellStats.nodes << " nodes, "
+            << cellStats.bytes / 1024 << " KiB, built in " << cellMs
+            << " ms; cull " << cellCullMs << " ms, " << cellCull.nodes
+            << " nodes and " << cellCull.drawables << " drawables of "
+            << cellCull.instances << " instances accepted" << std::endl;
+
+  return EXIT_SUCCESS;
+}
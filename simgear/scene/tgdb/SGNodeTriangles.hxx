@@ -1,3 +1,66 @@
+#include <mutex>
+
+#include <osg/Image>
+#include <osg/Texture2D>
+
+#include "SGSurfaceSampler.hxx"
+
+// An object mask decoded for SGSurfaceSampler. It is kept as the user data
+// of the mask image, so that each mask is only decoded once.
+class SGObjectMaskData : public osg::Referenced {
+public:
+    SGObjectMaskLookup lookup;
+
+    static osg::ref_ptr<SGObjectMaskData> get(osg::Texture2D* object_mask)
+    {
+        osg::Image* img = object_mask ? object_mask->getImage() : 0;
+        if (!img)
+            return 0;
+
+        static std::mutex mutex;
+        std::lock_guard<std::mutex> lock(mutex);
+        osg::ref_ptr<SGObjectMaskData> data =
+            dynamic_cast<SGObjectMaskData*>(img->getUserData());
+        if (data.valid())
+            return data;
+
+        data = new SGObjectMaskData;
+        data->decode(img);
+        // Do not replace user data set by someone else
+        if (!img->getUserData())
+            img->setUserData(data.get());
+        return data;
+    }
+
+private:
+    void decode(const osg::Image* img)
+    {
+        lookup.resize(img->s(), img->t());
+        const bool rgb = img->getPixelFormat() == GL_RGB;
+        const bool rgba = img->getPixelFormat() == GL_RGBA;
+        if (img->getDataType() == GL_UNSIGNED_BYTE && (rgb || rgba)) {
+            const unsigned step = rgba ? 4 : 3;
+            for (int y = 0; y < img->t(); ++y) {
+                const unsigned char* row = img->data(0, y);
+                for (int x = 0; x < img->s(); ++x, row += step)
+                    lookup.set(x, y, row[0], row[1], row[2]);
+            }
+        } else {
+            // Any other format goes through the generic, per texel conversion
+            for (int y = 0; y < img->t(); ++y) {
+                for (int x = 0; x < img->s(); ++x) {
+                    osg::Vec4 color = img->getColor(x, y);
+                    lookup.set(x, y, toByte(color.r()), toByte(color.g()),
+                               toByte(color.b()));
+                }
+            }
+        }
+    }
+
+    static uint8_t toByte(float value)
+    { return uint8_t(SGMiscf::clip(value, 0, 1) * 255 + 0.5f); }
+};
+
 // future API - just run through once to convert from OSG to SG
 // then we can use these triangle lists for random 
 // trees/lights/buildings/objects
@@ -20,7 +83,7 @@ class SGTriangleInfo
 public:
     SGTriangleInfo( const SGVec3d& center ) {
         gbs_center = center;
-        mt_init(&seed, 123);
+        sampleRandom.reset(123);
     }
 
     // API used to build the Info by the visitor
@@ -228,60 +291,32 @@ public:
                 const osg::PrimitiveSet* ps = geometries[0]->getPrimitiveSet(0);
                 unsigned int numIndices = ps->getNumIndices();
                 
+                SGSurfaceSampler sampler;
+                std::vector<SGVec3f> offsets;
+                sampler.reserve(numIndices/3);
                 for ( unsigned int i=2; i<numIndices; i+= 3 ) {                    
-                    SGVec3f v0 = toSG(vertices->operator[](ps->index(i-2)));
-                    SGVec3f v1 = toSG(vertices->operator[](ps->index(i-1)));
-                    SGVec3f v2 = toSG(vertices->operator[](ps->index(i-0)));
-                    
-                    SGVec2f t0 = toSG(texcoords->operator[](ps->index(i-2)));
-                    SGVec2f t1 = toSG(texcoords->operator[](ps->index(i-1)));
-                    SGVec2f t2 = toSG(texcoords->operator[](ps->index(i-0)));
-                    
-                    SGVec3f normal = cross(v1 - v0, v2 - v0);
+                    SGSurfaceSampler::Triangle triangle = getSampleTriangle(vertices, texcoords, ps, i);
+                    SGVec3f normal = cross(triangle.v1 - triangle.v0, triangle.v2 - triangle.v0);
             
                     // Compute the area
                     float area = 0.5f*length(normal);
                     if (area <= SGLimitsf::min())
                         continue;
             
-                    // For partial units of area, use a zombie door method to
-                    // create the proper random chance of a light being created
-                    // for this triangle
-                    float unit = area + mt_rand(&seed)*coverage;
-            
-                    SGVec3f offsetVector = offset*normalize(normal);
-                    // generate a light point for each unit of area
-            
-                    while ( coverage < unit ) {
-                        float a = mt_rand(&seed);
-                        float b = mt_rand(&seed);
-                
-                        if ( a + b > 1 ) {
-                            a = 1 - a;
-                            b = 1 - b;
-                        }
-                        float c = 1 - a - b;
-                        SGVec3f randomPoint = offsetVector + a*v0 + b*v1 + c*v2;
-                
-                        if (object_mask != NULL) {
-                            SGVec2f texCoord = a*t0 + b*t1 + c*t2;
-                    
-                            // Check this random point against the object mask
-                            // red channel.
-                            osg::Image* img = object_mask->getImage();            
-                            unsigned int x = (int) (img->s() * texCoord.x()) % img->s();
-                            unsigned int y = (int) (img->t() * texCoord.y()) % img->t();
-                    
-                            if (mt_rand(&seed) < img->getColor(x, y).r()) {                
-                                points.push_back(randomPoint);        
-                            }                    
-                        } else {      
-                            // No object mask, so simply place the object  
-                            points.push_back(randomPoint);        
-                        }
-                        unit -= coverage;        
-                    }
+                    // One light point for each unit of area
+                    triangle.expected = area / coverage;
+                    sampler.addTriangle(triangle);
+                    offsets.push_back(offset*normalize(normal));
                 }
+
+                // Check the random points against the object mask
+                // red channel.
+                osg::ref_ptr<SGObjectMaskData> mask = SGObjectMaskData::get(object_mask);
+                sampler.sample(sampleRandom, mask.valid() ? &mask->lookup : 0,
+                               SGObjectMaskLookup::RED,
+                               [&](size_t j, const SGVec3f& randomPoint) {
+                                   points.push_back(offsets[j] + randomPoint);
+                               });
             }
         }
     }
@@ -304,15 +339,14 @@ public:
                 const osg::PrimitiveSet* ps = geometries[0]->getPrimitiveSet(0);
                 unsigned int numIndices = ps->getNumIndices();
 
+                osg::ref_ptr<SGObjectMaskData> mask = SGObjectMaskData::get(object_mask);
+                SGSurfaceSampler sampler;
+                std::vector<SGVec3f> samplerNormals;
                 for ( unsigned int i=2; i<numIndices; i+= 3 ) {                    
                     SGVec3f v0 = toSG(vertices->operator[](ps->index(i-2)));
                     SGVec3f v1 = toSG(vertices->operator[](ps->index(i-1)));
                     SGVec3f v2 = toSG(vertices->operator[](ps->index(i-0)));
 
-                    SGVec2f t0 = toSG(texcoords->operator[](ps->index(i-2)));
-                    SGVec2f t1 = toSG(texcoords->operator[](ps->index(i-1)));
-                    SGVec2f t2 = toSG(texcoords->operator[](ps->index(i-0)));
-
                     SGVec3f normal = cross(v1 - v0, v2 - v0);
 
                     // Ensure the slope isn't too steep by checking the
@@ -368,14 +402,10 @@ public:
                                 float ptz = (-normal.x()*ptx - normal.y()*pty-d)/normal.z();
                                 SGVec3f randomPoint = SGVec3f(ptx,pty,ptz);
 
-                                if (object_mask != NULL) {
+                                if (mask.valid()) {
                                     // Check this point against the object mask
                                     // green (for trees) channel.
-                                    osg::Image* img = object_mask->getImage();
-                                    unsigned int x = (int) (img->s() * newpt.x()) % img->s();
-                                    unsigned int y = (int) (img->t() * newpt.y()) % img->t();
-
-                                    if (mt_rand(&seed) < img->getColor(x, y).g()) {
+                                    if (sampleRandom.next() < mask->lookup.lookup(SGObjectMaskLookup::GREEN, newpt)) {
                                         // The red channel contains the rotation for this object
                                         points.push_back(randomPoint);
                                         normals.push_back(normalize(normal));
@@ -389,46 +419,22 @@ public:
                     }  else  {
                         // Determine the number of trees, taking into account vegetation
                         // density (which is linear) and the slope density factor.
-                        // Use a zombie door method to create the proper random chance 
-                        // of a tree being created for partial values.
-                        int woodcount = (int) (vegetation_density * vegetation_density * 
-                                               slope_density *
-                                               area / wood_coverage + mt_rand(&seed));
-                        for (int j = 0; j < woodcount; j++) {
-                            // Use barycentric coordinates
-                            float a = mt_rand(&seed);
-                            float b = mt_rand(&seed);
-
-                            if ( a + b > 1.0f ) {
-                                a = 1.0f - a;
-                                b = 1.0f - b;
-                            }
-
-                            float c = 1.0f - a - b;
-
-                            SGVec3f randomPoint = a*v0 + b*v1 + c*v2;
-                            if (object_mask != NULL) {
-                                SGVec2f texCoord = a*t0 + b*t1 + c*t2;
-
-                                // Check this random point against the object mask
-                                // green (for trees) channel.
-                                osg::Image* img = object_mask->getImage();       
-                                unsigned int x = (int) (img->s() * texCoord.x()) % img->s();
-                                unsigned int y = (int) (img->t() * texCoord.y()) % img->t();
-
-                                if (mt_rand(&seed) < img->getColor(x, y).g()) {
-                                    // The red channel contains the rotation for this object
-                                    points.push_back(randomPoint);
-                                    normals.push_back(normalize(normal));
-                                }
-                            } else {
-                                points.push_back(randomPoint);
-                                normals.push_back(normalize(normal));
-
-                            }
-                        }
+                        SGSurfaceSampler::Triangle triangle = getSampleTriangle(vertices, texcoords, ps, i);
+                        triangle.expected = vegetation_density * vegetation_density * 
+                                            slope_density * area / wood_coverage;
+                        sampler.addTriangle(triangle);
+                        samplerNormals.push_back(normalize(normal));
                     }
                 }
+
+                // Check the random points against the object mask
+                // green (for trees) channel.
+                sampler.sample(sampleRandom, mask.valid() ? &mask->lookup : 0,
+                               SGObjectMaskLookup::GREEN,
+                               [&](size_t j, const SGVec3f& randomPoint) {
+                                   points.push_back(randomPoint);
+                                   normals.push_back(samplerNormals[j]);
+                               });
             }
         }
     }
@@ -492,7 +498,24 @@ public:
 #endif    
     
 private:
-    mt seed;
+    SGSurfaceSampler::Triangle getSampleTriangle(const osg::Vec3Array* vertices,
+                                                 const osg::Vec2Array* texcoords,
+                                                 const osg::PrimitiveSet* ps,
+                                                 unsigned int i) const
+    {
+        SGSurfaceSampler::Triangle triangle;
+        triangle.v0 = toSG(vertices->operator[](ps->index(i-2)));
+        triangle.v1 = toSG(vertices->operator[](ps->index(i-1)));
+        triangle.v2 = toSG(vertices->operator[](ps->index(i-0)));
+        triangle.t0 = toSG(texcoords->operator[](ps->index(i-2)));
+        triangle.t1 = toSG(texcoords->operator[](ps->index(i-1)));
+        triangle.t2 = toSG(texcoords->operator[](ps->index(i-0)));
+        triangle.expected = 0;
+        return triangle;
+    }
+
+    // Random stream of the batched surface and tree point sampling.
+    SGCounterRandom sampleRandom;
     SGMaterial* mat;
     SGVec3d gbs_center;
     std::vector<osg::Geometry*> geometries;
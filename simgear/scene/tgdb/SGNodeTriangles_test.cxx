@@ -0,0 +1,256 @@
+// Checks the random light and tree points SGTriangleInfo places on a tile
+// geometry, the path SGTileDetailsCallback uses, and compares its speed with
+// the former one point at a time sampling with osg::Image::getColor().
+
+#ifdef HAVE_CONFIG_H
+#  include <simgear_config.h>
+#endif
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <osg/Geometry>
+#include <osg/Image>
+#include <osg/PrimitiveSet>
+#include <osg/Texture2D>
+
+#include <simgear/debug/logstream.hxx>
+#include <simgear/math/SGMath.hxx>
+#include <simgear/math/sg_random.h>
+#include <simgear/misc/test_macros.hxx>
+
+#include "SGTileGeometryBin.hxx"
+#include "SGTileDetailsCallback.hxx"
+
+static const int MaskSize = 512;
+static const int NumTriangles = 20000;
+
+// A patch of terrain made of triangles between 20 and 2000 m^2, as a tile
+// geometry with one triangle primitive set
+static osg::ref_ptr<osg::Geometry> makeGeometry()
+{
+  mt seed;
+  mt_init(&seed, unsigned(586));
+  osg::ref_ptr<osg::Vec3Array> vertices = new osg::Vec3Array;
+  osg::ref_ptr<osg::Vec2Array> texcoords = new osg::Vec2Array;
+  osg::ref_ptr<osg::DrawElementsUInt> triangles =
+    new osg::DrawElementsUInt(osg::PrimitiveSet::TRIANGLES);
+  for (int i = 0; i < NumTriangles; ++i) {
+    float x = (i % 200) * 40.0f, y = (i / 200) * 40.0f;
+    float size = 6.0f + 60.0f * float(mt_rand(&seed));
+    vertices->push_back(osg::Vec3(x, y, 0));
+    vertices->push_back(osg::Vec3(x + size, y, 1));
+    vertices->push_back(osg::Vec3(x, y + size, 2));
+    texcoords->push_back(osg::Vec2(x / 1000, y / 1000));
+    texcoords->push_back(osg::Vec2((x + size) / 1000, y / 1000));
+    texcoords->push_back(osg::Vec2(x / 1000, (y + size) / 1000));
+    for (int j = 0; j < 3; ++j)
+      triangles->push_back(3 * i + j);
+  }
+
+  osg::ref_ptr<osg::Geometry> geometry = new osg::Geometry;
+  geometry->setVertexArray(vertices.get());
+  geometry->setTexCoordArray(0, texcoords.get());
+  geometry->addPrimitiveSet(triangles.get());
+  return geometry;
+}
+
+// A mask with a gradient in red and green and a full blue channel
+static osg::ref_ptr<osg::Texture2D> makeMask()
+{
+  osg::ref_ptr<osg::Image> image = new osg::Image;
+  image->allocateImage(MaskSize, MaskSize, 1, GL_RGB, GL_UNSIGNED_BYTE);
+  for (int y = 0; y < MaskSize; ++y) {
+    unsigned char* p = image->data(0, y);
+    for (int x = 0; x < MaskSize; ++x, p += 3) {
+      p[0] = (unsigned char)(x * 255 / (MaskSize - 1));
+      p[1] = (unsigned char)(y * 255 / (MaskSize - 1));
+      p[2] = 255;
+    }
+  }
+  osg::ref_ptr<osg::Texture2D> texture = new osg::Texture2D;
+  texture->setImage(image.get());
+  return texture;
+}
+
+// The former SGTriangleInfo::addRandomSurfacePoints(): one mt_rand() per
+// random number and a getColor() per point.
+static void addSurfacePointsSerial(const osg::Geometry* geometry, float coverage,
+                                   float offset, osg::Texture2D* object_mask,
+                                   std::vector<SGVec3f>& points)
+{
+  mt seed;
+  mt_init(&seed, 123);
+  const osg::Vec3Array* vertices  = dynamic_cast<const osg::Vec3Array*>(geometry->getVertexArray());
+  const osg::Vec2Array* texcoords = dynamic_cast<const osg::Vec2Array*>(geometry->getTexCoordArray(0));
+  const osg::PrimitiveSet* ps = geometry->getPrimitiveSet(0);
+  unsigned int numIndices = ps->getNumIndices();
+  for ( unsigned int i=2; i<numIndices; i+= 3 ) {
+    SGVec3f v0 = toSG(vertices->operator[](ps->index(i-2)));
+    SGVec3f v1 = toSG(vertices->operator[](ps->index(i-1)));
+    SGVec3f v2 = toSG(vertices->operator[](ps->index(i-0)));
+    SGVec2f t0 = toSG(texcoords->operator[](ps->index(i-2)));
+    SGVec2f t1 = toSG(texcoords->operator[](ps->index(i-1)));
+    SGVec2f t2 = toSG(texcoords->operator[](ps->index(i-0)));
+    SGVec3f normal = cross(v1 - v0, v2 - v0);
+    float area = 0.5f*length(normal);
+    if (area <= SGLimitsf::min())
+      continue;
+    float unit = area + mt_rand(&seed)*coverage;
+    SGVec3f offsetVector = offset*normalize(normal);
+    while ( coverage < unit ) {
+      float a = mt_rand(&seed);
+      float b = mt_rand(&seed);
+      if ( a + b > 1 ) {
+        a = 1 - a;
+        b = 1 - b;
+      }
+      float c = 1 - a - b;
+      SGVec3f randomPoint = offsetVector + a*v0 + b*v1 + c*v2;
+      SGVec2f texCoord = a*t0 + b*t1 + c*t2;
+      osg::Image* img = object_mask->getImage();
+      unsigned int x = (int) (img->s() * texCoord.x()) % img->s();
+      unsigned int y = (int) (img->t() * texCoord.y()) % img->t();
+      if (mt_rand(&seed) < img->getColor(x, y).r())
+        points.push_back(randomPoint);
+      unit -= coverage;
+    }
+  }
+}
+
+// The former random (not plantation) SGTriangleInfo::addRandomTreePoints()
+static void addTreePointsSerial(const osg::Geometry* geometry, float wood_coverage,
+                                osg::Texture2D* object_mask,
+                                std::vector<SGVec3f>& points)
+{
+  mt seed;
+  mt_init(&seed, 123);
+  const osg::Vec3Array* vertices  = dynamic_cast<const osg::Vec3Array*>(geometry->getVertexArray());
+  const osg::Vec2Array* texcoords = dynamic_cast<const osg::Vec2Array*>(geometry->getTexCoordArray(0));
+  const osg::PrimitiveSet* ps = geometry->getPrimitiveSet(0);
+  unsigned int numIndices = ps->getNumIndices();
+  for ( unsigned int i=2; i<numIndices; i+= 3 ) {
+    SGVec3f v0 = toSG(vertices->operator[](ps->index(i-2)));
+    SGVec3f v1 = toSG(vertices->operator[](ps->index(i-1)));
+    SGVec3f v2 = toSG(vertices->operator[](ps->index(i-0)));
+    SGVec2f t0 = toSG(texcoords->operator[](ps->index(i-2)));
+    SGVec2f t1 = toSG(texcoords->operator[](ps->index(i-1)));
+    SGVec2f t2 = toSG(texcoords->operator[](ps->index(i-0)));
+    SGVec3f normal = cross(v1 - v0, v2 - v0);
+    float area = 0.5f*length(normal);
+    if (area <= SGLimitsf::min())
+      continue;
+    int woodcount = (int) (area / wood_coverage + mt_rand(&seed));
+    for (int j = 0; j < woodcount; j++) {
+      float a = mt_rand(&seed);
+      float b = mt_rand(&seed);
+      if ( a + b > 1.0f ) {
+        a = 1.0f - a;
+        b = 1.0f - b;
+      }
+      float c = 1.0f - a - b;
+      SGVec3f randomPoint = a*v0 + b*v1 + c*v2;
+      SGVec2f texCoord = a*t0 + b*t1 + c*t2;
+      osg::Image* img = object_mask->getImage();
+      unsigned int x = (int) (img->s() * texCoord.x()) % img->s();
+      unsigned int y = (int) (img->t() * texCoord.y()) % img->t();
+      if (mt_rand(&seed) < img->getColor(x, y).g())
+        points.push_back(randomPoint);
+    }
+  }
+}
+
+static double msSince(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+  osg::ref_ptr<osg::Geometry> geometry = makeGeometry();
+  osg::ref_ptr<osg::Texture2D> mask = makeMask();
+  const float coverage = 10.0f;
+  const float offset = 3.0f;
+
+  // The mask is decoded once and kept with the image
+  osg::ref_ptr<SGObjectMaskData> maskData = SGObjectMaskData::get(mask.get());
+  SG_VERIFY(maskData.valid());
+  SG_VERIFY(SGObjectMaskData::get(mask.get()) == maskData);
+  SG_VERIFY(mask->getImage()->getUserData() == maskData.get());
+  SG_CHECK_EQUAL(maskData->lookup.getWidth(), MaskSize);
+  SG_CHECK_EQUAL(int(maskData->lookup.get(SGObjectMaskLookup::RED, MaskSize - 1, 0)), 255);
+  SG_CHECK_EQUAL(int(maskData->lookup.get(SGObjectMaskLookup::GREEN, 0, MaskSize - 1)), 255);
+  SG_VERIFY(!SGObjectMaskData::get(0).valid());
+
+  // Same geometry, same points; without a mask every triangle gets its
+  // expected share, offset along the normal
+  double expected = 0;
+  const osg::Vec3Array* vertices =
+    static_cast<const osg::Vec3Array*>(geometry->getVertexArray());
+  for (int i = 0; i < NumTriangles; ++i) {
+    SGVec3f v0 = toSG((*vertices)[3 * i]);
+    expected += 0.5f * length(cross(toSG((*vertices)[3 * i + 1]) - v0,
+                                    toSG((*vertices)[3 * i + 2]) - v0)) / coverage;
+  }
+  std::vector<std::vector<SGVec3f> > runs(2);
+  for (int run = 0; run < 2; ++run) {
+    SGTriangleInfo info(SGVec3d(0, 0, 0));
+    info.addGeometry(geometry.get());
+    info.addRandomSurfacePoints(coverage, offset, 0, runs[run]);
+  }
+  SG_VERIFY(runs[0] == runs[1]);
+  SG_VERIFY(std::fabs(runs[0].size() - expected) < 0.01 * expected);
+  for (const SGVec3f& p : runs[0])
+    SG_VERIFY(p.z() > 0 && p.z() < 2 + offset);
+
+  // Flat enough for full density; a tree for each unit of wood coverage
+  std::vector<SGVec3f> trees, normals;
+  {
+    SGTriangleInfo info(SGVec3d(0, 0, 0));
+    info.addGeometry(geometry.get());
+    info.addRandomTreePoints(coverage, 0, 1.0f, 0.5f, 0.2f, false, trees, normals);
+  }
+  SG_CHECK_EQUAL(trees.size(), normals.size());
+  SG_VERIFY(std::fabs(trees.size() - expected) < 0.01 * expected);
+  for (size_t i = 0; i < trees.size(); ++i) {
+    SG_VERIFY(trees[i].z() >= 0 && trees[i].z() <= 2);
+    SG_VERIFY(std::fabs(length(normals[i]) - 1) < 1e-5);
+  }
+
+  // With the mask, against the former sampling of the same geometry
+  std::vector<SGVec3f> serialLights, batchLights, serialTrees, batchTrees;
+  auto start = std::chrono::steady_clock::now();
+  addSurfacePointsSerial(geometry.get(), coverage, offset, mask.get(), serialLights);
+  double serialLightMs = msSince(start);
+  start = std::chrono::steady_clock::now();
+  addTreePointsSerial(geometry.get(), coverage, mask.get(), serialTrees);
+  double serialTreeMs = msSince(start);
+
+  SGTriangleInfo info(SGVec3d(0, 0, 0));
+  info.addGeometry(geometry.get());
+  start = std::chrono::steady_clock::now();
+  info.addRandomSurfacePoints(coverage, offset, mask.get(), batchLights);
+  double batchLightMs = msSince(start);
+  normals.clear();
+  start = std::chrono::steady_clock::now();
+  info.addRandomTreePoints(coverage, mask.get(), 1.0f, 0.5f, 0.2f, false,
+                           batchTrees, normals);
+  double batchTreeMs = msSince(start);
+
+  // Both keep about the same share of the points
+  SG_VERIFY(std::fabs(double(batchLights.size()) - double(serialLights.size()))
+            < 0.02 * serialLights.size());
+  SG_VERIFY(std::fabs(double(batchTrees.size()) - double(serialTrees.size()))
+            < 0.02 * serialTrees.size());
+
+  std::cout << "lights: " << batchLights.size() << " points, serial "
+            << serialLightMs << " ms, batched " << batchLightMs << " ms" << std::endl;
+  std::cout << "trees: " << batchTrees.size() << " points, serial "
+            << serialTreeMs << " ms, batched " << batchTreeMs << " ms" << std::endl;
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,304 @@
+// SGSTGCache.cxx -- parsed contents of .stg files, with an on-disk cache
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifdef HAVE_CONFIG_H
+#  include <simgear_config.h>
+#endif
+
+#include "SGSTGCache.hxx"
+
+#include <cstdint>
+#include <cstdlib>
+#include <sstream>
+
+#include <simgear/bucket/newbucket.hxx>
+#include <simgear/debug/logstream.hxx>
+#include <simgear/io/iostreams/sgstream.hxx>
+#include <simgear/math/sg_random.h>
+
+#include "SGCacheFile_private.hxx"
+
+namespace simgear {
+
+namespace {
+
+const char CacheMagic[8] = { 'S', 'G', 'S', 'T', 'G', 'C', 'C', 'H' };
+const uint32_t CacheVersion = 2;
+
+// Token, name, material and path strings, 9 doubles, the size, the number
+// of words and the inside flag
+const size_t MinRecordSize = 4 * sizeof(uint32_t) + 9 * sizeof(double) +
+                             sizeof(int32_t) + sizeof(uint32_t) + sizeof(uint8_t);
+
+SGBucket bucketFromFileName(const SGPath& stgFile)
+{
+    std::istringstream ss(stgFile.file_base());
+    long index;
+    ss >> index;
+    if (ss.fail())
+        return SGBucket();
+    return SGBucket(index);
+}
+
+// The LOD range of an object is scaled by a random factor
+double rangeFactor(mt& seed)
+{
+    double lrand = mt_rand(&seed);
+    if      (lrand < 0.1) return 2.0;
+    else if (lrand < 0.4) return 1.5;
+    return 1.0;
+}
+
+// Everything ReaderWriterSTG derives from a record that only depends on the
+// .stg file itself. The random numbers are drawn in the same order as the
+// loader used to, so the ranges do not change.
+void resolve(const SGPath& stgFile, STGRecordList& records)
+{
+    const SGPath dir = stgFile.dirPath();
+    const SGBucket bucket = bucketFromFileName(stgFile);
+
+    // Bucket provides a consistent seed
+    // so we have consistent set of pseudo-random numbers for each STG file
+    mt seed;
+    mt_init(&seed, atoi(stgFile.file_base().c_str()));
+
+    for (auto& record : records) {
+        SGPath path = dir;
+        path.append(record._name);
+        record._path = path.utf8Str();
+
+        const std::string& token = record._token;
+        if (token == "OBJECT_BASE" || token == "OBJECT")
+            continue;
+
+        record._rangeFactor = rangeFactor(seed);
+        if (token == "OBJECT_BUILDING_MESH_DETAILED" || token == "OBJECT_ROAD_DETAILED" ||
+            token == "OBJECT_RAILWAY_DETAILED")
+            record._detailedRangeFactor = rangeFactor(seed);
+
+        // The loader has always checked in single precision
+        record._insideBucket = bucket ==
+            SGBucket(SGGeod::fromDeg(float(record._lon), float(record._lat)));
+    }
+}
+
+} // anonymous namespace
+
+bool STGRecord::operator==(const STGRecord& other) const
+{
+    return _token == other._token && _name == other._name &&
+           _material == other._material &&
+           _lon == other._lon && _lat == other._lat && _elev == other._elev &&
+           _hdg == other._hdg && _pitch == other._pitch &&
+           _roll == other._roll && _radius == other._radius &&
+           _size == other._size && _restOfLine == other._restOfLine &&
+           _path == other._path && _rangeFactor == other._rangeFactor &&
+           _detailedRangeFactor == other._detailedRangeFactor &&
+           _insideBucket == other._insideBucket;
+}
+
+STGCache::STGCache(const SGPath& cacheDir) :
+    _cacheDir(cacheDir)
+{
+}
+
+bool STGCache::parseLine(const std::string& text, STGRecord& record)
+{
+    record = STGRecord();
+
+    // strip comments
+    std::string line(text);
+    std::string::size_type hash_pos = line.find('#');
+    if (hash_pos != std::string::npos)
+        line.resize(hash_pos);
+
+    std::stringstream in(line);
+    in >> record._token;
+
+    // No comment
+    if (record._token.empty())
+        return false;
+
+    // Then there is always a name
+    in >> record._name;
+
+    const std::string& token = record._token;
+    if (token == "OBJECT_BASE" || token == "OBJECT") {
+        // nothing else
+    } else if (token == "OBJECT_STATIC" || token == "OBJECT_STATIC_AGL" ||
+               token == "OBJECT_SHARED" || token == "OBJECT_SHARED_AGL" ||
+               token == "OBJECT_BUILDING_MESH_ROUGH" || token == "OBJECT_BUILDING_MESH_DETAILED" ||
+               token == "OBJECT_ROAD_ROUGH" || token == "OBJECT_ROAD_DETAILED" ||
+               token == "OBJECT_RAILWAY_ROUGH" || token == "OBJECT_RAILWAY_DETAILED") {
+        in >> record._lon >> record._lat >> record._elev >> record._hdg
+           >> record._pitch >> record._roll >> record._radius;
+    } else if (token == "OBJECT_SIGN" || token == "OBJECT_SIGN_AGL") {
+        in >> record._lon >> record._lat >> record._elev >> record._hdg >> record._size;
+    } else if (token == "BUILDING_LIST" || token == "TREE_LIST") {
+        in >> record._material >> record._lon >> record._lat >> record._elev;
+    } else {
+        // Possibly handled by an STG object callback: pitch and roll are
+        // not common, so they are passed in the rest of the line
+        in >> record._lon >> record._lat >> record._elev >> record._hdg;
+        std::string buf;
+        while (in >> buf) {
+            record._restOfLine.push_back(buf);
+        }
+    }
+    return true;
+}
+
+bool STGCache::parse(const SGPath& stgFile, STGRecordList& records)
+{
+    records.clear();
+    if (!stgFile.exists()) {
+        return false;
+    }
+
+    sg_gzifstream stream(stgFile);
+    if (!stream.is_open()) {
+        return false;
+    }
+
+    STGRecord record;
+    while (!stream.eof()) {
+        // read a line
+        std::string line;
+        std::getline(stream, line);
+        if (parseLine(line, record))
+            records.push_back(record);
+    }
+    resolve(stgFile, records);
+    return true;
+}
+
+SGPath STGCache::cacheFile(const SGPath& stgFile) const
+{
+    return cacheFilePath(_cacheDir, stgFile, ".cache");
+}
+
+bool STGCache::loadCache(const SGPath& stgFile, STGRecordList& records) const
+{
+    if (_cacheDir.isNull())
+        return false;
+
+    SGPath file = cacheFile(stgFile);
+    if (!file.exists())
+        return false;
+
+    // The whole cache file is read at once
+    sg_ifstream stream(file, std::ios::in | std::ios::binary);
+    if (!stream.is_open())
+        return false;
+    const std::string data = stream.read_all();
+
+    CacheFileReader reader(data.data(), data.size());
+    if (!reader.checkHeader(CacheMagic, CacheVersion, stgFile))
+        return false;
+
+    // Do not trust the count of a corrupt or truncated file
+    uint32_t count = reader.get<uint32_t>();
+    if (!reader.ok() || count > reader.remaining() / MinRecordSize) {
+        SG_LOG(SG_TERRAIN, SG_WARN, "Ignoring corrupt STG cache file " << file);
+        return false;
+    }
+    STGRecordList result;
+    result.reserve(count);
+    for (uint32_t i = 0; i < count && reader.ok(); ++i) {
+        STGRecord record;
+        record._token = reader.getString();
+        record._name = reader.getString();
+        record._material = reader.getString();
+        record._lon = reader.get<double>();
+        record._lat = reader.get<double>();
+        record._elev = reader.get<double>();
+        record._hdg = reader.get<double>();
+        record._pitch = reader.get<double>();
+        record._roll = reader.get<double>();
+        record._radius = reader.get<double>();
+        record._size = reader.get<int32_t>();
+        uint32_t words = reader.get<uint32_t>();
+        for (uint32_t j = 0; j < words && reader.ok(); ++j)
+            record._restOfLine.push_back(reader.getString());
+        record._path = reader.getString();
+        record._rangeFactor = reader.get<double>();
+        record._detailedRangeFactor = reader.get<double>();
+        record._insideBucket = reader.get<uint8_t>() != 0;
+        result.push_back(record);
+    }
+
+    if (!reader.ok() || !reader.atEnd()) {
+        SG_LOG(SG_TERRAIN, SG_WARN, "Ignoring corrupt STG cache file " << file);
+        return false;
+    }
+
+    records.swap(result);
+    return true;
+}
+
+bool STGCache::saveCache(const SGPath& stgFile, const STGRecordList& records) const
+{
+    if (_cacheDir.isNull())
+        return false;
+
+    CacheFileWriter writer;
+    writer.putHeader(CacheMagic, CacheVersion, stgFile);
+    writer.put(uint32_t(records.size()));
+    for (const auto& record : records) {
+        writer.putString(record._token);
+        writer.putString(record._name);
+        writer.putString(record._material);
+        writer.put(record._lon);
+        writer.put(record._lat);
+        writer.put(record._elev);
+        writer.put(record._hdg);
+        writer.put(record._pitch);
+        writer.put(record._roll);
+        writer.put(record._radius);
+        writer.put(int32_t(record._size));
+        writer.put(uint32_t(record._restOfLine.size()));
+        for (const auto& word : record._restOfLine)
+            writer.putString(word);
+        writer.putString(record._path);
+        writer.put(record._rangeFactor);
+        writer.put(record._detailedRangeFactor);
+        writer.put(uint8_t(record._insideBucket));
+    }
+
+    return writer.writeFile(cacheFile(stgFile));
+}
+
+bool STGCache::read(const SGPath& stgFile, STGRecordList& records) const
+{
+    if (!stgFile.exists()) {
+        return false;
+    }
+
+    if (loadCache(stgFile, records)) {
+        return true;
+    }
+
+    if (!parse(stgFile, records)) {
+        return false;
+    }
+
+    if (!_cacheDir.isNull() && !saveCache(stgFile, records)) {
+        SG_LOG(SG_TERRAIN, SG_DEBUG, "Unable to write STG cache for " << stgFile);
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,102 @@
+// SGSTGCache.hxx -- parsed contents of .stg files, with an on-disk cache
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef _SGSTGCACHE_HXX
+#define _SGSTGCACHE_HXX
+
+#include <string>
+#include <vector>
+
+#include <simgear/math/sg_types.hxx>
+#include <simgear/misc/sg_path.hxx>
+
+namespace simgear {
+
+/**
+ * One line of a .stg file, with the fields the line has for its token
+ * already converted. Fields a line does not specify keep their defaults.
+ *
+ * STGCache::parse() also stores what the STG loader derives from a line
+ * without looking at its options: the path of the named file, the LOD
+ * range factors and whether the position is inside the tile.
+ */
+struct STGRecord {
+    STGRecord() : _lon(0), _lat(0), _elev(0), _hdg(0), _pitch(0), _roll(0),
+                  _radius(10), _size(-1), _rangeFactor(1),
+                  _detailedRangeFactor(1), _insideBucket(true) { }
+
+    bool operator==(const STGRecord& other) const;
+
+    std::string _token;
+    std::string _name;
+    /// material of BUILDING_LIST and TREE_LIST
+    std::string _material;
+    double _lon, _lat, _elev;
+    double _hdg, _pitch, _roll;
+    double _radius;
+    /// size of OBJECT_SIGN
+    int _size;
+    /// remaining words of tokens handled by an STG object callback
+    string_list _restOfLine;
+
+    /// the named file in the directory of the .stg file
+    std::string _path;
+    /// factors of the rough and, for detailed meshes, the detailed object
+    /// range, drawn from a random stream seeded with the tile index
+    double _rangeFactor, _detailedRangeFactor;
+    /// false if the position belongs to another tile
+    bool _insideBucket;
+};
+
+typedef std::vector<STGRecord> STGRecordList;
+
+/**
+ * Parses .stg files and keeps the result in a binary cache file per .stg
+ * file, so that revisiting an area does not parse the text again. A cache
+ * file is only used while the modification time and size of its .stg file
+ * are unchanged.
+ */
+class STGCache {
+public:
+    /// @param cacheDir directory for the cache files; caching is disabled
+    ///        if it is empty.
+    explicit STGCache(const SGPath& cacheDir);
+
+    /// Read the records of an .stg file, from the cache if it is up to date,
+    /// and otherwise by parsing the file and updating the cache.
+    /// @return false if the .stg file cannot be read
+    bool read(const SGPath& stgFile, STGRecordList& records) const;
+
+    /// Parse an .stg file without using any cache, and resolve the records
+    /// against the location and tile index of the file.
+    static bool parse(const SGPath& stgFile, STGRecordList& records);
+
+    /// Parse a single line; returns false for empty and comment lines.
+    static bool parseLine(const std::string& line, STGRecord& record);
+
+    /// The cache file used for an .stg file.
+    SGPath cacheFile(const SGPath& stgFile) const;
+
+    bool loadCache(const SGPath& stgFile, STGRecordList& records) const;
+    bool saveCache(const SGPath& stgFile, const STGRecordList& records) const;
+
+private:
+    SGPath _cacheDir;
+};
+
+}
+
+#endif // _SGSTGCACHE_HXX
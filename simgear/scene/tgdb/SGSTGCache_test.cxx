@@ -0,0 +1,211 @@
+// Checks that STGCache returns the same records from its cache files as
+// from parsing the .stg text, that changed or corrupt cache files are not
+// used, and compares the time ReaderWriterSTG takes to load a revisited
+// tile with and without the cache.
+
+#ifdef HAVE_CONFIG_H
+#  include <simgear_config.h>
+#endif
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+#include <osgDB/ReaderWriter>
+
+#include <simgear/bucket/newbucket.hxx>
+#include <simgear/io/iostreams/sgstream.hxx>
+#include <simgear/math/SGMath.hxx>
+#include <simgear/misc/sg_dir.hxx>
+#include <simgear/misc/test_macros.hxx>
+#include <simgear/scene/util/SGReaderWriterOptions.hxx>
+
+#include "ReaderWriterSTG.hxx"
+#include "SGCacheFile_private.hxx"
+#include "SGSTGCache.hxx"
+
+using namespace simgear;
+
+// A busy OSM tile: many shared objects and building meshes
+static void writeSTG(const SGPath& path, int objects, bool airport = true)
+{
+    sg_ofstream out(path);
+    out << "# generated for the STG cache test\n";
+    out << "OBJECT_BASE 942050.btg.gz\n";
+    if (airport)
+        out << "OBJECT KSFO.btg.gz\n";
+    for (int i = 0; i < objects; ++i) {
+        double lon = -122.4 + i * 1e-5, lat = 37.6 + (i % 97) * 1e-4;
+        switch (i % 6) {
+        case 0:
+            out << "OBJECT_SHARED Models/Power/generic_pylon_50m.ac " << lon << " " << lat
+                << " 12.5 " << (i % 360) << " 0 0\n";
+            break;
+        case 1:
+            out << "OBJECT_STATIC_AGL windturbine.xml " << lon << " " << lat
+                << " 0.0 " << (i % 360) << " 1.5 -2 30   # with radius\n";
+            break;
+        case 2:
+            out << "OBJECT_BUILDING_MESH_DETAILED osm_" << i << ".ac " << lon << " " << lat
+                << " 4.25 0 0 0 120\n";
+            break;
+        case 3:
+            out << "OBJECT_SIGN_AGL {@size=2,^l28R-10L} " << lon << " " << lat << " 0 281 2\n";
+            break;
+        case 4:
+            out << "BUILDING_LIST buildings_" << i << ".txt OSM_Building " << lon << " " << lat << " 7\n";
+            break;
+        case 5:
+            out << "OBJECT_CUSTOM custom.xml " << lon << " " << lat << " 3 45 extra words here\n";
+            break;
+        }
+    }
+}
+
+// Load the tile by its name from the scenery directory, the way the tile
+// pager does, and return the average time
+static double readNodeMs(const SGPath& sceneryDir, const SGPath& cacheDir, int repeat)
+{
+    osg::ref_ptr<SGReaderWriterOptions> options = new SGReaderWriterOptions;
+    options->getDatabasePathList().push_back(sceneryDir.utf8Str());
+    options->setSceneryPathSuffixes(string_list(1, "Objects"));
+    options->setPluginStringData("SimGear::LOD_RANGE_DETAILED", "1500");
+    options->setPluginStringData("SimGear::LOD_RANGE_BARE", "10000");
+    options->setPluginStringData("SimGear::LOD_RANGE_ROUGH", "9000");
+    // There is no terrain to load
+    options->setPluginStringData("SimGear::FG_ONLY_AIRPORTS", "ON");
+    options->setPluginStringData("SimGear::STG_CACHE_PATH", cacheDir.utf8Str());
+
+    ReaderWriterSTG reader;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeat; ++i) {
+        osgDB::ReaderWriter::ReadResult result = reader.readNode("942050.stg", options.get());
+        SG_VERIFY(result.validNode());
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / repeat;
+}
+
+int main(int argc, char* argv[])
+{
+    simgear::Dir tmpDir = simgear::Dir::tempDir("FlightGear");
+    tmpDir.setRemoveOnDestroy();
+
+    const SGPath stg = tmpDir.path() / "942050.stg";
+    writeSTG(stg, 20000);
+
+    // Single lines keep the defaults of missing fields
+    STGRecord record;
+    SG_VERIFY(!STGCache::parseLine("   # only a comment", record));
+    SG_VERIFY(STGCache::parseLine("OBJECT_SHARED a.ac 1 2 3 4", record));
+    SG_CHECK_EQUAL(record._hdg, 4.0);
+    SG_CHECK_EQUAL(record._radius, 10.0);
+    SG_VERIFY(STGCache::parseLine("OBJECT_SIGN s 1 2 3 4", record));
+    SG_CHECK_EQUAL(record._size, -1);
+    SG_VERIFY(STGCache::parseLine("TREE_LIST t.txt Forest 1 2 3 # trees", record));
+    SG_CHECK_EQUAL(record._material, "Forest");
+    SG_CHECK_EQUAL(record._elev, 3.0);
+
+    STGRecordList parsed;
+    SG_VERIFY(STGCache::parse(stg, parsed));
+    SG_CHECK_EQUAL(parsed.size(), 20002u);
+    SG_CHECK_EQUAL(parsed[7]._restOfLine.size(), 3u);
+
+    // Parsing resolves the paths, the range factors and the tile check
+    SG_CHECK_EQUAL(parsed[1]._path, (tmpDir.path() / "KSFO.btg.gz").utf8Str());
+    SG_CHECK_EQUAL(parsed[1]._rangeFactor, 1.0);
+    const SGBucket bucket(942050);
+    size_t inside = 0, scaled = 0;
+    for (const STGRecord& r : parsed) {
+        SG_VERIFY(r._rangeFactor == 1.0 || r._rangeFactor == 1.5 || r._rangeFactor == 2.0);
+        if (r._token != "OBJECT_BUILDING_MESH_DETAILED")
+            SG_CHECK_EQUAL(r._detailedRangeFactor, 1.0);
+        if (r._token == "OBJECT_BASE" || r._token == "OBJECT")
+            continue;
+        SG_CHECK_EQUAL(r._insideBucket,
+                       bucket == SGBucket(SGGeod::fromDeg(float(r._lon), float(r._lat))));
+        inside += r._insideBucket;
+        scaled += r._rangeFactor != 1.0;
+    }
+    SG_VERIFY(inside > 0 && inside < parsed.size() - 2);
+    // 40% of the objects get a larger range
+    SG_VERIFY(scaled > parsed.size() / 3 && scaled < parsed.size() / 2);
+
+    // No cache directory: parse only
+    STGCache noCache((SGPath()));
+    STGRecordList records;
+    SG_VERIFY(noCache.read(stg, records));
+    SG_VERIFY(records == parsed);
+    SG_VERIFY(!noCache.loadCache(stg, records));
+
+    // First read writes the cache, second one uses it
+    const SGPath cacheDir = tmpDir.path() / "cache";
+    STGCache cache(cacheDir);
+    SG_VERIFY(!cache.loadCache(stg, records));
+    SG_VERIFY(cache.read(stg, records));
+    SG_VERIFY(records == parsed);
+    SG_VERIFY(cache.cacheFile(stg).exists());
+    records.clear();
+    SG_VERIFY(cache.loadCache(stg, records));
+    SG_VERIFY(records == parsed);
+
+    // Missing .stg files are not found, even with a cache
+    STGRecordList none;
+    SG_VERIFY(!cache.read(tmpDir.path() / "942051.stg", none));
+
+    // A changed .stg file invalidates the cache
+    writeSTG(stg, 100);
+    SG_VERIFY(!cache.loadCache(stg, records));
+    SG_VERIFY(cache.read(stg, records));
+    SG_CHECK_EQUAL(records.size(), 102u);
+    SG_VERIFY(cache.loadCache(stg, records));
+    SG_CHECK_EQUAL(records.size(), 102u);
+
+    // A corrupt cache file is ignored
+    {
+        sg_ofstream out(cache.cacheFile(stg));
+        out << "SGSTGCCH garbage";
+    }
+    SG_VERIFY(!cache.loadCache(stg, records));
+    SG_VERIFY(cache.read(stg, records));
+    SG_CHECK_EQUAL(records.size(), 102u);
+
+    // So is a truncated one, and a record count larger than the file can hold
+    std::string data;
+    {
+        sg_ifstream in(cache.cacheFile(stg), std::ios::in | std::ios::binary);
+        data = in.read_all();
+    }
+    {
+        sg_ofstream out(cache.cacheFile(stg), std::ios::out | std::ios::binary);
+        out.write(data.data(), data.size() / 2);
+    }
+    SG_VERIFY(!cache.loadCache(stg, records));
+    CacheFileWriter writer;
+    const char magic[8] = { 'S', 'G', 'S', 'T', 'G', 'C', 'C', 'H' };
+    writer.putHeader(magic, 2, stg);
+    writer.put(uint32_t(0xffffffff));
+    SG_VERIFY(writer.writeFile(cache.cacheFile(stg)));
+    SG_VERIFY(!cache.loadCache(stg, records));
+    SG_VERIFY(cache.read(stg, records));
+    SG_CHECK_EQUAL(records.size(), 102u);
+
+    // Revisiting a tile: the whole load through ReaderWriterSTG, parsing the
+    // text or using the cache file
+    const SGPath sceneryDir = tmpDir.path() / "Scenery";
+    const SGPath tileDir = sceneryDir / "Objects" / bucket.gen_base_path();
+    SG_VERIFY(simgear::Dir(tileDir).create(0755));
+    writeSTG(tileDir / "942050.stg", 20000, false);
+    ReaderWriterSTG::setSTGObjectHandler("OBJECT_CUSTOM",
+        [](const std::string&, const std::string&, const SGGeod&, double,
+           const string_list&) { return true; });
+
+    const int repeat = 5;
+    double parseMs = readNodeMs(sceneryDir, SGPath(), repeat);
+    readNodeMs(sceneryDir, cacheDir, 1);
+    double cacheMs = readNodeMs(sceneryDir, cacheDir, repeat);
+    std::cout << parsed.size() << " STG records, ReaderWriterSTG::readNode: parse "
+              << parseMs << " ms, cache " << cacheMs << " ms" << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,150 @@
+/* -*-c++-*-
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifndef SG_SPACING_GRID_HXX
+#define SG_SPACING_GRID_HXX
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <simgear/math/SGMath.hxx>
+
+/// Points with a clearance radius, for the spacing checks of random objects
+/// and buildings. isClose() answers whether a new point with its own radius
+/// would come closer to any stored point than the sum of both radii, and
+/// gives exactly the same answer as testing every stored point.
+///
+/// Points are hashed into a uniform grid of cubic cells; a cell size of about
+/// twice the typical radius keeps each query to the 27 surrounding cells.
+/// With only a few points stored, a plain scan is faster and is used instead.
+class SGSpacingGrid {
+public:
+  explicit SGSpacingGrid(float cellSize = 1.0f)
+  { setCellSize(cellSize); }
+
+  /// Also clears the grid.
+  void setCellSize(float cellSize)
+  {
+    _cellSize = std::max(cellSize, 1e-3f);
+    _invCellSize = 1.0f / _cellSize;
+    clear();
+  }
+
+  void clear()
+  {
+    _points.clear();
+    _cells.clear();
+    _maxRadius = 0.0f;
+  }
+
+  bool empty() const
+  { return _points.empty(); }
+
+  void insert(const SGVec3f& p, float radius)
+  {
+    _points.push_back(Point{p, radius});
+    _maxRadius = std::max(_maxRadius, radius);
+
+    if (_points.size() == LINEAR_SCAN_LIMIT) {
+      // From now on, use the grid
+      for (unsigned i = 0; i < _points.size(); ++i)
+        _cells[cellKey(cellOf(_points[i].position))].push_back(i);
+    } else if (_points.size() > LINEAR_SCAN_LIMIT) {
+      _cells[cellKey(cellOf(p))].push_back(_points.size() - 1);
+    }
+  }
+
+  /// The sum of radii is computed in the type of 'radius' (float or
+  /// double), like the scans this replaces did.
+  template<typename R>
+  bool isClose(const SGVec3f& p, R radius) const
+  {
+    if (_points.size() < LINEAR_SCAN_LIMIT) {
+      for (const Point& point : _points) {
+        if (tooClose(point, p, radius))
+          return true;
+      }
+      return false;
+    }
+
+    // Any point that is too close is within this many cells
+    const int reach = int((float(radius) + _maxRadius) * _invCellSize) + 1;
+    const SGVec3i c = cellOf(p);
+    for (int x = c[0] - reach; x <= c[0] + reach; ++x) {
+      for (int y = c[1] - reach; y <= c[1] + reach; ++y) {
+        for (int z = c[2] - reach; z <= c[2] + reach; ++z) {
+          CellMap::const_iterator cell = _cells.find(cellKey(SGVec3i(x, y, z)));
+          if (cell == _cells.end())
+            continue;
+          for (unsigned i : cell->second) {
+            if (tooClose(_points[i], p, radius))
+              return true;
+          }
+        }
+      }
+    }
+    return false;
+  }
+
+private:
+  enum { LINEAR_SCAN_LIMIT = 16 };
+
+  struct Point {
+    SGVec3f position;
+    float radius;
+  };
+
+  typedef std::unordered_map<uint64_t, std::vector<unsigned> > CellMap;
+
+  // Same expression as the linear scans this replaces, so that rounding
+  // gives the same answers.
+  template<typename R>
+  static bool tooClose(const Point& point, const SGVec3f& p, R radius)
+  {
+    R min_dist = point.radius + radius;
+    float min_dist2 = min_dist * min_dist;
+    return distSqr(point.position, p) < min_dist2;
+  }
+
+  SGVec3i cellOf(const SGVec3f& p) const
+  {
+    return SGVec3i(int(std::floor(p[0] * _invCellSize)),
+                   int(std::floor(p[1] * _invCellSize)),
+                   int(std::floor(p[2] * _invCellSize)));
+  }
+
+  static uint64_t cellKey(const SGVec3i& c)
+  {
+    // 21 bits per axis covers any tile at any sensible cell size
+    const uint64_t mask = (uint64_t(1) << 21) - 1;
+    return ((uint64_t(c[0]) & mask) << 42) | ((uint64_t(c[1]) & mask) << 21) |
+           (uint64_t(c[2]) & mask);
+  }
+
+  float _cellSize;
+  float _invCellSize;
+  float _maxRadius;
+  std::vector<Point> _points;
+  CellMap _cells;
+};
+
+#endif
@@ -0,0 +1,121 @@
+// Checks that SGSpacingGrid accepts and rejects exactly the same random
+// object and building placements as the linear scans it replaced in
+// SGTileDetailsCallback, on a dense urban triangle, and reports timings.
+
+#ifdef HAVE_CONFIG_H
+#  include <simgear_config.h>
+#endif
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include <simgear/math/SGMath.hxx>
+#include <simgear/math/sg_random.h>
+#include <simgear/misc/test_macros.hxx>
+
+#include "SGSpacingGrid.hxx"
+
+typedef std::vector<std::pair<SGVec3f, float> > PointList;
+
+// Placement decisions, in order
+typedef std::vector<bool> Placements;
+
+// Linear scan, as formerly done in SGTileDetailsCallback
+template<typename R>
+static bool scanIsClose(const PointList& list, const SGVec3f& p, R radius)
+{
+  bool close = false;
+  for (PointList::const_iterator l = list.begin(); l != list.end(); ++l) {
+    R min_dist = l->second + radius;
+    float min_dist2 = min_dist * min_dist;
+    if (distSqr(l->first, p) < min_dist2)
+      close = true;
+  }
+  return close;
+}
+
+// One triangle of a dense urban landclass: first random objects (double
+// spacing, as SGMatModel::get_spacing_m()), then buildings (float radii).
+template<typename Objects, typename Buildings>
+static Placements placeDetails(Objects& objects, Buildings& buildings,
+                               double& ms)
+{
+  mt seed;
+  mt_init(&seed, unsigned(123));
+  const SGVec3f origin(-1200, -900, 35);
+  const SGVec3f v0(2500, 300, 12), v1(400, 2100, -20);
+  const double spacings[] = { 3.0, 7.5, 12.0 };
+  const float radii[] = { 6.0f, 11.0f, 19.0f };
+  Placements placements;
+
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < 6000; ++i) {
+    float a = mt_rand(&seed), b = mt_rand(&seed);
+    if (a + b > 1) { a = 1 - a; b = 1 - b; }
+    const SGVec3f p = origin + a * v0 + b * v1;
+    const double spacing = spacings[i % 3];
+    const bool close = objects.isClose(p, spacing);
+    if (!close)
+      objects.insert(p, float(spacing));
+    placements.push_back(!close);
+  }
+  for (int i = 0; i < 20000; ++i) {
+    float a = mt_rand(&seed), b = mt_rand(&seed);
+    if (a + b > 1) { a = 1 - a; b = 1 - b; }
+    const SGVec3f p = origin + a * v0 + b * v1;
+    const float radius = radii[int(mt_rand(&seed) * 3) % 3];
+    const bool close = buildings.isClose(p, radius) || objects.isClose(p, radius);
+    if (!close)
+      buildings.insert(p, radius);
+    placements.push_back(!close);
+  }
+  auto end = std::chrono::steady_clock::now();
+  ms = std::chrono::duration<double, std::milli>(end - start).count();
+  return placements;
+}
+
+struct ScanList {
+  PointList list;
+  template<typename R>
+  bool isClose(const SGVec3f& p, R radius) const
+  { return scanIsClose(list, p, radius); }
+  void insert(const SGVec3f& p, float radius)
+  { list.push_back(std::make_pair(p, radius)); }
+};
+
+int main(int argc, char* argv[])
+{
+  ScanList scanObjects, scanBuildings;
+  SGSpacingGrid gridObjects(2.0f * 19.0f), gridBuildings(2.0f * 19.0f);
+
+  double scanMs = 0, gridMs = 0;
+  const Placements expected = placeDetails(scanObjects, scanBuildings, scanMs);
+  const Placements actual = placeDetails(gridObjects, gridBuildings, gridMs);
+
+  SG_CHECK_EQUAL(expected.size(), actual.size());
+  SG_VERIFY(expected == actual);
+
+  size_t placed = 0;
+  for (bool b : actual)
+    placed += b;
+  std::cout << placed << " of " << actual.size() << " details placed: "
+            << "linear scan " << scanMs << " ms, spatial hash " << gridMs
+            << " ms" << std::endl;
+
+  // Small lists are scanned, large ones use the grid: both must agree
+  // around the switch-over point, and after clear().
+  gridObjects.clear();
+  SG_VERIFY(gridObjects.empty());
+  SG_VERIFY(!gridObjects.isClose(SGVec3f(0, 0, 0), 1.0f));
+  for (int i = 0; i < 40; ++i) {
+    gridObjects.insert(SGVec3f(i * 10.0f, 0, 0), 2.0f);
+    SG_VERIFY(gridObjects.isClose(SGVec3f(i * 10.0f + 3.9f, 0, 0), 2.0f));
+    SG_VERIFY(!gridObjects.isClose(SGVec3f(i * 10.0f + 4.1f, 0.0f, 0), 1.0f));
+    SG_VERIFY(!gridObjects.isClose(SGVec3f(i * 10.0f, -4.1f, 0), 2.0f));
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,224 @@
+/* -*-c++-*-
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifndef SG_SURFACE_SAMPLER_HXX
+#define SG_SURFACE_SAMPLER_HXX
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <simgear/math/SGMath.hxx>
+
+/// Counter based random numbers: number i of the stream with a given key is
+/// a pure function of (key, i). Blocks of numbers can therefore be produced
+/// by a plain loop the compiler can vectorize, and a stream is reproduced
+/// exactly by its key and counter.
+class SGCounterRandom {
+public:
+  explicit SGCounterRandom(uint64_t key = 0, uint64_t counter = 0) :
+    _key(key), _counter(counter)
+  { }
+
+  void reset(uint64_t key, uint64_t counter = 0)
+  { _key = key; _counter = counter; }
+
+  uint64_t getKey() const
+  { return _key; }
+  uint64_t getCounter() const
+  { return _counter; }
+
+  /// Uniform in [0, 1)
+  float next()
+  { return toFloat(value(_key, _counter++)); }
+
+  /// Same as calling next() n times.
+  void fill(float* out, size_t n)
+  {
+    const uint64_t key = _key, counter = _counter;
+    for (size_t i = 0; i < n; ++i)
+      out[i] = toFloat(value(key, counter + i));
+    _counter += n;
+  }
+
+  static uint64_t value(uint64_t key, uint64_t counter)
+  {
+    // SplitMix64 output function applied to a Weyl sequence
+    uint64_t z = key + (counter + 1) * 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+  static float toFloat(uint64_t x)
+  { return float(x >> 40) * (1.0f / 16777216.0f); }
+
+private:
+  uint64_t _key;
+  uint64_t _counter;
+};
+
+/// The red, green and blue channels of an object mask, decoded once into
+/// 8 bit texels. Texture coordinates wrap around as with GL_REPEAT.
+class SGObjectMaskLookup {
+public:
+  enum Channel { RED = 0, GREEN = 1, BLUE = 2 };
+
+  SGObjectMaskLookup() : _width(0), _height(0)
+  { }
+  SGObjectMaskLookup(int width, int height)
+  { resize(width, height); }
+
+  void resize(int width, int height)
+  {
+    _width = std::max(width, 0);
+    _height = std::max(height, 0);
+    for (int c = 0; c < 3; ++c)
+      _channels[c].assign(size_t(_width) * _height, 0);
+  }
+
+  int getWidth() const
+  { return _width; }
+  int getHeight() const
+  { return _height; }
+  bool empty() const
+  { return _width == 0 || _height == 0; }
+
+  void set(int x, int y, uint8_t r, uint8_t g, uint8_t b)
+  {
+    const size_t i = size_t(y) * _width + x;
+    _channels[RED][i] = r;
+    _channels[GREEN][i] = g;
+    _channels[BLUE][i] = b;
+  }
+
+  uint8_t get(Channel channel, int x, int y) const
+  { return _channels[channel][size_t(y) * _width + x]; }
+
+  /// The texel of a channel at a texture coordinate, scaled to [0, 1].
+  float lookup(Channel channel, const SGVec2f& texCoord) const
+  {
+    int x = int(_width * texCoord.x()) % _width;
+    int y = int(_height * texCoord.y()) % _height;
+    if (x < 0) x += _width;
+    if (y < 0) y += _height;
+    return get(channel, x, y) * (1.0f / 255.0f);
+  }
+
+private:
+  int _width;
+  int _height;
+  std::vector<uint8_t> _channels[3];
+};
+
+/// Draws random points on a list of triangles, optionally thinned out by an
+/// object mask channel.
+///
+/// Each triangle gets floor(expected + u) points with u uniform in [0, 1),
+/// placed uniformly as a*v0 + b*v1 + c*v2. The random numbers are generated
+/// in blocks of BlockSize points, so the output only depends on the
+/// triangles, the mask and the state of the random stream.
+class SGSurfaceSampler {
+public:
+  enum { BlockSize = 256 };
+
+  struct Triangle {
+    SGVec3f v0, v1, v2;
+    SGVec2f t0, t1, t2;
+    /// Expected number of points
+    float expected;
+  };
+
+  void clear()
+  { _triangles.clear(); }
+
+  void reserve(size_t n)
+  { _triangles.reserve(n); }
+
+  void addTriangle(const Triangle& triangle)
+  { _triangles.push_back(triangle); }
+
+  size_t getNumTriangles() const
+  { return _triangles.size(); }
+  const Triangle& getTriangle(size_t i) const
+  { return _triangles[i]; }
+
+  /// Calls emit(triangleIndex, point) for every point that is placed, in
+  /// triangle order.
+  template<typename Emit>
+  void sample(SGCounterRandom& random, const SGObjectMaskLookup* mask,
+              SGObjectMaskLookup::Channel channel, Emit emit) const
+  {
+    if (mask && mask->empty())
+      mask = 0;
+
+    // Number of points per triangle, with a zombie door for the fraction
+    const size_t numTriangles = _triangles.size();
+    std::vector<unsigned> counts(numTriangles);
+    size_t total = 0;
+    float u[BlockSize];
+    for (size_t first = 0; first < numTriangles; first += BlockSize) {
+      const size_t n = std::min(size_t(BlockSize), numTriangles - first);
+      random.fill(u, n);
+      for (size_t i = 0; i < n; ++i) {
+        float expected = _triangles[first + i].expected + u[i];
+        counts[first + i] = expected > 0 ? unsigned(expected) : 0;
+        total += counts[first + i];
+      }
+    }
+
+    float a[BlockSize], b[BlockSize], keep[BlockSize];
+    size_t triangle = 0;
+    unsigned left = numTriangles ? counts[0] : 0;
+    while (total > 0) {
+      const size_t n = std::min(size_t(BlockSize), total);
+      random.fill(a, n);
+      random.fill(b, n);
+      random.fill(keep, n);
+      for (size_t i = 0; i < n; ++i) {
+        if (a[i] + b[i] > 1) {
+          a[i] = 1 - a[i];
+          b[i] = 1 - b[i];
+        }
+      }
+
+      for (size_t i = 0; i < n; ++i) {
+        while (left == 0)
+          left = counts[++triangle];
+        --left;
+
+        const Triangle& t = _triangles[triangle];
+        const float c = 1 - a[i] - b[i];
+        if (mask) {
+          SGVec2f texCoord = a[i]*t.t0 + b[i]*t.t1 + c*t.t2;
+          if (!(keep[i] < mask->lookup(channel, texCoord)))
+            continue;
+        }
+        emit(triangle, a[i]*t.v0 + b[i]*t.v1 + c*t.v2);
+      }
+      total -= n;
+    }
+  }
+
+private:
+  std::vector<Triangle> _triangles;
+};
+
+#endif
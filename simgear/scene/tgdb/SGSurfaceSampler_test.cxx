@@ -0,0 +1,205 @@
+// Checks that SGSurfaceSampler is reproducible and places the expected
+// number of points inside the triangles, and compares its speed with the
+// former one point at a time sampling of SGTriangleInfo.
+
+#ifdef HAVE_CONFIG_H
+#  include <simgear_config.h>
+#endif
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <simgear/math/SGMath.hxx>
+#include <simgear/math/sg_random.h>
+#include <simgear/misc/test_macros.hxx>
+
+#include "SGSurfaceSampler.hxx"
+
+static const int MaskSize = 512;
+
+// Stand-in for osg::Image::getColor(): dispatches on the pixel format for
+// every texel and converts all channels to float.
+enum PixelFormat { LUMINANCE, RGB, RGBA };
+
+struct Color { float r, g, b, a; };
+
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+static Color getColor(const std::vector<unsigned char>& data,
+                      PixelFormat format, int x, int y)
+{
+  Color color = { 0, 0, 0, 1 };
+  switch (format) {
+  case LUMINANCE: {
+    float l = data[y * MaskSize + x] / 255.0f;
+    color.r = color.g = color.b = l;
+    break;
+  }
+  case RGB: {
+    const unsigned char* p = &data[(y * MaskSize + x) * 3];
+    color.r = p[0] / 255.0f;
+    color.g = p[1] / 255.0f;
+    color.b = p[2] / 255.0f;
+    break;
+  }
+  case RGBA: {
+    const unsigned char* p = &data[(y * MaskSize + x) * 4];
+    color.r = p[0] / 255.0f;
+    color.g = p[1] / 255.0f;
+    color.b = p[2] / 255.0f;
+    color.a = p[3] / 255.0f;
+    break;
+  }
+  }
+  return color;
+}
+
+// A patch of terrain made of triangles between 20 and 2000 m^2
+static SGSurfaceSampler makeTriangles(float coverage)
+{
+  mt seed;
+  mt_init(&seed, unsigned(586));
+  SGSurfaceSampler sampler;
+  for (int i = 0; i < 20000; ++i) {
+    SGSurfaceSampler::Triangle t;
+    float x = (i % 200) * 40.0f, y = (i / 200) * 40.0f;
+    float size = 6.0f + 60.0f * float(mt_rand(&seed));
+    t.v0 = SGVec3f(x, y, 0);
+    t.v1 = SGVec3f(x + size, y, 1);
+    t.v2 = SGVec3f(x, y + size, 2);
+    t.t0 = SGVec2f(x / 1000, y / 1000);
+    t.t1 = SGVec2f((x + size) / 1000, y / 1000);
+    t.t2 = SGVec2f(x / 1000, (y + size) / 1000);
+    t.expected = 0.5f * size * size / coverage;
+    sampler.addTriangle(t);
+  }
+  return sampler;
+}
+
+// The former sampling: one mt_rand() per random number and a getColor()
+// per point.
+static void sampleSerial(const SGSurfaceSampler& sampler, float coverage,
+                         const std::vector<unsigned char>& mask,
+                         std::vector<SGVec3f>& points)
+{
+  mt seed;
+  mt_init(&seed, unsigned(123));
+  for (size_t i = 0; i < sampler.getNumTriangles(); ++i) {
+    const SGSurfaceSampler::Triangle& t = sampler.getTriangle(i);
+    float area = t.expected * coverage;
+    float unit = area + mt_rand(&seed)*coverage;
+    while ( coverage < unit ) {
+      float a = mt_rand(&seed);
+      float b = mt_rand(&seed);
+      if ( a + b > 1 ) {
+        a = 1 - a;
+        b = 1 - b;
+      }
+      float c = 1 - a - b;
+      SGVec3f randomPoint = a*t.v0 + b*t.v1 + c*t.v2;
+      SGVec2f texCoord = a*t.t0 + b*t.t1 + c*t.t2;
+      unsigned int x = (int) (MaskSize * texCoord.x()) % MaskSize;
+      unsigned int y = (int) (MaskSize * texCoord.y()) % MaskSize;
+      if (mt_rand(&seed) < getColor(mask, RGB, x, y).r)
+        points.push_back(randomPoint);
+      unit -= coverage;
+    }
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  // A mask with a gradient in red and nothing in green
+  std::vector<unsigned char> maskData(MaskSize * MaskSize * 3);
+  SGObjectMaskLookup mask(MaskSize, MaskSize);
+  for (int y = 0; y < MaskSize; ++y) {
+    for (int x = 0; x < MaskSize; ++x) {
+      unsigned char* p = &maskData[(y * MaskSize + x) * 3];
+      p[0] = (unsigned char)(x * 255 / (MaskSize - 1));
+      p[1] = 0;
+      p[2] = 255;
+      mask.set(x, y, p[0], p[1], p[2]);
+    }
+  }
+
+  // Counter based random numbers: blocks and single values agree
+  SGCounterRandom r1(123), r2(123);
+  std::vector<float> block(1000);
+  r1.fill(block.data(), block.size());
+  for (size_t i = 0; i < block.size(); ++i) {
+    float value = r2.next();
+    SG_CHECK_EQUAL(block[i], value);
+    SG_VERIFY(0 <= value && value < 1);
+  }
+  SG_CHECK_EQUAL(r1.getCounter(), r2.getCounter());
+
+  const float coverage = 10.0f;
+  SGSurfaceSampler sampler = makeTriangles(coverage);
+
+  // Same stream, same points; no mask gives the expected point count,
+  // all of them inside their triangle.
+  std::vector<std::vector<SGVec3f> > runs(2);
+  std::vector<size_t> perTriangle(sampler.getNumTriangles());
+  for (int run = 0; run < 2; ++run) {
+    SGCounterRandom random(123);
+    sampler.sample(random, 0, SGObjectMaskLookup::RED,
+                   [&](size_t i, const SGVec3f& p) {
+                     runs[run].push_back(p);
+                     if (run == 0)
+                       ++perTriangle[i];
+                   });
+  }
+  SG_VERIFY(runs[0] == runs[1]);
+
+  double expected = 0;
+  size_t sampled = 0;
+  for (size_t i = 0; i < sampler.getNumTriangles(); ++i) {
+    const SGSurfaceSampler::Triangle& t = sampler.getTriangle(i);
+    expected += t.expected;
+    sampled += perTriangle[i];
+    // floor(expected + u) is one of the two integers around expected
+    SG_VERIFY(perTriangle[i] >= size_t(std::floor(t.expected)) &&
+              perTriangle[i] <= size_t(std::ceil(t.expected)));
+  }
+  SG_CHECK_EQUAL(sampled, runs[0].size());
+  SG_VERIFY(std::fabs(runs[0].size() - expected) < 0.01 * expected);
+  for (const SGVec3f& p : runs[0])
+    SG_VERIFY(p.z() >= 0 && p.z() <= 2);
+
+  // A green mask of zero places nothing, a blue one of 255 everything
+  size_t placed = 0;
+  SGCounterRandom random(123);
+  sampler.sample(random, &mask, SGObjectMaskLookup::GREEN,
+                 [&](size_t, const SGVec3f&) { ++placed; });
+  SG_CHECK_EQUAL(placed, size_t(0));
+  random.reset(123);
+  sampler.sample(random, &mask, SGObjectMaskLookup::BLUE,
+                 [&](size_t, const SGVec3f&) { ++placed; });
+  SG_CHECK_EQUAL(placed, runs[0].size());
+
+  // Speed with the red gradient mask, against the former serial sampling
+  std::vector<SGVec3f> serialPoints, batchPoints;
+  auto start = std::chrono::steady_clock::now();
+  sampleSerial(sampler, coverage, maskData, serialPoints);
+  auto middle = std::chrono::steady_clock::now();
+  random.reset(123);
+  sampler.sample(random, &mask, SGObjectMaskLookup::RED,
+                 [&](size_t, const SGVec3f& p) { batchPoints.push_back(p); });
+  auto end = std::chrono::steady_clock::now();
+
+  // Both keep about half of the points
+  SG_VERIFY(std::fabs(double(batchPoints.size()) - double(serialPoints.size()))
+            < 0.02 * serialPoints.size());
+
+  double serialMs = std::chrono::duration<double, std::milli>(middle - start).count();
+  double batchMs = std::chrono::duration<double, std::milli>(end - middle).count();
+  std::cout << batchPoints.size() << " of " << runs[0].size() << " points: "
+            << "serial " << serialMs << " ms, batched " << batchMs
+            << " ms, speed-up " << serialMs / batchMs << std::endl;
+
+  return EXIT_SUCCESS;
+}
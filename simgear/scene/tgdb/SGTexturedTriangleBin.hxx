@@ -30,9 +30,11 @@
 #include <osg/Texture2D>
 #include <osg/ref_ptr>
 #include <stdio.h>
+#include <cstring>
 
 #include <simgear/math/sg_random.h>
 #include <simgear/scene/util/OsgMath.hxx>
+#include "SGBTGCache.hxx"
 #include "SGTriangleBin.hxx"
 
 
@@ -77,6 +79,29 @@ struct SGVertNormTex {
     }
   };
 
+  // Hash of the members compared by less. Texture coordinates are only
+  // compared when both vertices have them, so vertices with different
+  // tc_mask values hash differently and are never merged: with the former
+  // std::map, whether they were depended on the map's internal layout.
+  struct hash
+  {
+    inline size_t operator() (const SGVertNormTex& v) const
+    {
+      size_t h = v.tc_mask;
+      for (int i = 0; i < 3; ++i) {
+        h = SGVertexArrayBinHashFloat(h, v.vertex(i));
+        h = SGVertexArrayBinHashFloat(h, v.normal(i));
+      }
+      for (int idx = 0; idx < 4; ++idx) {
+        if (v.tc_mask & 1<<idx) {
+          h = SGVertexArrayBinHashFloat(h, v.texCoord[idx](0));
+          h = SGVertexArrayBinHashFloat(h, v.texCoord[idx](1));
+        }
+      }
+      return h;
+    }
+  };
+
   void SetVertex( const SGVec3f& v )          { vertex = v; }
   const SGVec3f& GetVertex( void ) const      { return vertex; }
   
@@ -148,210 +173,6 @@ public:
     has_sec_tcs = false;
   }
 
-  // Computes and adds random surface points to the points list.
-  // The random points are computed with a density of (coverage points)/1
-  // The points are offsetted away from the triangles in
-  // offset * positive normal direction.
-  void addRandomSurfacePoints(float coverage, float offset,
-                              osg::Texture2D* object_mask,
-                              std::vector<SGVec3f>& points)
-  {
-    unsigned num = getNumTriangles();
-    for (unsigned i = 0; i < num; ++i) {
-      triangle_ref triangleRef = getTriangleRef(i);
-      SGVec3f v0 = getVertex(triangleRef[0]).GetVertex();
-      SGVec3f v1 = getVertex(triangleRef[1]).GetVertex();
-      SGVec3f v2 = getVertex(triangleRef[2]).GetVertex();
-      SGVec2f t0 = getVertex(triangleRef[0]).GetTexCoord(0);
-      SGVec2f t1 = getVertex(triangleRef[1]).GetTexCoord(0);
-      SGVec2f t2 = getVertex(triangleRef[2]).GetTexCoord(0);
-      SGVec3f normal = cross(v1 - v0, v2 - v0);
-      
-      // Compute the area
-      float area = 0.5f*length(normal);
-      if (area <= SGLimitsf::min())
-        continue;
-      
-      // For partial units of area, use a zombie door method to
-      // create the proper random chance of a light being created
-      // for this triangle
-      float unit = area + mt_rand(&seed)*coverage;
-      
-      SGVec3f offsetVector = offset*normalize(normal);
-      // generate a light point for each unit of area
-
-      while ( coverage < unit ) {
-
-        float a = mt_rand(&seed);
-        float b = mt_rand(&seed);
-
-        if ( a + b > 1 ) {
-          a = 1 - a;
-          b = 1 - b;
-        }
-        float c = 1 - a - b;
-        SGVec3f randomPoint = offsetVector + a*v0 + b*v1 + c*v2;
-        
-        if (object_mask != NULL) {
-          SGVec2f texCoord = a*t0 + b*t1 + c*t2;
-          
-          // Check this random point against the object mask
-          // red channel.
-          osg::Image* img = object_mask->getImage();            
-          unsigned int x = (int) (img->s() * texCoord.x()) % img->s();
-          unsigned int y = (int) (img->t() * texCoord.y()) % img->t();
-          
-          if (mt_rand(&seed) < img->getColor(x, y).r()) {                
-            points.push_back(randomPoint);        
-          }                    
-        } else {      
-          // No object mask, so simply place the object  
-          points.push_back(randomPoint);        
-        }
-        unit -= coverage;        
-      }
-    }
-  }
-
-  // Computes and adds random surface points to the points list for tree
-  // coverage.
-  void addRandomTreePoints(float wood_coverage, 
-                           osg::Texture2D* object_mask,
-                           float vegetation_density,
-                           float cos_max_density_angle,
-                           float cos_zero_density_angle,
-                           bool is_plantation,
-                           std::vector<SGVec3f>& points,
-			   std::vector<SGVec3f>& normals)
-  {
-    unsigned num = getNumTriangles();
-    for (unsigned i = 0; i < num; ++i) {
-      triangle_ref triangleRef = getTriangleRef(i);
-      SGVec3f v0 = getVertex(triangleRef[0]).GetVertex();
-      SGVec3f v1 = getVertex(triangleRef[1]).GetVertex();
-      SGVec3f v2 = getVertex(triangleRef[2]).GetVertex();
-      SGVec2f t0 = getVertex(triangleRef[0]).GetTexCoord(0);
-      SGVec2f t1 = getVertex(triangleRef[1]).GetTexCoord(0);
-      SGVec2f t2 = getVertex(triangleRef[2]).GetTexCoord(0);
-      SGVec3f normal = cross(v1 - v0, v2 - v0);
-      
-      // Ensure the slope isn't too steep by checking the
-      // cos of the angle between the slope normal and the
-      // vertical (conveniently the z-component of the normalized
-      // normal) and values passed in.                   
-      float alpha = normalize(normal).z();
-      float slope_density = 1.0;
-      
-      if (alpha < cos_zero_density_angle) 
-        continue; // Too steep for any vegetation      
-      
-      if (alpha < cos_max_density_angle) {
-        slope_density = 
-          (alpha - cos_zero_density_angle) / (cos_max_density_angle - cos_zero_density_angle);
-      }
-      
-      // Compute the area
-      float area = 0.5f*length(normal);
-      if (area <= SGLimitsf::min())
-        continue;
-      if (is_plantation) {          // regularly-spaced vegetation
-
-        int separation = (int) ceil(sqrt(wood_coverage));
-        float max_x = ceil(max(max(v1.x(),v2.x()),v0.x()));
-        float min_x = floor(min(min(v1.x(),v2.x()),v0.x()));
-        float max_y = ceil(max(max(v1.y(),v2.y()),v0.y()));
-        float min_y = floor(min(min(v1.y(),v2.y()),v0.y()));
-
-        // equation of the plane ax+by+cz+d=0, need d
-
-        float d = -1*(normal.x()*v0.x() + normal.y()*v0.y()+normal.z()*v0.z());
-
-        // Now loop over a grid, skipping points not in the triangle
-
-        int x_steps = (int) (max_x - min_x)/separation;
-        int y_steps = (int) (max_y - min_y)/separation;
-        SGVec2f v02d = SGVec2f(v0.x(),v0.y());
-        SGVec2f v12d = SGVec2f(v1.x(),v1.y());
-        SGVec2f v22d = SGVec2f(v2.x(),v2.y());
-
-        for (int jx = 0; jx < x_steps; jx++) {
-          float ptx = min_x + jx * separation;
-
-          for (int jy = 0; jy < y_steps; jy++) {
-            float pty = min_y + jy * separation;
-            SGVec2f newpt = SGVec2f(ptx,pty);
-            if (!point_in_triangle(newpt,v02d,v12d,v22d))
-              continue;
-
-            // z = (-ax-by-d)/c; c is not zero as
-            // that would be alpha of 1.0
-
-            float ptz = (-normal.x()*ptx - normal.y()*pty-d)/normal.z();
-            SGVec3f randomPoint = SGVec3f(ptx,pty,ptz);
-
-            if (object_mask != NULL) {
-              // Check this point against the object mask
-              // green (for trees) channel.
-              osg::Image* img = object_mask->getImage();   
-              unsigned int x = (int) (img->s() * newpt.x()) % img->s();
-              unsigned int y = (int) (img->t() * newpt.y()) % img->t();
-
-              if (mt_rand(&seed) < img->getColor(x, y).g()) {  
-                // The red channel contains the rotation for this object
-                points.push_back(randomPoint);
-                normals.push_back(normalize(normal));
-              }
-            } else {
-              points.push_back(randomPoint);
-              normals.push_back(normalize(normal));
-            }
-          }
-        }
-      } else {
-        // Determine the number of trees, taking into account vegetation
-        // density (which is linear) and the slope density factor.
-        // Use a zombie door method to create the proper random chance 
-        // of a tree being created for partial values.
-        int woodcount = (int) (vegetation_density * vegetation_density * 
-                               slope_density *
-                               area / wood_coverage + mt_rand(&seed));
-      
-        for (int j = 0; j < woodcount; j++) {
-          float a = mt_rand(&seed);
-          float b = mt_rand(&seed);
-
-          if ( a + b > 1.0f ) {
-            a = 1.0f - a;
-            b = 1.0f - b;
-          }
-
-          float c = 1.0f - a - b;
-
-          SGVec3f randomPoint = a*v0 + b*v1 + c*v2;
-        
-          if (object_mask != NULL) {
-            SGVec2f texCoord = a*t0 + b*t1 + c*t2;
-          
-            // Check this random point against the object mask
-            // green (for trees) channel.
-            osg::Image* img = object_mask->getImage();            
-            unsigned int x = (int) (img->s() * texCoord.x()) % img->s();
-            unsigned int y = (int) (img->t() * texCoord.y()) % img->t();
-          
-            if (mt_rand(&seed) < img->getColor(x, y).g()) {  
-              // The red channel contains the rotation for this object
-              points.push_back(randomPoint);
-              normals.push_back(normalize(normal));
-            }
-          } else {
-            points.push_back(randomPoint);
-            normals.push_back(normalize(normal));
-          }
-        }
-      }
-    }
-  }
-
   void addRandomPoints(double coverage, 
                         double spacing,
                         osg::Texture2D* object_mask,
@@ -425,45 +246,68 @@ public:
     }
   }
 
+  // The vertices of the triangles in the order they are first used, and
+  // the indices of the triangles into them.
+  void getGeometryBuffers(const TriangleVector& triangles,
+                          std::vector<simgear::BTGCacheVertex>& vertices,
+                          std::vector<uint32_t>& indices) const
+  {
+    vertices.clear();
+    indices.clear();
+    if (empty() || triangles.empty())
+      return;
+
+    const unsigned invalid = ~unsigned(0);
+    std::vector<unsigned> indexMap(getNumVertices(), invalid);
+
+    indices.reserve(3 * triangles.size());
+    for (index_type i = 0; i < triangles.size(); ++i) {
+      triangle_ref triangle = triangles[i];
+      for (int j = 0; j < 3; ++j) {
+        if (indexMap[triangle[j]] == invalid) {
+          indexMap[triangle[j]] = vertices.size();
+          const SGVertNormTex& v = getVertex(triangle[j]);
+          simgear::BTGCacheVertex cv;
+          std::memcpy(cv.position, v.GetVertex().data(), sizeof(cv.position));
+          std::memcpy(cv.normal, v.GetNormal().data(), sizeof(cv.normal));
+          std::memcpy(cv.texCoord0, v.GetTexCoord(0).data(), sizeof(cv.texCoord0));
+          if ( has_sec_tcs ) {
+            std::memcpy(cv.texCoord1, v.GetTexCoord(1).data(), sizeof(cv.texCoord1));
+          } else {
+            cv.texCoord1[0] = cv.texCoord1[1] = 0;
+          }
+          std::memcpy(cv.overlayCoord, v.GetOverlayCoord().data(), sizeof(cv.overlayCoord));
+          vertices.push_back(cv);
+        }
+        indices.push_back(indexMap[triangle[j]]);
+      }
+    }
+  }
+
   // If include_norms is true, normals from the input vertices are added to the geometry. If false,
   // they should be generated during geometry initialisation.
+  // The arrays are filled directly, the vertices in the same order as
+  // getGeometryBuffers() puts them for a BTG cache file.
   osg::Geometry* buildGeometry(const TriangleVector& triangles, bool useVBOs, bool include_norms) const
   {
     // Do not build anything if there is nothing in here ...
     if (empty() || triangles.empty())
       return 0;
 
-    // FIXME: do not include all values here ...
+    const size_t numVertices = std::min(size_t(getNumVertices()), 3 * triangles.size());
     osg::ref_ptr<osg::Vec3Array> vertices = new osg::Vec3Array;
     osg::ref_ptr<osg::Vec3Array> normals = new osg::Vec3Array;
     osg::ref_ptr<osg::Vec2Array> priTexCoords = new osg::Vec2Array;
-    osg::ref_ptr<osg::Vec2Array> secTexCoords = new osg::Vec2Array;
+    osg::ref_ptr<osg::Vec2Array> secTexCoords;
     osg::ref_ptr<osg::Vec2Array> overlayCoords = new osg::Vec2Array;
-
-    osg::ref_ptr<osg::Vec4Array> colors = new osg::Vec4Array;
-    colors->push_back(osg::Vec4(1, 1, 1, 1));
-
-    osg::Geometry* geometry = new osg::Geometry;
-    if (useVBOs) {
-        geometry->setUseDisplayList(false);
-        geometry->setUseVertexBufferObjects(true);
-    }
-    
-    geometry->setDataVariance(osg::Object::STATIC);
-    geometry->setVertexArray(vertices.get());
-    if (include_norms) { 
-        geometry->setNormalArray(normals.get());
-        geometry->setNormalBinding(osg::Geometry::BIND_PER_VERTEX);
-    }
-    geometry->setColorArray(colors.get());
-    geometry->setColorBinding(osg::Geometry::BIND_OVERALL);
+    vertices->reserve(numVertices);
+    normals->reserve(numVertices);
+    priTexCoords->reserve(numVertices);
+    overlayCoords->reserve(numVertices);
     if ( has_sec_tcs ) {
-        geometry->setTexCoordArray(0, priTexCoords.get());
-        geometry->setTexCoordArray(1, secTexCoords.get());
-    } else {
-        geometry->setTexCoordArray(0, priTexCoords.get());
-    }        
-    geometry->setVertexAttribArray(14, overlayCoords.get(), osg::Array::BIND_PER_VERTEX);
+      secTexCoords = new osg::Vec2Array;
+      secTexCoords->reserve(numVertices);
+    }
 
     const unsigned invalid = ~unsigned(0);
     std::vector<unsigned> indexMap(getNumVertices(), invalid);
@@ -471,45 +315,58 @@ public:
     DrawElementsFacade deFacade;
     for (index_type i = 0; i < triangles.size(); ++i) {
       triangle_ref triangle = triangles[i];
-      if (indexMap[triangle[0]] == invalid) {
-        indexMap[triangle[0]] = vertices->size();
-        vertices->push_back(toOsg(getVertex(triangle[0]).GetVertex()));
-        normals->push_back(toOsg(getVertex(triangle[0]).GetNormal()));
-        priTexCoords->push_back(toOsg(getVertex(triangle[0]).GetTexCoord(0)));
-        if ( has_sec_tcs ) {
-            secTexCoords->push_back(toOsg(getVertex(triangle[0]).GetTexCoord(1)));
+      for (int j = 0; j < 3; ++j) {
+        if (indexMap[triangle[j]] == invalid) {
+          indexMap[triangle[j]] = vertices->size();
+          const SGVertNormTex& v = getVertex(triangle[j]);
+          vertices->push_back(toOsg(v.GetVertex()));
+          normals->push_back(toOsg(v.GetNormal()));
+          priTexCoords->push_back(toOsg(v.GetTexCoord(0)));
+          if ( secTexCoords.valid() )
+            secTexCoords->push_back(toOsg(v.GetTexCoord(1)));
+          overlayCoords->push_back(toOsg(v.GetOverlayCoord()));
         }
-        overlayCoords->push_back(toOsg(getVertex(triangle[0]).GetOverlayCoord()));
+        deFacade.push_back(indexMap[triangle[j]]);
       }
-      deFacade.push_back(indexMap[triangle[0]]);
-
-      if (indexMap[triangle[1]] == invalid) {
-        indexMap[triangle[1]] = vertices->size();
-        vertices->push_back(toOsg(getVertex(triangle[1]).GetVertex()));
-        normals->push_back(toOsg(getVertex(triangle[1]).GetNormal()));
-        priTexCoords->push_back(toOsg(getVertex(triangle[1]).GetTexCoord(0)));
-        if ( has_sec_tcs ) {
-            secTexCoords->push_back(toOsg(getVertex(triangle[1]).GetTexCoord(1)));
-        }
-        overlayCoords->push_back(toOsg(getVertex(triangle[1]).GetOverlayCoord()));
-      }
-      deFacade.push_back(indexMap[triangle[1]]);
-
-      if (indexMap[triangle[2]] == invalid) {
-        indexMap[triangle[2]] = vertices->size();
-        vertices->push_back(toOsg(getVertex(triangle[2]).GetVertex()));
-        normals->push_back(toOsg(getVertex(triangle[2]).GetNormal()));
-        priTexCoords->push_back(toOsg(getVertex(triangle[2]).GetTexCoord(0)));
-        if ( has_sec_tcs ) {
-            secTexCoords->push_back(toOsg(getVertex(triangle[2]).GetTexCoord(1)));
-        }
-        overlayCoords->push_back(toOsg(getVertex(triangle[2]).GetOverlayCoord()));
-      }
-      deFacade.push_back(indexMap[triangle[2]]);
     }
-    geometry->addPrimitiveSet(deFacade.getDrawElements());
 
-    return geometry;
+    return makeGeometry(vertices.get(), normals.get(), priTexCoords.get(),
+                        secTexCoords.get(), overlayCoords.get(), deFacade,
+                        useVBOs, include_norms);
+  }
+
+  // Build the geometry of a mesh, either built from a bin or read from a
+  // BTG cache file.
+  static osg::Geometry* buildGeometry(const simgear::BTGCacheMesh& mesh, bool useVBOs, bool include_norms)
+  {
+    if (mesh.numIndices == 0)
+      return 0;
+
+    osg::ref_ptr<osg::Vec3Array> vertices = new osg::Vec3Array(mesh.numVertices);
+    osg::ref_ptr<osg::Vec3Array> normals = new osg::Vec3Array(mesh.numVertices);
+    osg::ref_ptr<osg::Vec2Array> priTexCoords = new osg::Vec2Array(mesh.numVertices);
+    osg::ref_ptr<osg::Vec2Array> secTexCoords;
+    osg::ref_ptr<osg::Vec2Array> overlayCoords = new osg::Vec2Array(mesh.numVertices);
+    if ( mesh.hasSecondaryTexCoord )
+      secTexCoords = new osg::Vec2Array(mesh.numVertices);
+
+    for (uint32_t i = 0; i < mesh.numVertices; ++i) {
+      const simgear::BTGCacheVertex& v = mesh.vertices[i];
+      (*vertices)[i].set(v.position[0], v.position[1], v.position[2]);
+      (*normals)[i].set(v.normal[0], v.normal[1], v.normal[2]);
+      (*priTexCoords)[i].set(v.texCoord0[0], v.texCoord0[1]);
+      if ( secTexCoords.valid() )
+        (*secTexCoords)[i].set(v.texCoord1[0], v.texCoord1[1]);
+      (*overlayCoords)[i].set(v.overlayCoord[0], v.overlayCoord[1]);
+    }
+
+    DrawElementsFacade deFacade;
+    for (uint32_t i = 0; i < mesh.numIndices; ++i)
+      deFacade.push_back(mesh.indices[i]);
+
+    return makeGeometry(vertices.get(), normals.get(), priTexCoords.get(),
+                        secTexCoords.get(), overlayCoords.get(), deFacade,
+                        useVBOs, include_norms);
   }
 
   osg::Geometry* buildGeometry(bool useVBOs, bool include_norms) const
@@ -527,10 +384,44 @@ public:
   }
   
   void hasSecondaryTexCoord( bool sec_tc ) { has_sec_tcs = sec_tc; }
+  bool hasSecondaryTexCoord() const { return has_sec_tcs; }
 
 private:
+  static osg::Geometry* makeGeometry(osg::Vec3Array* vertices, osg::Vec3Array* normals,
+                                     osg::Vec2Array* priTexCoords, osg::Vec2Array* secTexCoords,
+                                     osg::Vec2Array* overlayCoords, DrawElementsFacade& deFacade,
+                                     bool useVBOs, bool include_norms)
+  {
+    osg::ref_ptr<osg::Vec4Array> colors = new osg::Vec4Array;
+    colors->push_back(osg::Vec4(1, 1, 1, 1));
+
+    osg::Geometry* geometry = new osg::Geometry;
+    if (useVBOs) {
+        geometry->setUseDisplayList(false);
+        geometry->setUseVertexBufferObjects(true);
+    }
+    
+    geometry->setDataVariance(osg::Object::STATIC);
+    geometry->setVertexArray(vertices);
+    if (include_norms) { 
+        geometry->setNormalArray(normals);
+        geometry->setNormalBinding(osg::Geometry::BIND_PER_VERTEX);
+    }
+    geometry->setColorArray(colors.get());
+    geometry->setColorBinding(osg::Geometry::BIND_OVERALL);
+    geometry->setTexCoordArray(0, priTexCoords);
+    if ( secTexCoords ) {
+        geometry->setTexCoordArray(1, secTexCoords);
+    }
+    geometry->setVertexAttribArray(14, overlayCoords, osg::Array::BIND_PER_VERTEX);
+    geometry->addPrimitiveSet(deFacade.getDrawElements());
+
+    return geometry;
+  }
+
   // Random seed for the triangle.
   mt seed;
+
   
   // does the triangle array have secondary texture coordinates
   bool has_sec_tcs;
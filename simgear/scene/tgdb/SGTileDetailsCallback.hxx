@@ -26,6 +26,9 @@
 #  include <simgear_config.h>
 #endif
 
+#include <cstdint>
+#include <cstring>
+
 #include <osg/LOD>
 
 #include <boost/foreach.hpp>
@@ -36,6 +39,7 @@
 #include <simgear/scene/util/SGReaderWriterOptions.hxx>
 #include <simgear/scene/util/OptionsReadFileCallback.hxx>
 #include <simgear/scene/util/SGNodeMasks.hxx>
+#include <simgear/threads/SGWorkerPool.hxx>
 
 #include "SGNodeTriangles.hxx"
 #include "GroundLightManager.hxx"
@@ -43,6 +47,7 @@
 #include "SGDirectionalLightBin.hxx"
 #include "SGModelBin.hxx"
 #include "SGBuildingBin.hxx"
+#include "SGSpacingGrid.hxx"
 #include "TreeBin.hxx"
 
 #include "pt_lights.hxx"
@@ -270,6 +275,38 @@ public:
         return sqrt( min_dist_sq );
     }
     
+    // A repeatable seed for the random stream of one material bin, derived
+    // from the tile centre, the generation stage and the bin index.
+    unsigned materialSeed(unsigned stage, unsigned m) const
+    {
+        uint64_t h = stage;
+        for (int i = 0; i < 3; i++) {
+            uint64_t bits;
+            std::memcpy(&bits, &_gbs_center[i], sizeof(bits));
+            h = mixSeed(h ^ bits);
+        }
+        h = mixSeed(h ^ m);
+        return unsigned(h ^ (h >> 32));
+    }
+
+    static uint64_t mixSeed(uint64_t x)
+    {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    // Call func(m) for every material bin m, spread over the shared worker
+    // pool, and return once all calls are done. func may only modify state
+    // belonging to bin m. The first exception thrown is rethrown here.
+    template<typename Func>
+    static void forEachMaterial(unsigned count, Func func)
+    {
+        SGWorkerPool::shared().forEach(count, func);
+    }
+
     // let's break random objects from randomBuildings
     void computeRandomObjectsAndBuildings(
         std::vector<SGTriangleInfo>& matTris, 
@@ -280,350 +317,383 @@ public:
         SGMatModelBin&     randomModels,
         SGBuildingBinList& randomBuildings )
     {
-        unsigned int m;
-        
         // Only compute the random objects if we haven't already done so
         if (_tileRandomObjectsComputed) {
             return;
         }
         _tileRandomObjectsComputed = true;
         
+        // The material bins are independent, so generate them in parallel
+        // and append the results in material order afterwards.
+        std::vector<SGMatModelBin>  materialModels(matTris.size());
+        std::vector<SGBuildingBin*> materialBuildings(matTris.size(), NULL);
+        
+        forEachMaterial(matTris.size(), [&](unsigned m) {
+            computeRandomObjectsAndBuildings(matTris[m],
+                                             materialSeed(123, m),
+                                             building_density,
+                                             use_random_objects,
+                                             use_random_buildings,
+                                             useVBOs,
+                                             materialModels[m],
+                                             materialBuildings[m]);
+        });
+        
+        for (unsigned m = 0; m < matTris.size(); m++) {
+            for (unsigned i = 0; i < materialModels[m].getNumModels(); i++)
+                randomModels.insert(materialModels[m].getMatModel(i));
+            if (materialBuildings[m])
+                randomBuildings.push_back(materialBuildings[m]);
+        }
+    }
+    
+    // Random objects and buildings of a single material bin.
+    void computeRandomObjectsAndBuildings(
+        SGTriangleInfo& tris,
+        unsigned seedValue,
+        float building_density,
+        bool use_random_objects,
+        bool use_random_buildings,
+        bool useVBOs,
+        SGMatModelBin&  randomModels,
+        SGBuildingBin*& bin )
+    {
         // generate a repeatable random seed
         mt seed;
-        mt_init(&seed, unsigned(123));
+        mt_init(&seed, seedValue);
         
-        for ( m=0; m<matTris.size(); m++ ) {
-            SGMaterial *mat = matTris[m].getMaterial();
-            if (!mat)
-                continue;
-                        
-            osg::Texture2D* object_mask  = mat->get_one_object_mask(matTris[m].getTextureIndex());
-            
-            int   group_count            = mat->get_object_group_count();
-            float building_coverage      = mat->get_building_coverage();
-            float cos_zero_density_angle = mat->get_cos_object_zero_density_slope_angle();
-            float cos_max_density_angle  = mat->get_cos_object_max_density_slope_angle();
-            
-            if ((building_coverage == 0) && (group_count ==0))
-                continue;
+        SGMaterial *mat = tris.getMaterial();
+        if (!mat)
+            return;
+                    
+        osg::Texture2D* object_mask  = mat->get_one_object_mask(tris.getTextureIndex());
+        
+        int   group_count            = mat->get_object_group_count();
+        float building_coverage      = mat->get_building_coverage();
+        float cos_zero_density_angle = mat->get_cos_object_zero_density_slope_angle();
+        float cos_max_density_angle  = mat->get_cos_object_max_density_slope_angle();
+        
+        if ((building_coverage == 0) && (group_count ==0))
+            return;
+        
+        if (building_coverage > 0) {
+            // REVIEW: Memory Leak - 317,405 (544 direct, 316,861 indirect) bytes in 4 blocks are definitely lost
+            bin = new SGBuildingBin(mat, useVBOs);                
+        }
+
+        // Spatial hashes of the random objects and buildings generated
+        // for the current triangle, for the spacing checks. The cells
+        // are twice the largest clearance radius of this material.
+        float max_radius = 0.0f;
+        for (int j = 0; j < group_count; j++) {
+            SGMatModelGroup *object_group = mat->get_object_group(j);
+            for (int k = 0; k < object_group->get_object_count(); k++)
+                max_radius = std::max(max_radius, float(object_group->get_object(k)->get_spacing_m()));
+        }
+        if (bin) {
+            for (SGBuildingBin::BuildingType type : { SGBuildingBin::SMALL,
+                                                      SGBuildingBin::MEDIUM,
+                                                      SGBuildingBin::LARGE })
+                max_radius = std::max(max_radius, bin->getBuildingMaxRadius(type));
+        }
+        SGSpacingGrid triangleObjectsGrid(2.0f * std::max(max_radius, 1.0f));
+        SGSpacingGrid triangleBuildingGrid(2.0f * std::max(max_radius, 1.0f));
+        
+        unsigned num = tris.getNumTriangles();
+        int random_dropped = 0;
+        int mask_dropped = 0;
+        int building_dropped = 0;
+        int triangle_dropped = 0;
+        
+        // get the polygon border segments
+//            std::vector<SGBorderContour> borderSegs;
+//            tris.getBorderContours( borderSegs );
+        
+        for (unsigned i = 0; i < num; ++i) {
+            std::vector<SGVec3f> triVerts;
+            std::vector<SGVec2f> triTCs;
+            tris.getTriangle(i, triVerts, triTCs);
             
-            SGBuildingBin* bin = NULL;
+            SGVec3f vorigin = triVerts[0];
+            SGVec3f v0 = triVerts[1] - vorigin;
+            SGVec3f v1 = triVerts[2] - vorigin;
+            SGVec2f torigin = triTCs[0];
+            SGVec2f t0 = triTCs[1] - torigin;
+            SGVec2f t1 = triTCs[2] - torigin;
+            SGVec3f normal = cross(v0, v1);
             
-            if (building_coverage > 0) {
-                // REVIEW: Memory Leak - 317,405 (544 direct, 316,861 indirect) bytes in 4 blocks are definitely lost
-                bin = new SGBuildingBin(mat, useVBOs);                
-                randomBuildings.push_back(bin);
+            // Ensure the slope isn't too steep by checking the
+            // cos of the angle between the slope normal and the
+            // vertical (conveniently the z-component of the normalized
+            // normal) and values passed in.
+            float cos = normalize(normal).z();
+            float slope_density = 1.0;
+            if (cos < cos_zero_density_angle) continue; // Too steep for any objects
+            if (cos < cos_max_density_angle) {
+                slope_density =
+                (cos - cos_zero_density_angle) /
+                (cos_max_density_angle - cos_zero_density_angle);
             }
             
-            unsigned num = matTris[m].getNumTriangles();
-            int random_dropped = 0;
-            int mask_dropped = 0;
-            int building_dropped = 0;
-            int triangle_dropped = 0;
+            // The random buildings and objects generated for this
+            // triangle, for collision detection purposes.
+            triangleObjectsGrid.clear();
+            triangleBuildingGrid.clear();
             
-            // get the polygon border segments
-//            std::vector<SGBorderContour> borderSegs;
-//            matTris[m].getBorderContours( borderSegs );
+            // Compute the area : todo - we only want to stop if the area of the POLY
+            // is too small
+            // so we need to know area of each poly....
+            float area = 0.5f*length(normal);
+            if (area <= SGLimitsf::min())
+                continue;
             
-            for (unsigned i = 0; i < num; ++i) {
-                std::vector<SGVec3f> triVerts;
-                std::vector<SGVec2f> triTCs;
-                matTris[m].getTriangle(i, triVerts, triTCs);
-                
-                SGVec3f vorigin = triVerts[0];
-                SGVec3f v0 = triVerts[1] - vorigin;
-                SGVec3f v1 = triVerts[2] - vorigin;
-                SGVec2f torigin = triTCs[0];
-                SGVec2f t0 = triTCs[1] - torigin;
-                SGVec2f t1 = triTCs[2] - torigin;
-                SGVec3f normal = cross(v0, v1);
-                
-                // Ensure the slope isn't too steep by checking the
-                // cos of the angle between the slope normal and the
-                // vertical (conveniently the z-component of the normalized
-                // normal) and values passed in.
-                float cos = normalize(normal).z();
-                float slope_density = 1.0;
-                if (cos < cos_zero_density_angle) continue; // Too steep for any objects
-                if (cos < cos_max_density_angle) {
-                    slope_density =
-                    (cos - cos_zero_density_angle) /
-                    (cos_max_density_angle - cos_zero_density_angle);
-                }
-                
-                // Containers to hold the random buildings and objects generated
-                // for this triangle for collision detection purposes.
-                std::vector< std::pair< SGVec3f, float> > triangleObjectsList;
-                std::vector< std::pair< SGVec3f, float> > triangleBuildingList;
-                
-                // Compute the area : todo - we only want to stop if the area of the POLY
-                // is too small
-                // so we need to know area of each poly....
-                float area = 0.5f*length(normal);
-                if (area <= SGLimitsf::min())
-                    continue;
-                
-                // Generate any random objects
-                if (use_random_objects && (group_count > 0))
+            // Generate any random objects
+            if (use_random_objects && (group_count > 0))
+            {
+                for (int j = 0; j < group_count; j++)
                 {
-                    for (int j = 0; j < group_count; j++)
-                    {
-                        SGMatModelGroup *object_group =  mat->get_object_group(j);
-                        int nObjects = object_group->get_object_count();
+                    SGMatModelGroup *object_group =  mat->get_object_group(j);
+                    int nObjects = object_group->get_object_count();
+                    
+                    if (nObjects == 0) continue;
+                    
+                    // For each of the random models in the group, determine an appropriate
+                    // number of random placements and insert them.
+                    for (int k = 0; k < nObjects; k++) {
+                        SGMatModel * object = object_group->get_object(k);
+                        
+                        // Determine the number of objecst to place, taking into account
+                        // the slope density factor.
+                        double n = slope_density * area / object->get_coverage_m2();
                         
-                        if (nObjects == 0) continue;
+                        // Use the zombie door method to determine fractional object placement.
+                        n = n + mt_rand(&seed);
                         
-                        // For each of the random models in the group, determine an appropriate
-                        // number of random placements and insert them.
-                        for (int k = 0; k < nObjects; k++) {
-                            SGMatModel * object = object_group->get_object(k);
+                        // place an object each unit of area
+                        while ( n > 1.0 ) {
+                            n -= 1.0;
                             
-                            // Determine the number of objecst to place, taking into account
-                            // the slope density factor.
-                            double n = slope_density * area / object->get_coverage_m2();
+                            float a = mt_rand(&seed);
+                            float b = mt_rand(&seed);
+                            if ( a + b > 1 ) {
+                                a = 1 - a;
+                                b = 1 - b;
+                            }
                             
-                            // Use the zombie door method to determine fractional object placement.
-                            n = n + mt_rand(&seed);
+                            SGVec3f randomPoint = vorigin + a*v0 + b*v1;
+                            float rotation = static_cast<float>(mt_rand(&seed));
                             
-                            // place an object each unit of area
-                            while ( n > 1.0 ) {
-                                n -= 1.0;
-                                
-                                float a = mt_rand(&seed);
-                                float b = mt_rand(&seed);
-                                if ( a + b > 1 ) {
-                                    a = 1 - a;
-                                    b = 1 - b;
-                                }
-                                
-                                SGVec3f randomPoint = vorigin + a*v0 + b*v1;
-                                float rotation = static_cast<float>(mt_rand(&seed));
-                                
-                                // Check that the point is sufficiently far from
-                                // the edge of the triangle by measuring the distance
-                                // from the three lines that make up the triangle.
-                                float spacing = object->get_spacing_m();
-                                
-                                SGVec3f p = randomPoint - vorigin;
+                            // Check that the point is sufficiently far from
+                            // the edge of the triangle by measuring the distance
+                            // from the three lines that make up the triangle.
+                            float spacing = object->get_spacing_m();
+                            
+                            SGVec3f p = randomPoint - vorigin;
 #if 1
-                                float edges[] = { 
-                                    length(cross(p     , p - v0)) / length(v0),
-                                    length(cross(p - v0, p - v1)) / length(v1 - v0),
-                                    length(cross(p - v1, p     )) / length(v1)      };
-                                    float edge_dist = *std::min_element(edges, edges + 3);
+                            float edges[] = { 
+                                length(cross(p     , p - v0)) / length(v0),
+                                length(cross(p - v0, p - v1)) / length(v1 - v0),
+                                length(cross(p - v1, p     )) / length(v1)      };
+                                float edge_dist = *std::min_element(edges, edges + 3);
 #else
-                                    float edge_dist = min_dist_from_borders( randomPoint, borderSegs );
+                                float edge_dist = min_dist_from_borders( randomPoint, borderSegs );
 #endif
-                                    if (edge_dist < spacing) {
-                                        continue;
-                                    }
-                                    
-                                    if (object_mask != NULL) {
-                                        SGVec2f texCoord = torigin + a*t0 + b*t1;
-                                        
-                                        // Check this random point against the object mask
-                                        // blue (for buildings) channel.
-                                        osg::Image* img = object_mask->getImage();
-                                        unsigned int x = (int) (img->s() * texCoord.x()) % img->s();
-                                        unsigned int y = (int) (img->t() * texCoord.y()) % img->t();
-                                        
-                                        if (mt_rand(&seed) > img->getColor(x, y).b()) {
-                                            // Failed object mask check
-                                            continue;
-                                        }
-                                        
-                                        rotation = img->getColor(x,y).r();
-                                    }
+                                if (edge_dist < spacing) {
+                                    continue;
+                                }
+                                
+                                if (object_mask != NULL) {
+                                    SGVec2f texCoord = torigin + a*t0 + b*t1;
                                     
-                                    bool close = false;
+                                    // Check this random point against the object mask
+                                    // blue (for buildings) channel.
+                                    osg::Image* img = object_mask->getImage();
+                                    unsigned int x = (int) (img->s() * texCoord.x()) % img->s();
+                                    unsigned int y = (int) (img->t() * texCoord.y()) % img->t();
                                     
-                                    // Check it isn't too close to any other random objects in the triangle
-                                    std::vector<std::pair<SGVec3f, float> >::iterator l;
-                                    for (l = triangleObjectsList.begin(); l != triangleObjectsList.end(); ++l) {
-                                        float min_dist2 = (l->second + object->get_spacing_m()) *
-                                        (l->second + object->get_spacing_m());
-                                        
-                                        if (distSqr(l->first, randomPoint) < min_dist2) {
-                                            close = true;
-                                            continue;
-                                        }
+                                    if (mt_rand(&seed) > img->getColor(x, y).b()) {
+                                        // Failed object mask check
+                                        continue;
                                     }
                                     
-                                    if (!close) {
-                                        triangleObjectsList.push_back(std::make_pair(randomPoint, object->get_spacing_m()));
-                                        randomModels.insert(randomPoint,
-                                                            object,
-                                                            (int)object->get_randomized_range_m(&seed),
-                                                            rotation);
-                                    }
-                            }
+                                    rotation = img->getColor(x,y).r();
+                                }
+                                
+                                // Check it isn't too close to any other random objects in the triangle
+                                bool close = triangleObjectsGrid.isClose(randomPoint, object->get_spacing_m());
+                                
+                                if (!close) {
+                                    triangleObjectsGrid.insert(randomPoint, spacing);
+                                    randomModels.insert(randomPoint,
+                                                        object,
+                                                        (int)object->get_randomized_range_m(&seed),
+                                                        rotation);
+                                }
                         }
                     }
                 }
+            }
+            
+            // Random objects now generated.  Now generate the random buildings (if any);
+            if (use_random_buildings && (building_coverage > 0) && (building_density > 0)) {
                 
-                // Random objects now generated.  Now generate the random buildings (if any);
-                if (use_random_buildings && (building_coverage > 0) && (building_density > 0)) {
-                    
-                    // Calculate the number of buildings, taking into account building density (which is linear)
-                    // and the slope density factor.
-                    double num = building_density * building_density * slope_density * area / building_coverage;
+                // Calculate the number of buildings, taking into account building density (which is linear)
+                // and the slope density factor.
+                double num = building_density * building_density * slope_density * area / building_coverage;
+                
+                // For partial units of area, use a zombie door method to
+                // create the proper random chance of an object being created
+                // for this triangle.
+                num = num + mt_rand(&seed);
+                
+                if (num < 1.0f) {
+                    continue;
+                }
+                
+                // Cosine of the angle between the two vectors.
+                float cosine = (dot(v0, v1) / (length(v0) * length(v1)));
+                
+                // Determine a grid spacing in each vector such that the correct
+                // coverage will result.
+                float stepv0 = (sqrtf(building_coverage) / building_density) / length(v0) / sqrtf(1 - cosine * cosine);
+                float stepv1 = (sqrtf(building_coverage) / building_density) / length(v1);
+                
+                stepv0 = std::min(stepv0, 1.0f);
+                stepv1 = std::min(stepv1, 1.0f);
+                
+                // Start at a random point. a will be immediately incremented below.
+                float a = -mt_rand(&seed) * stepv0;
+                float b = mt_rand(&seed) * stepv1;
+                
+                // Place an object each unit of area
+                while (num > 1.0) {
+                    num -= 1.0;
                     
-                    // For partial units of area, use a zombie door method to
-                    // create the proper random chance of an object being created
-                    // for this triangle.
-                    num = num + mt_rand(&seed);
+                    // Set the next location to place a building
+                    a += stepv0;
                     
-                    if (num < 1.0f) {
-                        continue;
+                    if ((a + b) > 1.0f) {
+                        // Reached the end of the scan-line on v0. Reset and increment
+                        // scan-line on v1
+                        a = mt_rand(&seed) * stepv0;
+                        b += stepv1;
                     }
                     
-                    // Cosine of the angle between the two vectors.
-                    float cosine = (dot(v0, v1) / (length(v0) * length(v1)));
-                    
-                    // Determine a grid spacing in each vector such that the correct
-                    // coverage will result.
-                    float stepv0 = (sqrtf(building_coverage) / building_density) / length(v0) / sqrtf(1 - cosine * cosine);
-                    float stepv1 = (sqrtf(building_coverage) / building_density) / length(v1);
+                    if (b > 1.0f) {
+                        // In a degenerate case of a single point, we might be outside the
+                        // scanline.  Note that we need to still ensure that a+b < 1.
+                        b = mt_rand(&seed) * stepv1 * (1.0f - a);
+                    }
                     
-                    stepv0 = std::min(stepv0, 1.0f);
-                    stepv1 = std::min(stepv1, 1.0f);
+                    if ((a + b) > 1.0f ) {
+                        // Truly degenerate case - simply choose a random point guaranteed
+                        // to fulfil the constraing of a+b < 1.
+                        a = mt_rand(&seed);
+                        b = mt_rand(&seed) * (1.0f - a);
+                    }
                     
-                    // Start at a random point. a will be immediately incremented below.
-                    float a = -mt_rand(&seed) * stepv0;
-                    float b = mt_rand(&seed) * stepv1;
+                    SGVec3f randomPoint = vorigin + a*v0 + b*v1;
+                    float rotation = mt_rand(&seed);
                     
-                    // Place an object each unit of area
-                    while (num > 1.0) {
-                        num -= 1.0;
+                    if (object_mask != NULL) {
+                        SGVec2f texCoord = torigin + a*t0 + b*t1;
+                        osg::Image* img = object_mask->getImage();
+                        int x = (int) (img->s() * texCoord.x()) % img->s();
+                        int y = (int) (img->t() * texCoord.y()) % img->t();
                         
-                        // Set the next location to place a building
-                        a += stepv0;
+                        // In some degenerate cases x or y can be < 1, in which case the mod operand fails
+                        while (x < 0) x += img->s();
+                        while (y < 0) y += img->t();
                         
-                        if ((a + b) > 1.0f) {
-                            // Reached the end of the scan-line on v0. Reset and increment
-                            // scan-line on v1
-                            a = mt_rand(&seed) * stepv0;
-                            b += stepv1;
+                        if (mt_rand(&seed) < img->getColor(x, y).b()) {
+                            // Object passes mask. Rotation is taken from the red channel
+                            rotation = img->getColor(x,y).r();
+                        } else {
+                            // Fails mask test - try again.
+                            mask_dropped++;
+                            continue;
                         }
-                        
-                        if (b > 1.0f) {
-                            // In a degenerate case of a single point, we might be outside the
-                            // scanline.  Note that we need to still ensure that a+b < 1.
-                            b = mt_rand(&seed) * stepv1 * (1.0f - a);
+                    }
+                    
+                    // Check building isn't too close to the triangle edge.
+                    float type_roll = mt_rand(&seed);
+                    SGBuildingBin::BuildingType buildingtype = bin->getBuildingType(type_roll);
+                    float radius = bin->getBuildingMaxRadius(buildingtype);
+                    
+                    // Determine the actual center of the building, by shifting from the
+                    // center of the front face to the true center.
+                    osg::Matrix rotationMat = osg::Matrix::rotate(- rotation * M_PI * 2,
+                                                                  osg::Vec3f(0.0, 0.0, 1.0));
+                    SGVec3f buildingCenter = randomPoint + toSG(osg::Vec3f(-0.5 * bin->getBuildingMaxDepth(buildingtype), 0.0, 0.0) * rotationMat);
+                    
+                    SGVec3f p = buildingCenter - vorigin;
+#if 1
+                    float edges[] = { length(cross(p     , p - v0)) / length(v0),
+                        length(cross(p - v0, p - v1)) / length(v1 - v0),
+                        length(cross(p - v1, p     )) / length(v1)      };
+                        float edge_dist = *std::min_element(edges, edges + 3);
+#else
+                        float edge_dist = min_dist_from_borders(randomPoint, borderSegs);
+#endif
+                        if (edge_dist < radius) {
+                            triangle_dropped++;
+                            continue;
                         }
                         
-                        if ((a + b) > 1.0f ) {
-                            // Truly degenerate case - simply choose a random point guaranteed
-                            // to fulfil the constraing of a+b < 1.
-                            a = mt_rand(&seed);
-                            b = mt_rand(&seed) * (1.0f - a);
+                        // Check building isn't too close to random objects and other buildings.
+                        if (triangleBuildingGrid.isClose(buildingCenter, radius)) {
+                            building_dropped++;
+                            continue;
                         }
                         
-                        SGVec3f randomPoint = vorigin + a*v0 + b*v1;
-                        float rotation = mt_rand(&seed);
-                        
-                        if (object_mask != NULL) {
-                            SGVec2f texCoord = torigin + a*t0 + b*t1;
-                            osg::Image* img = object_mask->getImage();
-                            int x = (int) (img->s() * texCoord.x()) % img->s();
-                            int y = (int) (img->t() * texCoord.y()) % img->t();
-                            
-                            // In some degenerate cases x or y can be < 1, in which case the mod operand fails
-                            while (x < 0) x += img->s();
-                            while (y < 0) y += img->t();
-                            
-                            if (mt_rand(&seed) < img->getColor(x, y).b()) {
-                                // Object passes mask. Rotation is taken from the red channel
-                                rotation = img->getColor(x,y).r();
-                            } else {
-                                // Fails mask test - try again.
-                                mask_dropped++;
-                                continue;
-                            }
+                        if (triangleObjectsGrid.isClose(buildingCenter, radius)) {
+                            random_dropped++;
+                            continue;
                         }
                         
-                        // Check building isn't too close to the triangle edge.
-                        float type_roll = mt_rand(&seed);
-                        SGBuildingBin::BuildingType buildingtype = bin->getBuildingType(type_roll);
-                        float radius = bin->getBuildingMaxRadius(buildingtype);
-                        
-                        // Determine the actual center of the building, by shifting from the
-                        // center of the front face to the true center.
-                        osg::Matrix rotationMat = osg::Matrix::rotate(- rotation * M_PI * 2,
-                                                                      osg::Vec3f(0.0, 0.0, 1.0));
-                        SGVec3f buildingCenter = randomPoint + toSG(osg::Vec3f(-0.5 * bin->getBuildingMaxDepth(buildingtype), 0.0, 0.0) * rotationMat);
-                        
-                        SGVec3f p = buildingCenter - vorigin;
-#if 1
-                        float edges[] = { length(cross(p     , p - v0)) / length(v0),
-                            length(cross(p - v0, p - v1)) / length(v1 - v0),
-                            length(cross(p - v1, p     )) / length(v1)      };
-                            float edge_dist = *std::min_element(edges, edges + 3);
-#else
-                            float edge_dist = min_dist_from_borders(randomPoint, borderSegs);
-#endif
-                            if (edge_dist < radius) {
-                                triangle_dropped++;
-                                continue;
-                            }
-                            
-                            // Check building isn't too close to random objects and other buildings.
-                            bool close = false;
-                            std::vector<std::pair<SGVec3f, float> >::iterator iter;
-                            
-                            for (iter = triangleBuildingList.begin(); iter != triangleBuildingList.end(); ++iter) {
-                                float min_dist = iter->second + radius;
-                                if (distSqr(iter->first, buildingCenter) < min_dist * min_dist) {
-                                    close = true;
-                                    continue;
-                                }
-                            }
-                            
-                            if (close) {
-                                building_dropped++;
-                                continue;
-                            }
-                            
-                            for (iter = triangleObjectsList.begin(); iter != triangleObjectsList.end(); ++iter) {
-                                float min_dist = iter->second + radius;
-                                if (distSqr(iter->first, buildingCenter) < min_dist * min_dist) {
-                                    close = true;
-                                    continue;
-                                }
-                            }
-                            
-                            if (close) {
-                                random_dropped++;
-                                continue;
-                            }
-                            
-                            std::pair<SGVec3f, float> pt = std::make_pair(buildingCenter, radius);
-                            triangleBuildingList.push_back(pt);
-                            bin->insert(randomPoint, rotation, buildingtype);
-                    }
+                        triangleBuildingGrid.insert(buildingCenter, radius);
+                        bin->insert(randomPoint, rotation, buildingtype);
                 }
-                
-                triangleObjectsList.clear();
-                triangleBuildingList.clear();
-            }
-            
-            const int numBuildings = (bin) ? bin->getNumBuildings() : 0;
-            if (numBuildings > 0) {
-                SG_LOG(SG_TERRAIN, SG_DEBUG, "computed Random Buildings: " << numBuildings);
-                SG_LOG(SG_TERRAIN, SG_DEBUG, "  Dropped due to mask: " << mask_dropped);
-                SG_LOG(SG_TERRAIN, SG_DEBUG, "  Dropped due to random object: " << random_dropped);
-                SG_LOG(SG_TERRAIN, SG_DEBUG, "  Dropped due to other buildings: " << building_dropped);
             }
         }
+        
+        const int numBuildings = (bin) ? bin->getNumBuildings() : 0;
+        if (numBuildings > 0) {
+            SG_LOG(SG_TERRAIN, SG_DEBUG, "computed Random Buildings: " << numBuildings);
+            SG_LOG(SG_TERRAIN, SG_DEBUG, "  Dropped due to mask: " << mask_dropped);
+            SG_LOG(SG_TERRAIN, SG_DEBUG, "  Dropped due to random object: " << random_dropped);
+            SG_LOG(SG_TERRAIN, SG_DEBUG, "  Dropped due to other buildings: " << building_dropped);
+        }
     }
     
     void computeRandomForest(std::vector<SGTriangleInfo>& matTris, float vegetation_density, SGTreeBinList& randomForest)
     {        
         unsigned int i;
         
-        // generate a repeatable random seed
-        mt seed;
-        mt_init(&seed, unsigned(586));
+        // The tree positions of each material bin are generated in
+        // parallel; sorting them into the shared tree bins happens below,
+        // in material order.
+        std::vector<std::vector<SGVec3f> > materialPoints(matTris.size());
+        std::vector<std::vector<SGVec3f> > materialNormals(matTris.size());
+        
+        forEachMaterial(matTris.size(), [&](unsigned m) {
+            SGMaterial *mat = matTris[m].getMaterial();
+            if (!mat)
+                return;
+            
+            float wood_coverage = mat->get_wood_coverage();
+            if ((wood_coverage <= 0) || (vegetation_density <= 0))
+                return;
+            
+            matTris[m].addRandomTreePoints(wood_coverage,
+                                           mat->get_one_object_mask(matTris[m].getTextureIndex()),
+                                           vegetation_density,
+                                           mat->get_cos_tree_max_density_slope_angle(),
+                                           mat->get_cos_tree_zero_density_slope_angle(),
+                                           mat->get_is_plantation(),
+                                           materialPoints[m],
+                                           materialNormals[m]);
+        });
         
         for ( i=0; i<matTris.size(); i++ ) {
             SGMaterial *mat = matTris[i].getMaterial();
@@ -664,19 +734,11 @@ public:
                 randomForest.push_back(bin);
             }
             
-            std::vector<SGVec3f> randomPoints;
-            std::vector<SGVec3f> randomPointNormals;
-            matTris[i].addRandomTreePoints(wood_coverage,
-                                           mat->get_one_object_mask(matTris[i].getTextureIndex()),
-                                           vegetation_density,
-                                           mat->get_cos_tree_max_density_slope_angle(),
-                                           mat->get_cos_tree_zero_density_slope_angle(),
-                                           mat->get_is_plantation(),
-                                           randomPoints,
-                                           randomPointNormals);
+            const std::vector<SGVec3f>& randomPoints = materialPoints[i];
+            const std::vector<SGVec3f>& randomPointNormals = materialNormals[i];
             
-            std::vector<SGVec3f>::iterator k;
-            std::vector<SGVec3f>::iterator j;
+            std::vector<SGVec3f>::const_iterator k;
+            std::vector<SGVec3f>::const_iterator j;
             for (k = randomPoints.begin(), j = randomPointNormals.begin(); k != randomPoints.end(); ++k, ++j) {
 	              bin->insert(*k, *j);
             }
@@ -696,47 +758,63 @@ public:
         } 
         _randomSurfaceLightsComputed = true;
         
+        // Each material bin gets its own lights and repeatable random
+        // seed, so the bins can be filled in parallel and then appended
+        // in material order.
+        std::vector<SGLightBin> materialLights(matTris.size());
+        
+        forEachMaterial(matTris.size(), [&](unsigned m) {
+            computeRandomSurfaceLights(matTris[m], materialSeed(123, m), materialLights[m]);
+        });
+        
+        for ( i=0; i<matTris.size(); i++ ) {
+            for (unsigned j = 0; j < materialLights[i].getNumLights(); ++j)
+                randomTileLights.insert(materialLights[i].getLight(j));
+        }
+    }
+    
+    // Random surface lights of a single material bin.
+    void computeRandomSurfaceLights(SGTriangleInfo& tris, unsigned seedValue, SGLightBin& randomTileLights )
+    {
+        SGMaterial *mat = tris.getMaterial();
+        if (!mat)
+            return;
+        
+        float coverage = mat->get_light_coverage();
+        if (coverage <= 0)
+            return;
+        
         // generate a repeatable random seed
         mt seed;
-        mt_init(&seed, unsigned(123));
-
-        for ( i=0; i<matTris.size(); i++ ) {
-            SGMaterial *mat = matTris[i].getMaterial();
-            if (!mat)
-                continue;
-            
-            float coverage = mat->get_light_coverage();
-            if (coverage <= 0)
-                continue;
-                        
-            int texIndex = matTris[i].getTextureIndex();
+        mt_init(&seed, seedValue);
+        
+        int texIndex = tris.getTextureIndex();
+        
+        std::vector<SGVec3f> randomPoints;
+        tris.addRandomSurfacePoints(coverage, 3, mat->get_one_object_mask(texIndex), randomPoints);
+        std::vector<SGVec3f>::iterator j;
+        for (j = randomPoints.begin(); j != randomPoints.end(); ++j) {
+            float zombie = mt_rand(&seed);
+            // factor = sg_random() ^ 2, range = 0 .. 1 concentrated towards 0
+            float factor = mt_rand(&seed);
+            factor *= factor;
             
-            std::vector<SGVec3f> randomPoints;
-            matTris[i].addRandomSurfacePoints(coverage, 3, mat->get_one_object_mask(texIndex), randomPoints);
-            std::vector<SGVec3f>::iterator j;
-            for (j = randomPoints.begin(); j != randomPoints.end(); ++j) {
-                float zombie = mt_rand(&seed);
-                // factor = sg_random() ^ 2, range = 0 .. 1 concentrated towards 0
-                float factor = mt_rand(&seed);
-                factor *= factor;
-                
-                float bright = 1;
-                SGVec4f color;
-                if ( zombie > 0.5 ) {
-                    // 50% chance of yellowish
-                    color = SGVec4f(0.9f, 0.9f, 0.3f, bright - factor * 0.2f);
-                } else if (zombie > 0.15f) {
-                    // 35% chance of whitish
-                    color = SGVec4f(0.9, 0.9f, 0.8f, bright - factor * 0.2f);
-                } else if (zombie > 0.05f) {
-                    // 10% chance of orangish
-                    color = SGVec4f(0.9f, 0.6f, 0.2f, bright - factor * 0.2f);
-                } else {
-                    // 5% chance of redish
-                    color = SGVec4f(0.9f, 0.2f, 0.2f, bright - factor * 0.2f);
-                }
-                randomTileLights.insert(*j, color);
+            float bright = 1;
+            SGVec4f color;
+            if ( zombie > 0.5 ) {
+                // 50% chance of yellowish
+                color = SGVec4f(0.9f, 0.9f, 0.3f, bright - factor * 0.2f);
+            } else if (zombie > 0.15f) {
+                // 35% chance of whitish
+                color = SGVec4f(0.9, 0.9f, 0.8f, bright - factor * 0.2f);
+            } else if (zombie > 0.05f) {
+                // 10% chance of orangish
+                color = SGVec4f(0.9f, 0.6f, 0.2f, bright - factor * 0.2f);
+            } else {
+                // 5% chance of redish
+                color = SGVec4f(0.9f, 0.2f, 0.2f, bright - factor * 0.2f);
             }
+            randomTileLights.insert(*j, color);
         }
     }
     
@@ -38,7 +38,7 @@ public:
       return mult(texCoords[tc[i]], tcScale);
   }
 
-  SGVec2f getTexCoordScale(const std::string& name, SGMaterialCache* matcache)
+  static SGVec2f getTexCoordScale(const std::string& name, SGMaterialCache* matcache)
   {
     if (!matcache)
       return SGVec2f(1, 1);
@@ -274,6 +274,37 @@ public:
     return true;
   }
 
+  // The EffectGeode for the surface of a material. include_normals is
+  // cleared if the effect generates its own normals.
+  static EffectGeode* createEffectGeode(const std::string& materialName, int textureIndex,
+                                        SGMaterialCache* matcache, bool& include_normals)
+  {
+    SGMaterial *mat = NULL;
+    if (matcache) {
+      mat = matcache->find(materialName);
+    }
+    EffectGeode* eg = new EffectGeode;
+    eg->setName("EffectGeode");
+    if (mat) {
+      eg->setMaterial(mat);
+      eg->setEffect(mat->get_one_effect(textureIndex));
+    } else {
+      eg->setMaterial(NULL);
+    }
+
+    // If effect requests normal generation, we do not include terragear
+    // normals in the geometry
+    include_normals = true;
+
+    auto eff = eg->getEffect();
+    if (eff) {
+        int n = eff->getGenerator(Effect::NORMAL);
+        if (n != -1)
+            include_normals = false;
+    }
+    return eg;
+  }
+
   osg::Node* getSurfaceGeometry(SGMaterialCache* matcache, bool useVBOs) const
   {
     if (materialTriangleMap.empty())
@@ -288,31 +319,75 @@ public:
     //osg::Geode* geode = new osg::Geode;
     SGMaterialTriangleMap::const_iterator i;
     for (i = materialTriangleMap.begin(); i != materialTriangleMap.end(); ++i) {
-      SGMaterial *mat = NULL;
-      if (matcache) {
-        mat = matcache->find(i->first);
-      }
-      eg = new EffectGeode;
-      eg->setName("EffectGeode");
-      if (mat) {
-        eg->setMaterial(mat);
-        eg->setEffect(mat->get_one_effect(i->second.getTextureIndex()));
-      } else {
-        eg->setMaterial(NULL);
+      bool include_normals;
+      eg = createEffectGeode(i->first, i->second.getTextureIndex(), matcache, include_normals);
+
+      osg::Geometry* geometry = i->second.buildGeometry(useVBOs, include_normals);
+      eg->runGenerators(geometry);  // Generate extra data needed by effect
+      eg->addDrawable(geometry);
+      if (group) {
+        group->addChild(eg);
       }
+    }
+
+    if (group) {
+        return group;
+    } else {
+        return eg;
+    }
+  }
 
-      // If effect requests normal generation, we do not include terragear
-      // normals in the geometry
-      bool include_normals = true;
+  // Add the surface geometry of every material to a BTG cache file.
+  void addCacheMeshes(BTGCacheWriter& writer, SGMaterialCache* matcache) const
+  {
+    std::vector<BTGCacheVertex> vertices;
+    std::vector<uint32_t> indices;
+    SGMaterialTriangleMap::const_iterator i;
+    for (i = materialTriangleMap.begin(); i != materialTriangleMap.end(); ++i) {
+      i->second.getGeometryBuffers(i->second.getTriangles(), vertices, indices);
+      BTGCacheMesh mesh;
+      mesh.material = i->first;
+      mesh.textureIndex = i->second.getTextureIndex();
+      mesh.hasSecondaryTexCoord = i->second.hasSecondaryTexCoord();
+      mesh.texCoordScale = getTexCoordScale(i->first, matcache);
+      mesh.vertices = vertices.data();
+      mesh.numVertices = vertices.size();
+      mesh.indices = indices.data();
+      mesh.numIndices = indices.size();
+      writer.addMesh(mesh);
+    }
+  }
 
-      auto eff = eg->getEffect();
-      if (eff) {
-          int n = eff->getGenerator(Effect::NORMAL);
-          if (n != -1)
-              include_normals = false;
-      }
+  // A cache file is stale if the material library now scales the texture
+  // coordinates of one of its materials differently.
+  static bool matchesMaterials(const std::vector<BTGCacheMesh>& meshes, SGMaterialCache* matcache)
+  {
+    for (const BTGCacheMesh& mesh : meshes) {
+      if (mesh.texCoordScale != getTexCoordScale(mesh.material, matcache))
+        return false;
+    }
+    return true;
+  }
 
-      osg::Geometry* geometry = i->second.buildGeometry(useVBOs, include_normals);
+  // The surface geometry of cached meshes, the same as getSurfaceGeometry()
+  // returns for the bins they were made of.
+  static osg::Node* getSurfaceGeometry(const std::vector<BTGCacheMesh>& meshes,
+                                       SGMaterialCache* matcache, bool useVBOs)
+  {
+    if (meshes.empty())
+      return 0;
+
+    EffectGeode* eg = NULL;
+    osg::Group* group = (meshes.size() > 1 ? new osg::Group : NULL);
+    if (group) {
+        group->setName("surfaceGeometryGroup");
+    }
+
+    for (const BTGCacheMesh& mesh : meshes) {
+      bool include_normals;
+      eg = createEffectGeode(mesh.material, mesh.textureIndex, matcache, include_normals);
+
+      osg::Geometry* geometry = SGTexturedTriangleBin::buildGeometry(mesh, useVBOs, include_normals);
       eg->runGenerators(geometry);  // Generate extra data needed by effect
       eg->addDrawable(geometry);
       if (group) {
@@ -22,8 +22,9 @@
 #ifndef SG_TRIANGLE_BIN_HXX
 #define SG_TRIANGLE_BIN_HXX
 
+#include <algorithm>
+#include <list>
 #include <vector>
-#include <map>
 #include "SGVertexArrayBin.hxx"
 
 template<typename T>
@@ -35,8 +36,13 @@ public:
   typedef SGVec2<index_type> edge_ref;
   typedef SGVec3<index_type> triangle_ref;
   typedef std::vector<triangle_ref> TriangleVector;
-  typedef std::vector<index_type> TriangleList;
-  typedef std::map<edge_ref,TriangleList> EdgeMap;
+  // Directed edges with the triangle they belong to, in insertion order.
+  // Sorting this (stably) groups the triangles sharing an edge.
+  struct EdgeEntry {
+    edge_ref edge;
+    index_type triangle;
+  };
+  typedef std::vector<EdgeEntry> EdgeVector;
 
   void insert(const value_type& v0, const value_type& v1, const value_type& v2)
   {
@@ -46,9 +52,9 @@ public:
     index_type triangleIndex = _triangleVector.size();
     _triangleVector.push_back(triangle_ref(i0, i1, i2));
 #ifdef BUILD_EDGE_MAP
-    _edgeMap[edge_ref(i0, i1)].push_back(triangleIndex);
-    _edgeMap[edge_ref(i1, i2)].push_back(triangleIndex);
-    _edgeMap[edge_ref(i2, i0)].push_back(triangleIndex);
+    _edges.push_back(EdgeEntry{edge_ref(i0, i1), triangleIndex});
+    _edges.push_back(EdgeEntry{edge_ref(i1, i2), triangleIndex});
+    _edges.push_back(EdgeEntry{edge_ref(i2, i0), triangleIndex});
 #endif
   }
 
@@ -63,6 +69,9 @@ public:
 // protected: //FIXME
   void getConnectedSets(std::list<TriangleVector>& connectSets) const
   {
+    EdgeVector edges(_edges);
+    std::stable_sort(edges.begin(), edges.end(), edgeLess);
+
     std::vector<bool> processedTriangles(getNumTriangles(), false);
     for (index_type i = 0; i < getNumTriangles(); ++i) {
       if (processedTriangles[i])
@@ -84,17 +93,15 @@ public:
         edge_ref edge = edgeStack.back();
         edgeStack.pop_back();
         
-        typename EdgeMap::const_iterator emiList[2] = {
-          _edgeMap.find(edge),
-          _edgeMap.find(edge_ref(edge[1], edge[0]))
+        const EdgeEntry keys[2] = {
+          EdgeEntry{edge, 0},
+          EdgeEntry{edge_ref(edge[1], edge[0]), 0}
         };
         for (unsigned ei = 0; ei < 2; ++ei) {
-          typename EdgeMap::const_iterator emi = emiList[ei];
-          if (emi == _edgeMap.end())
-            continue;
-
-          for (unsigned ti = 0; ti < emi->second.size(); ++ti) {
-            index_type triangleIndex = emi->second[ti];
+          typename EdgeVector::const_iterator emi
+            = std::lower_bound(edges.begin(), edges.end(), keys[ei], edgeLess);
+          for (; emi != edges.end() && !edgeLess(keys[ei], *emi); ++emi) {
+            index_type triangleIndex = emi->triangle;
             if (processedTriangles[triangleIndex])
               continue;
 
@@ -114,9 +121,14 @@ public:
 #endif
 
 private:
+#ifdef BUILD_EDGE_MAP
+  static bool edgeLess(const EdgeEntry& l, const EdgeEntry& r)
+  { return l.edge < r.edge; }
+#endif
+
   TriangleVector _triangleVector;
 #ifdef BUILD_EDGE_MAP
-  EdgeMap _edgeMap;
+  EdgeVector _edges;
 #endif
 };
 
@@ -0,0 +1,167 @@
+// Checks SGTriangleBin/SGVertexArrayBin against the std::map based binning
+// they replaced, and reports how long binning a tile's triangles takes.
+//
+// Usage: test_SGTriangleBin [file.btg.gz]
+// Without argument, a synthetic tile is used.
+
+#ifdef HAVE_CONFIG_H
+#  include <simgear_config.h>
+#endif
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <list>
+#include <map>
+#include <vector>
+
+#include <simgear/io/sg_binobj.hxx>
+#include <simgear/math/SGGeometry.hxx>
+#include <simgear/misc/sg_path.hxx>
+#include <simgear/misc/test_macros.hxx>
+
+#include "SGTexturedTriangleBin.hxx"
+
+typedef std::vector<SGVertNormTex> TriangleStream; // 3 vertices per triangle
+
+// The implementation before hashing: a vertex map and an edge map
+struct ReferenceBin {
+  typedef SGTriangleBin<SGVertNormTex>::triangle_ref triangle_ref;
+  typedef SGTriangleBin<SGVertNormTex>::edge_ref edge_ref;
+  typedef unsigned index_type;
+
+  std::vector<SGVertNormTex> values;
+  std::map<SGVertNormTex, index_type, SGVertNormTex::less> valueMap;
+  std::vector<triangle_ref> triangles;
+  std::map<edge_ref, std::vector<index_type> > edgeMap;
+
+  index_type insert(const SGVertNormTex& v)
+  {
+    auto i = valueMap.find(v);
+    if (i != valueMap.end())
+      return i->second;
+    index_type index = values.size();
+    valueMap[v] = index;
+    values.push_back(v);
+    return index;
+  }
+
+  void insert(const SGVertNormTex& v0, const SGVertNormTex& v1,
+              const SGVertNormTex& v2)
+  {
+    index_type i0 = insert(v0), i1 = insert(v1), i2 = insert(v2);
+    index_type triangleIndex = triangles.size();
+    triangles.push_back(triangle_ref(i0, i1, i2));
+    edgeMap[edge_ref(i0, i1)].push_back(triangleIndex);
+    edgeMap[edge_ref(i1, i2)].push_back(triangleIndex);
+    edgeMap[edge_ref(i2, i0)].push_back(triangleIndex);
+  }
+};
+
+static SGVertNormTex makeVertex(const SGVec3f& p, const SGVec3f& n,
+                                const SGVec2f& tc)
+{
+  SGVertNormTex v;
+  v.SetVertex(p);
+  v.SetNormal(n);
+  v.SetTexCoord(0, tc);
+  return v;
+}
+
+static TriangleStream loadBTG(const SGPath& path)
+{
+  TriangleStream stream;
+  SGBinObject obj;
+  SG_VERIFY(obj.read_bin(path));
+
+  const std::vector<SGVec3d>& vertices(obj.get_wgs84_nodes());
+  const std::vector<SGVec3f>& normals(obj.get_normals());
+  const std::vector<SGVec2f>& texCoords(obj.get_texcoords());
+  for (unsigned grp = 0; grp < obj.get_tris_v().size(); ++grp) {
+    const int_list& tris_v(obj.get_tris_v()[grp]);
+    const int_list& tris_n(obj.get_tris_n()[grp]);
+    const int_list& tris_tc(obj.get_tris_tcs()[grp][0]);
+    for (unsigned i = 0; i < tris_v.size(); ++i) {
+      const int n = (tris_n.size() == tris_v.size()) ? tris_n[i] : tris_v[i];
+      const SGVec2f tc = (tris_tc.size() == tris_v.size()) ?
+        texCoords[tris_tc[i]] : SGVec2f(0, 0);
+      stream.push_back(makeVertex(toVec3f(vertices[tris_v[i]]), normals[n], tc));
+    }
+  }
+  return stream;
+}
+
+// A tiled grid; vertices on tile borders are shared by triangles with
+// different texture coordinates.
+static TriangleStream syntheticTile()
+{
+  TriangleStream stream;
+  const int size = 400;
+  auto vertex = [](int x, int y, int tile) {
+    SGVec3f p(x * 25.0f, y * 25.0f, float((x * 7 + y * 13) % 17));
+    SGVec3f n = normalize(SGVec3f(float(x % 3) - 1.0f, float(y % 5) - 2.0f, 8.0f));
+    SGVec2f tc(x / 16.0f - tile, y / 16.0f);
+    return makeVertex(p, n, tc);
+  };
+
+  for (int y = 0; y < size; ++y) {
+    for (int x = 0; x < size; ++x) {
+      const int tile = x / 50;
+      stream.push_back(vertex(x, y, tile));
+      stream.push_back(vertex(x + 1, y, tile));
+      stream.push_back(vertex(x + 1, y + 1, tile));
+      stream.push_back(vertex(x, y, tile));
+      stream.push_back(vertex(x + 1, y + 1, tile));
+      stream.push_back(vertex(x, y + 1, tile));
+    }
+  }
+  return stream;
+}
+
+template<typename Bin>
+static double bin(Bin& bin, const TriangleStream& stream)
+{
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i + 2 < stream.size(); i += 3)
+    bin.insert(stream[i], stream[i + 1], stream[i + 2]);
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+  const TriangleStream stream = (argc > 1) ? loadBTG(SGPath(argv[1])) :
+                                             syntheticTile();
+
+  ReferenceBin reference;
+  SGTriangleBin<SGVertNormTex> triangles;
+  const double referenceMs = bin(reference, stream);
+  const double hashedMs = bin(triangles, stream);
+
+  // Same vertices, in the same order, bit for bit
+  SG_CHECK_EQUAL(triangles.getNumVertices(), reference.values.size());
+  for (unsigned i = 0; i < reference.values.size(); ++i) {
+    SG_VERIFY(!std::memcmp(&triangles.getVertex(i), &reference.values[i],
+                           sizeof(SGVertNormTex)));
+  }
+
+  SG_CHECK_EQUAL(triangles.getNumTriangles(), reference.triangles.size());
+  for (unsigned i = 0; i < reference.triangles.size(); ++i)
+    SG_VERIFY(triangles.getTriangleRef(i) == reference.triangles[i]);
+
+  // Every triangle ends up in exactly one connected set
+  std::list<SGTriangleBin<SGVertNormTex>::TriangleVector> sets;
+  triangles.getConnectedSets(sets);
+  size_t count = 0;
+  for (const auto& s : sets)
+    count += s.size();
+  SG_CHECK_EQUAL(count, reference.triangles.size());
+
+  std::cout << stream.size() / 3 << " triangles, "
+            << reference.values.size() << " unique vertices: "
+            << "std::map " << referenceMs << " ms, hashed " << hashedMs
+            << " ms" << std::endl;
+
+  return EXIT_SUCCESS;
+}
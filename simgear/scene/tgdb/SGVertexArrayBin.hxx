@@ -22,28 +22,55 @@
 #ifndef SG_VERTEX_ARRAY_BIN_HXX
 #define SG_VERTEX_ARRAY_BIN_HXX
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <vector>
-#include <map>
 
+/// Mix the bits of a float into a hash value. Both zeros hash the same, as
+/// they compare equal.
+inline size_t
+SGVertexArrayBinHashFloat(size_t h, float f)
+{
+  f += 0.0f; // -0 -> +0
+  uint32_t bits;
+  std::memcpy(&bits, &f, sizeof(bits));
+  h ^= bits + 0x9e3779b9u + (h << 6) + (h >> 2);
+  return h;
+}
+
+/// Collects unique vertices. T must provide T::less, a strict weak ordering
+/// whose equivalence classes are the vertices to merge, and T::hash. Two
+/// vertices are merged if they have the same hash and are equivalent.
+/// Vertices are numbered in order of first insertion.
 template<typename T>
 class SGVertexArrayBin {
 public:
   typedef T value_type;
   typedef typename value_type::less less;
+  typedef typename value_type::hash hash;
   typedef std::vector<value_type> ValueVector;
   typedef typename ValueVector::size_type index_type;
-  typedef std::map<value_type, index_type, less> ValueMap;
 
   index_type insert(const value_type& t)
   {
-    typename ValueMap::iterator i = _valueMap.find(t);
-    if (i != _valueMap.end())
-      return i->second;
-
-    index_type index = _values.size();
-    _valueMap[t] = index;
-    _values.push_back(t);
-    return index;
+    // Keep the load factor at or below 1/2
+    if (2 * (_values.size() + 1) > _slots.size())
+      grow();
+
+    const size_t h = hash()(t);
+    const size_t mask = _slots.size() - 1;
+    for (size_t s = h & mask;; s = (s + 1) & mask) {
+      Slot& slot = _slots[s];
+      if (slot.index == emptySlot()) {
+        slot.hash = h;
+        slot.index = _values.size();
+        _values.push_back(t);
+        return slot.index;
+      }
+      if (slot.hash == h && equivalent(_values[slot.index], t))
+        return slot.index;
+    }
   }
 
   const value_type& getVertex(index_type index) const
@@ -56,8 +83,39 @@ public:
   { return _values.empty(); }
 
 private:
+  // Open addressing with linear probing; the table holds indices into
+  // _values, along with their hash to avoid most comparisons.
+  struct Slot {
+    size_t hash;
+    index_type index;
+  };
+
+  static index_type emptySlot()
+  { return ~index_type(0); }
+
+  static bool equivalent(const value_type& l, const value_type& r)
+  { return !less()(l, r) && !less()(r, l); }
+
+  void grow()
+  {
+    std::vector<Slot> oldSlots;
+    oldSlots.swap(_slots);
+    _slots.assign(std::max(size_t(64), 2 * oldSlots.size()),
+                  Slot{0, emptySlot()});
+
+    const size_t mask = _slots.size() - 1;
+    for (const Slot& slot : oldSlots) {
+      if (slot.index == emptySlot())
+        continue;
+      size_t s = slot.hash & mask;
+      while (_slots[s].index != emptySlot())
+        s = (s + 1) & mask;
+      _slots[s] = slot;
+    }
+  }
+
   ValueVector _values;
-  ValueMap _valueMap;
+  std::vector<Slot> _slots;
 };
 
 #endif
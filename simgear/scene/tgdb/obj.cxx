@@ -32,6 +32,8 @@
 #include <osg/Texture2D>
 #include <osg/TexEnv>
 
+#include <memory>
+
 #include "obj.hxx"
 
 #include <simgear/debug/logstream.hxx>
@@ -39,6 +41,7 @@
 #include <simgear/bucket/newbucket.hxx>
 #include <simgear/scene/util/OrthophotoManager.hxx>
 
+#include "SGBTGCache.hxx"               // for cached tile geometry
 #include "SGTileGeometryBin.hxx"        // for original tile loading
 #include "SGTileDetailsCallback.hxx"    // for tile details ( random objects, and lighting )
 
@@ -48,10 +51,6 @@ using namespace simgear;
 osg::Node*
 SGLoadBTG(const std::string& path, const simgear::SGReaderWriterOptions* options)
 {
-    SGBinObject tile;
-    if (!tile.read_bin(path))
-      return NULL;
-
     SGMaterialLibPtr matlib;
     osg::ref_ptr<SGMaterialCache> matcache;
     bool useVBOs = false;
@@ -69,12 +68,46 @@ SGLoadBTG(const std::string& path, const simgear::SGReaderWriterOptions* options
       usePhotoscenery = propertyNode->getBoolValue("/sim/rendering/photoscenery/enabled", usePhotoscenery);
     }
 
-    SGVec3d center = tile.get_gbs_center();
+    // The binned surface geometry can be kept in a cache file per tile.
+    // Overlay coordinates depend on the orthophotos present, so tiles are
+    // not cached with photoscenery.
+    const SGPath btgPath = SGPath::fromUtf8(path);
+    SGPath cacheFile;
+    std::unique_ptr<BTGCacheFile> cache;
+    if (options && !usePhotoscenery) {
+      const std::string cacheDir = options->getPluginStringData("SimGear::BTG_CACHE_PATH");
+      if (!cacheDir.empty()) {
+        cacheFile = btgCacheFile(SGPath::fromUtf8(cacheDir), btgPath);
+        cache = BTGCacheFile::open(cacheFile, btgPath);
+      }
+    }
+
+    SGBinObject tile;
+    bool tileRead = false;
+    if (!cache) {
+      if (!tile.read_bin(path))
+        return NULL;
+      tileRead = true;
+    }
+
+    SGVec3d center = tileRead ? tile.get_gbs_center() : cache->getCenter();
     SGGeod geodPos = SGGeod::fromCart(center);
     SGQuatd hlOr = SGQuatd::fromLonLat(geodPos)*SGQuatd::fromEulerDeg(0, 0, 180);
     if (matlib)
     	matcache = matlib->generateMatCache(geodPos, options);
 
+    if (cache && !SGTileGeometryBin::matchesMaterials(cache->getMeshes(), matcache)) {
+      SG_LOG(SG_TERRAIN, SG_DEBUG, "Materials changed, ignoring BTG cache for " << path);
+      cache.reset();
+    }
+
+    // Point lights are not cached, they still need the tile itself
+    if (!tileRead && (!cache || cache->hasPoints())) {
+      if (!tile.read_bin(path))
+        return NULL;
+      tileRead = true;
+    }
+
     std::vector<SGVec3d> nodes = tile.get_wgs84_nodes();
 
     std::vector<SGVec2f> satellite_overlay_coords;
@@ -115,12 +148,27 @@ SGLoadBTG(const std::string& path, const simgear::SGReaderWriterOptions* options
     tile.set_normals(normals);
 
     // tile surface    
-    osg::ref_ptr<SGTileGeometryBin> tileGeometryBin = new SGTileGeometryBin();
-
-    if (!tileGeometryBin->insertSurfaceGeometry(tile, matcache))
-      return NULL;
-
-    osg::Node* node = tileGeometryBin->getSurfaceGeometry(matcache, useVBOs);
+    osg::Node* node = NULL;
+    if (cache) {
+      node = SGTileGeometryBin::getSurfaceGeometry(cache->getMeshes(), matcache, useVBOs);
+    } else {
+      osg::ref_ptr<SGTileGeometryBin> tileGeometryBin = new SGTileGeometryBin();
+
+      if (!tileGeometryBin->insertSurfaceGeometry(tile, matcache))
+        return NULL;
+
+      if (!cacheFile.isNull()) {
+        BTGCacheWriter writer;
+        writer.setCenter(center);
+        writer.setHasPoints(!tile.get_pts_v().empty());
+        tileGeometryBin->addCacheMeshes(writer, matcache);
+        node = SGTileGeometryBin::getSurfaceGeometry(writer.getMeshes(), matcache, useVBOs);
+        if (!writer.write(cacheFile, btgPath))
+          SG_LOG(SG_TERRAIN, SG_DEBUG, "Unable to write BTG cache for " << path);
+      } else {
+        node = tileGeometryBin->getSurfaceGeometry(matcache, useVBOs);
+      }
+    }
 
     if (node) {
       // Get base node stateset
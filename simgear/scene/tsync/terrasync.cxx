@@ -46,6 +46,9 @@
 #include <fstream>
 #include <string>
 #include <map>
+#include <set>
+#include <algorithm>
+#include <vector>
 
 #include <simgear/version.h>
 
@@ -66,6 +69,7 @@
 #include <simgear/io/DNSClient.hxx>
 #include <simgear/structure/exception.hxx>
 #include <simgear/math/sg_random.h>
+#include <simgear/math/SGGeodesy.hxx>
 
 using namespace simgear;
 using namespace std;
@@ -179,21 +183,20 @@ std::ostream& operator << (std::ostream& out, const SyncItem& s)
 ///////////////////////////////////////////////////////////////////////////////
 
 /**
- * @brief SyncSlot encapsulates a queue of sync items we will fetch
- * serially. Multiple slots exist to sync different types of item in
- * parallel.
+ * @brief SyncJob is a single repository sync in progress, owned by a
+ * SyncSlot.
  */
-class SyncSlot
+class SyncJob
 {
 public:
-    SyncSlot() = default;
+    SyncJob() = default;
 
     SyncItem currentItem;
+    std::string root; ///< repository root of currentItem, see repositoryRootForItem()
     bool isNewDirectory = false;
-    std::deque<SyncItem> queue;
     std::unique_ptr<HTTPRepository> repository;
     SGTimeStamp stamp;
-    bool busy = false; ///< is the slot working or idle
+    bool busy = false; ///< is the job working or idle
     unsigned int pendingKBytes = 0;
     unsigned int nextWarnTimeout = 0;
 };
@@ -205,6 +208,245 @@ static const int SYNC_SLOT_OSM_TILE_DATA = 3;
 
 static const unsigned int NUM_SYNC_SLOTS = 4;
 
+/// below ~ taxi speed the track is meaningless
+static const double MinTrackSpeedKt = 30.0;
+
+/// queued tiles are ranked again when the aircraft moved or turned more
+/// than this, see SGTerraSync::WorkerThread::setPosition()
+static const double RerankDistanceM = 1000.0;
+static const double RerankTrackDeg = 10.0;
+
+/**
+ * @brief Aircraft position and motion used to order tile syncs, so the
+ * tiles we are flying towards are fetched before the ones behind us.
+ */
+struct SyncPosition
+{
+    bool valid = false;
+    SGGeod position;
+    double trackDeg = 0.0;
+    double groundSpeedKt = 0.0;
+    unsigned int generation = 0; ///< changes when the ranking has to be redone
+};
+
+/**
+ * @brief unit vector from the earth centre towards a position; a sphere
+ * is good enough to rank tiles.
+ */
+static SGVec3d unitVectorForGeod(const SGGeod& geod)
+{
+    const double lon = geod.getLongitudeRad(), lat = geod.getLatitudeRad();
+    return SGVec3d(cos(lat) * cos(lon), cos(lat) * sin(lon), sin(lat));
+}
+
+/**
+ * @brief the aircraft position prepared for syncPriority(): the vectors
+ * up, east and north at the aircraft, so ranking a tile takes a few dot
+ * products instead of solving the geodesic problem.
+ */
+struct SyncRanking
+{
+    SyncRanking() = default;
+
+    explicit SyncRanking(const SyncPosition& pos) :
+        valid(pos.valid),
+        moving(pos.groundSpeedKt >= MinTrackSpeedKt),
+        trackRad(SGMiscd::deg2rad(pos.trackDeg))
+    {
+        const double lon = pos.position.getLongitudeRad();
+        const double lat = pos.position.getLatitudeRad();
+        up = unitVectorForGeod(pos.position);
+        east = SGVec3d(-sin(lon), cos(lon), 0.0);
+        north = SGVec3d(-sin(lat) * cos(lon), -sin(lat) * sin(lon), cos(lat));
+    }
+
+    bool valid = false;
+    bool moving = false;
+    double trackRad = 0.0;
+    SGVec3d up, east, north;
+};
+
+/**
+ * @brief the local directory, relative to the TerraSync root, which the
+ * HTTPRepository syncing an item is rooted at: the category directory
+ * of a tile, eg 'Terrain', otherwise the item's own directory. Syncs of
+ * the same root update the same .dirindex files, so only one of them
+ * may run at a time.
+ */
+static std::string repositoryRootForItem(const SyncItem& item)
+{
+    if ((item._type == SyncItem::Tile) || (item._type == SyncItem::OSMTile)) {
+        const auto comps = strutils::split(item._dir, "/");
+        if (comps.size() == 3) {
+            return comps.front();
+        }
+    }
+
+    return item._dir;
+}
+
+/**
+ * @brief a SyncItem waiting in a SyncSlot, with its tile centre and
+ * repository root worked out once when it is queued.
+ */
+struct QueuedSyncItem
+{
+    SyncItem item;
+    std::string root;
+    bool hasCenter = false;
+    SGVec3d center; ///< unit vector towards the tile centre
+    double priority = 0.0;
+    unsigned long sequence = 0; ///< keeps FIFO order between equal priorities
+};
+
+/**
+ * @brief extract the centre of the 1x1 degree tile named by the last
+ * component of a tile path, eg 'Terrain/e000n50/e001n52'.
+ */
+static bool tileCenterForPath(const std::string& dir, SGGeod& center)
+{
+    const auto slash = dir.rfind('/');
+    const std::string name = (slash == std::string::npos) ? dir : dir.substr(slash + 1);
+    if (name.size() != 7) {
+        return false;
+    }
+
+    const char ew = name[0], ns = name[4];
+    if (((ew != 'e') && (ew != 'w')) || ((ns != 'n') && (ns != 's'))) {
+        return false;
+    }
+
+    const int lon = atoi(name.substr(1, 3).c_str());
+    const int lat = atoi(name.substr(5, 2).c_str());
+    center = SGGeod::fromDeg((ew == 'w' ? -lon : lon) + 0.5,
+                             (ns == 's' ? -lat : lat) + 0.5);
+    return true;
+}
+
+/**
+ * @brief rank a queued item against the aircraft position; lower values
+ * are synced first. Tiles are ranked by distance, stretched by up to a factor
+ * of three for tiles behind the aircraft when it is moving, so a tile
+ * 30km ahead beats one 20km behind. Items without a location rank
+ * ahead of all tiles, preserving their FIFO order.
+ */
+static double syncPriority(const QueuedSyncItem& queued, const SyncRanking& ranking)
+{
+    if (!ranking.valid || !queued.hasCenter) {
+        return 0.0;
+    }
+
+    const SGVec3d& c = queued.center;
+    const double distanceM = SGGeodesy::EQURAD *
+        atan2(length(cross(ranking.up, c)), dot(ranking.up, c));
+    if (!ranking.moving) {
+        return distanceM;
+    }
+
+    // initial course of the great circle towards the tile
+    const double course = atan2(dot(c, ranking.east), dot(c, ranking.north));
+    return distanceM * (2.0 - cos(course - ranking.trackRad));
+}
+
+/// heap order of SyncSlot::queue: true if a is synced after b
+static bool syncedAfter(const QueuedSyncItem& a, const QueuedSyncItem& b)
+{
+    if (a.priority != b.priority) {
+        return a.priority > b.priority;
+    }
+
+    return a.sequence > b.sequence;
+}
+
+/**
+ * @brief SyncSlot encapsulates a queue of sync items we will fetch. Each
+ * slot runs up to jobs.size() syncs concurrently (one by default), but
+ * never two of the same repository root at once, in any slot; multiple
+ * slots exist to sync different types of item in parallel.
+ */
+class SyncSlot
+{
+public:
+    SyncSlot() : jobs(1) {}
+
+    /// queue an item, ranked against the current ranking
+    void push(const SyncItem& item);
+
+    /// take the item to sync next whose repository root is not in
+    /// busyRoots, ranking the queue again first if the aircraft moved
+    /// or turned since it was last ranked
+    bool pop(const SyncPosition& pos, const std::set<std::string>& busyRoots,
+             SyncItem& item, std::string& root);
+
+    /// a heap on syncedAfter(), so the next item is at the front
+    std::vector<QueuedSyncItem> queue;
+    std::vector<SyncJob> jobs;
+
+    SyncRanking ranking;
+    unsigned int rankedGeneration = 0;
+    unsigned long nextSequence = 0;
+};
+
+void SyncSlot::push(const SyncItem& item)
+{
+    QueuedSyncItem queued;
+    queued.item = item;
+    queued.root = repositoryRootForItem(item);
+
+    SGGeod center;
+    if (((item._type == SyncItem::Tile) || (item._type == SyncItem::OSMTile)) &&
+        tileCenterForPath(item._dir, center)) {
+        queued.hasCenter = true;
+        queued.center = unitVectorForGeod(center);
+    }
+
+    queued.priority = syncPriority(queued, ranking);
+    queued.sequence = nextSequence++;
+    queue.push_back(queued);
+    std::push_heap(queue.begin(), queue.end(), syncedAfter);
+}
+
+bool SyncSlot::pop(const SyncPosition& pos, const std::set<std::string>& busyRoots,
+                   SyncItem& item, std::string& root)
+{
+    if (queue.empty()) {
+        return false;
+    }
+
+    if (pos.generation != rankedGeneration) {
+        ranking = SyncRanking(pos);
+        rankedGeneration = pos.generation;
+        for (auto& queued : queue) {
+            queued.priority = syncPriority(queued, ranking);
+        }
+        std::make_heap(queue.begin(), queue.end(), syncedAfter);
+    }
+
+    // items of a busy root keep their place, they are put back below
+    std::vector<QueuedSyncItem> deferred;
+    bool found = false;
+    while (!queue.empty()) {
+        std::pop_heap(queue.begin(), queue.end(), syncedAfter);
+        if (busyRoots.count(queue.back().root) == 0) {
+            item = queue.back().item;
+            root = queue.back().root;
+            queue.pop_back();
+            found = true;
+            break;
+        }
+
+        deferred.push_back(std::move(queue.back()));
+        queue.pop_back();
+    }
+
+    for (auto& queued : deferred) {
+        queue.push_back(std::move(queued));
+        std::push_heap(queue.begin(), queue.end(), syncedAfter);
+    }
+
+    return found;
+}
+
 /**
  * @brief translate a sync item type into one of the available slots.
  * This provides the scheduling / balancing / prioritising between slots.
@@ -359,6 +601,17 @@ public:
 
     void setCachePath(const SGPath &p) { _persistentCachePath = p; }
 
+    void setPosition(const SyncPosition& pos);
+
+    void clearTrack()
+    {
+        std::lock_guard<std::mutex> g(_stateLock);
+        _position.groundSpeedKt = 0.0;
+        _position.generation++;
+    }
+
+    void setTileSlotConcurrency(unsigned int count);
+
   private:
       std::string dnsSelectServerForService(const std::string& service);
 
@@ -373,10 +626,13 @@ public:
     // internal mode run and helpers
     void runInternal();
     void updateSyncSlot(SyncSlot& slot);
+    void updateSyncJob(SyncSlot& slot, SyncJob& job);
+    bool popNextItem(SyncSlot& slot, SyncJob& job);
+    void finishSyncJob(SyncJob& job);
 
-    void beginSyncAirports(SyncSlot& slot);
-    void beginSyncTile(SyncSlot& slot);
-    void beginNormalSync(SyncSlot& slot);
+    void beginSyncAirports(SyncJob& job);
+    void beginSyncTile(SyncJob& job);
+    void beginNormalSync(SyncJob& job);
 
     void drainWaitingTiles();
 
@@ -392,6 +648,8 @@ public:
 
     HTTP::Client _http;
     SyncSlot _syncSlots[NUM_SYNC_SLOTS];
+    /// repository roots of the running jobs of all slots
+    std::set<std::string> _busyRoots;
 
     bool _stop, _running;
     SGBlockingDeque <SyncItem> waitingTiles;
@@ -413,6 +671,8 @@ public:
     string _dnsdn;
 
     TerrasyncThreadState _state;
+    SyncPosition _position;
+    unsigned int _tileSlotConcurrency = 1;
     mutable std::mutex _stateLock;
 };
 
@@ -446,6 +706,7 @@ void SGTerraSync::WorkerThread::stop()
     for (unsigned int slot = 0; slot < NUM_SYNC_SLOTS; ++slot) {
         _syncSlots[slot] = {};
     }
+    _busyRoots.clear();
 
     // clear these so if re-init-ing, we check again
     _completedTiles.clear();
@@ -500,6 +761,10 @@ bool SGTerraSync::WorkerThread::start()
     _stop = false;
     _state = TerrasyncThreadState(); // clean state
 
+    // tile syncs are independent of each other, so allow several at once
+    _syncSlots[SYNC_SLOT_TILES].jobs.resize(_tileSlotConcurrency);
+    _syncSlots[SYNC_SLOT_OSM_TILE_DATA].jobs.resize(_tileSlotConcurrency);
+
     SG_LOG(SG_TERRASYNC, SG_MANDATORY_INFO,
            "Starting automatic scenery download/synchronization to '" << _local_dir << "'.");
 
@@ -607,94 +872,151 @@ void SGTerraSync::WorkerThread::run()
     }
 }
 
+void SGTerraSync::WorkerThread::setTileSlotConcurrency(unsigned int count)
+{
+    // only applied when the thread is (re-)started, see start()
+    _tileSlotConcurrency = std::max(1u, std::min(count, 8u));
+}
+
+void SGTerraSync::WorkerThread::setPosition(const SyncPosition& pos)
+{
+    std::lock_guard<std::mutex> g(_stateLock);
+
+    // this is called every frame: only take the new position, which
+    // makes the slots rank their queues again, once it makes a difference
+    if (_position.valid) {
+        const bool wasMoving = _position.groundSpeedKt >= MinTrackSpeedKt;
+        const bool moving = pos.groundSpeedKt >= MinTrackSpeedKt;
+        const double turnDeg = SGMiscd::normalizePeriodic(-180.0, 180.0, pos.trackDeg - _position.trackDeg);
+        if ((wasMoving == moving) && (!moving || (fabs(turnDeg) <= RerankTrackDeg)) &&
+            (SGGeodesy::distanceM(_position.position, pos.position) <= RerankDistanceM)) {
+            return;
+        }
+    }
+
+    const unsigned int generation = _position.generation + 1;
+    _position = pos;
+    _position.generation = generation;
+}
+
+bool SGTerraSync::WorkerThread::popNextItem(SyncSlot& slot, SyncJob& job)
+{
+    if (slot.queue.empty()) {
+        return false;
+    }
+
+    SyncPosition pos;
+    {
+        std::lock_guard<std::mutex> g(_stateLock);
+        pos = _position;
+    }
+
+    if (!slot.pop(pos, _busyRoots, job.currentItem, job.root)) {
+        return false;
+    }
+
+    _busyRoots.insert(job.root);
+    return true;
+}
+
+void SGTerraSync::WorkerThread::finishSyncJob(SyncJob& job)
+{
+    _busyRoots.erase(job.root);
+    job.busy = false;
+    job.repository.reset();
+    job.pendingKBytes = 0;
+    job.currentItem = {};
+    job.root.clear();
+}
+
 void SGTerraSync::WorkerThread::updateSyncSlot(SyncSlot &slot)
 {
-    if (slot.repository.get()) {
-        slot.repository->process();
-        if (slot.repository->isDoingSync()) {
+    for (auto& job : slot.jobs) {
+        updateSyncJob(slot, job);
+    }
+}
+
+void SGTerraSync::WorkerThread::updateSyncJob(SyncSlot& slot, SyncJob& job)
+{
+    if (job.repository.get()) {
+        job.repository->process();
+        if (job.repository->isDoingSync()) {
 #if 1
-            if (slot.stamp.elapsedMSec() > (int)slot.nextWarnTimeout) {
-                SG_LOG(SG_TERRASYNC, SG_INFO, "sync taking a long time:" << slot.currentItem._dir << " taken " << slot.stamp.elapsedMSec());
+            if (job.stamp.elapsedMSec() > (int)job.nextWarnTimeout) {
+                SG_LOG(SG_TERRASYNC, SG_INFO, "sync taking a long time:" << job.currentItem._dir << " taken " << job.stamp.elapsedMSec());
                 SG_LOG(SG_TERRASYNC, SG_INFO, "HTTP request count:" << _http.hasActiveRequests());
-                slot.nextWarnTimeout += 30 * 1000;
+                job.nextWarnTimeout += 30 * 1000;
             }
 #endif
             // convert bytes to kbytes here
-            slot.pendingKBytes = (slot.repository->bytesToDownload() >> 10);
+            job.pendingKBytes = (job.repository->bytesToDownload() >> 10);
             return; // easy, still working
         }
 
         // check result
-        HTTPRepository::ResultCode res = slot.repository->failure();
+        HTTPRepository::ResultCode res = job.repository->failure();
 
         if (res == HTTPRepository::REPO_ERROR_NOT_FOUND) {
-            notFound(slot.currentItem);
+            notFound(job.currentItem);
         } else if (res != HTTPRepository::REPO_NO_ERROR) {
-            fail(slot.currentItem);
+            fail(job.currentItem);
 
             // in case the Airports_archive download fails, create the
             // directory, so that next sync, we do a manual sync
-            if ((slot.currentItem._type == SyncItem::AirportData) && slot.isNewDirectory) {
+            if ((job.currentItem._type == SyncItem::AirportData) && job.isNewDirectory) {
                 SG_LOG(SG_TERRASYNC, SG_ALERT, "Failed to download Airports_archive, will download discrete files next time");
                 simgear::Dir d(_local_dir + "/Airports");
                 d.create(0755);
-                _completedTiles.erase(slot.currentItem._dir);
+                _completedTiles.erase(job.currentItem._dir);
             }
         } else {
-            updated(slot.currentItem, slot.isNewDirectory);
-            SG_LOG(SG_TERRASYNC, SG_DEBUG, "sync of " << slot.repository->baseUrl() << " finished ("
-                   << slot.stamp.elapsedMSec() << " msec");
+            updated(job.currentItem, job.isNewDirectory);
+            SG_LOG(SG_TERRASYNC, SG_DEBUG, "sync of " << job.repository->baseUrl() << " finished ("
+                   << job.stamp.elapsedMSec() << " msec");
         }
 
         // whatever happened, we're done with this repository instance
-        slot.busy = false;
-        slot.repository.reset();
-        slot.pendingKBytes = 0;
-        slot.currentItem = {};
+        finishSyncJob(job);
     }
 
     // init and start sync of the next repository
-    if (!slot.queue.empty()) {
-        slot.currentItem = slot.queue.front();
-        slot.queue.pop_front();
-
+    if (popNextItem(slot, job)) {
         SGPath path(_local_dir);
-        path.append(slot.currentItem._dir);
-        slot.isNewDirectory = !path.exists();
-        const auto type = slot.currentItem._type;
+        path.append(job.currentItem._dir);
+        job.isNewDirectory = !path.exists();
+        const auto type = job.currentItem._type;
 
         if (type == SyncItem::AirportData) {
-            beginSyncAirports(slot);
+            beginSyncAirports(job);
         } else if ((type == SyncItem::Tile) || (type == SyncItem::OSMTile)) {
-            beginSyncTile(slot);
+            beginSyncTile(job);
         } else {
-            beginNormalSync(slot);
+            beginNormalSync(job);
         }
 
         try {
-            slot.repository->update();
+            job.repository->update();
         } catch (sg_exception& e) {
-            SG_LOG(SG_TERRASYNC, SG_INFO, "sync of " << slot.repository->baseUrl() << " failed to start with error:"
+            SG_LOG(SG_TERRASYNC, SG_INFO, "sync of " << job.repository->baseUrl() << " failed to start with error:"
                    << e.getFormattedMessage());
-            fail(slot.currentItem);
-            slot.busy = false;
-            slot.repository.reset();
+            fail(job.currentItem);
+            finishSyncJob(job);
             return;
         }
 
-        slot.nextWarnTimeout = 30 * 1000;
-        slot.stamp.stamp();
-        slot.busy = true;
-        slot.pendingKBytes = slot.repository->bytesToDownload();
+        job.nextWarnTimeout = 30 * 1000;
+        job.stamp.stamp();
+        job.busy = true;
+        job.pendingKBytes = job.repository->bytesToDownload();
 
-        SG_LOG(SG_TERRASYNC, SG_INFO, "sync of " << slot.repository->baseUrl() << " started, queue size is " << slot.queue.size());
+        SG_LOG(SG_TERRASYNC, SG_INFO, "sync of " << job.repository->baseUrl() << " started, queue size is " << slot.queue.size());
     }
 }
 
-void SGTerraSync::WorkerThread::beginSyncAirports(SyncSlot& slot)
+void SGTerraSync::WorkerThread::beginSyncAirports(SyncJob& job)
 {
-    if (!slot.isNewDirectory) {
-        beginNormalSync(slot);
+    if (!job.isNewDirectory) {
+        beginNormalSync(job);
         return;
     }
 
@@ -703,8 +1025,8 @@ void SGTerraSync::WorkerThread::beginSyncAirports(SyncSlot& slot)
     // we want to sync the 'root' TerraSync dir, but not all of it, just
     // the Airports_archive.tar.gz file so we use our TerraSync local root
     // as the path (since the archive will add Airports/)
-    slot.repository.reset(new HTTPRepository(_local_dir, &_http));
-    slot.repository->setBaseUrl(_httpServer);
+    job.repository.reset(new HTTPRepository(_local_dir, &_http));
+    job.repository->setBaseUrl(_httpServer);
 
     // filter callback to *only* sync the Airport_archive tarball,
     // and ensure no other contents are touched
@@ -714,19 +1036,19 @@ void SGTerraSync::WorkerThread::beginSyncAirports(SyncSlot& slot)
         return (item.filename.find("Airports_archive.") == 0);
     };
 
-    slot.repository->setFilter(f);
+    job.repository->setFilter(f);
 }
 
-void SGTerraSync::WorkerThread::beginSyncTile(SyncSlot& slot)
+void SGTerraSync::WorkerThread::beginSyncTile(SyncJob& job)
 {
     // avoid 404 requests by doing a sync which excludes all paths
     // except our tile path. In the case of a missing 1x1 tile, we will
     // stop becuase all directories are filtered out, which is what we want
 
-    auto comps = strutils::split(slot.currentItem._dir, "/");
+    auto comps = strutils::split(job.currentItem._dir, "/");
     if (comps.size() != 3) {
-        SG_LOG(SG_TERRASYNC, SG_ALERT, "Bad tile path:" << slot.currentItem._dir);
-        beginNormalSync(slot);
+        SG_LOG(SG_TERRASYNC, SG_ALERT, "Bad tile path:" << job.currentItem._dir);
+        beginNormalSync(job);
         return;
     }
 
@@ -735,17 +1057,17 @@ void SGTerraSync::WorkerThread::beginSyncTile(SyncSlot& slot)
     const auto oneByOneDir = comps.at(2);
 
     const auto path = SGPath::fromUtf8(_local_dir) / tileCategory;
-    slot.repository.reset(new HTTPRepository(path, &_http));
+    job.repository.reset(new HTTPRepository(path, &_http));
 
-    if (slot.currentItem._type == SyncItem::OSMTile) {
-        slot.repository->setBaseUrl(_osmCityServer + "/" + tileCategory);
+    if (job.currentItem._type == SyncItem::OSMTile) {
+        job.repository->setBaseUrl(_osmCityServer + "/" + tileCategory);
     } else {
-        slot.repository->setBaseUrl(_httpServer + "/" + tileCategory);
+        job.repository->setBaseUrl(_httpServer + "/" + tileCategory);
     }
 
     if (_installRoot.exists()) {
       SGPath p = _installRoot / tileCategory;
-      slot.repository->setInstalledCopyPath(p);
+      job.repository->setInstalledCopyPath(p);
     }
 
     const auto dirPrefix = tenByTenDir + "/" + oneByOneDir;
@@ -773,20 +1095,20 @@ void SGTerraSync::WorkerThread::beginSyncTile(SyncSlot& slot)
         return false;
     };
 
-    slot.repository->setFilter(f);
+    job.repository->setFilter(f);
 }
 
-void SGTerraSync::WorkerThread::beginNormalSync(SyncSlot& slot)
+void SGTerraSync::WorkerThread::beginNormalSync(SyncJob& job)
 {
     SGPath path(_local_dir);
-    path.append(slot.currentItem._dir);
-    slot.repository.reset(new HTTPRepository(path, &_http));
-    slot.repository->setBaseUrl(_httpServer + "/" + slot.currentItem._dir);
+    path.append(job.currentItem._dir);
+    job.repository.reset(new HTTPRepository(path, &_http));
+    job.repository->setBaseUrl(_httpServer + "/" + job.currentItem._dir);
 
     if (_installRoot.exists()) {
       SGPath p = _installRoot;
-      p.append(slot.currentItem._dir);
-      slot.repository->setInstalledCopyPath(p);
+      p.append(job.currentItem._dir);
+      job.repository->setInstalledCopyPath(p);
     }
 }
 
@@ -834,8 +1156,10 @@ void SGTerraSync::WorkerThread::runInternal()
         // update each sync slot in turn
         for (unsigned int slot=0; slot < NUM_SYNC_SLOTS; ++slot) {
             updateSyncSlot(_syncSlots[slot]);
-            newPendingCount += _syncSlots[slot].pendingKBytes;
-            anySlotBusy |= _syncSlots[slot].busy;
+            for (const auto& job : _syncSlots[slot].jobs) {
+                newPendingCount += job.pendingKBytes;
+                anySlotBusy |= job.busy;
+            }
         }
 
         {
@@ -950,7 +1274,7 @@ void SGTerraSync::WorkerThread::drainWaitingTiles()
 
         const auto slot = syncSlotForType(next._type);
         SG_LOG(SG_TERRASYNC, SG_INFO, "adding to _syncSlots slot=" << slot);
-        _syncSlots[slot].queue.push_back(next);
+        _syncSlots[slot].push(next);
     }
 }
 
@@ -971,11 +1295,13 @@ bool SGTerraSync::WorkerThread::isDirActive(const std::string& path) const
     std::lock_guard<std::mutex> g(_stateLock);
     for (unsigned int slot = 0; slot < NUM_SYNC_SLOTS; ++slot) {
         const auto& syncSlot = _syncSlots[slot];
-        if (syncSlot.currentItem._dir == path)
-            return true;
+        for (const auto& job : syncSlot.jobs) {
+            if (job.currentItem._dir == path)
+                return true;
+        }
 
-        auto it = std::find_if(syncSlot.queue.begin(), syncSlot.queue.end(), [&path](const SyncItem& i) {
-            return i._dir == path;
+        auto it = std::find_if(syncSlot.queue.begin(), syncSlot.queue.end(), [&path](const QueuedSyncItem& i) {
+            return i.item._dir == path;
         });
 
         if (it != syncSlot.queue.end()) {
@@ -1085,11 +1411,21 @@ void SGTerraSync::setRoot(SGPropertyNode_ptr root)
     if (!root) {
         _terraRoot.clear();
         _renderingRoot.clear();
+        _latitudeNode.clear();
+        _longitudeNode.clear();
+        _trackNode.clear();
+        _groundSpeedNode.clear();
         return;
     }
 
     _terraRoot = root->getNode("/sim/terrasync",true);
     _renderingRoot = root->getNode("/sim/rendering", true);
+
+    // the aircraft position and motion, to rank the queued tiles
+    _latitudeNode = root->getNode("/position/latitude-deg", true);
+    _longitudeNode = root->getNode("/position/longitude-deg", true);
+    _trackNode = root->getNode("/orientation/track-deg", true);
+    _groundSpeedNode = root->getNode("/velocities/groundspeed-kt", true);
 }
 
 void SGTerraSync::init()
@@ -1148,6 +1484,7 @@ void SGTerraSync::reinit()
         }
 
         _workerThread->setCacheHits(_terraRoot->getIntValue("cache-hit", 0));
+        _workerThread->setTileSlotConcurrency(_terraRoot->getIntValue("tile-slot-concurrency", 1));
 
         if (_workerThread->start())
         {
@@ -1204,6 +1541,10 @@ void SGTerraSync::unbind()
     _activeNode.clear();
     _cacheHits.clear();
     _renderingRoot.clear();
+    _latitudeNode.clear();
+    _longitudeNode.clear();
+    _trackNode.clear();
+    _groundSpeedNode.clear();
     _busyNode.clear();
     _updateCountNode.clear();
     _errorCountNode.clear();
@@ -1252,6 +1593,11 @@ void SGTerraSync::update(double)
     _stalledNode->setBoolValue(_workerThread->isStalled());
     _activeNode->setBoolValue(worker_running);
 
+    if (worker_running && _latitudeNode && _latitudeNode->hasValue() && _longitudeNode->hasValue()) {
+        setPosition(SGGeod::fromDeg(_longitudeNode->getDoubleValue(), _latitudeNode->getDoubleValue()),
+                    _trackNode->getDoubleValue(), _groundSpeedNode->getDoubleValue());
+    }
+
     int allowedErrors = _maxErrorsNode->getIntValue();
     if (worker_running && (copiedState._consecutive_errors >= allowedErrors)) {
         _workerThread->stop();
@@ -1372,7 +1718,20 @@ bool SGTerraSync::isDataDirPending(const std::string& dataDir) const
 
 void SGTerraSync::reposition()
 {
-    // stub, remove
+    // we jumped rather than travelled, so our previous track says nothing
+    // about which tiles are needed first: rank by distance alone until
+    // the next position update.
+    _workerThread->clearTrack();
+}
+
+void SGTerraSync::setPosition(const SGGeod& pos, double trackDeg, double groundSpeedKt)
+{
+    SyncPosition p;
+    p.valid = true;
+    p.position = pos;
+    p.trackDeg = trackDeg;
+    p.groundSpeedKt = groundSpeedKt;
+    _workerThread->setPosition(p);
 }
 
 
@@ -29,6 +29,7 @@
 
 class SGPath;
 class SGBucket;
+class SGGeod;
 
 namespace simgear
 {
@@ -58,6 +59,14 @@ public:
     /// certain tiles when we reposition.
     void reposition();
 
+    /// update the aircraft position and motion. Queued tiles are synced
+    /// nearest first, preferring those ahead of the aircraft along its
+    /// track over those behind it. update() calls this with the values of
+    /// /position/latitude-deg, /position/longitude-deg,
+    /// /orientation/track-deg and /velocities/groundspeed-kt, once they
+    /// have been set.
+    void setPosition(const SGGeod& pos, double trackDeg, double groundSpeedKt);
+
     bool isIdle();
 
     bool scheduleTile(const SGBucket& bucket);
@@ -94,6 +103,10 @@ private:
     WorkerThread* _workerThread;
     SGPropertyNode_ptr _terraRoot;
     SGPropertyNode_ptr _renderingRoot;
+    SGPropertyNode_ptr _latitudeNode;
+    SGPropertyNode_ptr _longitudeNode;
+    SGPropertyNode_ptr _trackNode;
+    SGPropertyNode_ptr _groundSpeedNode;
     SGPropertyNode_ptr _stalledNode;
     SGPropertyNode_ptr _cacheHits;
     SGPropertyNode_ptr _busyNode;
@@ -0,0 +1,305 @@
+// Flies a simulated aircraft past a local HTTP server standing in for the
+// TerraSync server, and checks that SGTerraSync syncs the tiles ahead of
+// the aircraft before the ones behind it, and that it ranks its queue
+// again when the aircraft turns around. Then checks that parallel tile
+// syncs never run two syncs of the same repository root at once.
+
+#include <simgear_config.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <simgear/bucket/newbucket.hxx>
+#include <simgear/io/test_HTTP.hxx>
+#include <simgear/misc/sg_dir.hxx>
+#include <simgear/misc/test_macros.hxx>
+#include <simgear/props/props.hxx>
+#include <simgear/scene/tsync/terrasync.hxx>
+#include <simgear/timing/timestamp.hxx>
+
+using namespace simgear;
+
+// Answers every request with a 404, which ends the sync of a tile as not
+// found, but holds requests back while holdRequests is set, so the test
+// decides when each tile sync finishes.
+class TerraSyncChannel : public TestServerChannel
+{
+public:
+    ~TerraSyncChannel()
+    {
+        held.erase(std::remove(held.begin(), held.end(), this), held.end());
+    }
+
+    void processRequestHeaders() override
+    {
+        if (holdRequests) {
+            held.push_back(this);
+            return;
+        }
+
+        sendErrorResponse(404, false, "");
+    }
+
+    static void releaseOne()
+    {
+        TerraSyncChannel* channel = held.front();
+        held.pop_front();
+        channel->sendErrorResponse(404, false, "");
+    }
+
+    static bool holdRequests;
+    static std::deque<TerraSyncChannel*> held;
+};
+
+bool TerraSyncChannel::holdRequests = false;
+std::deque<TerraSyncChannel*> TerraSyncChannel::held;
+
+static TestServer<TerraSyncChannel> testServer;
+
+static bool pollUntil(const std::function<bool()>& done)
+{
+    SGTimeStamp start(SGTimeStamp::now());
+    while (start.elapsedMSec() < 10000) {
+        testServer.poll();
+        if (done()) {
+            return true;
+        }
+        SGTimeStamp::sleepForMSec(5);
+    }
+
+    return false;
+}
+
+static std::string tilePath(double lon, double lat)
+{
+    return SGBucket(SGGeod::fromDeg(lon, lat)).gen_base_path();
+}
+
+static void setAircraft(SGTerraSync& terraSync, SGPropertyNode* root,
+                        double lon, double lat, double trackDeg)
+{
+    root->setDoubleValue("/position/longitude-deg", lon);
+    root->setDoubleValue("/position/latitude-deg", lat);
+    root->setDoubleValue("/orientation/track-deg", trackDeg);
+    root->setDoubleValue("/velocities/groundspeed-kt", 250.0);
+    terraSync.update(0.1);
+}
+
+// Queue the tiles of one row behind a tile far away, which keeps the
+// tile slot busy until they are all queued, as the tile manager of a
+// flying aircraft would
+static void scheduleRow(SGTerraSync& terraSync, const std::string& blocker,
+                        const std::vector<std::string>& row)
+{
+    TerraSyncChannel::holdRequests = true;
+    terraSync.syncAreaByPath(blocker);
+    SG_VERIFY(pollUntil([] { return !TerraSyncChannel::held.empty(); }));
+
+    for (const auto& tile : row) {
+        terraSync.syncAreaByPath(tile);
+    }
+
+    // give the worker thread time to take them from its waiting queue
+    SGTimeStamp::sleepForMSec(200);
+}
+
+// Let the held requests go one at a time and return the tiles in the order
+// their syncs finished
+static std::vector<std::string> releaseTiles(SGTerraSync& terraSync, std::vector<std::string>& pending,
+                                             size_t count)
+{
+    std::vector<std::string> finished;
+    while (finished.size() < count) {
+        SG_VERIFY(pollUntil([] { return !TerraSyncChannel::held.empty(); }));
+        TerraSyncChannel::releaseOne();
+
+        auto it = pending.end();
+        SG_VERIFY(pollUntil([&] {
+            it = std::find_if(pending.begin(), pending.end(), [&](const std::string& tile) {
+                return !terraSync.isTileDirPending(tile);
+            });
+            return it != pending.end();
+        }));
+
+        finished.push_back(*it);
+        pending.erase(it);
+    }
+
+    return finished;
+}
+
+// The repository root, 'Terrain' or 'Objects', a held request is for
+static std::string heldRoot(const TerraSyncChannel* channel)
+{
+    return (channel->path.find("/Objects") != std::string::npos) ? "Objects" : "Terrain";
+}
+
+static bool heldRootsDistinct()
+{
+    std::vector<std::string> roots;
+    for (const auto* channel : TerraSyncChannel::held) {
+        roots.push_back(heldRoot(channel));
+    }
+    std::sort(roots.begin(), roots.end());
+    return std::adjacent_find(roots.begin(), roots.end()) == roots.end();
+}
+
+static void startTerraSync(SGTerraSync& terraSync, SGPropertyNode* root, const SGPath& dir)
+{
+    root->setStringValue("/sim/terrasync/http-server", "http://localhost:2000/");
+    root->setStringValue("/sim/terrasync/scenery-dir", dir.utf8Str());
+    root->setBoolValue("/sim/terrasync/enabled", true);
+    root->setBoolValue("/sim/terrasync/enable-persistent-cache", false);
+    root->setIntValue("/sim/terrasync/max-errors", 1000);
+
+    terraSync.setRoot(root);
+    terraSync.bind();
+    terraSync.init();
+
+    // The shared data is synced first; wait for the worker to run and
+    // for those syncs to finish
+    SGTimeStamp start(SGTimeStamp::now());
+    while (!terraSync.isDataDirPending("Airports") && (start.elapsedMSec() < 10000)) {
+        SGTimeStamp::sleepForMSec(5);
+    }
+    SG_VERIFY(pollUntil([&] {
+        return !terraSync.isDataDirPending("Airports") && !terraSync.isDataDirPending("Models");
+    }));
+}
+
+// Two tile syncs at once: the tiles of one category wait for each other,
+// as they share the .dirindex files of their category, while a tile of
+// another category is synced alongside
+static void testParallelSlotJobs()
+{
+    simgear::Dir tmpDir = simgear::Dir::tempDir("FlightGear");
+    tmpDir.setRemoveOnDestroy();
+
+    SGPropertyNode_ptr root(new SGPropertyNode);
+    root->setIntValue("/sim/terrasync/tile-slot-concurrency", 2);
+    root->setStringValue("/sim/rendering/scenery-path-suffix[0]/name", "Terrain");
+
+    SGTerraSync terraSync;
+    startTerraSync(terraSync, root, tmpDir.path());
+
+    TerraSyncChannel::holdRequests = true;
+    std::vector<std::string> pending;
+    for (int lon = 4; lon <= 6; ++lon) {
+        pending.push_back(tilePath(lon + 0.5, 47.5));
+        terraSync.syncAreaByPath(pending.back());
+    }
+    SG_VERIFY(pollUntil([] { return !TerraSyncChannel::held.empty(); }));
+    SGTimeStamp start(SGTimeStamp::now());
+    while (start.elapsedMSec() < 300) {
+        testServer.poll();
+        SGTimeStamp::sleepForMSec(5);
+    }
+    SG_CHECK_EQUAL(TerraSyncChannel::held.size(), 1u);
+
+    // an Objects tile is not held up by the queued Terrain tiles
+    root->setStringValue("/sim/rendering/scenery-path-suffix[1]/name", "Objects");
+    pending.push_back(tilePath(7.5, 47.5));
+    terraSync.syncAreaByPath(pending.back());
+    SG_VERIFY(pollUntil([] { return TerraSyncChannel::held.size() == 2; }));
+    SG_VERIFY(heldRootsDistinct());
+
+    auto dropFinished = [&] {
+        pending.erase(std::remove_if(pending.begin(), pending.end(), [&](const std::string& tile) {
+            return !terraSync.isTileDirPending(tile);
+        }), pending.end());
+        return pending.empty();
+    };
+    while (!dropFinished()) {
+        SG_VERIFY(pollUntil([&] { return !TerraSyncChannel::held.empty() || dropFinished(); }));
+        SG_VERIFY(heldRootsDistinct());
+        if (!TerraSyncChannel::held.empty()) {
+            TerraSyncChannel::releaseOne();
+        }
+    }
+
+    TerraSyncChannel::holdRequests = false;
+    terraSync.unbind();
+}
+
+static size_t indexOf(const std::vector<std::string>& order, const std::string& tile)
+{
+    auto it = std::find(order.begin(), order.end(), tile);
+    SG_VERIFY(it != order.end());
+    return it - order.begin();
+}
+
+int main(int argc, char* argv[])
+{
+    simgear::Dir tmpDir = simgear::Dir::tempDir("FlightGear");
+    tmpDir.setRemoveOnDestroy();
+
+    SGPropertyNode_ptr root(new SGPropertyNode);
+    root->setStringValue("/sim/rendering/scenery-path-suffix[0]/name", "Terrain");
+
+    SGTerraSync terraSync;
+    startTerraSync(terraSync, root, tmpDir.path());
+
+    // Flying east along 47.5N, over the tile e008n47. The row of tiles
+    // around it is queued from west to east, the wrong order.
+    setAircraft(terraSync, root, 8.5, 47.5, 90.0);
+    std::vector<std::string> row;
+    for (int lon = 4; lon <= 12; ++lon) {
+        row.push_back(tilePath(lon + 0.5, 47.5));
+    }
+    const std::string blocker = tilePath(-99.5, 30.5);
+    scheduleRow(terraSync, blocker, row);
+
+    std::vector<std::string> pending = row;
+    pending.push_back(blocker);
+    std::vector<std::string> order = releaseTiles(terraSync, pending, row.size() + 1);
+    SG_CHECK_EQUAL(order[0], blocker);
+    SG_CHECK_EQUAL(order[1], tilePath(8.5, 47.5));
+    for (int k = 1; k <= 4; ++k) {
+        const size_t ahead = indexOf(order, tilePath(8.5 + k, 47.5));
+        const size_t behind = indexOf(order, tilePath(8.5 - k, 47.5));
+        SG_VERIFY(ahead < behind);
+        if (k > 1) {
+            SG_VERIFY(indexOf(order, tilePath(7.5 + k, 47.5)) < ahead);
+            SG_VERIFY(indexOf(order, tilePath(9.5 - k, 47.5)) < behind);
+        }
+    }
+
+    // One row south, still flying east, the aircraft turns around after
+    // two syncs. The tile synced then was picked flying east, all the
+    // others must be picked flying west.
+    setAircraft(terraSync, root, 8.5, 46.5, 90.0);
+    row.clear();
+    for (int lon = 4; lon <= 12; ++lon) {
+        row.push_back(tilePath(lon + 0.5, 46.5));
+    }
+    const std::string blocker2 = tilePath(-99.5, 31.5);
+    scheduleRow(terraSync, blocker2, row);
+
+    pending = row;
+    pending.push_back(blocker2);
+    order = releaseTiles(terraSync, pending, 2);
+    SG_CHECK_EQUAL(order[0], blocker2);
+    SG_CHECK_EQUAL(order[1], tilePath(8.5, 46.5));
+
+    setAircraft(terraSync, root, 8.5, 46.5, 270.0);
+    order = releaseTiles(terraSync, pending, pending.size());
+    SG_CHECK_EQUAL(order[0], tilePath(9.5, 46.5));
+    for (int k = 1; k <= 4; ++k) {
+        SG_CHECK_EQUAL(order[k], tilePath(8.5 - k, 46.5));
+    }
+
+    TerraSyncChannel::holdRequests = false;
+    terraSync.unbind();
+
+    std::cout << "Passed simulated flight" << std::endl;
+
+    testParallelSlotJobs();
+    std::cout << "Passed parallel slot jobs" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -16,7 +16,8 @@
 
 #include "ClusteredShading.hxx"
 
-#include <thread>
+#include <algorithm>
+#include <limits>
 
 #include <osg/RenderInfo>
 #include <osg/Texture2D>
@@ -40,14 +41,16 @@ ClusteredShading::ClusteredShading(osg::Camera *camera,
     _max_light_indices = config->getIntValue("max-light-indices", 256);
     _tile_size = config->getIntValue("tile-size", 128);
     _depth_slices = config->getIntValue("depth-slices", 1);
-    _num_threads = config->getIntValue("num-threads", 1);
+    _num_threads = std::max(1, config->getIntValue("num-threads", 1));
     _slices_per_thread = _depth_slices / _num_threads;
     if (_slices_per_thread == 0) {
         SG_LOG(SG_INPUT, SG_INFO, "ClusteredShading::ClusteredShading(): "
                "More threads than depth slices");
         _num_threads = _depth_slices;
+        _slices_per_thread = 1;
     }
     _slices_remainder = _depth_slices % _num_threads;
+    _thread_hits.resize(_num_threads);
 
     osg::StateSet *ss = _camera->getOrCreateStateSet();
 
@@ -174,6 +177,35 @@ ClusteredShading::ClusteredShading(osg::Camera *camera,
 
 ClusteredShading::~ClusteredShading()
 {
+    stopWorkers();
+}
+
+void
+ClusteredShading::SphereArrays::clear()
+{
+    x.clear(); y.clear(); z.clear(); radius.clear();
+    count = 0;
+}
+
+void
+ClusteredShading::SphereArrays::add(const osg::Vec4f &center, float r)
+{
+    x.push_back(center.x());
+    y.push_back(center.y());
+    z.push_back(center.z());
+    radius.push_back(r);
+    ++count;
+}
+
+void
+ClusteredShading::SphereArrays::pad()
+{
+    while (x.size() % LIGHT_BLOCK) {
+        x.push_back(0.0f);
+        y.push_back(0.0f);
+        z.push_back(0.0f);
+        radius.push_back(-std::numeric_limits<float>::max());
+    }
 }
 
 void
@@ -183,6 +215,8 @@ ClusteredShading::update(const SGLightList &light_list)
     // testing, separating point and spot lights in the process
     _point_bounds.clear();
     _spot_bounds.clear();
+    _point_spheres.clear();
+    _spot_spheres.clear();
     for (const auto &light : light_list) {
         if (light->getType() == SGLight::POINT) {
             PointlightBound point;
@@ -195,6 +229,7 @@ ClusteredShading::update(const SGLightList &light_list)
             point.range = light->getRange();
 
             _point_bounds.push_back(point);
+            _point_spheres.add(point.position, point.range);
         } else if (light->getType() == SGLight::SPOT) {
             SpotlightBound spot;
             spot.light = light;
@@ -218,12 +253,16 @@ ClusteredShading::update(const SGLightList &light_list)
                 spot.position + spot.direction * spot.bounding_sphere.radius;
 
             _spot_bounds.push_back(spot);
+            _spot_spheres.add(spot.bounding_sphere.center,
+                              spot.bounding_sphere.radius);
         }
     }
     if (_point_bounds.size() > static_cast<unsigned int>(_max_pointlights) ||
         _spot_bounds.size()  > static_cast<unsigned int>(_max_spotlights)) {
         throw sg_range_exception("Maximum amount of visible lights surpassed");
     }
+    _point_spheres.pad();
+    _spot_spheres.pad();
 
     float l = 0.f, r = 0.f, b = 0.f, t = 0.f;
     _camera->getProjectionMatrix().getFrustum(l, r, b, t, _zNear, _zFar);
@@ -282,17 +321,12 @@ ClusteredShading::update(const SGLightList &light_list)
     if (_depth_slices == 1) {
         // Just run the light assignment on the main thread to avoid the
         // unnecessary threading overhead
-        assignLightsToSlice(0);
+        assignLightsToSlice(0, _thread_hits[0]);
     } else if (_num_threads == 1) {
         // Again, avoid the unnecessary threading overhead
         threadFunc(0);
     } else {
-        std::vector<std::thread> threads;
-        threads.reserve(_num_threads);
-        for (int i = 0; i < _num_threads; ++i)
-            threads.emplace_back(&ClusteredShading::threadFunc, this, i);
-
-        for (auto &t : threads) t.join();
+        runWorkers();
     }
 
     // Force upload of the image data
@@ -303,18 +337,140 @@ ClusteredShading::update(const SGLightList &light_list)
     writeSpotlightData();
 }
 
+void
+ClusteredShading::runWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(_pool_mutex);
+        // The workers are started on first use and then stay parked on
+        // _work_cv between frames
+        if (_workers.empty()) {
+            _workers.reserve(_num_threads - 1);
+            for (int i = 1; i < _num_threads; ++i)
+                _workers.emplace_back(&ClusteredShading::workerMain, this, i);
+        }
+        _pending_workers = _num_threads - 1;
+        _worker_error = nullptr;
+        ++_frame;
+    }
+    _work_cv.notify_all();
+
+    // This thread takes the share of thread 0
+    std::exception_ptr error;
+    try {
+        threadFunc(0);
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(_pool_mutex);
+        _done_cv.wait(lock, [this] { return _pending_workers == 0; });
+        if (!error)
+            error = _worker_error;
+    }
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+void
+ClusteredShading::stopWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(_pool_mutex);
+        _stop_workers = true;
+    }
+    _work_cv.notify_all();
+
+    for (auto &t : _workers)
+        t.join();
+    _workers.clear();
+}
+
+void
+ClusteredShading::workerMain(int thread_id)
+{
+    unsigned int frame = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(_pool_mutex);
+            _work_cv.wait(lock, [&] {
+                return _stop_workers || _frame != frame;
+            });
+            if (_stop_workers)
+                return;
+            frame = _frame;
+        }
+
+        std::exception_ptr error;
+        try {
+            threadFunc(thread_id);
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_pool_mutex);
+            if (error && !_worker_error)
+                _worker_error = error;
+            --_pending_workers;
+        }
+        _done_cv.notify_one();
+    }
+}
+
 void
 ClusteredShading::threadFunc(int thread_id)
 {
+    std::vector<GLushort> &hits = _thread_hits[thread_id];
+
     for (int i = 0; i < _slices_per_thread; ++i)
-        assignLightsToSlice(thread_id * _slices_per_thread + i);
+        assignLightsToSlice(thread_id * _slices_per_thread + i, hits);
 
     if (_slices_remainder > thread_id)
-        assignLightsToSlice(_slices_per_thread * _num_threads + thread_id);
+        assignLightsToSlice(_slices_per_thread * _num_threads + thread_id, hits);
 }
 
 void
-ClusteredShading::assignLightsToSlice(int slice)
+ClusteredShading::intersectSpheres(const Subfrustum &subfrustum,
+                                   const SphereArrays &spheres,
+                                   std::vector<GLushort> &hits)
+{
+    static_assert(LIGHT_BLOCK <= 32, "lane mask must fit in an unsigned int");
+    const unsigned int all_lanes = (1u << LIGHT_BLOCK) - 1u;
+
+    for (size_t base = 0; base < spheres.count; base += LIGHT_BLOCK) {
+        const float *x = &spheres.x[base];
+        const float *y = &spheres.y[base];
+        const float *z = &spheres.z[base];
+        const float *r = &spheres.radius[base];
+
+        // Frustum-sphere collision tests, a whole block of lights per plane.
+        // The fixed-size inner loops are meant to be vectorized.
+        unsigned int inside = all_lanes;
+        for (int n = 0; n < 6 && inside; ++n) {
+            const osg::Vec4f &p = subfrustum.plane[n];
+            float distance[LIGHT_BLOCK];
+            for (int k = 0; k < LIGHT_BLOCK; ++k)
+                distance[k] = p._v[0] * x[k] + p._v[1] * y[k] +
+                    p._v[2] * z[k] + p._v[3] + r[k];
+
+            unsigned int plane_mask = 0;
+            for (int k = 0; k < LIGHT_BLOCK; ++k)
+                plane_mask |= unsigned(distance[k] > 0.0f) << k;
+            inside &= plane_mask;
+        }
+
+        for (int k = 0; inside; ++k, inside >>= 1) {
+            if (inside & 1u)
+                hits.push_back(GLushort(base + k));
+        }
+    }
+}
+
+void
+ClusteredShading::assignLightsToSlice(int slice, std::vector<GLushort> &hits)
 {
     size_t z_offset = slice * _n_htiles * _n_vtiles;
 
@@ -332,64 +488,23 @@ ClusteredShading::assignLightsToSlice(int slice)
         subfrustum.plane[4] = near_plane;
         subfrustum.plane[5] = far_plane;
 
-        GLint start_offset = _global_light_count;
-        GLint local_point_count = 0;
-        GLint local_spot_count = 0;
-
-        // Test point lights
-        for (GLushort point_iterator = 0;
-             point_iterator < _point_bounds.size();
-             ++point_iterator) {
-            PointlightBound point = _point_bounds[point_iterator];
-
-            // Perform frustum-sphere collision tests
-            float distance = 0.0f;
-            for (int n = 0; n < 6; ++n) {
-                distance = subfrustum.plane[n] * point.position + point.range;
-                if (distance <= 0.0f)
-                    break;
-            }
-
-            if (distance > 0.0f) {
-                indices[_global_light_count] = GLfloat(point_iterator);
-                ++local_point_count;
-                ++_global_light_count; // Atomic increment
-            }
-
-            if (_global_light_count >= (_max_light_indices * _max_light_indices)) {
-                throw sg_range_exception(
-                    "Clustered shading light index count is over the hardcoded limit ("
-                    + std::to_string(_max_light_indices * _max_light_indices) + ")");
-            }
+        hits.clear();
+        intersectSpheres(subfrustum, _point_spheres, hits);
+        const GLint local_point_count = GLint(hits.size());
+        intersectSpheres(subfrustum, _spot_spheres, hits);
+        const GLint local_spot_count = GLint(hits.size()) - local_point_count;
+
+        // Reserve room for all the indices of this cluster at once
+        const GLint start_offset = _global_light_count.fetch_add(GLint(hits.size()));
+        if (start_offset + GLint(hits.size()) >
+            (_max_light_indices * _max_light_indices)) {
+            throw sg_range_exception(
+                "Clustered shading light index count is over the hardcoded limit ("
+                + std::to_string(_max_light_indices * _max_light_indices) + ")");
         }
 
-        // Test spot lights
-        for (GLushort spot_iterator = 0;
-             spot_iterator < _spot_bounds.size();
-             ++spot_iterator) {
-            SpotlightBound spot = _spot_bounds[spot_iterator];
-
-            // Perform frustum-sphere collision tests
-            float distance = 0.0f;
-            for (int n = 0; n < 6; ++n) {
-                distance = subfrustum.plane[n] * spot.bounding_sphere.center
-                    + spot.bounding_sphere.radius;
-                if (distance <= 0.0f)
-                    break;
-            }
-
-            if (distance > 0.0f) {
-                indices[_global_light_count] = GLfloat(spot_iterator);
-                ++local_spot_count;
-                ++_global_light_count; // Atomic increment
-            }
-
-            if (_global_light_count >= (_max_light_indices * _max_light_indices)) {
-                throw sg_range_exception(
-                    "Clustered shading light index count is over the hardcoded limit ("
-                    + std::to_string(_max_light_indices * _max_light_indices) + ")");
-            }
-        }
+        for (size_t n = 0; n < hits.size(); ++n)
+            indices[start_offset + n] = GLfloat(hits[n]);
 
         clusters[(z_offset + i) * 3 + 0] = GLfloat(start_offset);
         clusters[(z_offset + i) * 3 + 1] = GLfloat(local_point_count);
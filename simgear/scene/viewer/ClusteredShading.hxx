@@ -18,6 +18,11 @@
 #define SG_CLUSTERED_SHADING_HXX
 
 #include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include <osg/Camera>
 #include <osg/Uniform>
@@ -57,8 +62,28 @@ protected:
         } bounding_sphere;
     };
 
+    // Light bounding spheres in view space as a structure of arrays, so that
+    // LIGHT_BLOCK lights can be tested against a plane at once. The arrays
+    // are padded to a multiple of LIGHT_BLOCK with spheres that are outside
+    // every plane.
+    static const int LIGHT_BLOCK = 8;
+    struct SphereArrays {
+        std::vector<float> x, y, z, radius;
+        size_t count = 0; // number of actual lights, without padding
+
+        void clear();
+        void add(const osg::Vec4f &center, float r);
+        void pad();
+    };
+
     void threadFunc(int thread_id);
-    void assignLightsToSlice(int slice);
+    void assignLightsToSlice(int slice, std::vector<GLushort> &hits);
+    static void intersectSpheres(const Subfrustum &subfrustum,
+                                 const SphereArrays &spheres,
+                                 std::vector<GLushort> &hits);
+    void runWorkers();
+    void stopWorkers();
+    void workerMain(int thread_id);
     void writePointlightData();
     void writeSpotlightData();
     float getDepthForSlice(int slice) const;
@@ -100,8 +125,24 @@ protected:
 
     std::vector<PointlightBound>    _point_bounds;
     std::vector<SpotlightBound>     _spot_bounds;
+    SphereArrays                    _point_spheres;
+    SphereArrays                    _spot_spheres;
 
     std::atomic<int>                _global_light_count;
+
+    // Light indices found for the current cluster, one buffer per thread
+    std::vector<std::vector<GLushort>> _thread_hits;
+
+    // Persistent worker threads, parked between frames. Thread 0 is the
+    // thread calling update(), so there are _num_threads - 1 workers.
+    std::vector<std::thread>        _workers;
+    std::mutex                      _pool_mutex;
+    std::condition_variable         _work_cv;
+    std::condition_variable         _done_cv;
+    unsigned int                    _frame = 0;
+    int                             _pending_workers = 0;
+    bool                            _stop_workers = false;
+    std::exception_ptr              _worker_error;
 };
 
 } // namespace compositor
@@ -0,0 +1,125 @@
+// Light assignment benchmark for ClusteredShading. Runs on the CPU only:
+// nothing is rendered, the camera merely provides the view and projection.
+
+#include <simgear_config.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <osg/MatrixTransform>
+
+#include <simgear/misc/test_macros.hxx>
+#include <simgear/props/props.hxx>
+
+#include "ClusteredShading.hxx"
+
+using namespace simgear::compositor;
+
+// Gives access to the light assignment results
+class TestClusteredShading : public ClusteredShading {
+public:
+    TestClusteredShading(osg::Camera *camera, const SGPropertyNode *config) :
+        ClusteredShading(camera, config) {}
+
+    // Sorted light indices of cluster i, point lights then spot lights
+    std::vector<int> cluster(int i) const
+    {
+        const float *clusters = reinterpret_cast<const float *>(_clusters->data());
+        const float *indices = reinterpret_cast<const float *>(_indices->data());
+        int start = int(clusters[i * 3 + 0]);
+        int count = int(clusters[i * 3 + 1]) + int(clusters[i * 3 + 2]);
+        return std::vector<int>(indices + start, indices + start + count);
+    }
+
+    int clusterCount() const
+    {
+        return _n_htiles * _n_vtiles * _depth_slices;
+    }
+};
+
+static osg::ref_ptr<osg::Camera> createCamera()
+{
+    osg::ref_ptr<osg::Camera> camera = new osg::Camera;
+    camera->setViewport(0, 0, 1920, 1080);
+    camera->setProjectionMatrixAsPerspective(60.0, 1920.0 / 1080.0, 1.0, 5000.0);
+    camera->setViewMatrix(osg::Matrix::identity());
+    return camera;
+}
+
+// Random lights in front of the camera. Each light is placed by its own
+// transform, which 'transforms' keeps alive.
+static SGLightList createLights(int count, std::vector<osg::ref_ptr<osg::Node>> &transforms)
+{
+    std::default_random_engine rng(count);
+    std::uniform_real_distribution<float> lateral(-1500.0f, 1500.0f);
+    std::uniform_real_distribution<float> depth(5.0f, 4000.0f);
+    std::uniform_real_distribution<float> range(2.0f, 60.0f);
+    std::uniform_real_distribution<float> cutoff(10.0f, 80.0f);
+
+    SGLightList lights;
+    for (int i = 0; i < count; ++i) {
+        osg::ref_ptr<osg::MatrixTransform> t = new osg::MatrixTransform(
+            osg::Matrix::translate(lateral(rng), lateral(rng) * 0.5f, -depth(rng)));
+        osg::ref_ptr<SGLight> light = new SGLight;
+        light->setType((i % 4 == 3) ? SGLight::SPOT : SGLight::POINT);
+        light->setRange(range(rng));
+        light->setSpotCutoff(cutoff(rng));
+        t->addChild(light);
+        transforms.push_back(t);
+        lights.push_back(light);
+    }
+    return lights;
+}
+
+static SGPropertyNode_ptr createConfig(int numThreads)
+{
+    SGPropertyNode_ptr config = new SGPropertyNode;
+    config->setIntValue("max-pointlights", 10000);
+    config->setIntValue("max-spotlights", 10000);
+    config->setIntValue("max-light-indices", 2048);
+    config->setIntValue("tile-size", 64);
+    config->setIntValue("depth-slices", 16);
+    config->setIntValue("num-threads", numThreads);
+    return config;
+}
+
+int main(int argc, char* argv[])
+{
+    osg::ref_ptr<osg::Camera> camera = createCamera();
+    const int threads = std::max(2u, std::thread::hardware_concurrency());
+
+    for (int count : {1000, 4000, 10000}) {
+        std::vector<osg::ref_ptr<osg::Node>> transforms;
+        SGLightList lights = createLights(count, transforms);
+
+        osg::ref_ptr<TestClusteredShading> single =
+            new TestClusteredShading(camera, createConfig(1));
+        osg::ref_ptr<TestClusteredShading> pooled =
+            new TestClusteredShading(camera, createConfig(threads));
+
+        // Both must assign the same lights to every cluster
+        single->update(lights);
+        pooled->update(lights);
+        SG_CHECK_EQUAL(single->clusterCount(), pooled->clusterCount());
+        for (int i = 0; i < single->clusterCount(); ++i)
+            SG_VERIFY(single->cluster(i) == pooled->cluster(i));
+
+        for (auto *cs : {single.get(), pooled.get()}) {
+            const int frames = 20;
+            auto start = std::chrono::steady_clock::now();
+            for (int f = 0; f < frames; ++f)
+                cs->update(lights);
+            auto end = std::chrono::steady_clock::now();
+            double ms = std::chrono::duration<double, std::milli>(end - start).count();
+            std::cout << count << " lights, "
+                      << ((cs == single.get()) ? 1 : threads) << " thread(s): "
+                      << ms / frames << " ms per frame" << std::endl;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
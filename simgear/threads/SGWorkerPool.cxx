@@ -0,0 +1,141 @@
+// SGWorkerPool - a fixed set of worker threads shared by parallel loops.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+#ifdef HAVE_CONFIG_H
+#  include <simgear_config.h>
+#endif
+
+#include "SGWorkerPool.hxx"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+struct SGWorkerPool::Loop {
+    Loop(unsigned count_, const std::function<void(unsigned)>& func_) :
+        func(func_), count(count_)
+    { }
+
+    const std::function<void(unsigned)>& func;
+    const unsigned count;
+    // Next index to take
+    std::atomic<unsigned> next{0};
+    std::atomic<bool> failed{false};
+    // Guarded by the pool mutex
+    unsigned finished = 0;
+    std::exception_ptr error;
+};
+
+SGWorkerPool::SGWorkerPool(unsigned numWorkers)
+{
+    for (unsigned i = 0; i < numWorkers; ++i)
+        _workers.emplace_back(&SGWorkerPool::workerMain, this);
+}
+
+SGWorkerPool::~SGWorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _workCond.notify_all();
+    for (auto& worker : _workers)
+        worker.join();
+}
+
+SGWorkerPool& SGWorkerPool::shared()
+{
+    static SGWorkerPool pool(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+    return pool;
+}
+
+void SGWorkerPool::forEach(unsigned count, const std::function<void(unsigned)>& func)
+{
+    if (_workers.empty() || count <= 1) {
+        for (unsigned i = 0; i < count; ++i)
+            func(i);
+        return;
+    }
+
+    auto loop = std::make_shared<Loop>(count, func);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _loops.push_back(loop);
+    }
+    _workCond.notify_all();
+
+    runLoop(*loop);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    auto it = std::find(_loops.begin(), _loops.end(), loop);
+    if (it != _loops.end())
+        _loops.erase(it);
+    // Indices taken by workers are still running
+    _doneCond.wait(lock, [&loop]() { return loop->finished == loop->count; });
+    if (loop->error)
+        std::rethrow_exception(loop->error);
+}
+
+void SGWorkerPool::runLoop(Loop& loop)
+{
+    unsigned done = 0;
+    std::exception_ptr error;
+    for (unsigned i = loop.next++; i < loop.count; i = loop.next++) {
+        if (!loop.failed) {
+            try {
+                loop.func(i);
+            } catch (...) {
+                if (!error)
+                    error = std::current_exception();
+                loop.failed = true;
+            }
+        }
+        ++done;
+    }
+
+    if (done == 0)
+        return;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (error && !loop.error)
+        loop.error = error;
+    loop.finished += done;
+    if (loop.finished == loop.count)
+        _doneCond.notify_all();
+}
+
+void SGWorkerPool::workerMain()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (;;) {
+        _workCond.wait(lock, [this]() { return _stop || !_loops.empty(); });
+        if (_stop)
+            return;
+
+        // Keep the loop alive, its caller may return as soon as the
+        // indices taken here are finished
+        std::shared_ptr<Loop> loop = _loops.front();
+        lock.unlock();
+        runLoop(*loop);
+        lock.lock();
+
+        // All indices are taken, nobody needs to look at it any more
+        auto it = std::find(_loops.begin(), _loops.end(), loop);
+        if (it != _loops.end())
+            _loops.erase(it);
+    }
+}
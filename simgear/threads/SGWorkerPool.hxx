@@ -0,0 +1,85 @@
+// SGWorkerPool - a fixed set of worker threads shared by parallel loops.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+
+#ifndef SGWORKERPOOL_HXX_INCLUDED
+#define SGWORKERPOOL_HXX_INCLUDED 1
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A fixed number of worker threads, started once and parked between
+ * loops, which help the threads calling forEach(). However many threads
+ * call forEach() at the same time, no more than getNumWorkers() threads
+ * are added to them.
+ */
+class SGWorkerPool {
+public:
+    /**
+     * Start the worker threads. With no workers, forEach() runs the
+     * whole loop on the calling thread.
+     */
+    explicit SGWorkerPool(unsigned numWorkers);
+
+    /**
+     * Stop and join the worker threads. No forEach() may be running.
+     */
+    ~SGWorkerPool();
+
+    /**
+     * The pool shared by the parallel loops of SimGear, with one worker
+     * less than there are hardware threads, as the calling thread takes
+     * part in each loop. It is created on first use.
+     */
+    static SGWorkerPool& shared();
+
+    unsigned getNumWorkers() const
+    { return unsigned(_workers.size()); }
+
+    /**
+     * Call func(i) for every i in [0, count) and return once all calls
+     * are done. The calls are spread over the calling thread and the
+     * workers which are idle or become idle; func must be safe to call
+     * concurrently for different i. If calls throw, the remaining indices
+     * are skipped and the first exception is rethrown here.
+     *
+     * func may call forEach() itself: the calling thread always works
+     * through the loop too, so a loop never waits for a free worker.
+     */
+    void forEach(unsigned count, const std::function<void(unsigned)>& func);
+
+private:
+    struct Loop;
+
+    void workerMain();
+    void runLoop(Loop& loop);
+
+    std::vector<std::thread> _workers;
+    std::mutex _mutex;
+    std::condition_variable _workCond;
+    std::condition_variable _doneCond;
+    // Loops which still have indices nobody has taken yet
+    std::deque<std::shared_ptr<Loop> > _loops;
+    bool _stop = false;
+};
+
+#endif /* SGWORKERPOOL_HXX_INCLUDED */
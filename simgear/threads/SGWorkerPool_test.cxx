@@ -0,0 +1,168 @@
+// Checks that SGWorkerPool::forEach() calls every index once, rethrows
+// exceptions, allows nested loops and keeps concurrent callers within the
+// bound of its workers, and compares it with starting threads for every
+// loop, as the material loops of the tile loader did.
+
+#ifdef HAVE_CONFIG_H
+#  include <simgear_config.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <simgear/misc/test_macros.hxx>
+#include <simgear/threads/SGWorkerPool.hxx>
+
+static double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+// Some work for one item, about the size of the random objects of a
+// small material bin
+static unsigned work(unsigned i)
+{
+    unsigned h = i;
+    for (int k = 0; k < 20000; ++k)
+        h = h * 1664525u + 1013904223u;
+    return h;
+}
+
+static void testEachIndexOnce(SGWorkerPool& pool)
+{
+    for (unsigned count : { 0u, 1u, 2u, 7u, 100u, 5000u }) {
+        std::vector<std::atomic<int> > calls(count);
+        for (auto& c : calls)
+            c = 0;
+        pool.forEach(count, [&](unsigned i) { calls[i]++; });
+        for (unsigned i = 0; i < count; ++i)
+            SG_CHECK_EQUAL(calls[i], 1);
+    }
+}
+
+static void testException(SGWorkerPool& pool)
+{
+    std::atomic<unsigned> calls(0);
+    bool thrown = false;
+    try {
+        pool.forEach(1000, [&](unsigned i) {
+            calls++;
+            if (i == 10)
+                throw std::runtime_error("item 10");
+        });
+    } catch (std::runtime_error& e) {
+        thrown = true;
+        SG_CHECK_EQUAL(std::string(e.what()), "item 10");
+    }
+    SG_VERIFY(thrown);
+    SG_VERIFY(calls < 1000u);
+
+    // still usable afterwards
+    testEachIndexOnce(pool);
+}
+
+static void testNested(SGWorkerPool& pool)
+{
+    std::vector<std::atomic<int> > calls(20 * 30);
+    for (auto& c : calls)
+        c = 0;
+    pool.forEach(20, [&](unsigned i) {
+        pool.forEach(30, [&](unsigned j) { calls[i * 30 + j]++; });
+    });
+    for (auto& c : calls)
+        SG_CHECK_EQUAL(c, 1);
+}
+
+static void testConcurrentCallers(SGWorkerPool& pool)
+{
+    const unsigned callers = 8;
+    std::atomic<int> active(0), maxActive(0);
+    std::atomic<unsigned> total(0);
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < callers; ++t) {
+        threads.emplace_back([&]() {
+            for (int n = 0; n < 20; ++n) {
+                pool.forEach(16, [&](unsigned i) {
+                    int a = ++active;
+                    int m = maxActive;
+                    while (a > m && !maxActive.compare_exchange_weak(m, a)) { }
+                    work(i);
+                    total++;
+                    --active;
+                });
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    SG_CHECK_EQUAL(total, callers * 20 * 16);
+    SG_VERIFY(maxActive <= int(callers + pool.getNumWorkers()));
+}
+
+int main(int argc, char* argv[])
+{
+    SGWorkerPool none(0);
+    testEachIndexOnce(none);
+    testException(none);
+
+    SGWorkerPool pool(3);
+    SG_CHECK_EQUAL(pool.getNumWorkers(), 3u);
+    testEachIndexOnce(pool);
+    testException(pool);
+    testNested(pool);
+    testConcurrentCallers(pool);
+
+    SGWorkerPool& shared = SGWorkerPool::shared();
+    SG_CHECK_EQUAL(&shared, &SGWorkerPool::shared());
+    testEachIndexOnce(shared);
+    testNested(shared);
+
+    // Benchmark: a tile with 30 material bins, loaded 200 times
+    const unsigned loops = 200, bins = 30;
+    std::vector<unsigned> results(bins);
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned n = 0; n < loops; ++n) {
+        for (unsigned m = 0; m < bins; ++m)
+            results[m] = work(m);
+    }
+    const double serialMs = elapsedMs(start);
+
+    // threads started for every loop
+    start = std::chrono::steady_clock::now();
+    for (unsigned n = 0; n < loops; ++n) {
+        unsigned numThreads = std::min(std::max(std::thread::hardware_concurrency(), 1u), bins);
+        std::atomic<unsigned> next(0);
+        auto worker = [&]() {
+            for (unsigned m = next++; m < bins; m = next++)
+                results[m] = work(m);
+        };
+        std::vector<std::thread> threads;
+        for (unsigned t = 1; t < numThreads; t++)
+            threads.emplace_back(worker);
+        worker();
+        for (auto& thread : threads)
+            thread.join();
+    }
+    const double spawnMs = elapsedMs(start);
+
+    start = std::chrono::steady_clock::now();
+    for (unsigned n = 0; n < loops; ++n)
+        shared.forEach(bins, [&](unsigned m) { results[m] = work(m); });
+    const double poolMs = elapsedMs(start);
+
+    std::cout << loops << " loops of " << bins << " items, "
+              << shared.getNumWorkers() << " workers: serial " << serialMs
+              << " ms, threads per loop " << spawnMs << " ms, pool "
+              << poolMs << " ms" << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -38,32 +38,28 @@
 /* adapted from zdump.c */
 void show (const char *zone, time_t t, int v);
 
-/* adapted from <time.h> */
+/* The rules of a time zone, as read from its file.  */
+struct fgtz_zone;
+
+/* Return the rules in the time zone file TZNAME, reading it on first use,
+   or NULL if it can't be read.  Zones are shared and never change once
+   read, the result stays valid until the program ends.  Thread safe.  */
+const struct fgtz_zone * fgtz_load (const char *tzName);
+
+/* adapted from <time.h>.  Returns a static buffer, so not thread safe;
+   throws an sg_exception if the zone file can't be read.  */
 struct tm * fgLocaltime (const time_t *t, const char *tzName);
 
+/* Re-entrant version of fgLocaltime for a zone from fgtz_load: stores
+   the local time of *T in *TP and returns TP, or NULL if T or ZONE
+   is NULL.  */
+struct tm * fgLocaltime_r (const time_t *t, const struct fgtz_zone *zone,
+			   struct tm *tp);
+
 /* Prototype for the internal function to get information based on TZ.  */
 extern struct tm *fgtz_convert (const time_t *t, int use_localtime,
 				     struct tm *tp, const char *tzName);
 
-/* This structure contains all the information about a
-   timezone given in the POSIX standard TZ envariable.  */
-typedef struct
-  {
-    const char *name;
-
-    /* When to change.  */
-    enum { J0, J1, M } type;	/* Interpretation of:  */
-    unsigned short int m, n, d;	/* Month, week, day.  */
-    unsigned int secs;		/* Time of day.  */
-
-    long int offset;		/* Seconds east of GMT (west if < 0).  */
-
-    /* We cache the computed time of change for a
-       given year so we don't have to recompute it.  */
-    time_t change;	/* When to change to this zone.  */
-    int computed_for;	/* Year above is computed for.  */
-  } fgtz_rule;
-
 struct tzhead {
  	char	tzh_magic[4];		/* TZ_MAGIC */
 	char	tzh_reserved[16];	/* reserved for future use */
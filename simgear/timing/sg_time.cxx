@@ -45,6 +45,7 @@
 #include <simgear/constants.h>
 #include <simgear/debug/logstream.hxx>
 #include <simgear/misc/sg_path.hxx>
+#include <simgear/structure/exception.hxx>
 
 #include "sg_time.hxx"
 #include "timezone.h"
@@ -244,7 +245,14 @@ void SGTime::updateLocal( const SGGeod& aLocation, const SGPath& root ) {
 
     currGMT = sgTimeGetGMT( gmtime(&cur_time) );
     std::string zs = zone.utf8Str();
-    aircraftLocalTime = sgTimeGetGMT( (fgLocaltime(&cur_time, zs.c_str())) );
+    // The zone rules are read once and shared, so switching between the
+    // zones of several aircraft costs no file access
+    const fgtz_zone* tz = fgtz_load(zs.c_str());
+    if (!tz) {
+        throw sg_exception("Timezone reading failed");
+    }
+    struct tm localTime;
+    aircraftLocalTime = sgTimeGetGMT( fgLocaltime_r(&cur_time, tz, &localTime) );
     local_offset = aircraftLocalTime - currGMT;
     // cout << "Using " << local_offset << " as local time offset Timezone is " 
     //      << zonename << endl;
@@ -0,0 +1,195 @@
+// Checks fgtz_load and the re-entrant fgLocaltime_r against zone files
+// with known rules, from many threads at once, and times looking up two
+// alternating zones.
+
+#ifdef HAVE_CONFIG_H
+#  include <simgear_config.h>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <simgear/io/iostreams/sgstream.hxx>
+#include <simgear/misc/sg_dir.hxx>
+#include <simgear/misc/test_macros.hxx>
+#include <simgear/structure/exception.hxx>
+#include <simgear/timing/lowleveltime.h>
+#include <simgear/timing/sg_time.hxx>
+
+static const int NumThreads = 8;
+static const int NumIterations = 20000;
+
+// Daylight saving time from the last Sunday in March to the last one in
+// October of 2000 to 2037, at 01:00 UTC, as in Europe
+static std::vector<time_t> dstTransitions()
+{
+    std::vector<time_t> transitions;
+    for (int year = 2000; year < 2038; ++year) {
+        for (int month : { 3, 10 }) {
+            time_t t = sgTimeGetGMT(year - 1900, month - 1, 31, 1, 0, 0);
+            struct tm* tm = gmtime(&t);
+            transitions.push_back(t - tm->tm_wday * 24 * 3600);
+        }
+    }
+    return transitions;
+}
+
+static void put32(sg_ofstream& out, long value)
+{
+    unsigned long v = (unsigned long)value;
+    char bytes[4] = { char(v >> 24), char(v >> 16), char(v >> 8), char(v) };
+    out.write(bytes, 4);
+}
+
+struct ZoneType {
+    long offset;
+    bool isdst;
+    std::string name;
+};
+
+// A version 1 TZif file, as found in the zoneinfo directory of FGData
+static void writeZone(const SGPath& path, const std::vector<time_t>& transitions,
+                      const std::vector<ZoneType>& types)
+{
+    std::string names;
+    std::vector<size_t> nameIndex;
+    for (const ZoneType& type : types) {
+        nameIndex.push_back(names.size());
+        names += type.name;
+        names += '\0';
+    }
+
+    sg_ofstream out(path, std::ios::binary);
+    out.write("TZif", 4);
+    out.write(std::string(16, '\0').data(), 16);
+    put32(out, 0);                         // isgmt flags
+    put32(out, 0);                         // isstd flags
+    put32(out, 0);                         // leap seconds
+    put32(out, transitions.size());
+    put32(out, types.size());
+    put32(out, names.size());
+    for (time_t t : transitions)
+        put32(out, t);
+    // The types alternate, starting with daylight saving time
+    for (size_t i = 0; i < transitions.size(); ++i)
+        out.put(char(types.size() > 1 ? (i + 1) % 2 : 0));
+    for (size_t i = 0; i < types.size(); ++i) {
+        put32(out, types[i].offset);
+        out.put(char(types[i].isdst));
+        out.put(char(nameIndex[i]));
+    }
+    out.write(names.data(), names.size());
+}
+
+static long expectedOffset(const std::vector<time_t>& transitions, time_t t, bool& isdst)
+{
+    size_t after = 0;
+    while (after < transitions.size() && transitions[after] <= t)
+        ++after;
+    isdst = after % 2 == 1;
+    return isdst ? 7200 : 3600;
+}
+
+int main(int argc, char* argv[])
+{
+    simgear::Dir tmpDir = simgear::Dir::tempDir("FlightGear");
+    tmpDir.setRemoveOnDestroy();
+
+    const std::vector<time_t> transitions = dstTransitions();
+    const std::string europe = (tmpDir.path() / "Europe_Test").utf8Str();
+    const std::string asia = (tmpDir.path() / "Asia_Test").utf8Str();
+    writeZone(SGPath::fromUtf8(europe), transitions,
+              { { 3600, false, "CET" }, { 7200, true, "CEST" } });
+    writeZone(SGPath::fromUtf8(asia), {}, { { 19800, false, "IST" } });
+
+    // Zones are read once and shared; missing files give no zone
+    const fgtz_zone* europeZone = fgtz_load(europe.c_str());
+    SG_VERIFY(europeZone);
+    SG_VERIFY(fgtz_load(europe.c_str()) == europeZone);
+    SG_VERIFY(fgtz_load((":" + europe).c_str()) == europeZone);
+    const std::string missing = (tmpDir.path() / "Missing").utf8Str();
+    SG_VERIFY(!fgtz_load(missing.c_str()));
+    bool thrown = false;
+    try {
+        time_t t = 0;
+        fgLocaltime(&t, missing.c_str());
+    } catch (const sg_exception&) {
+        thrown = true;
+    }
+    SG_VERIFY(thrown);
+    // Failures are not cached, the zone is read once it is there
+    writeZone(SGPath::fromUtf8(missing), {}, { { 0, false, "UTC" } });
+    SG_VERIFY(fgtz_load(missing.c_str()));
+
+    // Around a transition, and the same from the old interface
+    const time_t summer = transitions[20];
+    struct tm tm;
+    SG_VERIFY(fgLocaltime_r(&summer, europeZone, &tm) == &tm);
+    SG_CHECK_EQUAL(tm.tm_hour, 3);
+    SG_CHECK_EQUAL(tm.tm_isdst, 1);
+    const time_t before = summer - 1;
+    fgLocaltime_r(&before, europeZone, &tm);
+    SG_CHECK_EQUAL(tm.tm_hour, 1);
+    SG_CHECK_EQUAL(tm.tm_min, 59);
+    SG_CHECK_EQUAL(tm.tm_isdst, 0);
+    struct tm* legacy = fgLocaltime(&before, europe.c_str());
+    SG_CHECK_EQUAL(sgTimeGetGMT(legacy), sgTimeGetGMT(&tm));
+    SG_CHECK_EQUAL(legacy->tm_isdst, tm.tm_isdst);
+    SG_VERIFY(!fgLocaltime_r(&before, nullptr, &tm));
+
+    // Many threads, alternating between the zones, loading them and
+    // converting at the same time
+    std::atomic<int> failures(0);
+    std::vector<std::thread> threads;
+    for (int n = 0; n < NumThreads; ++n) {
+        threads.emplace_back([&, n]() {
+            unsigned seed = 1234 + n;
+            for (int i = 0; i < NumIterations; ++i) {
+                seed = seed * 1103515245 + 12345;
+                const time_t t = transitions.front() - 86400
+                    + time_t(seed % (transitions.back() - transitions.front() + 172800));
+                struct tm local;
+                bool isdst = false;
+                long offset = 19800;
+                if (i % 2) {
+                    offset = expectedOffset(transitions, t, isdst);
+                    fgLocaltime_r(&t, fgtz_load(europe.c_str()), &local);
+                } else {
+                    fgLocaltime_r(&t, fgtz_load(asia.c_str()), &local);
+                }
+                if (sgTimeGetGMT(&local) - t != offset || (local.tm_isdst != 0) != isdst)
+                    ++failures;
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+    SG_CHECK_EQUAL(failures.load(), 0);
+
+    // Alternating zones, as with two aircraft
+    auto start = std::chrono::steady_clock::now();
+    time_t t = summer;
+    long sum = 0;
+    for (int i = 0; i < NumIterations; ++i, t += 3600) {
+        struct tm* local = fgLocaltime(&t, (i % 2) ? europe.c_str() : asia.c_str());
+        sum += local->tm_hour;
+    }
+    auto middle = std::chrono::steady_clock::now();
+    for (int i = 0; i < NumIterations; ++i, t += 3600) {
+        fgLocaltime_r(&t, (i % 2) ? europeZone : fgtz_load(asia.c_str()), &tm);
+        sum += tm.tm_hour;
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::cout << NumIterations << " conversions alternating between two zones: fgLocaltime "
+              << std::chrono::duration<double, std::milli>(middle - start).count()
+              << " ms, fgLocaltime_r "
+              << std::chrono::duration<double, std::milli>(end - middle).count()
+              << " ms (" << sum << ")" << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,128 @@
+// Checks that SGTimeZoneContainer::getNearest finds the same zones as a
+// linear scan over all of them, and compares the time both take for
+// random positions all over the globe.
+
+#ifdef HAVE_CONFIG_H
+#  include <simgear_config.h>
+#endif
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <simgear/io/iostreams/sgstream.hxx>
+#include <simgear/math/sg_random.h>
+#include <simgear/misc/sg_dir.hxx>
+#include <simgear/misc/test_macros.hxx>
+#include <simgear/timing/timezone.h>
+
+static const int NumZones = 500;   // zone.tab has about 400
+static const int NumQueries = 10000;
+
+// A zone.tab line, in the degrees and minutes format or with seconds
+static std::string zoneLine(int i, double lat, double lon)
+{
+    char buffer[128];
+    char latSign = lat < 0 ? '-' : '+', lonSign = lon < 0 ? '-' : '+';
+    int latMin = (int)(fabs(lat)*3600)/60, lonMin = (int)(fabs(lon)*3600)/60;
+    if (i % 2)
+        snprintf(buffer, sizeof(buffer), "X%d\t%c%02d%02d%c%03d%02d\tZone/%d\tcomment\n",
+                 i % 100, latSign, latMin/60, latMin % 60,
+                 lonSign, lonMin/60, lonMin % 60, i);
+    else
+        snprintf(buffer, sizeof(buffer), "X%d\t%c%02d%02d%02d%c%03d%02d%02d\tZone/%d\n",
+                 i % 100, latSign, latMin/60, latMin % 60, i % 60,
+                 lonSign, lonMin/60, lonMin % 60, i % 60, i);
+    return buffer;
+}
+
+static SGTimeZone* linearNearest(const std::vector<std::unique_ptr<SGTimeZone>>& zones,
+                                 const SGGeod& ref)
+{
+    SGVec3d refCart(SGVec3d::fromGeod(ref));
+    SGTimeZone* match = NULL;
+    double minDist2 = HUGE_VAL;
+    for (const auto& zone : zones) {
+        double d2 = distSqr(zone->cartCenterpoint(), refCart);
+        if (d2 < minDist2) {
+            match = zone.get();
+            minDist2 = d2;
+        }
+    }
+    return match;
+}
+
+int main(int argc, char* argv[])
+{
+    sg_srandom(42);
+
+    simgear::Dir tmpDir = simgear::Dir::tempDir("FlightGear");
+    tmpDir.setRemoveOnDestroy();
+    const SGPath path = tmpDir.path() / "zone.tab";
+
+    // Zones clustered like real ones, with a few sharing a centerpoint
+    std::vector<std::string> lines;
+    for (int i = 0; i < NumZones; ++i) {
+        double lat = 140*sg_random() - 70, lon = 360*sg_random() - 180;
+        if (i % 4)
+            lat = 35 + 25*sg_random(), lon = 60*sg_random() - 10;
+        if (i % 50 == 1)
+            lines.push_back(lines.back().substr(0, lines.back().find("Zone/"))
+                            + "Zone/" + std::to_string(i) + "\n");
+        else
+            lines.push_back(zoneLine(i, lat, lon));
+    }
+    {
+        sg_ofstream zoneTab(path);
+        zoneTab << "# tz zone descriptions\n";
+        for (const std::string& line : lines)
+            zoneTab << line;
+    }
+
+    SGTimeZoneContainer container(path.c_str());
+    std::vector<std::unique_ptr<SGTimeZone>> zones;
+    for (const std::string& line : lines)
+        zones.emplace_back(new SGTimeZone(line.c_str()));
+
+    std::vector<SGGeod> queries;
+    for (int i = 0; i < NumQueries; ++i)
+        queries.push_back(SGGeod::fromDegM(360*sg_random() - 180,
+                                           180*sg_random() - 90,
+                                           10000*sg_random()));
+    // Right on a centerpoint, and on one shared by two zones
+    queries.push_back(SGGeod::fromCart(zones[10]->cartCenterpoint()));
+    queries.push_back(SGGeod::fromCart(zones[51]->cartCenterpoint()));
+    queries.push_back(SGGeod::fromDeg(0, 90));
+
+    for (const SGGeod& ref : queries) {
+        SGTimeZone* nearest = container.getNearest(ref);
+        SG_VERIFY(nearest);
+        SG_CHECK_EQUAL(std::string(nearest->getDescription()),
+                       std::string(linearNearest(zones, ref)->getDescription()));
+    }
+    SG_CHECK_EQUAL(std::string(container.getNearest(queries[NumQueries + 1])->getDescription()),
+                   "Zone/50");
+
+    auto start = std::chrono::steady_clock::now();
+    size_t linearSum = 0;
+    for (const SGGeod& ref : queries)
+        linearSum += (size_t)linearNearest(zones, ref)->getDescription()[5];
+    auto middle = std::chrono::steady_clock::now();
+    size_t treeSum = 0;
+    for (const SGGeod& ref : queries)
+        treeSum += (size_t)container.getNearest(ref)->getDescription()[5];
+    auto end = std::chrono::steady_clock::now();
+    SG_CHECK_EQUAL(linearSum, treeSum);
+
+    std::cout << queries.size() << " queries over " << NumZones << " zones: linear scan "
+              << std::chrono::duration<double, std::milli>(middle - start).count()
+              << " ms, k-d tree "
+              << std::chrono::duration<double, std::milli>(end - middle).count()
+              << " ms" << std::endl;
+
+    return EXIT_SUCCESS;
+}
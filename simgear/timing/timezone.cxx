@@ -34,6 +34,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <cstdlib>
+#include <algorithm>
 
 #include <simgear/structure/exception.hxx>
 #include <simgear/misc/strutils.hxx>
@@ -171,6 +172,12 @@ SGTimeZoneContainer::SGTimeZoneContainer(const char *filename)
     }
     
     fclose(infile);
+
+    tree.resize(zones.size());
+    for (unsigned i = 0; i < tree.size(); ++i)
+        tree[i] = i;
+    treeAxis.resize(zones.size());
+    buildTree(0, tree.size());
 }
 
 SGTimeZoneContainer::~SGTimeZoneContainer()
@@ -181,21 +188,77 @@ SGTimeZoneContainer::~SGTimeZoneContainer()
   }
 }
 
-SGTimeZone* SGTimeZoneContainer::getNearest(const SGGeod& ref) const
+void SGTimeZoneContainer::buildTree(size_t begin, size_t end)
 {
-  SGVec3d refCart(SGVec3d::fromGeod(ref));
-  SGTimeZone* match = NULL;
-  double minDist2 = HUGE_VAL;
-  
-  TZVec::const_iterator it = zones.begin();
-  for (; it != zones.end(); ++it) {
-    double d2 = distSqr((*it)->cartCenterpoint(), refCart);
-    if (d2 < minDist2) {
-      match = *it;
-      minDist2 = d2;
-    }
+  if (end - begin < 2)
+    return;
+
+  // Split along the axis the centerpoints spread most on
+  SGVec3d min = zones[tree[begin]]->cartCenterpoint(), max = min;
+  for (size_t i = begin + 1; i < end; ++i) {
+    const SGVec3d& c = zones[tree[i]]->cartCenterpoint();
+    min = SGVec3d(SGMiscd::min(min[0], c[0]), SGMiscd::min(min[1], c[1]),
+                  SGMiscd::min(min[2], c[2]));
+    max = SGVec3d(SGMiscd::max(max[0], c[0]), SGMiscd::max(max[1], c[1]),
+                  SGMiscd::max(max[2], c[2]));
   }
+  SGVec3d extent = max - min;
+  unsigned axis = 0;
+  if (extent[1] > extent[axis])
+    axis = 1;
+  if (extent[2] > extent[axis])
+    axis = 2;
 
-  return match;
+  size_t mid = begin + (end - begin)/2;
+  std::nth_element(tree.begin() + begin, tree.begin() + mid, tree.begin() + end,
+                   [this, axis](unsigned a, unsigned b) {
+                     return zones[a]->cartCenterpoint()[axis]
+                       < zones[b]->cartCenterpoint()[axis];
+                   });
+  treeAxis[mid] = axis;
+  buildTree(begin, mid);
+  buildTree(mid + 1, end);
 }
 
+void SGTimeZoneContainer::findNearest(const SGVec3d& p, size_t begin,
+                                      size_t end, unsigned& best,
+                                      double& bestDist2) const
+{
+  if (begin == end)
+    return;
+
+  size_t mid = begin + (end - begin)/2;
+  unsigned index = tree[mid];
+  const SGVec3d& c = zones[index]->cartCenterpoint();
+  double d2 = distSqr(c, p);
+  if (d2 < bestDist2 || (d2 == bestDist2 && index < best)) {
+    best = index;
+    bestDist2 = d2;
+  }
+  if (end - begin == 1)
+    return;
+
+  // The near side first, the far one only if it may hold one as close
+  unsigned axis = treeAxis[mid];
+  double offset = p[axis] - c[axis];
+  if (offset < 0) {
+    findNearest(p, begin, mid, best, bestDist2);
+    if (offset*offset <= bestDist2)
+      findNearest(p, mid + 1, end, best, bestDist2);
+  } else {
+    findNearest(p, mid + 1, end, best, bestDist2);
+    if (offset*offset <= bestDist2)
+      findNearest(p, begin, mid, best, bestDist2);
+  }
+}
+
+SGTimeZone* SGTimeZoneContainer::getNearest(const SGGeod& ref) const
+{
+  SGVec3d refCart(SGVec3d::fromGeod(ref));
+  unsigned best = 0;
+  double minDist2 = HUGE_VAL;
+  findNearest(refCart, 0, tree.size(), best, minDist2);
+  if (minDist2 == HUGE_VAL)
+    return NULL;
+  return zones[best];
+}
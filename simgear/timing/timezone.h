@@ -94,11 +94,26 @@ public:
   SGTimeZoneContainer(const char *filename);
   ~SGTimeZoneContainer();
   
+  /**
+   * Return the zone with the centerpoint closest to ref, in O(log n)
+   * with a k-d tree over the centerpoints.  Of zones at the same
+   * distance the first one in the file is returned, as by a linear scan.
+   */
   SGTimeZone* getNearest(const SGGeod& ref) const;
   
 private:
   typedef std::vector<SGTimeZone*> TZVec;
   TZVec zones;
+
+  // The k-d tree: the indices into zones, each median of a range
+  // splitting the rest of it along the axis in treeAxis at the same
+  // place
+  std::vector<unsigned> tree;
+  std::vector<unsigned char> treeAxis;
+
+  void buildTree(size_t begin, size_t end);
+  void findNearest(const SGVec3d& p, size_t begin, size_t end,
+                   unsigned& best, double& bestDist2) const;
 };
 
 